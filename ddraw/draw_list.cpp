@@ -0,0 +1,267 @@
+#include "draw_list.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief Orders batches by their keys, batches with equal keys in the order
+ * in which they were added.
+ */
+bool is_batch_before(const DrawList::Batch &first, const DrawList::Batch &second)
+{
+    if (first.key == second.key) {
+        return first.first_index < second.first_index;
+    }
+    return first.key < second.key;
+}
+
+} // anonymous namespace
+
+DrawSortKey::DrawSortKey()
+    : variant(0)
+    , texture(0)
+    , state(0)
+    , fog_color(0)
+{
+}
+
+/**
+ * @brief Returns key for sorting of the geometry with specified state.
+ *
+ * The texture stage and fog configuration are the most expensive
+ * to change so they form the primary part of the key.
+ */
+DrawSortKey::DrawSortKey(const HWStateKey &hw_state)
+    : variant((((hw_state.texture != 0) ? (hw_state.texture_blend + 1) : 0) * SIZE_OF_FOG) + hw_state.fog)
+    , texture(hw_state.texture)
+    , state(hw_state.depth_test | (hw_state.alpha_test << 4) | (hw_state.alpha_blend << 8) | (hw_state.shade_mode << 16))
+    , fog_color(hw_state.fog_color)
+{
+}
+
+bool DrawSortKey::operator==(const DrawSortKey &other) const
+{
+    return
+        (variant == other.variant) &&
+        (texture == other.texture) &&
+        (state == other.state) &&
+        (fog_color == other.fog_color)
+    ;
+}
+
+/**
+ * @brief Orders the keys so the most expensive changes are the least frequent.
+ */
+bool DrawSortKey::operator<(const DrawSortKey &other) const
+{
+    if (variant != other.variant) {
+        return variant < other.variant;
+    }
+    if (texture != other.texture) {
+        return texture < other.texture;
+    }
+    if (state != other.state) {
+        return state < other.state;
+    }
+    return fog_color < other.fog_color;
+}
+
+DrawList::DrawList()
+    : vertices()
+    , indices()
+    , batches()
+    , joined_count(0)
+    , fixed_count(0)
+{
+}
+
+/**
+ * @brief Forgets all batches. The arrays are kept allocated.
+ */
+void DrawList::clear(void)
+{
+    vertices.clear();
+    indices.clear();
+    batches.clear();
+    joined_count = 0;
+    fixed_count = 0;
+}
+
+/**
+ * @brief Allocates the arrays for specified number of vertices, indices
+ * and batches.
+ */
+void DrawList::reserve(const size_t vertex_count, const size_t index_count, const size_t batch_count)
+{
+    vertices.reserve(vertex_count);
+    indices.reserve(index_count);
+    batches.reserve(batch_count);
+}
+
+bool DrawList::is_empty(void) const
+{
+    return batches.empty();
+}
+
+/**
+ * @brief Determines if batch with specified number of vertices fits
+ * into the list.
+ */
+bool DrawList::can_add(const size_t vertex_count) const
+{
+    return (vertices.size() + vertex_count) <= MAXIMAL_VERTEX_COUNT;
+}
+
+/**
+ * @brief Adds batch of triangles using specified range of the source vertices.
+ *
+ * The vertices are copied so the source might be changed afterwards.
+ * The ordered batch is placed after the last earlier batch with the same
+ * key if it can be moved there, otherwise at the end. The batch which
+ * is not ordered is fixed when its depth is constant.
+ */
+void DrawList::add(const DrawSortKey &key, const size_t tag, const TLVertex * const source_vertices, const size_t first_vertex, const size_t vertex_count, const unsigned short * const source_indices, const size_t index_count, const bool ordered)
+{
+    assert(can_add(vertex_count));
+    assert(vertex_count > 0);
+    assert((index_count % 3) == 0);
+
+    const size_t base = vertices.size();
+    vertices.insert(vertices.end(), source_vertices + first_vertex, source_vertices + first_vertex + vertex_count);
+
+    // Rebase the indices to the copied vertices.
+
+    const size_t old_size = indices.size();
+    indices.resize(old_size + index_count);
+    for (size_t i = 0; i < index_count; ++i) {
+        assert(source_indices[i] >= first_vertex);
+        assert(source_indices[i] < (first_vertex + vertex_count));
+        indices[old_size + i] = static_cast<unsigned short>((source_indices[i] - first_vertex) + base);
+    }
+
+    Batch batch;
+    batch.key = key;
+    batch.tag = tag;
+    batch.first_index = old_size;
+    batch.index_count = index_count;
+    batch.min_vertex = base;
+    batch.max_vertex = base + vertex_count - 1;
+    get_vertex_bounds(&vertices[base], vertex_count, batch.bounds);
+    batch.fixed = false;
+
+    if (! ordered) {
+        batch.fixed = is_depth_constant(batch.bounds);
+        fixed_count += batch.fixed ? 1 : 0;
+        batches.push_back(batch);
+        return;
+    }
+
+    const size_t position = find_ordered_position(key, batch.bounds);
+    batches.insert(batches.begin() + position, batch);
+}
+
+/**
+ * @brief Sorts the batches by their keys.
+ *
+ * Batches with equal keys keep the order in which they were added.
+ * The fixed batches keep their position and the batches are sorted
+ * only between them. The order of addition is part of the comparison
+ * so the sort does not need the temporary buffer of the stable sort,
+ * which would be allocated on each submission.
+ */
+void DrawList::sort(void)
+{
+    BatchList::iterator first = batches.begin();
+    for (BatchList::iterator it = batches.begin(); it != batches.end(); ++it) {
+        if (it->fixed) {
+            std::sort(first, it, is_batch_before);
+            first = it + 1;
+        }
+    }
+    std::sort(first, batches.end(), is_batch_before);
+}
+
+const DrawList::BatchList &DrawList::get_batches(void) const
+{
+    return batches;
+}
+
+/**
+ * @brief Returns index of the first batch after specified one which has
+ * different key or the batch count if there is none.
+ */
+size_t DrawList::get_group_end(const size_t first) const
+{
+    assert(first < batches.size());
+    size_t end = first + 1;
+    while ((end < batches.size()) && (batches[end].key == batches[first].key)) {
+        end++;
+    }
+    return end;
+}
+
+const TLVertex *DrawList::get_vertices(void) const
+{
+    return vertices.empty() ? NULL : &vertices[0];
+}
+
+size_t DrawList::get_vertex_count(void) const
+{
+    return vertices.size();
+}
+
+const unsigned short *DrawList::get_indices(void) const
+{
+    return indices.empty() ? NULL : &indices[0];
+}
+
+size_t DrawList::get_joined_count(void) const
+{
+    return joined_count;
+}
+
+size_t DrawList::get_fixed_count(void) const
+{
+    return fixed_count;
+}
+
+/**
+ * @brief Returns size of memory allocated by the arrays.
+ */
+size_t DrawList::get_capacity_bytes(void) const
+{
+    return
+        (vertices.capacity() * sizeof(TLVertex)) +
+        (indices.capacity() * sizeof(unsigned short)) +
+        (batches.capacity() * sizeof(Batch))
+    ;
+}
+
+/**
+ * @brief Finds position at which the ordered batch should be inserted.
+ *
+ * The batch can move over batches which do not overlap it on the screen
+ * as their order does not affect any pixel.
+ */
+size_t DrawList::find_ordered_position(const DrawSortKey &key, const VertexBounds &bounds)
+{
+    const size_t limit = (batches.size() > MAXIMAL_ORDERED_MOVE) ? (batches.size() - MAXIMAL_ORDERED_MOVE) : 0;
+    for (size_t i = batches.size(); i > limit; --i) {
+        const Batch &batch = batches[i - 1];
+        if (batch.key == key) {
+            joined_count++;
+            return i;
+        }
+        if (are_bounds_overlapping(batch.bounds, bounds)) {
+            break;
+        }
+    }
+    return batches.size();
+}
+
+} // namespace emu
+
+// EOF //
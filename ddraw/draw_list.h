@@ -0,0 +1,158 @@
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include "../hw/hw_types.h"
+#include "hw_state_key.h"
+#include "vertex_bounds.h"
+#include <cstddef>
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Key by which the batches of the draw list are sorted.
+ *
+ * Batches with equal keys must need the same HW state.
+ */
+struct DrawSortKey {
+
+    /**
+     * @brief Configuration of the texture stage and fog.
+     */
+    unsigned int variant;
+
+    /**
+     * @brief Handle of the bound texture.
+     */
+    unsigned int texture;
+
+    /**
+     * @brief Remaining HW states.
+     */
+    unsigned int state;
+    unsigned int fog_color;
+
+    DrawSortKey();
+    explicit DrawSortKey(const HWStateKey &hw_state);
+
+    bool operator==(const DrawSortKey &other) const;
+    bool operator<(const DrawSortKey &other) const;
+};
+
+/**
+ * @brief Geometry collected for submission grouped by its state.
+ *
+ * The batches of geometry whose result does not depend on the order
+ * of drawing are sorted. Other batches are kept in order and can only
+ * join earlier batch with the same state if they do not overlap any
+ * batch between them. The vertices of all batches are copied into
+ * single array so they can be uploaded by single operation.
+ *
+ * The sorting relies on the depth test to resolve the order, which
+ * does not hold where two batches produce the same depth at some pixel.
+ * With the less-equal test the later one wins there. Batches with
+ * constant depth (cockpit, HUD and other screen overlays) keep their
+ * position, the sorted batches do not move over them. Coplanar decals
+ * with varying depth are not detected, their order relative to the
+ * underlying surface might change.
+ */
+class DrawList {
+
+public:
+
+    /**
+     * @brief Maximal number of vertices, all must be addressable
+     * by the 16 bit indices.
+     */
+    static const size_t MAXIMAL_VERTEX_COUNT = 65536;
+
+    /**
+     * @brief Maximal number of batches the ordered batch can move over.
+     */
+    static const size_t MAXIMAL_ORDERED_MOVE = 64;
+
+    struct Batch {
+        DrawSortKey key;
+
+        /**
+         * @brief Value identifying the state of the batch for the owner.
+         */
+        size_t tag;
+
+        /**
+         * @brief Triangle indices of the batch within the index array.
+         */
+        //@{
+        size_t first_index;
+        size_t index_count;
+        //@}
+
+        /**
+         * @brief Range of vertices used by the batch.
+         */
+        //@{
+        size_t min_vertex;
+        size_t max_vertex;
+        //@}
+
+        /**
+         * @brief Screen space bounds.
+         */
+        VertexBounds bounds;
+
+        /**
+         * @brief Set for the sorted batch which keeps its position.
+         */
+        bool fixed;
+    };
+
+    typedef std::vector<Batch> BatchList;
+
+private:
+
+    std::vector<TLVertex> vertices;
+    std::vector<unsigned short> indices;
+    BatchList batches;
+
+    /**
+     * @brief Number of ordered batches which joined earlier batch.
+     */
+    size_t joined_count;
+
+    /**
+     * @brief Number of sorted batches which kept their position.
+     */
+    size_t fixed_count;
+
+public:
+
+    DrawList();
+
+    void clear(void);
+    void reserve(const size_t vertex_count, const size_t index_count, const size_t batch_count);
+    bool is_empty(void) const;
+    bool can_add(const size_t vertex_count) const;
+    void add(const DrawSortKey &key, const size_t tag, const TLVertex * const source_vertices, const size_t first_vertex, const size_t vertex_count, const unsigned short * const source_indices, const size_t index_count, const bool ordered);
+    void sort(void);
+
+    // Queries.
+
+    const BatchList &get_batches(void) const;
+    size_t get_group_end(const size_t first) const;
+    const TLVertex *get_vertices(void) const;
+    size_t get_vertex_count(void) const;
+    const unsigned short *get_indices(void) const;
+    size_t get_joined_count(void) const;
+    size_t get_fixed_count(void) const;
+    size_t get_capacity_bytes(void) const;
+
+private:
+
+    size_t find_ordered_position(const DrawSortKey &key, const VertexBounds &bounds);
+};
+
+} // namespace emu
+
+#endif // DRAW_LIST_H
+
+// EOF //
@@ -2,6 +2,7 @@
 #include "structure_log.h"
 #include "../hw/hw_layer.h"
 #include "surface_emu.h"
+#include "execute_profiler.h"
 #include <assert.h>
 
 namespace emu {
@@ -10,6 +11,8 @@ Direct3DExecuteBufferEmu::Direct3DExecuteBufferEmu(HWLayer &the_hw_layer, const
     : hw_layer(the_hw_layer)
     , size(buffer_size)
     , memory(NULL)
+    , decoded_instructions()
+    , decoded_valid(false)
 {
     LOG_METHOD();
     memory = malloc(size);
@@ -46,31 +49,29 @@ void Direct3DExecuteBufferEmu::execute(DirectDrawSurfaceEmu &device, const LPDIR
 
     device.begin_geometry(execute_data.dwVertexCount);
 
-    assert((execute_data.dwInstructionOffset + execute_data.dwInstructionLength) <= size);
-
-    size_t offset = execute_data.dwInstructionOffset;
-    size_t length = execute_data.dwInstructionLength;
-
-    while (length > 0) {
-
-        // Fetch the instruction header.
+    ExecuteProfiler &device_profiler = device.get_emulation_info().execute_profiler;
+    ExecuteProfiler * const profiler = device_profiler.is_enabled() ? &device_profiler : NULL;
+    if (profiler) {
+        profiler->begin_execute(execute_data.dwVertexCount);
+    }
 
-        assert(length >= sizeof(D3DINSTRUCTION));
-        const D3DINSTRUCTION instruction = *reinterpret_cast<const D3DINSTRUCTION * >(static_cast<char *>(memory) + offset);
-        offset += sizeof(D3DINSTRUCTION);
-        length -= sizeof(D3DINSTRUCTION);
+    // Walk the decoded instructions.
 
-        // Check that the data block it describes fits to the buffer.
+    if (! decoded_valid) {
+        decode_instructions();
+    }
 
-        const size_t data_length = instruction.bSize * instruction.wCount;
-        assert(data_length <= length);
+    bool running = true;
+    for (size_t i = 0; running && (i < decoded_instructions.size()); ++i) {
+        const DecodedInstruction &instruction = decoded_instructions[i];
+        bool supported = true;
 
-#define OPERATION(name, type) case D3DOP_##name : assert(sizeof(type) == instruction.bSize); if (! execute_block<type>(device, offset, instruction.wCount)) { length = 0; }; break;
-#define UNSUPPORTED_OPERATION(name) case D3DOP_##name : logKA(MSG_ERROR, 0, "Unsupported D3DOP_" #name " %u %u", instruction.bSize, instruction.wCount); break;
-        switch (instruction.bOpcode) {
+#define OPERATION(name, type) case D3DOP_##name : assert(sizeof(type) == instruction.size); running = execute_block<type>(device, instruction.offset, instruction.count); break;
+#define UNSUPPORTED_OPERATION(name) case D3DOP_##name : logKA(MSG_ERROR, 0, "Unsupported D3DOP_" #name " %u %u", instruction.size, instruction.count); supported = false; break;
+        switch (instruction.opcode) {
             OPERATION(POINT, D3DPOINT);
             OPERATION(LINE, D3DLINE);
-            OPERATION(TRIANGLE, D3DTRIANGLE);
+            case D3DOP_TRIANGLE : assert(sizeof(D3DTRIANGLE) == instruction.size); running = execute_triangles(device, instruction.offset, instruction.count); break;
             UNSUPPORTED_OPERATION(MATRIXLOAD);
             UNSUPPORTED_OPERATION(MATRIXMULTIPLY);
             UNSUPPORTED_OPERATION(STATETRANSFORM);
@@ -81,28 +82,36 @@ void Direct3DExecuteBufferEmu::execute(DirectDrawSurfaceEmu &device, const LPDIR
             UNSUPPORTED_OPERATION(BRANCHFORWARD);
             UNSUPPORTED_OPERATION(SPAN);
             UNSUPPORTED_OPERATION(SETSTATUS);
-
-            // End of the buffer.
-
-            case D3DOP_EXIT: {
-                assert(instruction.bSize == 0);
-                assert(instruction.wCount == 0);
-                length = 0;
-                break;
-            }
         }
 #undef OPERATION
 #undef UNSUPPORTED_OPERATION
 
-        // Skip to the next instruction.
-
-        offset += data_length;
-        length -= data_length;
+        if (profiler) {
+            profiler->record_decoded_instruction(memory, instruction, supported, running);
+        }
     }
 
     // We are done.
 
     device.end_geometry();
+    if (profiler) {
+        profiler->end_execute();
+    }
+}
+
+/**
+ * @brief Decodes the instruction stream of the execute data.
+ */
+void Direct3DExecuteBufferEmu::decode_instructions(void)
+{
+    assert(INSTRUCTION_TRIANGLE == static_cast<int>(D3DOP_TRIANGLE));
+    assert(INSTRUCTION_STATERENDER == static_cast<int>(D3DOP_STATERENDER));
+    assert(INSTRUCTION_PROCESSVERTICES == static_cast<int>(D3DOP_PROCESSVERTICES));
+    assert(INSTRUCTION_EXIT == static_cast<int>(D3DOP_EXIT));
+    assert(INSTRUCTION_HEADER_SIZE == sizeof(D3DINSTRUCTION));
+    assert((execute_data.dwInstructionOffset + execute_data.dwInstructionLength) <= size);
+    emu::decode_instructions(memory, execute_data.dwInstructionOffset, execute_data.dwInstructionLength, decoded_instructions);
+    decoded_valid = true;
 }
 
 /**
@@ -120,6 +129,22 @@ bool Direct3DExecuteBufferEmu::execute_block(DirectDrawSurfaceEmu &device, const
     return true;
 }
 
+/**
+ * @brief Executes block of D3DOP_TRIANGLE operations at once.
+ */
+bool Direct3DExecuteBufferEmu::execute_triangles(DirectDrawSurfaceEmu &device, const size_t start_offset, const size_t count)
+{
+    // Logging of the individual triangles needs the per-triangle path.
+
+    if (MSG_ULTRA_VERBOSE <= MAXIMAL_MSG_LEVEL) {
+        return execute_block<D3DTRIANGLE>(device, start_offset, count);
+    }
+
+    const D3DTRIANGLE * const data = reinterpret_cast<const D3DTRIANGLE *>(static_cast<const char *>(memory) + start_offset);
+    device.add_triangles(data, count);
+    return true;
+}
+
 /**
  * @brief Executes the D3DOP_STATERENDER operation.
  */
@@ -289,18 +314,15 @@ bool Direct3DExecuteBufferEmu::execute_operation(DirectDrawSurfaceEmu &device, c
     logKA(MSG_ULTRA_VERBOSE, 4, "dwCount: %u", data.dwCount);
     logKA(MSG_ULTRA_VERBOSE, 4, "dwReserved: %u", data.dwReserved);
 
-    // Currently only vertices added at start of the buffer are supported.
+    // The source window must be inside the vertex data. The destination
+    // window is checked by the device.
 
-    if (data.wStart != 0) {
-        logKA(MSG_ERROR, 0, "Unsupported value of wStart");
-        return false;
-    }
-    if (data.wDest != 0) {
-        logKA(MSG_ERROR, 0, "Unsupported value of wDest");
+    if ((data.wStart + data.dwCount) > execute_data.dwVertexCount) {
+        logKA(MSG_ERROR, 0, "Vertex window %u+%u is outside of %u vertices of the buffer", data.wStart, data.dwCount, execute_data.dwVertexCount);
         return false;
     }
 
-    // Set the vertices.
+    // Copy the window.
 
     const size_t start_offset =
         execute_data.dwVertexOffset +
@@ -323,6 +345,10 @@ STDMETHODIMP Direct3DExecuteBufferEmu::Lock(LPD3DEXECUTEBUFFERDESC desc)
     CHECK_STRUCTURE(desc, D3DEXECUTEBUFFERDESC);
     log_structure(MSG_ULTRA_VERBOSE, 1, *desc);
 
+    // The instructions might be changed.
+
+    decoded_valid = false;
+
     desc->dwFlags |= D3DDEB_CAPS | D3DDEB_BUFSIZE | D3DDEB_LPDATA;
     desc->dwCaps = D3DDEBCAPS_VIDEOMEMORY;
     desc->dwBufferSize = size;
@@ -348,6 +374,9 @@ STDMETHODIMP Direct3DExecuteBufferEmu::SetExecuteData(LPD3DEXECUTEDATA data)
     CHECK_STRUCTURE(data, D3DEXECUTEDATA);
     log_structure(MSG_VERBOSE, 1, *data);
 
+    if ((data->dwInstructionOffset != execute_data.dwInstructionOffset) || (data->dwInstructionLength != execute_data.dwInstructionLength)) {
+        decoded_valid = false;
+    }
     execute_data = *data;
     return DD_OK;
 }
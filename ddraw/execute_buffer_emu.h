@@ -4,13 +4,16 @@
 #include "../helpers/interface.h"
 #include "../helpers/log.h"
 #include "ddraw_emu.h"
+#include "instruction_decoder.h"
 #include "ddraw.h"
 #include "d3d.h"
 #include <deque>
+#include <vector>
 
 namespace emu {
 
 class DirectDrawSurfaceEmu;
+class ExecuteProfiler;
 
 class Direct3DExecuteBufferEmu : public IUnknownImpl, public IDirect3DExecuteBuffer {
 
@@ -35,15 +38,26 @@ private:
      */
     D3DEXECUTEDATA execute_data;
 
+    /**
+     * @brief Instructions of the execute data decoded by previous execute.
+     *
+     * The game reuses the same instruction streams so they are decoded
+     * again only after Lock() or change of the instruction range.
+     */
+    std::vector<DecodedInstruction> decoded_instructions;
+    bool decoded_valid;
+
 public:
 
     Direct3DExecuteBufferEmu(HWLayer &the_hw_layer, const size_t buffer_size);
     virtual ~Direct3DExecuteBufferEmu();
 
     void execute(DirectDrawSurfaceEmu &device, const LPDIRECT3DVIEWPORT viewport,const DWORD flags);
+    void decode_instructions(void);
 
     template<typename Type>
     bool execute_block(DirectDrawSurfaceEmu &device, const size_t start_offset, const size_t count);
+    bool execute_triangles(DirectDrawSurfaceEmu &device, const size_t start_offset, const size_t count);
 
     bool execute_operation(DirectDrawSurfaceEmu &device, const D3DSTATE &data);
     bool execute_operation(DirectDrawSurfaceEmu &device, const D3DPOINT &data);
@@ -0,0 +1,514 @@
+#include "execute_profiler.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief Names of the D3DOP_* opcodes indexed by their value.
+ */
+const char * const OPCODE_NAMES[] = {
+    NULL,
+    "POINT",
+    "LINE",
+    "TRIANGLE",
+    "MATRIXLOAD",
+    "MATRIXMULTIPLY",
+    "STATETRANSFORM",
+    "STATELIGHT",
+    "STATERENDER",
+    "PROCESSVERTICES",
+    "TEXTURELOAD",
+    "EXIT",
+    "BRANCHFORWARD",
+    "SPAN",
+    "SETSTATUS",
+};
+
+const size_t OPCODE_NAME_COUNT = sizeof(OPCODE_NAMES) / sizeof(OPCODE_NAMES[0]);
+
+/**
+ * @brief Maps opcode to slot of the counters. Unknown opcodes share slot 0.
+ */
+size_t get_opcode_slot(const size_t opcode)
+{
+    return (opcode < ExecuteProfiler::OPCODE_SLOTS) ? opcode : 0;
+}
+
+
+} // anonymous namespace
+
+Histogram::Histogram()
+{
+    clear();
+}
+
+void Histogram::clear(void)
+{
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        buckets[i] = 0;
+    }
+    count = 0;
+    sum = 0.0;
+    maximum = 0;
+}
+
+void Histogram::add(const size_t value)
+{
+    buckets[get_bucket_index(value)]++;
+    count++;
+    sum += static_cast<double>(value);
+    if (value > maximum) {
+        maximum = value;
+    }
+}
+
+size_t Histogram::get_count(void) const
+{
+    return count;
+}
+
+size_t Histogram::get_bucket(const size_t bucket) const
+{
+    assert(bucket < BUCKET_COUNT);
+    return buckets[bucket];
+}
+
+size_t Histogram::get_maximum(void) const
+{
+    return maximum;
+}
+
+double Histogram::get_average(void) const
+{
+    return (count == 0) ? 0.0 : (sum / static_cast<double>(count));
+}
+
+size_t Histogram::get_bucket_index(const size_t value)
+{
+    size_t bucket = 0;
+    for (size_t remaining = value; (remaining != 0) && (bucket < (BUCKET_COUNT - 1)); remaining >>= 1) {
+        bucket++;
+    }
+    return bucket;
+}
+
+/**
+ * @brief Returns the smallest value counted by specified bucket.
+ */
+size_t Histogram::get_bucket_minimum(const size_t bucket)
+{
+    return (bucket == 0) ? 0 : (static_cast<size_t>(1) << (bucket - 1));
+}
+
+/**
+ * @brief Formats the histogram as single line listing non-empty buckets.
+ */
+std::string Histogram::format(const char * const name) const
+{
+    char line[128];
+    sprintf(line, "%-26s count %u avg %.2f max %u |", name, static_cast<unsigned int>(count), get_average(), static_cast<unsigned int>(maximum));
+    std::string result = line;
+
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+        sprintf(line, " %u%s:%u", static_cast<unsigned int>(get_bucket_minimum(i)), (i == (BUCKET_COUNT - 1)) ? "+" : "", static_cast<unsigned int>(buckets[i]));
+        result += line;
+    }
+    result += "\n";
+    return result;
+}
+
+ExecuteProfiler::ExecuteProfiler()
+    : enabled(false)
+{
+    clear();
+}
+
+void ExecuteProfiler::set_enabled(const bool value)
+{
+    enabled = value;
+}
+
+bool ExecuteProfiler::is_enabled(void) const
+{
+    return enabled;
+}
+
+/**
+ * @brief Forgets all recorded data.
+ */
+void ExecuteProfiler::clear(void)
+{
+    execute_count = 0;
+    frame_count = 0;
+    for (size_t i = 0; i < OPCODE_SLOTS; ++i) {
+        opcode_instructions[i] = 0;
+        opcode_operations[i] = 0;
+        unsupported_hits[i] = 0;
+        failure_hits[i] = 0;
+    }
+    process_vertices_count = 0;
+    process_vertices_offset_count = 0;
+    triangle_index_count = 0;
+    submitted_index_count = 0;
+    strip_draw_count = 0;
+    merged_batch_count = 0;
+    tested_triangle_count = 0;
+    culled_triangle_count = 0;
+
+    vertices_per_execute.clear();
+    instructions_per_execute.clear();
+    triangles_per_block.clear();
+    vertices_per_process.clear();
+    state_changes_per_draw.clear();
+    primitives_per_draw.clear();
+    executes_per_frame.clear();
+    triangles_per_frame.clear();
+    draws_per_frame.clear();
+    unmerged_draws_per_frame.clear();
+    state_changes_per_frame.clear();
+    index_savings_per_frame.clear();
+    culled_percent_per_frame.clear();
+
+    execute_instructions = 0;
+    pending_state_changes = 0;
+    frame_executes = 0;
+    frame_triangles = 0;
+    frame_draws = 0;
+    frame_merged_batches = 0;
+    frame_state_changes = 0;
+    frame_index_savings = 0;
+    frame_tested_triangles = 0;
+    frame_culled_triangles = 0;
+}
+
+void ExecuteProfiler::begin_execute(const size_t vertex_count)
+{
+    assert(enabled);
+    execute_count++;
+    frame_executes++;
+    execute_instructions = 0;
+    vertices_per_execute.add(vertex_count);
+}
+
+void ExecuteProfiler::end_execute(void)
+{
+    assert(enabled);
+    instructions_per_execute.add(execute_instructions);
+}
+
+/**
+ * @brief Records instruction with specified number of operations.
+ */
+void ExecuteProfiler::record_instruction(const size_t opcode, const size_t count)
+{
+    assert(enabled);
+    const size_t slot = get_opcode_slot(opcode);
+    opcode_instructions[slot]++;
+    opcode_operations[slot] += count;
+    execute_instructions++;
+}
+
+void ExecuteProfiler::record_unsupported(const size_t opcode)
+{
+    assert(enabled);
+    unsupported_hits[get_opcode_slot(opcode)]++;
+}
+
+/**
+ * @brief Records instruction which aborted the execute.
+ */
+void ExecuteProfiler::record_failure(const size_t opcode)
+{
+    assert(enabled);
+    failure_hits[get_opcode_slot(opcode)]++;
+}
+
+/**
+ * @brief Records block of triangles from single D3DOP_TRIANGLE instruction.
+ */
+void ExecuteProfiler::record_triangles(const size_t count)
+{
+    assert(enabled);
+    triangles_per_block.add(count);
+    frame_triangles += count;
+}
+
+void ExecuteProfiler::record_state_changes(const size_t count)
+{
+    assert(enabled);
+    pending_state_changes += count;
+    frame_state_changes += count;
+}
+
+/**
+ * @brief Records D3DOP_PROCESSVERTICES operation.
+ *
+ * The offset indicates nonzero start or destination.
+ */
+void ExecuteProfiler::record_process_vertices(const size_t count, const bool offset)
+{
+    assert(enabled);
+    process_vertices_count++;
+    vertices_per_process.add(count);
+    if (offset) {
+        process_vertices_offset_count++;
+    }
+}
+
+/**
+ * @brief Records draw of the queued geometry.
+ *
+ * The state changes recorded since the previous draw are attributed to it.
+ */
+void ExecuteProfiler::record_draw(const size_t primitive_count)
+{
+    assert(enabled);
+    state_changes_per_draw.add(pending_state_changes);
+    primitives_per_draw.add(primitive_count);
+    pending_state_changes = 0;
+    frame_draws++;
+}
+
+/**
+ * @brief Records batch which continued into the following execute.
+ *
+ * Without the merging it would be drawn at the end of its execute.
+ */
+void ExecuteProfiler::record_merged_batch(void)
+{
+    assert(enabled);
+    merged_batch_count++;
+    frame_merged_batches++;
+}
+
+/**
+ * @brief Records indices of drawn triangles.
+ *
+ * The submitted count differs from the list count when the triangles
+ * were sent as strip.
+ */
+void ExecuteProfiler::record_triangle_indices(const size_t list_count, const size_t submitted_count, const bool strip)
+{
+    assert(enabled);
+    assert(submitted_count <= list_count);
+    triangle_index_count += list_count;
+    submitted_index_count += submitted_count;
+    frame_index_savings += (list_count - submitted_count);
+    if (strip) {
+        strip_draw_count++;
+    }
+}
+
+/**
+ * @brief Records triangles tested by the CPU culling and how many of them
+ * were dropped.
+ */
+void ExecuteProfiler::record_culled_triangles(const size_t tested_count, const size_t culled_count)
+{
+    assert(enabled);
+    assert(culled_count <= tested_count);
+    tested_triangle_count += tested_count;
+    culled_triangle_count += culled_count;
+    frame_tested_triangles += tested_count;
+    frame_culled_triangles += culled_count;
+}
+
+void ExecuteProfiler::end_frame(void)
+{
+    assert(enabled);
+    frame_count++;
+    executes_per_frame.add(frame_executes);
+    triangles_per_frame.add(frame_triangles);
+    draws_per_frame.add(frame_draws);
+    unmerged_draws_per_frame.add(frame_draws + frame_merged_batches);
+    state_changes_per_frame.add(frame_state_changes);
+    index_savings_per_frame.add(frame_index_savings);
+    if (frame_tested_triangles != 0) {
+        culled_percent_per_frame.add((frame_culled_triangles * 100) / frame_tested_triangles);
+    }
+    frame_executes = 0;
+    frame_triangles = 0;
+    frame_draws = 0;
+    frame_merged_batches = 0;
+    frame_state_changes = 0;
+    frame_index_savings = 0;
+    frame_tested_triangles = 0;
+    frame_culled_triangles = 0;
+}
+
+/**
+ * @brief Records the executed instruction with the details of its data block.
+ *
+ * The memory is the execute buffer the instruction was decoded from.
+ */
+void ExecuteProfiler::record_decoded_instruction(const void * const memory, const DecodedInstruction &instruction, const bool supported, const bool succeeded)
+{
+    assert(enabled);
+    record_instruction(instruction.opcode, instruction.count);
+    if (! supported) {
+        record_unsupported(instruction.opcode);
+    }
+    if (! succeeded) {
+        record_failure(instruction.opcode);
+    }
+
+    switch (instruction.opcode) {
+        case INSTRUCTION_TRIANGLE: {
+            record_triangles(instruction.count);
+            break;
+        }
+        case INSTRUCTION_STATERENDER: {
+            record_state_changes(instruction.count);
+            break;
+        }
+        case INSTRUCTION_PROCESSVERTICES: {
+
+            // D3DPROCESSVERTICES is flags, start and destination words
+            // and the vertex count.
+
+            const unsigned char * const data = static_cast<const unsigned char *>(memory) + instruction.offset;
+            for (size_t i = 0; i < instruction.count; ++i) {
+                const unsigned char * const operation = data + (i * instruction.size);
+                unsigned short start = 0;
+                unsigned short destination = 0;
+                unsigned int count = 0;
+                memcpy(&start, operation + 4, sizeof(start));
+                memcpy(&destination, operation + 6, sizeof(destination));
+                memcpy(&count, operation + 8, sizeof(count));
+                record_process_vertices(count, (start != 0) || (destination != 0));
+            }
+            break;
+        }
+    }
+}
+
+size_t ExecuteProfiler::get_execute_count(void) const
+{
+    return execute_count;
+}
+
+size_t ExecuteProfiler::get_frame_count(void) const
+{
+    return frame_count;
+}
+
+size_t ExecuteProfiler::get_instruction_count(const size_t opcode) const
+{
+    return opcode_instructions[get_opcode_slot(opcode)];
+}
+
+size_t ExecuteProfiler::get_operation_count(const size_t opcode) const
+{
+    return opcode_operations[get_opcode_slot(opcode)];
+}
+
+size_t ExecuteProfiler::get_unsupported_count(const size_t opcode) const
+{
+    return unsupported_hits[get_opcode_slot(opcode)];
+}
+
+size_t ExecuteProfiler::get_failure_count(const size_t opcode) const
+{
+    return failure_hits[get_opcode_slot(opcode)];
+}
+
+const Histogram &ExecuteProfiler::get_triangles_per_block(void) const
+{
+    return triangles_per_block;
+}
+
+const Histogram &ExecuteProfiler::get_state_changes_per_draw(void) const
+{
+    return state_changes_per_draw;
+}
+
+/**
+ * @brief Formats the session summary.
+ */
+std::string ExecuteProfiler::report(void) const
+{
+    std::string text = "KA_DDRAW execute buffer profile\n";
+
+    char line[128];
+    sprintf(line, "executes %u frames %u\n\n", static_cast<unsigned int>(execute_count), static_cast<unsigned int>(frame_count));
+    text += line;
+
+    text += "opcode              instructions operations unsupported failed\n";
+    for (size_t i = 0; i < OPCODE_SLOTS; ++i) {
+        if ((opcode_instructions[i] == 0) && (unsupported_hits[i] == 0)) {
+            continue;
+        }
+        sprintf(
+            line,
+            "%-19s %12u %10u %11u %6u\n",
+            get_opcode_name(i),
+            static_cast<unsigned int>(opcode_instructions[i]),
+            static_cast<unsigned int>(opcode_operations[i]),
+            static_cast<unsigned int>(unsupported_hits[i]),
+            static_cast<unsigned int>(failure_hits[i])
+        );
+        text += line;
+    }
+
+    sprintf(line, "\nprocess vertices %u, with offset %u\n", static_cast<unsigned int>(process_vertices_count), static_cast<unsigned int>(process_vertices_offset_count));
+    text += line;
+    sprintf(line, "triangle indices %u, submitted %u, strip draws %u\n", static_cast<unsigned int>(triangle_index_count), static_cast<unsigned int>(submitted_index_count), static_cast<unsigned int>(strip_draw_count));
+    text += line;
+    sprintf(line, "batches merged across executes %u\n", static_cast<unsigned int>(merged_batch_count));
+    text += line;
+    sprintf(line, "triangles tested by culling %u, culled %u\n\n", static_cast<unsigned int>(tested_triangle_count), static_cast<unsigned int>(culled_triangle_count));
+    text += line;
+
+    text += vertices_per_execute.format("vertices per execute");
+    text += instructions_per_execute.format("instructions per execute");
+    text += triangles_per_block.format("triangles per block");
+    text += vertices_per_process.format("vertices per process");
+    text += state_changes_per_draw.format("state changes per draw");
+    text += primitives_per_draw.format("primitives per draw");
+    text += executes_per_frame.format("executes per frame");
+    text += triangles_per_frame.format("triangles per frame");
+    text += draws_per_frame.format("draws per frame");
+    text += unmerged_draws_per_frame.format("draws per frame unmerged");
+    text += state_changes_per_frame.format("state changes per frame");
+    text += index_savings_per_frame.format("index savings per frame");
+    text += culled_percent_per_frame.format("culled percent per frame");
+    return text;
+}
+
+/**
+ * @brief Stores the report into specified file.
+ */
+bool ExecuteProfiler::save(const char * const file_name) const
+{
+    FILE * const file = fopen(file_name, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    const std::string text = report();
+    const bool written = (fwrite(text.data(), 1, text.size(), file) == text.size());
+    const bool closed = (fclose(file) == 0);
+    return written && closed;
+}
+
+/**
+ * @brief Returns name of the D3DOP_* opcode or "unknown".
+ */
+const char *ExecuteProfiler::get_opcode_name(const size_t opcode)
+{
+    if ((opcode == 0) || (opcode >= OPCODE_NAME_COUNT)) {
+        return "unknown";
+    }
+    return OPCODE_NAMES[opcode];
+}
+
+} // namespace emu
+
+// EOF //
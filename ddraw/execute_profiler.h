@@ -0,0 +1,165 @@
+#ifndef EXECUTE_PROFILER_H
+#define EXECUTE_PROFILER_H
+
+#include "instruction_decoder.h"
+#include <cstddef>
+#include <string>
+
+namespace emu {
+
+/**
+ * @brief Distribution of values in power of two buckets.
+ *
+ * Bucket 0 counts zeros, bucket N counts values from 2^(N-1) to 2^N - 1.
+ * The last bucket counts everything above.
+ */
+class Histogram {
+
+public:
+
+    static const size_t BUCKET_COUNT = 18;
+
+private:
+
+    size_t buckets[BUCKET_COUNT];
+    size_t count;
+    double sum;
+    size_t maximum;
+
+public:
+
+    Histogram();
+
+    void clear(void);
+    void add(const size_t value);
+
+    size_t get_count(void) const;
+    size_t get_bucket(const size_t bucket) const;
+    size_t get_maximum(void) const;
+    double get_average(void) const;
+
+    static size_t get_bucket_index(const size_t value);
+    static size_t get_bucket_minimum(const size_t bucket);
+
+    std::string format(const char * const name) const;
+};
+
+/**
+ * @brief Statistics about content of the execute buffers.
+ *
+ * The opcodes use the D3DOP_* numbering. Recording functions
+ * must be called only when the profiler is enabled.
+ */
+class ExecuteProfiler {
+
+public:
+
+    static const size_t OPCODE_SLOTS = 16;
+
+private:
+
+    bool enabled;
+
+    /**
+     * @name Session totals.
+     */
+    //@{
+    size_t execute_count;
+    size_t frame_count;
+    size_t opcode_instructions[OPCODE_SLOTS];
+    size_t opcode_operations[OPCODE_SLOTS];
+    size_t unsupported_hits[OPCODE_SLOTS];
+    size_t failure_hits[OPCODE_SLOTS];
+    size_t process_vertices_count;
+    size_t process_vertices_offset_count;
+    size_t triangle_index_count;
+    size_t submitted_index_count;
+    size_t strip_draw_count;
+    size_t merged_batch_count;
+    size_t tested_triangle_count;
+    size_t culled_triangle_count;
+    //@}
+
+    /**
+     * @name Distributions over the session.
+     */
+    //@{
+    Histogram vertices_per_execute;
+    Histogram instructions_per_execute;
+    Histogram triangles_per_block;
+    Histogram vertices_per_process;
+    Histogram state_changes_per_draw;
+    Histogram primitives_per_draw;
+    Histogram executes_per_frame;
+    Histogram triangles_per_frame;
+    Histogram draws_per_frame;
+    Histogram unmerged_draws_per_frame;
+    Histogram state_changes_per_frame;
+    Histogram index_savings_per_frame;
+    Histogram culled_percent_per_frame;
+    //@}
+
+    /**
+     * @name Values accumulated during the current execute and frame.
+     */
+    //@{
+    size_t execute_instructions;
+    size_t pending_state_changes;
+    size_t frame_executes;
+    size_t frame_triangles;
+    size_t frame_draws;
+    size_t frame_merged_batches;
+    size_t frame_state_changes;
+    size_t frame_index_savings;
+    size_t frame_tested_triangles;
+    size_t frame_culled_triangles;
+    //@}
+
+public:
+
+    ExecuteProfiler();
+
+    void set_enabled(const bool value);
+    bool is_enabled(void) const;
+    void clear(void);
+
+    // Recording.
+
+    void begin_execute(const size_t vertex_count);
+    void end_execute(void);
+    void record_instruction(const size_t opcode, const size_t count);
+    void record_unsupported(const size_t opcode);
+    void record_failure(const size_t opcode);
+    void record_triangles(const size_t count);
+    void record_state_changes(const size_t count);
+    void record_process_vertices(const size_t count, const bool offset);
+    void record_draw(const size_t primitive_count);
+    void record_merged_batch(void);
+    void record_triangle_indices(const size_t list_count, const size_t submitted_count, const bool strip);
+    void record_culled_triangles(const size_t tested_count, const size_t culled_count);
+    void end_frame(void);
+
+    void record_decoded_instruction(const void * const memory, const DecodedInstruction &instruction, const bool supported, const bool succeeded);
+
+    // Queries.
+
+    size_t get_execute_count(void) const;
+    size_t get_frame_count(void) const;
+    size_t get_instruction_count(const size_t opcode) const;
+    size_t get_operation_count(const size_t opcode) const;
+    size_t get_unsupported_count(const size_t opcode) const;
+    size_t get_failure_count(const size_t opcode) const;
+    const Histogram &get_triangles_per_block(void) const;
+    const Histogram &get_state_changes_per_draw(void) const;
+
+    std::string report(void) const;
+    bool save(const char * const file_name) const;
+
+    static const char *get_opcode_name(const size_t opcode);
+};
+
+} // namespace emu
+
+#endif // EXECUTE_PROFILER_H
+
+// EOF //
@@ -0,0 +1,149 @@
+#include "hw_state_key.h"
+
+namespace emu {
+
+HWStateKey::HWStateKey()
+    : depth_test(DEPTH_TEST_NONE)
+    , alpha_test(ALPHA_TEST_NONE)
+    , alpha_blend(BLEND_NONE)
+    , fog(FOG_NONE)
+    , fog_color(0)
+    , shade_mode(0)
+    , texture_blend(TEXTURE_BLEND_MODULATE)
+    , texture(0)
+{
+}
+
+/**
+ * @brief Derives the state which the apply_render_states() sends to the HW.
+ *
+ * Sets with the same key produce the same rendering. The raw shade mode
+ * is kept as the glow hack depends on it.
+ */
+HWStateKey::HWStateKey(const RenderStateSet &set)
+    : depth_test(get_depth_test_state(set))
+    , alpha_test(get_alpha_test_state(set))
+    , alpha_blend(get_alpha_blend_state(set))
+    , fog(get_fog_state(set))
+    , fog_color(0)
+    , shade_mode(static_cast<unsigned int>(set.get_rs_dw(RENDER_STATE_SHADEMODE)))
+    , texture_blend(TEXTURE_BLEND_MODULATE)
+    , texture(static_cast<unsigned int>(set.get_rs_dw(RENDER_STATE_TEXTUREHANDLE)))
+{
+    if (fog != FOG_NONE) {
+        fog_color = static_cast<unsigned int>(set.get_rs_dw(RENDER_STATE_FOGCOLOR));
+    }
+    if (texture != 0) {
+        texture_blend = get_texture_blend(set);
+    }
+}
+
+bool HWStateKey::operator==(const HWStateKey &other) const
+{
+    return
+        (depth_test == other.depth_test) &&
+        (alpha_test == other.alpha_test) &&
+        (alpha_blend == other.alpha_blend) &&
+        (fog == other.fog) &&
+        (fog_color == other.fog_color) &&
+        (shade_mode == other.shade_mode) &&
+        (texture_blend == other.texture_blend) &&
+        (texture == other.texture)
+    ;
+}
+
+DepthTest get_depth_test_state(const RenderStateSet &set)
+{
+    if (! set.get_rs_bool(RENDER_STATE_ZENABLE)) {
+        return DEPTH_TEST_NONE;
+    }
+
+    // The 'always' render state effectively disables test. If the
+    // writes are disabled as well, the result is equivalent to the
+    // full disable state (stencil buffer is not supported).
+
+    const size_t function = set.get_rs_dw(RENDER_STATE_ZFUNC);
+    if ((function == RENDER_VALUE_CMP_ALWAYS) && (! set.get_rs_bool(RENDER_STATE_ZWRITEENABLE))) {
+        return DEPTH_TEST_NONE;
+    }
+
+    // For enabled state check that the function is right.
+
+    if (function != RENDER_VALUE_CMP_LESSEQUAL) {
+        return DEPTH_TEST_NONE;
+    }
+
+    // Check for disabled z-buffer writes.
+
+    if (! set.get_rs_bool(RENDER_STATE_ZWRITEENABLE)) {
+        return DEPTH_TEST_NOZWRITE;
+    }
+    return DEPTH_TEST_ON;
+}
+
+AlphaTest get_alpha_test_state(const RenderStateSet &set)
+{
+    if (! set.get_rs_bool(RENDER_STATE_ALPHATESTENABLE)) {
+        return ALPHA_TEST_NONE;
+    }
+    if (set.get_rs_dw(RENDER_STATE_ALPHAREF) != 0) {
+        return ALPHA_TEST_NONE;
+    }
+    if (set.get_rs_dw(RENDER_STATE_ALPHAFUNC) == RENDER_VALUE_CMP_NOTEQUAL) {
+        return ALPHA_TEST_NOEQUAL;
+    }
+    return ALPHA_TEST_NONE;
+}
+
+Blend get_alpha_blend_state(const RenderStateSet &set)
+{
+    if (! set.get_rs_bool(RENDER_STATE_BLENDENABLE)) {
+        return BLEND_NONE;
+    }
+
+    const size_t src = set.get_rs_dw(RENDER_STATE_SRCBLEND);
+    const size_t dest = set.get_rs_dw(RENDER_STATE_DESTBLEND);
+    if ((src == RENDER_VALUE_BLEND_SRCALPHA) && (dest == RENDER_VALUE_BLEND_INVSRCALPHA)) {
+        return BLEND_OVER;
+    }
+    if (src == RENDER_VALUE_BLEND_BOTHSRCALPHA) {
+        return BLEND_OVER;
+    }
+    return BLEND_NONE;
+}
+
+Fog get_fog_state(const RenderStateSet &set)
+{
+    if (! set.get_rs_bool(RENDER_STATE_FOGENABLE)) {
+        return FOG_NONE;
+    }
+
+    // Fixed parameters.
+
+    if ((set.get_rs_float(RENDER_STATE_FOGTABLEDENSITY) != 1.0f) || (set.get_rs_float(RENDER_STATE_FOGTABLEEND) != 1.0f) || (set.get_rs_float(RENDER_STATE_FOGTABLESTART) != 0.0f)) {
+        return FOG_NONE;
+    }
+
+    // Table mode.
+
+    const size_t table_mode = set.get_rs_dw(RENDER_STATE_FOGTABLEMODE);
+    if (table_mode == RENDER_VALUE_FOG_NONE) {
+        return FOG_VERTEX;
+    }
+    if (table_mode == RENDER_VALUE_FOG_LINEAR) {
+        return FOG_TABLE;
+    }
+    return FOG_NONE;
+}
+
+TextureBlend get_texture_blend(const RenderStateSet &set)
+{
+    if (set.get_rs_dw(RENDER_STATE_TEXTUREMAPBLEND) == RENDER_VALUE_TBLEND_MODULATEALPHA) {
+        return TEXTURE_BLEND_MODULATEALPHA;
+    }
+    return TEXTURE_BLEND_MODULATE;
+}
+
+} // namespace emu
+
+// EOF //
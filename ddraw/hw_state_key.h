@@ -0,0 +1,93 @@
+#ifndef HW_STATE_KEY_H
+#define HW_STATE_KEY_H
+
+#include "../hw/hw_types.h"
+#include "render_state_set.h"
+#include <cstddef>
+
+namespace emu {
+
+/**
+ * @brief D3DRENDERSTATE_* types translated to the HW states.
+ */
+enum RenderStateType {
+    RENDER_STATE_TEXTUREHANDLE = 1,
+    RENDER_STATE_ZENABLE = 7,
+    RENDER_STATE_SHADEMODE = 9,
+    RENDER_STATE_ZWRITEENABLE = 14,
+    RENDER_STATE_ALPHATESTENABLE = 15,
+    RENDER_STATE_SRCBLEND = 19,
+    RENDER_STATE_DESTBLEND = 20,
+    RENDER_STATE_TEXTUREMAPBLEND = 21,
+    RENDER_STATE_ZFUNC = 23,
+    RENDER_STATE_ALPHAREF = 24,
+    RENDER_STATE_ALPHAFUNC = 25,
+    RENDER_STATE_BLENDENABLE = 27,
+    RENDER_STATE_FOGENABLE = 28,
+    RENDER_STATE_FOGCOLOR = 34,
+    RENDER_STATE_FOGTABLEMODE = 35,
+    RENDER_STATE_FOGTABLESTART = 36,
+    RENDER_STATE_FOGTABLEEND = 37,
+    RENDER_STATE_FOGTABLEDENSITY = 38
+};
+
+/**
+ * @brief D3D values of the translated render states.
+ */
+enum RenderStateValue {
+    RENDER_VALUE_CMP_LESSEQUAL = 4,     // D3DCMP_LESSEQUAL
+    RENDER_VALUE_CMP_NOTEQUAL = 6,      // D3DCMP_NOTEQUAL
+    RENDER_VALUE_CMP_ALWAYS = 8,        // D3DCMP_ALWAYS
+    RENDER_VALUE_BLEND_ZERO = 1,        // D3DBLEND_ZERO
+    RENDER_VALUE_BLEND_ONE = 2,         // D3DBLEND_ONE
+    RENDER_VALUE_BLEND_SRCALPHA = 5,    // D3DBLEND_SRCALPHA
+    RENDER_VALUE_BLEND_INVSRCALPHA = 6, // D3DBLEND_INVSRCALPHA
+    RENDER_VALUE_BLEND_BOTHSRCALPHA = 12, // D3DBLEND_BOTHSRCALPHA
+    RENDER_VALUE_FOG_NONE = 0,          // D3DFOG_NONE
+    RENDER_VALUE_FOG_LINEAR = 3,        // D3DFOG_LINEAR
+    RENDER_VALUE_TBLEND_MODULATE = 2,   // D3DTBLEND_MODULATE
+    RENDER_VALUE_TBLEND_MODULATEALPHA = 4 // D3DTBLEND_MODULATEALPHA
+};
+
+/**
+ * @brief Part of the render states which is actually sent to the HW
+ * by the apply_render_states().
+ *
+ * States which have no effect in current configuration are zero.
+ */
+struct HWStateKey {
+    DepthTest depth_test;
+    AlphaTest alpha_test;
+    Blend alpha_blend;
+    Fog fog;
+    unsigned int fog_color;
+    unsigned int shade_mode;
+    TextureBlend texture_blend;
+    unsigned int texture;
+
+    HWStateKey();
+    explicit HWStateKey(const RenderStateSet &set);
+
+    bool operator==(const HWStateKey &other) const;
+};
+
+/**
+ * @name Translation of the render states to the HW states.
+ *
+ * Unsupported values are translated to the default state without any
+ * report so the translation can be used on every state change. The
+ * owner reports them when the state is applied.
+ */
+//@{
+DepthTest get_depth_test_state(const RenderStateSet &set);
+AlphaTest get_alpha_test_state(const RenderStateSet &set);
+Blend get_alpha_blend_state(const RenderStateSet &set);
+Fog get_fog_state(const RenderStateSet &set);
+TextureBlend get_texture_blend(const RenderStateSet &set);
+//@}
+
+} // namespace emu
+
+#endif // HW_STATE_KEY_H
+
+// EOF //
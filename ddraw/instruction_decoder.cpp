@@ -0,0 +1,59 @@
+#include "instruction_decoder.h"
+#include <string.h>
+#include <assert.h>
+
+namespace emu {
+
+/**
+ * @brief Decodes the instruction stream stored in the memory of execute buffer.
+ *
+ * The decoding stops at the D3DOP_EXIT instruction or at the end of the
+ * stream. The instructions replace previous content of the vector.
+ */
+void decode_instructions(const void * const memory, const size_t offset, const size_t length, std::vector<DecodedInstruction> &instructions)
+{
+    instructions.clear();
+
+    const unsigned char * const bytes = static_cast<const unsigned char *>(memory);
+    size_t position = offset;
+    size_t remaining = length;
+
+    while (remaining > 0) {
+
+        // Fetch the instruction header, the D3DINSTRUCTION is opcode,
+        // size of the element and count of the elements.
+
+        assert(remaining >= INSTRUCTION_HEADER_SIZE);
+        DecodedInstruction instruction;
+        instruction.opcode = bytes[position];
+        instruction.size = bytes[position + 1];
+        memcpy(&instruction.count, bytes + position + 2, sizeof(instruction.count));
+        position += INSTRUCTION_HEADER_SIZE;
+        remaining -= INSTRUCTION_HEADER_SIZE;
+
+        // End of the buffer.
+
+        if (instruction.opcode == INSTRUCTION_EXIT) {
+            assert(instruction.size == 0);
+            assert(instruction.count == 0);
+            break;
+        }
+
+        // Check that the data block it describes fits to the buffer.
+
+        const size_t data_length = instruction.size * instruction.count;
+        assert(data_length <= remaining);
+
+        instruction.offset = static_cast<unsigned int>(position);
+        instructions.push_back(instruction);
+
+        // Skip to the next instruction.
+
+        position += data_length;
+        remaining -= data_length;
+    }
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,44 @@
+#ifndef INSTRUCTION_DECODER_H
+#define INSTRUCTION_DECODER_H
+
+#include <cstddef>
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief D3DOP_* opcodes interpreted outside of the execute buffer.
+ */
+enum InstructionOpcode {
+    INSTRUCTION_TRIANGLE = 3,
+    INSTRUCTION_STATERENDER = 8,
+    INSTRUCTION_PROCESSVERTICES = 9,
+    INSTRUCTION_EXIT = 11 // Ends the instruction stream.
+};
+
+/**
+ * @brief Size of the D3DINSTRUCTION header.
+ */
+const size_t INSTRUCTION_HEADER_SIZE = 4;
+
+/**
+ * @brief Instruction with its data block located inside of the execute buffer.
+ */
+struct DecodedInstruction {
+    unsigned char opcode;
+    unsigned char size;
+    unsigned short count;
+
+    /**
+     * @brief Offset of the data block.
+     */
+    unsigned int offset;
+};
+
+void decode_instructions(const void * const memory, const size_t offset, const size_t length, std::vector<DecodedInstruction> &instructions);
+
+} // namespace emu
+
+#endif // INSTRUCTION_DECODER_H
+
+// EOF //
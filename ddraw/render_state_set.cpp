@@ -0,0 +1,152 @@
+#include "render_state_set.h"
+#include <assert.h>
+#include <string.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief Returns Zobrist key of specified value of specified render state.
+ *
+ * The table of random keys is replaced by the SplitMix64 finalizer
+ * as the values span the whole 32 bit range. The set with all states
+ * zero has zero hash, the keys of the zero values are never added.
+ */
+ContentHash get_render_state_key(const size_t type, const unsigned int value)
+{
+    ContentHash key = (static_cast<ContentHash>(type) << 32) | value;
+    key += 0x9e3779b97f4a7c15ULL;
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Constructor.
+ */
+RenderStateSet::RenderStateSet()
+    : hash(0)
+    , sequence_number(0)
+{
+    memset(states, 0, sizeof(states));
+}
+
+/**
+ * @brief Sets value of specified state.
+ *
+ * Returns true if there was change.
+ */
+bool RenderStateSet::set_rs_dw(const size_t type, const unsigned int new_value)
+{
+    assert(type < RENDER_STATE_COUNT);
+
+    // Set value if there was change.
+
+    const unsigned int old_value = states[type];
+    if (old_value == new_value) {
+        return false;
+    }
+    states[type] = new_value;
+
+    // Update the hash.
+
+    hash ^= get_render_state_key(type, old_value);
+    hash ^= get_render_state_key(type, new_value);
+    sequence_number++;
+    return true;
+}
+
+/**
+ * @brief Sets value of specified state to provided float.
+ *
+ * Returns true if there was change.
+ */
+bool RenderStateSet::set_rs_float(const size_t type, const float value)
+{
+    unsigned int bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return set_rs_dw(type, bits);
+}
+
+/**
+ * @brief Returns value for specified dword typed render state.
+ */
+size_t RenderStateSet::get_rs_dw(const size_t type) const
+{
+    assert(type < RENDER_STATE_COUNT);
+    return states[type];
+}
+
+/**
+ * @brief Returns value for specified boolean typed render state.
+ */
+bool RenderStateSet::get_rs_bool(const size_t type) const
+{
+    assert(type < RENDER_STATE_COUNT);
+    return states[type] != 0;
+}
+
+/**
+ * @brief Returns value for specified float typed render state.
+ */
+float RenderStateSet::get_rs_float(const size_t type) const
+{
+    assert(type < RENDER_STATE_COUNT);
+    float value = 0.0f;
+    memcpy(&value, &states[type], sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Directly compares states without any optimizations.
+ */
+bool RenderStateSet::compare_states(const RenderStateSet &other) const
+{
+    return memcmp(states, other.states, sizeof(states)) == 0;
+}
+
+/**
+ * @brief Determines if both sets represent the same state.
+ *
+ * Decided by the hash alone, the debug build verifies it by full compare.
+ */
+bool RenderStateSet::equals(const RenderStateSet &other) const
+{
+    const bool same = (hash == other.hash);
+    assert(same == compare_states(other));
+    return same;
+}
+
+/**
+ * @brief Compares both sets.
+ *
+ * If they have the same sequence number, they are
+ * considered the same so this method should be only used
+ * to compare state with its older constant copy.
+ */
+bool RenderStateSet::equals_with_sequence(const RenderStateSet &other) const
+{
+    // Same sequence number means that the states are equivalent under
+    // the assumption documented above.
+
+    if (sequence_number == other.sequence_number) {
+        assert(equals(other));
+        return true;
+    }
+
+    // Full scale check.
+
+    return equals(other);
+}
+
+unsigned RenderStateSet::get_sequence_number(void) const
+{
+    return sequence_number;
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,80 @@
+#ifndef RENDER_STATE_SET_H
+#define RENDER_STATE_SET_H
+
+#include "../helpers/hash.h"
+#include <cstddef>
+
+namespace emu {
+
+/**
+ * @brief Set of render states.
+ *
+ * The states are indexed by the D3DRENDERSTATETYPE values, floating
+ * point states are stored as their bit pattern.
+ */
+class RenderStateSet {
+
+public:
+
+    enum {
+
+        /**
+         * @brief D3DRENDERSTATE_FOGTABLEDENSITY + 1.
+         */
+        RENDER_STATE_COUNT = 39
+    };
+
+private:
+
+    /**
+     * @brief State values.
+     */
+    unsigned int states[RENDER_STATE_COUNT];
+
+    /**
+     * @brief Hash of the state.
+     *
+     * XOR of keys of all (state, value) pairs in Zobrist fashion so it
+     * can be updated incrementally. Sets with different hash differ,
+     * sets with the same hash are considered equal as the chance of
+     * collision is negligible.
+     */
+    ContentHash hash;
+
+    /**
+     * @brief Set sequence number.
+     *
+     * Increased during each change of stored value. If one
+     * set is created by copying another set, they will have
+     * the same value.
+     */
+    unsigned sequence_number;
+
+public:
+
+    RenderStateSet();
+
+    // Changes.
+
+    bool set_rs_dw(const size_t type, const unsigned int value);
+    bool set_rs_float(const size_t type, const float value);
+
+    // Queries.
+
+    size_t get_rs_dw(const size_t type) const;
+    bool get_rs_bool(const size_t type) const;
+    float get_rs_float(const size_t type) const;
+
+    // Comparison.
+
+    bool compare_states(const RenderStateSet &other) const;
+    bool equals(const RenderStateSet &other) const;
+    bool equals_with_sequence(const RenderStateSet &other) const;
+    unsigned get_sequence_number(void) const;
+};
+
+} // namespace emu
+
+#endif // RENDER_STATE_SET_H
+
+// EOF //
@@ -1,6 +1,9 @@
 #include "surface_emu.h"
 #include "execute_buffer_emu.h"
 #include "structure_log.h"
+#include "triangle_indices.h"
+#include "triangle_strip.h"
+#include <algorithm>
 #include <assert.h>
 #include "../helpers/config.h"
 
@@ -27,6 +30,25 @@ const unsigned short SFA_COMPOSITION_KEY_MEMORY = 0x0001;
 const float SFA_COMPOSITION_KEY[3] = {0.0f, 0.0f, 0.0322580636f};
 //@}
 
+/**
+ * @brief Average number of vertices per batch used to size the batch
+ * arrays of the reserved geometry storage.
+ */
+const size_t VERTICES_PER_RESERVED_BATCH = 16;
+
+/**
+ * @brief File receiving the execute buffer profile at shutdown.
+ */
+const char * const EXECUTE_PROFILE_FILE_NAME = "d3demu_execute_profile.txt";
+
+/**
+ * @brief Distance in pixels outside of the render target within which
+ * the triangles are never culled as off-screen.
+ *
+ * Covers the half pixel offsets applied during the rasterization.
+ */
+const float CULL_MARGIN = 1.0f;
+
 const float * get_composition_key(void)
 {
     return is_inside_sfad3d() ? SFA_COMPOSITION_KEY : KA_COMPOSITION_KEY;
@@ -146,6 +168,29 @@ EmulationInfo::EmulationInfo(const HINSTANCE instance, DirectDrawSurfaceEmu &sur
     : emulation_state(EMULATION_STATE_WAITING_FOR_TIME)
     , emulation_timeout_start(0)
     , timer_window(NULL)
+    , execute_profiler()
+    , hw_state_batching(true)
+    , avoided_flush_count(0)
+    , execute_merging(true)
+    , merged_batch_count(0)
+    , draw_sorting(false)
+    , sorted_batch_count(0)
+    , sorted_draw_count(0)
+    , fixed_batch_count(0)
+    , blend_merging(false)
+    , joined_blend_batch_count(0)
+    , geometry_reserve(get_geometry_reserve_vertex_count())
+    , geometry_storage_bytes(0)
+    , geometry_storage_growth_count(0)
+    , cpu_culling(false)
+    , tested_triangle_count(0)
+    , culled_triangle_count(0)
+    , culled_records()
+    , texture_atlas(false)
+    , atlased_block_count(0)
+    , atlas_vertex_count(0)
+    , triangle_strips(false)
+    , strip_indices()
 {
     if (! is_option_enabled("D3DEMU_NO_TIMER")) {
         timer_window = create_timer_window(instance, surface);
@@ -159,312 +204,204 @@ EmulationInfo::EmulationInfo(const HINSTANCE instance, DirectDrawSurfaceEmu &sur
     else {
         logKA(emu::MSG_INFORM, 0, "Present timer is disabled");
     }
-}
 
-EmulationInfo::~EmulationInfo()
-{
-    if (timer_window) {
-        DestroyWindow(timer_window);
+    if (is_option_enabled("D3DEMU_EXECUTE_PROFILE")) {
+        execute_profiler.set_enabled(true);
+        logKA(emu::MSG_INFORM, 0, "Execute buffer profiler is enabled, the report will be stored in %s", EXECUTE_PROFILE_FILE_NAME);
     }
-}
 
-/**
- * @brief Constructor.
- */
-DirectDrawSurfaceEmu::RenderStateSet::RenderStateSet()
-    : hash(0)
-    , sequence_number(0)
-{
-    memset(states, 0, sizeof(states));
-}
+    if (is_option_enabled("D3DEMU_NO_HW_STATE_BATCHING")) {
+        hw_state_batching = false;
+        logKA(emu::MSG_INFORM, 0, "Batching across render state changes without HW effect is disabled");
+    }
 
-/**
- * @brief Sets value of specified state.
- *
- * Returns true if there was change.
- */
-bool DirectDrawSurfaceEmu::RenderStateSet::set_rs_dw(const D3DRENDERSTATETYPE type, const DWORD new_value)
-{
-    assert(type < (sizeof(states) / sizeof(states[0])));
+    if (is_option_enabled("D3DEMU_NO_EXECUTE_MERGING")) {
+        execute_merging = false;
+        logKA(emu::MSG_INFORM, 0, "Merging of geometry across executes is disabled");
+    }
 
-    // Set value if there was change.
+    if (is_option_enabled("D3DEMU_DRAW_SORTING")) {
+        draw_sorting = true;
+        logKA(emu::MSG_INFORM, 0, "Sorted drawing of opaque geometry is enabled");
+    }
 
-    const DWORD old_value = states[type].value.dw_value;
-    if (old_value == new_value) {
-        return false;
+    if (is_option_enabled("D3DEMU_BLEND_MERGING")) {
+        blend_merging = true;
+        logKA(emu::MSG_INFORM, 0, "Merging of non-overlapping blended geometry is enabled");
     }
-    states[type].value.dw_value = new_value;
 
-    // Update the hash.
+    if (is_option_enabled("D3DEMU_CPU_CULLING")) {
+        cpu_culling = true;
+        logKA(emu::MSG_INFORM, 0, "Culling of triangles which can not produce pixels is enabled");
+    }
 
-    hash -= static_cast<unsigned __int64>(type) * old_value;
-    hash += static_cast<unsigned __int64>(type) * new_value;
-    sequence_number++;
-    return true;
-}
+    if (is_option_enabled("D3DEMU_TEXTURE_ATLAS")) {
+        texture_atlas = true;
+        logKA(emu::MSG_INFORM, 0, "Batching of atlased textures by their atlas page is enabled");
+    }
 
-/**
- * @brief Sets value of specified state to provided float.
- *
- * Returns true if there was change.
- */
-bool DirectDrawSurfaceEmu::RenderStateSet::set_rs_float(const D3DRENDERSTATETYPE type, const float value)
-{
-    RenderStateInfo info;
-    info.value.float_value = value;
-    return set_rs_dw(type, info.value.dw_value);
+    if (is_option_enabled("D3DEMU_TRIANGLE_STRIPS")) {
+        triangle_strips = true;
+        logKA(emu::MSG_INFORM, 0, "Triangle strip reconstruction is enabled");
+    }
 }
 
-/**
- * @brief Returns value for specified dword typed render state.
- */
-size_t DirectDrawSurfaceEmu::RenderStateSet::get_rs_dw(const D3DRENDERSTATETYPE type) const
+EmulationInfo::~EmulationInfo()
 {
-    assert(type < (sizeof(states) / sizeof(states[0])));
-    return states[type].value.dw_value;
-}
+    if (timer_window) {
+        DestroyWindow(timer_window);
+    }
 
-/**
- * @brief Returns value for specified boolean typed render state.
- */
-bool DirectDrawSurfaceEmu::RenderStateSet::get_rs_bool(const D3DRENDERSTATETYPE type) const
-{
-    assert(type < (sizeof(states) / sizeof(states[0])));
-    return states[type].value.dw_value != 0;
-}
+    if (hw_state_batching) {
+        logKA(emu::MSG_INFORM, 0, "Render state changes without HW effect avoided %u flushes", avoided_flush_count);
+    }
 
-/**
- * @brief Returns value for specified float typed render state.
- */
-float DirectDrawSurfaceEmu::RenderStateSet::get_rs_float(const D3DRENDERSTATETYPE type) const
-{
-    assert(type < (sizeof(states) / sizeof(states[0])));
-    return states[type].value.float_value;
-}
+    if (execute_merging) {
+        logKA(emu::MSG_INFORM, 0, "Merging of executes avoided %u draws", merged_batch_count);
+    }
 
-/**
- * @brief Directly compares states without any optimizations.
- */
-bool DirectDrawSurfaceEmu::RenderStateSet::compare_states(const RenderStateSet &other) const
-{
-    return memcmp(states, other.states, sizeof(states)) == 0;
-}
+    if (draw_sorting) {
+        logKA(emu::MSG_INFORM, 0, "Sorted drawing submitted %u opaque batches in %u draws, %u batches with constant depth kept their position", sorted_batch_count, sorted_draw_count, fixed_batch_count);
+    }
 
-/**
- * @brief Determines if both sets represent the same state.
- */
-bool DirectDrawSurfaceEmu::RenderStateSet::equals(const RenderStateSet &other) const
-{
-    // Hash mismatch means difference.
+    if (blend_merging) {
+        logKA(emu::MSG_INFORM, 0, "Merging of blended geometry joined %u batches", joined_blend_batch_count);
+    }
 
-    if (hash != other.hash) {
-        assert(! compare_states(other));
-        return false;
+    if (cpu_culling) {
+        logKA(emu::MSG_INFORM, 0, "Culling dropped %u of %u triangles", culled_triangle_count, tested_triangle_count);
     }
 
-    // Compare the content.
+    if (texture_atlas) {
+        logKA(emu::MSG_INFORM, 0, "Texture atlas drew %u triangle blocks from atlas pages using %u remapped vertices", atlased_block_count, atlas_vertex_count);
+    }
 
-    return compare_states(other);
-}
+    logKA(emu::MSG_INFORM, 0, "Geometry storage peaked at %u KB and grew in %u frames", geometry_storage_bytes / 1024, geometry_storage_growth_count);
 
-/**
- * @brief Compares both sets.
- *
- * If they have the same sequence number, they are
- * considered the same so this method should be only used
- * to compare state with its older constant copy.
- */
-bool DirectDrawSurfaceEmu::RenderStateSet::equals_with_sequence(const RenderStateSet &other) const
-{
-    // Same sequence number means that the states are equivalent under
-    // the assumption documented above.
+    // Store the execute buffer statistics.
 
-    if (sequence_number == other.sequence_number) {
-        assert(equals(other));
-        return true;
+    if (execute_profiler.is_enabled()) {
+        if (execute_profiler.save(EXECUTE_PROFILE_FILE_NAME)) {
+            logKA(emu::MSG_INFORM, 0, "Stored execute buffer profile of %u executes in %u frames to %s", execute_profiler.get_execute_count(), execute_profiler.get_frame_count(), EXECUTE_PROFILE_FILE_NAME);
+        }
+        else {
+            logKA(emu::MSG_ERROR, 0, "Unable to store execute buffer profile to %s", EXECUTE_PROFILE_FILE_NAME);
+        }
     }
-
-    // Full scale check.
-
-    return equals(other);
 }
 
 /**
  * @brief Applies the render states.
+ *
+ * The atlas page, if valid, is bound instead of the texture of the set.
  */
-void DirectDrawSurfaceEmu::RenderStateSet::apply_render_states(HWLayer &hw_layer) const
+void DirectDrawSurfaceEmu::apply_render_states(const RenderStateSet &set, const HWSurfaceHandle atlas_page, HWLayer &hw_layer)
 {
     HWEVENT(hw_layer, L"apply_render_states");
 
     // Set complex states.
 
-    hw_layer.set_depth_test(get_depth_test_state());
-    hw_layer.set_alpha_test(get_alpha_test_state());
-    hw_layer.set_alpha_blend(get_alpha_blend_state());
-    hw_layer.set_fog(get_fog_state(), get_rs_dw(D3DRENDERSTATE_FOGCOLOR));
-    hw_layer.set_flat_blend((get_rs_dw(D3DRENDERSTATE_SHADEMODE) & 0x0F) == D3DSHADE_FLAT);
-    hw_layer.set_texture_blend(get_texture_blend());
+    hw_layer.set_depth_test(get_depth_test_state(set));
+    hw_layer.set_alpha_test(get_alpha_test_state(set));
+    hw_layer.set_alpha_blend(get_alpha_blend_state(set));
+    hw_layer.set_fog(get_fog_state(set), set.get_rs_dw(D3DRENDERSTATE_FOGCOLOR));
+    hw_layer.set_flat_blend((set.get_rs_dw(D3DRENDERSTATE_SHADEMODE) & 0x0F) == D3DSHADE_FLAT);
+    hw_layer.set_texture_blend(get_texture_blend(set));
 
     // Bind the texture. Will force upload to HW if necessary.
 
-    DirectDrawSurfaceEmu * const texture = reinterpret_cast<DirectDrawSurfaceEmu *>(get_rs_dw(D3DRENDERSTATE_TEXTUREHANDLE));
-    if (texture) {
+    DirectDrawSurfaceEmu * const texture = reinterpret_cast<DirectDrawSurfaceEmu *>(set.get_rs_dw(D3DRENDERSTATE_TEXTUREHANDLE));
+    if (atlas_page != INVALID_SURFACE_HANDLE) {
+        hw_layer.set_texture_surface(atlas_page);
+    }
+    else if (texture) {
         hw_layer.set_texture_surface(texture->get_hw_surface(false));
     }
     else {
         hw_layer.set_texture_surface(INVALID_SURFACE_HANDLE);
     }
 
-    // Report mismatch in hardcoded values.
-
-    if (get_rs_dw(D3DRENDERSTATE_CULLMODE) != D3DCULL_NONE) {
-        logKA(MSG_ERROR, 0, "CULLMODE %u is not supported", get_rs_dw(D3DRENDERSTATE_CULLMODE));
-    }
-    if (get_rs_dw(D3DRENDERSTATE_FILLMODE) != D3DFILL_SOLID) {
-        logKA(MSG_ERROR, 0, "FILLMODE %u is not supported", get_rs_dw(D3DRENDERSTATE_FILLMODE));
-    }
-    if (get_rs_bool(D3DRENDERSTATE_LASTPIXEL)) {
-        logKA(MSG_ERROR, 0, "LASTPIXEL true is not supported");
-    }
-    if (get_rs_bool(D3DRENDERSTATE_STIPPLEDALPHA)) {
-        logKA(MSG_ERROR, 0, "STIPPLEDALPHA true is not supported");
-    }
-    if (get_rs_dw(D3DRENDERSTATE_TEXTUREMAG) != D3DFILTER_LINEAR) {
-        logKA(MSG_ERROR, 0, "TETUREMAG %u is not supported", get_rs_dw(D3DRENDERSTATE_TEXTUREMAG));
-    }
-    if (get_rs_dw(D3DRENDERSTATE_TEXTUREMIN) != D3DFILTER_LINEAR) {
-        logKA(MSG_ERROR, 0, "TEXTUREMIN %u is not supported", get_rs_dw(D3DRENDERSTATE_TEXTUREMIN));
-    }
-
-    // States which we do not care for.
-    //
-    // D3DRENDERSTATE_DITHERENABLE
-    // D3DRENDERSTATE_TEXTUREPERSPECTIVE
+    log_unsupported_render_states(set);
 }
 
 /**
- * @name Getters for HW states from DX states.
+ * @brief Reports render state values which the HW states do not support.
  *
- * Return default value and logKA the problem if the DX state is not supported.
+ * The translation silently uses the default state for them.
  */
-//@{
-DepthTest DirectDrawSurfaceEmu::RenderStateSet::get_depth_test_state(void) const
+void DirectDrawSurfaceEmu::log_unsupported_render_states(const RenderStateSet &set)
 {
-    if (! get_rs_bool(D3DRENDERSTATE_ZENABLE)) {
-        return DEPTH_TEST_NONE;
-    }
-
-    // The 'always' render state effectively disables test. If the
-    // writes are disabled as well, the result is equivalent to the
-    // full disable state (stencil buffer is not supported).
-
-    if ((get_rs_dw(D3DRENDERSTATE_ZFUNC) == D3DCMP_ALWAYS) && (! get_rs_bool(D3DRENDERSTATE_ZWRITEENABLE))) {
-        return DEPTH_TEST_NONE;
-    }
-
-    // For enabled state check that the function is right.
-
-    if (get_rs_dw(D3DRENDERSTATE_ZFUNC) != D3DCMP_LESSEQUAL) {
-        logKA(MSG_ERROR, 0, "ZFUNC %u is not supported", get_rs_dw(D3DRENDERSTATE_ZFUNC));
-        return DEPTH_TEST_NONE;
-    }
-
-    // Check for disabled z-buffer writes.
-
-    if (! get_rs_bool(D3DRENDERSTATE_ZWRITEENABLE)) {
-        return DEPTH_TEST_NOZWRITE;
-    }
-    return DEPTH_TEST_ON;
-}
+    // Values replaced by the default state.
 
-AlphaTest DirectDrawSurfaceEmu::RenderStateSet::get_alpha_test_state(void) const
-{
-    if (! get_rs_bool(D3DRENDERSTATE_ALPHATESTENABLE)) {
-        return ALPHA_TEST_NONE;
-    }
-
-    if (get_rs_dw(D3DRENDERSTATE_ALPHAREF) != 0) {
-        logKA(MSG_ERROR, 0, "ALPHAREF %u is not supported", get_rs_dw(D3DRENDERSTATE_ALPHAREF));
-        return ALPHA_TEST_NONE;
-    }
-
-    if (get_rs_dw(D3DRENDERSTATE_ALPHAFUNC) == D3DCMP_NOTEQUAL) {
-        return ALPHA_TEST_NOEQUAL;
+    if (set.get_rs_bool(D3DRENDERSTATE_ZENABLE)) {
+        const size_t function = set.get_rs_dw(D3DRENDERSTATE_ZFUNC);
+        if ((function != D3DCMP_LESSEQUAL) && ((function != D3DCMP_ALWAYS) || set.get_rs_bool(D3DRENDERSTATE_ZWRITEENABLE))) {
+            logKA(MSG_ERROR, 0, "ZFUNC %u is not supported", function);
+        }
     }
-
-    logKA(MSG_ERROR, 0, "ALPHAFUNC %u is not supported", get_rs_dw(D3DRENDERSTATE_ALPHAFUNC));
-    return ALPHA_TEST_NONE;
-}
-
-Blend DirectDrawSurfaceEmu::RenderStateSet::get_alpha_blend_state(void) const
-{
-    if (! get_rs_bool(D3DRENDERSTATE_BLENDENABLE)) {
-        return BLEND_NONE;
+    if (set.get_rs_bool(D3DRENDERSTATE_ALPHATESTENABLE)) {
+        if (set.get_rs_dw(D3DRENDERSTATE_ALPHAREF) != 0) {
+            logKA(MSG_ERROR, 0, "ALPHAREF %u is not supported", set.get_rs_dw(D3DRENDERSTATE_ALPHAREF));
+        }
+        else if (set.get_rs_dw(D3DRENDERSTATE_ALPHAFUNC) != D3DCMP_NOTEQUAL) {
+            logKA(MSG_ERROR, 0, "ALPHAFUNC %u is not supported", set.get_rs_dw(D3DRENDERSTATE_ALPHAFUNC));
+        }
     }
-
-    const size_t src = get_rs_dw(D3DRENDERSTATE_SRCBLEND);
-    const size_t dest = get_rs_dw(D3DRENDERSTATE_DESTBLEND);
-    if ((src == D3DBLEND_ONE) && (dest == D3DBLEND_ZERO)) {
-        return BLEND_NONE;
+    if (set.get_rs_bool(D3DRENDERSTATE_BLENDENABLE)) {
+        const size_t src = set.get_rs_dw(D3DRENDERSTATE_SRCBLEND);
+        const size_t dest = set.get_rs_dw(D3DRENDERSTATE_DESTBLEND);
+        const bool none = (src == D3DBLEND_ONE) && (dest == D3DBLEND_ZERO);
+        const bool over = ((src == D3DBLEND_SRCALPHA) && (dest == D3DBLEND_INVSRCALPHA)) || (src == D3DBLEND_BOTHSRCALPHA);
+        if ((! none) && (! over)) {
+            logKA(MSG_ERROR, 0, "Unsupported blend combination %u + %u", src, dest);
+        }
     }
-    if ((src == D3DBLEND_SRCALPHA) && (dest == D3DBLEND_INVSRCALPHA)) {
-        return BLEND_OVER;
+    if (set.get_rs_bool(D3DRENDERSTATE_FOGENABLE)) {
+        if (set.get_rs_float(D3DRENDERSTATE_FOGTABLEDENSITY) != 1.0f) {
+            logKA(MSG_ERROR, 0, "FOGTABLEDENSITY %f is not supported", set.get_rs_float(D3DRENDERSTATE_FOGTABLEDENSITY));
+        }
+        if (set.get_rs_float(D3DRENDERSTATE_FOGTABLEEND) != 1.0f) {
+            logKA(MSG_ERROR, 0, "FOGTABLEEND %f is not supported", set.get_rs_float(D3DRENDERSTATE_FOGTABLEEND));
+        }
+        if (set.get_rs_float(D3DRENDERSTATE_FOGTABLESTART) != 0.0f) {
+            logKA(MSG_ERROR, 0, "FOGTABLESTART %f is not supported", set.get_rs_float(D3DRENDERSTATE_FOGTABLESTART));
+        }
+        const size_t table_mode = set.get_rs_dw(D3DRENDERSTATE_FOGTABLEMODE);
+        if ((table_mode != D3DFOG_NONE) && (table_mode != D3DFOG_LINEAR)) {
+            logKA(MSG_ERROR, 0, "FOGTABLEMODE %u is not supported", table_mode);
+        }
     }
-    if ((src == D3DBLEND_BOTHSRCALPHA)) {
-        return BLEND_OVER;
+    const size_t texture_blend = set.get_rs_dw(D3DRENDERSTATE_TEXTUREMAPBLEND);
+    if ((texture_blend != D3DTBLEND_MODULATE) && (texture_blend != D3DTBLEND_MODULATEALPHA)) {
+        logKA(MSG_ERROR, 0, "TEXTUREMAPBLEND %u is not supported", texture_blend);
     }
 
-    logKA(MSG_ERROR, 0, "Unsupported blend combination %u + %u", src, dest);
-    return BLEND_NONE;
-}
+    // Hardcoded values.
 
-Fog DirectDrawSurfaceEmu::RenderStateSet::get_fog_state(void) const
-{
-    if (! get_rs_bool(D3DRENDERSTATE_FOGENABLE)) {
-        return FOG_NONE;
+    if (set.get_rs_dw(D3DRENDERSTATE_CULLMODE) != D3DCULL_NONE) {
+        logKA(MSG_ERROR, 0, "CULLMODE %u is not supported", set.get_rs_dw(D3DRENDERSTATE_CULLMODE));
     }
-
-    // Fixed parameters.
-
-    if (get_rs_float(D3DRENDERSTATE_FOGTABLEDENSITY) != 1.0f) {
-        logKA(MSG_ERROR, 0, "FOGTABLEDENSITY %f is not supported", get_rs_float(D3DRENDERSTATE_FOGTABLEDENSITY));
-        return FOG_NONE;
+    if (set.get_rs_dw(D3DRENDERSTATE_FILLMODE) != D3DFILL_SOLID) {
+        logKA(MSG_ERROR, 0, "FILLMODE %u is not supported", set.get_rs_dw(D3DRENDERSTATE_FILLMODE));
     }
-    if (get_rs_float(D3DRENDERSTATE_FOGTABLEEND) != 1.0f) {
-        logKA(MSG_ERROR, 0, "FOGTABLEEND %f is not supported", get_rs_float(D3DRENDERSTATE_FOGTABLEEND));
-        return FOG_NONE;
+    if (set.get_rs_bool(D3DRENDERSTATE_LASTPIXEL)) {
+        logKA(MSG_ERROR, 0, "LASTPIXEL true is not supported");
     }
-    if (get_rs_float(D3DRENDERSTATE_FOGTABLESTART) != 0.0f) {
-        logKA(MSG_ERROR, 0, "FOGTABLESTART %f is not supported", get_rs_float(D3DRENDERSTATE_FOGTABLESTART));
-        return FOG_NONE;
+    if (set.get_rs_bool(D3DRENDERSTATE_STIPPLEDALPHA)) {
+        logKA(MSG_ERROR, 0, "STIPPLEDALPHA true is not supported");
     }
-
-    // Table mode.
-
-    const size_t table_mode = get_rs_dw(D3DRENDERSTATE_FOGTABLEMODE);
-    if (table_mode == D3DFOG_NONE) {
-        return FOG_VERTEX;
+    if (set.get_rs_dw(D3DRENDERSTATE_TEXTUREMAG) != D3DFILTER_LINEAR) {
+        logKA(MSG_ERROR, 0, "TEXTUREMAG %u is not supported", set.get_rs_dw(D3DRENDERSTATE_TEXTUREMAG));
     }
-    if (table_mode == D3DFOG_LINEAR) {
-        return FOG_TABLE;
+    if (set.get_rs_dw(D3DRENDERSTATE_TEXTUREMIN) != D3DFILTER_LINEAR) {
+        logKA(MSG_ERROR, 0, "TEXTUREMIN %u is not supported", set.get_rs_dw(D3DRENDERSTATE_TEXTUREMIN));
     }
-    logKA(MSG_ERROR, 0, "FOGTABLESTART %u is not supported", get_rs_float(D3DRENDERSTATE_FOGTABLESTART));
-    return FOG_NONE;
-}
 
-TextureBlend DirectDrawSurfaceEmu::RenderStateSet::get_texture_blend(void) const
-{
-    const size_t mode = get_rs_dw(D3DRENDERSTATE_TEXTUREMAPBLEND);
-    if (mode == D3DTBLEND_MODULATE) {
-        return TEXTURE_BLEND_MODULATE;
-    }
-    if (mode == D3DTBLEND_MODULATEALPHA) {
-        return TEXTURE_BLEND_MODULATEALPHA;
-    }
-    logKA(MSG_ERROR, 0, "TEXTUREMAPBLEND %u is not supported", mode);
-    return TEXTURE_BLEND_MODULATE;
+    // States which we do not care for.
+    //
+    // D3DRENDERSTATE_DITHERENABLE
+    // D3DRENDERSTATE_TEXTUREPERSPECTIVE
 }
-//@}
 
 /**
  * @brief Constructor.
@@ -475,6 +412,9 @@ DirectDrawSurfaceEmu::GeometryInfo::GeometryInfo()
     , min_vertex(~static_cast<size_t>(0))
     , max_vertex(0)
     , state_set()
+    , hw_state_key()
+    , equivalent_sequence_number(0)
+    , atlas_page(INVALID_SURFACE_HANDLE)
 {
 }
 
@@ -489,6 +429,22 @@ void DirectDrawSurfaceEmu::GeometryInfo::reset(void)
     max_vertex = 0;
 }
 
+/**
+ * @brief Allocates the index array for specified number of indices.
+ */
+void DirectDrawSurfaceEmu::GeometryInfo::reserve(const size_t index_count)
+{
+    indices.reserve(index_count);
+}
+
+/**
+ * @brief Returns size of memory allocated by the index array.
+ */
+size_t DirectDrawSurfaceEmu::GeometryInfo::get_capacity_bytes(void) const
+{
+    return indices.capacity() * sizeof(unsigned short);
+}
+
 /**
  * @brief Determines if the geometry is empty.
  */
@@ -497,6 +453,30 @@ bool DirectDrawSurfaceEmu::GeometryInfo::is_empty(void) const
     return (indices.size() == 0);
 }
 
+/**
+ * @brief Returns number of queued triangles, lines or points.
+ */
+size_t DirectDrawSurfaceEmu::GeometryInfo::get_primitive_count(void) const
+{
+    switch (geometry_mode) {
+        case GEOMETRY_MODE_TRIANGLES: return indices.size() / 3;
+        case GEOMETRY_MODE_LINES: return indices.size() / 2;
+        default: return indices.size();
+    }
+}
+
+/**
+ * @brief Determines if the queued primitives might reference vertex
+ * from specified range of the current window of the pool.
+ */
+bool DirectDrawSurfaceEmu::GeometryInfo::uses_vertices(const VertexPool &pool, const size_t start, const size_t count) const
+{
+    if (is_empty()) {
+        return false;
+    }
+    return pool.overwrites(start, count, min_vertex, max_vertex);
+}
+
 /**
  * @brief Returns geometry mode.
  */
@@ -525,6 +505,39 @@ void DirectDrawSurfaceEmu::GeometryInfo::set_state_set(const RenderStateSet &set
 {
     assert(is_empty());
     state_set = set;
+    hw_state_key = HWStateKey(set);
+    equivalent_sequence_number = set.get_sequence_number();
+    atlas_page = INVALID_SURFACE_HANDLE;
+}
+
+/**
+ * @brief Draws the future geometry from specified atlas page instead
+ * of the texture of the state set.
+ *
+ * Must follow the set_state_set().
+ */
+void DirectDrawSurfaceEmu::GeometryInfo::set_atlas_page(const HWSurfaceHandle page)
+{
+    assert(is_empty());
+    atlas_page = page;
+    if (page != INVALID_SURFACE_HANDLE) {
+        hw_state_key.texture = static_cast<unsigned int>(reinterpret_cast<size_t>(page));
+    }
+}
+
+HWSurfaceHandle DirectDrawSurfaceEmu::GeometryInfo::get_atlas_page(void) const
+{
+    return atlas_page;
+}
+
+const DirectDrawSurfaceEmu::RenderStateSet &DirectDrawSurfaceEmu::GeometryInfo::get_state_set(void) const
+{
+    return state_set;
+}
+
+const HWStateKey &DirectDrawSurfaceEmu::GeometryInfo::get_hw_state_key(void) const
+{
+    return hw_state_key;
 }
 
 /**
@@ -538,6 +551,38 @@ bool DirectDrawSurfaceEmu::GeometryInfo::is_state_set_unchanged(const RenderStat
     return state_set.equals_with_sequence(set);
 }
 
+/**
+ * @brief Determines if specified set configures the HW the same way as
+ * the set stored in the object.
+ *
+ * Has the same assumptions as is_state_set_unchanged(). Increments the
+ * counter when the sets differ only in states without effect on the HW.
+ * Geometry drawn from atlas page compares the page instead of the texture,
+ * the caller checks that the texture of the set is placed in the page.
+ */
+bool DirectDrawSurfaceEmu::GeometryInfo::is_hw_state_unchanged(const RenderStateSet &set, size_t &avoided_flush_count)
+{
+    if (set.get_sequence_number() == equivalent_sequence_number) {
+        return true;
+    }
+    if (is_state_set_unchanged(set)) {
+        return true;
+    }
+    HWStateKey key(set);
+    if (atlas_page != INVALID_SURFACE_HANDLE) {
+        key.texture = hw_state_key.texture;
+    }
+    if (! (key == hw_state_key)) {
+        return false;
+    }
+
+    // Remember the result until the set changes again.
+
+    equivalent_sequence_number = set.get_sequence_number();
+    avoided_flush_count++;
+    return true;
+}
+
 /**
  * @brief Reads value from the D3DRENDERSTATE_SHADEMODE state.
  */
@@ -572,6 +617,29 @@ void DirectDrawSurfaceEmu::GeometryInfo::add_triangle(const unsigned short v0, c
     max_vertex = max(max_vertex, v2);
 }
 
+/**
+ * @brief Adds block of triangles to the array of vertices.
+ *
+ * The base is added to the indices of the triangles. The object must
+ * be in the triangle mode.
+ */
+void DirectDrawSurfaceEmu::GeometryInfo::add_triangles(const D3DTRIANGLE * const triangles, const size_t count, const size_t base)
+{
+    assert(geometry_mode == GEOMETRY_MODE_TRIANGLES);
+    assert(sizeof(D3DTRIANGLE) == (TRIANGLE_RECORD_WORDS * sizeof(unsigned short)));
+    if (count == 0) {
+        return;
+    }
+
+    // Grow the array once. The copy needs one additional entry
+    // past the end which is removed afterwards.
+
+    const size_t old_size = indices.size();
+    indices.resize(old_size + (count * 3) + 1);
+    append_rebased_triangle_indices(reinterpret_cast<const unsigned short *>(triangles), count, base, &indices[old_size], min_vertex, max_vertex);
+    indices.pop_back();
+}
+
 /**
  * @brief Adds line with specified indices to the array of vertices.
  *
@@ -626,15 +694,51 @@ void DirectDrawSurfaceEmu::GeometryInfo::add_points(const size_t first, const si
  */
 void DirectDrawSurfaceEmu::GeometryInfo::apply_state(HWLayer &hw_layer)
 {
-    state_set.apply_render_states(hw_layer);
+    apply_render_states(state_set, atlas_page, hw_layer);
+}
+
+/**
+ * @brief Adds triangle indices using specified range of vertices.
+ *
+ * The object must be in the triangle mode.
+ */
+void DirectDrawSurfaceEmu::GeometryInfo::add_triangle_indices(const unsigned short * const source, const size_t count, const size_t first_vertex, const size_t last_vertex)
+{
+    assert(geometry_mode == GEOMETRY_MODE_TRIANGLES);
+    assert((count % 3) == 0);
+
+    indices.insert(indices.end(), source, source + count);
+    min_vertex = min(min_vertex, first_vertex);
+    max_vertex = max(max_vertex, last_vertex);
+}
+
+/**
+ * @brief Moves the triangles to specified draw list.
+ *
+ * Returns false if they do not fit into it. The object must be
+ * in the triangle mode.
+ */
+bool DirectDrawSurfaceEmu::GeometryInfo::move_to_draw_list(DrawList &list, const size_t tag, const TLVertex * const vertices, const bool ordered)
+{
+    assert(geometry_mode == GEOMETRY_MODE_TRIANGLES);
+    assert(! is_empty());
+
+    const size_t vertex_count = (max_vertex - min_vertex) + 1;
+    if (! list.can_add(vertex_count)) {
+        return false;
+    }
+    list.add(DrawSortKey(hw_state_key), tag, vertices, min_vertex, vertex_count, &indices[0], indices.size(), ordered);
+    reset();
+    return true;
 }
 
 /**
  * @brief Draws the stored geometry.
  *
- * Assumes that correct state is already set.
+ * Assumes that correct state is already set. The triangles are sent
+ * as strip if enabled and if the strip is shorter than the list.
  */
-void DirectDrawSurfaceEmu::GeometryInfo::draw_geometry(HWLayer &hw_layer, const TLVertex * const vertices)
+void DirectDrawSurfaceEmu::GeometryInfo::draw_geometry(HWLayer &hw_layer, const TLVertex * const vertices, EmulationInfo &info)
 {
     if (is_empty()) {
         return;
@@ -645,13 +749,28 @@ void DirectDrawSurfaceEmu::GeometryInfo::draw_geometry(HWLayer &hw_layer, const
     switch (geometry_mode) {
         case GEOMETRY_MODE_TRIANGLES: {
             assert((indices.size() % 3) == 0);
-            hw_layer.draw_triangles(
-                vertices,
-                min_vertex,
-                (max_vertex - min_vertex) + 1,
-                &indices[0],
-                indices.size() / 3
-            );
+            const bool strip = info.triangle_strips && build_triangle_strip(&indices[0], indices.size() / 3, info.strip_indices);
+            if (strip) {
+                hw_layer.draw_triangle_strip(
+                    vertices,
+                    min_vertex,
+                    (max_vertex - min_vertex) + 1,
+                    &info.strip_indices[0],
+                    info.strip_indices.size()
+                );
+            }
+            else {
+                hw_layer.draw_triangles(
+                    vertices,
+                    min_vertex,
+                    (max_vertex - min_vertex) + 1,
+                    &indices[0],
+                    indices.size() / 3
+                );
+            }
+            if (info.execute_profiler.is_enabled()) {
+                info.execute_profiler.record_triangle_indices(indices.size(), (strip ? info.strip_indices.size() : indices.size()), strip);
+            }
             break;
         }
         case GEOMETRY_MODE_LINES: {
@@ -682,6 +801,8 @@ void DirectDrawSurfaceEmu::GeometryInfo::draw_geometry(HWLayer &hw_layer, const
     reset();
 }
 
+DirectDrawSurfaceEmu *DirectDrawSurfaceEmu::deferred_geometry_device = NULL;
+
 DirectDrawSurfaceEmu::DirectDrawSurfaceEmu(HWLayer &the_hw_layer, const HINSTANCE the_instance)
     : hw_layer(the_hw_layer)
     , instance(the_instance)
@@ -690,14 +811,23 @@ DirectDrawSurfaceEmu::DirectDrawSurfaceEmu(HWLayer &the_hw_layer, const HINSTANC
     , owned(false)
     , attached_surfaces()
     , viewports()
-    , memory(NULL)
+    , memory()
     , hw_surface(INVALID_SURFACE_HANDLE)
+    , prepared_update(INVALID_PREPARED_UPDATE)
     , master(MASTER_NONE)
     , emulation(NULL)
     , scene_active(false)
     , lock_count(0)
     , active_lock_hack(LOCK_HACK_NONE)
-    , vertices()
+    , vertex_pool()
+    , geometry_carried(false)
+    , draw_list()
+    , draw_list_states()
+    , draw_list_pages()
+    , blend_list()
+    , blend_list_states()
+    , blend_list_pages()
+    , sorted_geometry()
 {
     LOG_METHOD();
     master_surface = this;
@@ -715,6 +845,16 @@ DirectDrawSurfaceEmu::~DirectDrawSurfaceEmu()
     assert(master_surface == this);
     HWEVENT(hw_layer, L"~DirectDrawSurfaceEmu");
 
+    // The geometry kept after the last execute might use us as texture.
+
+    if (deferred_geometry_device == this) {
+        deferred_geometry_device = NULL;
+    }
+    else {
+        flush_deferred_geometry();
+    }
+
+    discard_hw_update();
     if (hw_surface) {
         hw_layer.destroy_surface(hw_surface);
     }
@@ -724,10 +864,6 @@ DirectDrawSurfaceEmu::~DirectDrawSurfaceEmu()
         delete emulation;
     }
 
-    if (memory) {
-        free(memory);
-    }
-
     while (viewports.size() > 0) {
         DeleteViewport(viewports.front());
     }
@@ -742,7 +878,7 @@ DirectDrawSurfaceEmu::~DirectDrawSurfaceEmu()
  */
 HRESULT DirectDrawSurfaceEmu::initialize(const DDSURFACEDESC &descriptor)
 {
-    assert(memory == NULL);
+    assert(memory.get() == NULL);
     desc = descriptor;
 
     // Allocate the emulation structure if the type is right.
@@ -765,8 +901,7 @@ HRESULT DirectDrawSurfaceEmu::initialize(const DDSURFACEDESC &descriptor)
     // Allocate system memory backing the surface.
 
     const size_t memory_size = desc.dwHeight * desc.lPitch;
-    memory = malloc(memory_size);
-    memset(memory, 0, memory_size);
+    memory.allocate(memory_size);
 
     return DD_OK;
 }
@@ -1024,7 +1159,7 @@ void DirectDrawSurfaceEmu::show_primary()
  */
 void DirectDrawSurfaceEmu::synchronize_memory(void)
 {
-    assert(memory);
+    assert(memory.get());
     if ((master == MASTER_NONE) || (master == MASTER_MEMORY) || (master == MASTER_SYNCHRONIZED)) {
         return;
     }
@@ -1039,17 +1174,19 @@ void DirectDrawSurfaceEmu::synchronize_memory(void)
     // and the worst possible situation is assumed.
 
     if (master == MASTER_COMPOSITION) {
-        if ((get_composition_key_memory() != 0) || is_nonzero(memory, desc.dwHeight * desc.lPitch)) {
-            hw_layer.compose_render_target(hw_surface, memory, get_composition_key());
+        if ((get_composition_key_memory() != 0) || is_nonzero(memory.get(), desc.dwHeight * desc.lPitch)) {
+            hw_layer.compose_render_target(hw_surface, memory.get(), get_composition_key());
         }
     }
     else if (master == MASTER_COMPOSITION_NONKEY) {
-        hw_layer.compose_render_target(hw_surface, memory, get_composition_key());
+        hw_layer.compose_render_target(hw_surface, memory.get(), get_composition_key());
     }
 
-    // Read the result.
+    // Read the result. The memory might be still shared with surface
+    // loaded from this one.
 
-    hw_layer.read_surface(hw_surface, memory);
+    memory.make_unique();
+    hw_layer.read_surface(hw_surface, memory.get());
     master = MASTER_SYNCHRONIZED;
 }
 
@@ -1060,42 +1197,100 @@ void DirectDrawSurfaceEmu::synchronize_memory(void)
  */
 void DirectDrawSurfaceEmu::synchronize_hw(void)
 {
-    assert(memory);
+    assert(memory.get());
     if ((master == MASTER_HW) || (master == MASTER_SYNCHRONIZED)) {
         return;
     }
     HWEVENT(hw_layer, L"synchronize_hw");
 
+    // The HW surface shared by Load() must not be changed.
+
+    unshare_hw_surface();
+
     // Create the surface if necessary. If the memory copy is
     // in fresh state, do not upload it yet as it is likely that
     // it will be filled soon.
 
     if (hw_surface == INVALID_SURFACE_HANDLE) {
         assert((master != MASTER_COMPOSITION) && (master != MASTER_COMPOSITION_NONKEY));
-        void * const init_memory = (master == MASTER_NONE) ? NULL : memory;
-        const bool render_target = (desc.ddsCaps.dwCaps & DDSCAPS_3DDEVICE) != 0;
-        hw_surface = hw_layer.create_surface(desc.dwWidth, desc.dwHeight, get_hw_format(), init_memory, render_target);
+        if (prepared_update) {
+            hw_surface = hw_layer.create_surface_from_update(desc.dwWidth, desc.dwHeight, get_hw_format(), prepared_update);
+            prepared_update = INVALID_PREPARED_UPDATE;
+        }
+        else {
+            void * const init_memory = (master == MASTER_NONE) ? NULL : memory.get();
+            const bool render_target = (desc.ddsCaps.dwCaps & DDSCAPS_3DDEVICE) != 0;
+            hw_surface = hw_layer.create_surface(desc.dwWidth, desc.dwHeight, get_hw_format(), init_memory, render_target);
+        }
         assert(hw_surface != INVALID_SURFACE_HANDLE);
         master = MASTER_SYNCHRONIZED;
     }
     else {
         if (master == MASTER_COMPOSITION) {
-            if ((get_composition_key_memory() != 0) || is_nonzero(memory, desc.dwHeight * desc.lPitch)) {
-                hw_layer.compose_render_target(hw_surface, memory, get_composition_key());
+            if ((get_composition_key_memory() != 0) || is_nonzero(memory.get(), desc.dwHeight * desc.lPitch)) {
+                hw_layer.compose_render_target(hw_surface, memory.get(), get_composition_key());
             }
             master = MASTER_HW;
         }
         else if (master == MASTER_COMPOSITION_NONKEY) {
-            hw_layer.compose_render_target(hw_surface, memory, get_composition_key());
+            hw_layer.compose_render_target(hw_surface, memory.get(), get_composition_key());
             master = MASTER_HW;
         }
+        else if (prepared_update) {
+            hw_layer.apply_prepared_update(hw_surface, prepared_update);
+            prepared_update = INVALID_PREPARED_UPDATE;
+            master = MASTER_SYNCHRONIZED;
+        }
         else {
-            hw_layer.update_surface(hw_surface, memory);
+            hw_layer.update_surface(hw_surface, memory.get());
             master = MASTER_SYNCHRONIZED;
         }
     }
 }
 
+/**
+ * @brief Starts conversion of the memory copy for the HW surface.
+ *
+ * Called when the game finished writing a texture so the conversion
+ * can overlap with its work until the texture is used.
+ */
+void DirectDrawSurfaceEmu::prepare_hw_update(void)
+{
+    discard_hw_update();
+    if ((master != MASTER_MEMORY) || ((desc.ddsCaps.dwCaps & DDSCAPS_TEXTURE) == 0) || (desc.ddsCaps.dwCaps & (DDSCAPS_3DDEVICE | DDSCAPS_ZBUFFER))) {
+        return;
+    }
+    prepared_update = hw_layer.prepare_update(desc.dwWidth, desc.dwHeight, get_hw_format(), memory.get());
+}
+
+/**
+ * @brief Replaces HW surface shared with other surfaces by own one.
+ *
+ * Must be called before the HW surface is modified.
+ */
+void DirectDrawSurfaceEmu::unshare_hw_surface(void)
+{
+    if ((hw_surface == INVALID_SURFACE_HANDLE) || (! hw_layer.is_surface_shared(hw_surface))) {
+        return;
+    }
+
+    hw_layer.destroy_surface(hw_surface);
+    hw_surface = INVALID_SURFACE_HANDLE;
+    assert((master == MASTER_MEMORY) || (master == MASTER_SYNCHRONIZED));
+    master = MASTER_MEMORY;
+}
+
+/**
+ * @brief Drops conversion of the memory copy before the memory changes.
+ */
+void DirectDrawSurfaceEmu::discard_hw_update(void)
+{
+    if (prepared_update) {
+        hw_layer.discard_prepared_update(prepared_update);
+        prepared_update = INVALID_PREPARED_UPDATE;
+    }
+}
+
 /**
  * @brief Returns handle of the hardware surface ensuring that it is properly updated.
  *
@@ -1105,6 +1300,9 @@ void DirectDrawSurfaceEmu::synchronize_hw(void)
  */
 HWSurfaceHandle DirectDrawSurfaceEmu::get_hw_surface(const bool for_rendering_into)
 {
+    if (for_rendering_into) {
+        unshare_hw_surface();
+    }
     synchronize_hw();
     if (hw_surface && for_rendering_into) {
         master = MASTER_HW;
@@ -1134,6 +1332,14 @@ HWFormat DirectDrawSurfaceEmu::get_hw_format(void) const
  */
 void DirectDrawSurfaceEmu::set_default_render_states(void)
 {
+    assert(RenderStateSet::RENDER_STATE_COUNT == (static_cast<int>(D3DRENDERSTATE_FOGTABLEDENSITY) + 1));
+    assert(RENDER_STATE_TEXTUREHANDLE == static_cast<int>(D3DRENDERSTATE_TEXTUREHANDLE));
+    assert(RENDER_STATE_ZFUNC == static_cast<int>(D3DRENDERSTATE_ZFUNC));
+    assert(RENDER_STATE_FOGTABLEDENSITY == static_cast<int>(D3DRENDERSTATE_FOGTABLEDENSITY));
+    assert(RENDER_VALUE_CMP_LESSEQUAL == static_cast<int>(D3DCMP_LESSEQUAL));
+    assert(RENDER_VALUE_BLEND_BOTHSRCALPHA == static_cast<int>(D3DBLEND_BOTHSRCALPHA));
+    assert(RENDER_VALUE_FOG_LINEAR == static_cast<int>(D3DFOG_LINEAR));
+    assert(RENDER_VALUE_TBLEND_MODULATEALPHA == static_cast<int>(D3DTBLEND_MODULATEALPHA));
     active_render_states = RenderStateSet();
 
     // Set values which are not 0 in the default situation.
@@ -1193,85 +1399,282 @@ void DirectDrawSurfaceEmu::set_default_render_states(void)
 }
 
 /**
- * @brief Sets specified render state.
+ * @brief Sets specified render state.
+ */
+void DirectDrawSurfaceEmu::set_render_state(const D3DSTATE &state)
+{
+    // Check that the index is within the valid range.
+
+    const D3DRENDERSTATETYPE type = state.drstRenderStateType;
+    if (type >= RenderStateSet::RENDER_STATE_COUNT) {
+        logKA(MSG_ERROR, 0, "Setting unknown or unsupported render state %u", type);
+        return;
+    }
+
+    // Report changes of unsupported render states. Supported states are checked
+    // for correct values during upload.
+
+    if (! supported_states[type]) {
+        logKA(MSG_ERROR, 0, "Setting unsupported render state %u", type);
+    }
+
+    // Apply the new value to the live copy.
+
+    active_render_states.set_rs_dw(type, state.dwArg[0]);
+}
+
+/**
+ * @brief Starts drawing of geometry with specified number of vertices.
+ */
+void DirectDrawSurfaceEmu::begin_geometry(const size_t count)
+{
+    assert(find_back_buffer() == this);
+
+    if (deferred_geometry_device != this) {
+        flush_deferred_geometry();
+    }
+    deferred_geometry_device = NULL;
+
+    // The geometry of previous executes stays queued if our vertices
+    // fit behind its vertices.
+
+    if (! vertex_pool.can_append_window(count)) {
+        flush_geometry();
+    }
+    if (queued_geometry.is_empty()) {
+        queued_geometry.reset();
+        queued_overlay_geometry.reset();
+        vertex_pool.clear();
+    }
+    vertex_pool.begin_window(count);
+}
+
+/**
+ * @brief Set specified range of vertices using specified source vertices.
+ *
+ * Each call sets a window of the vertex pool. The geometry queued against
+ * other windows stays valid so several windows can be drawn by single
+ * draw. The queued geometry is flushed only when the window overwrites
+ * vertices it might use.
+ */
+bool DirectDrawSurfaceEmu::set_vertices(const size_t start, const D3DTLVERTEX * const new_vertices, const size_t count)
+{
+    if (count == 0) {
+        return true;
+    }
+    HWEVENT(hw_layer, L"set_vertices");
+
+    // Check that the parameters make sense.
+
+    if ((start + count) > vertex_pool.get_count()) {
+        logKA(MSG_ERROR, 0, "Attempting to set %u vertices from %u when only %u vertices should be present.", count, start, vertex_pool.get_count());
+        return false;
+    }
+
+    assert(sizeof(TLVertex) == sizeof(D3DTLVERTEX));
+    const TLVertex * const input = reinterpret_cast<const TLVertex *>(new_vertices);
+
+    // Draw the geometry which still needs the old content of the window.
+
+    if (queued_geometry.uses_vertices(vertex_pool, start, count) || queued_overlay_geometry.uses_vertices(vertex_pool, start, count)) {
+        flush_geometry();
+    }
+    vertex_pool.set_vertices(start, input, count);
+    return true;
+}
+
+/**
+ * @brief Adds triangle with specified indices to the array of vertices.
+ */
+void DirectDrawSurfaceEmu::add_triangle(const unsigned short v0, const unsigned short v1, const unsigned short v2)
+{
+    if (can_cull_triangles()) {
+        EmulationInfo &info = get_emulation_info();
+        const unsigned short triangle[TRIANGLE_RECORD_WORDS] = {v0, v1, v2, 0};
+        const bool culled = is_triangle_culled(triangle, vertex_pool.get_data() + vertex_pool.get_base(), vertex_pool.get_count(), get_cull_parameters());
+        info.tested_triangle_count++;
+        if (info.execute_profiler.is_enabled()) {
+            info.execute_profiler.record_culled_triangles(1, culled ? 1 : 0);
+        }
+        if (culled) {
+            info.culled_triangle_count++;
+            return;
+        }
+    }
+    const unsigned short triangle[TRIANGLE_RECORD_WORDS] = {v0, v1, v2, 0};
+    size_t base = vertex_pool.get_base();
+    const HWSurfaceHandle atlas_page = place_triangles_in_atlas(triangle, 1, base);
+    prepare_triangle_geometry(atlas_page).add_triangle(
+        static_cast<unsigned short>(base + v0),
+        static_cast<unsigned short>(base + v1),
+        static_cast<unsigned short>(base + v2)
+    );
+}
+
+/**
+ * @brief Adds block of triangles from the execute buffer.
+ *
+ * The render states do not change within the block so the geometry
+ * selection is done only once.
+ */
+void DirectDrawSurfaceEmu::add_triangles(const D3DTRIANGLE * const triangles, const size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    // Drop the triangles which can not produce any pixel so they do not
+    // occupy the indices nor the setup stage of the GPU.
+
+    const unsigned short *records = reinterpret_cast<const unsigned short *>(triangles);
+    size_t kept = count;
+    if (can_cull_triangles()) {
+        EmulationInfo &info = get_emulation_info();
+        info.culled_records.resize(count * TRIANGLE_RECORD_WORDS);
+        kept = cull_triangles(
+            records,
+            count,
+            vertex_pool.get_data() + vertex_pool.get_base(),
+            vertex_pool.get_count(),
+            get_cull_parameters(),
+            &info.culled_records[0]
+        );
+        info.tested_triangle_count += count;
+        info.culled_triangle_count += (count - kept);
+        if (info.execute_profiler.is_enabled()) {
+            info.execute_profiler.record_culled_triangles(count, count - kept);
+        }
+        if (kept == 0) {
+            return;
+        }
+        records = &info.culled_records[0];
+    }
+
+    size_t base = vertex_pool.get_base();
+    const HWSurfaceHandle atlas_page = place_triangles_in_atlas(records, kept, base);
+    prepare_triangle_geometry(atlas_page).add_triangles(reinterpret_cast<const D3DTRIANGLE *>(records), kept, base);
+}
+
+/**
+ * @brief Redirects block of triangles using the active texture to its
+ * atlas page.
+ *
+ * Copies of the vertices used by the triangles are appended to the vertex
+ * pool with the texture coordinates remapped to the page and the base
+ * is moved so the triangle indices address the copies. Returns the page
+ * or INVALID_SURFACE_HANDLE if the triangles use the original texture.
+ *
+ * The HW always wraps the texture coordinates so the texture drawn with
+ * coordinates outside of it or with the wrapping states is excluded
+ * from the atlas.
  */
-void DirectDrawSurfaceEmu::set_render_state(const D3DSTATE &state)
+HWSurfaceHandle DirectDrawSurfaceEmu::place_triangles_in_atlas(const unsigned short * const records, const size_t count, size_t &base)
 {
-    // Check that the index is within the valid range.
+    EmulationInfo &info = get_emulation_info();
+    DirectDrawSurfaceEmu * const texture = reinterpret_cast<DirectDrawSurfaceEmu *>(active_render_states.get_rs_dw(D3DRENDERSTATE_TEXTUREHANDLE));
+    if ((! info.texture_atlas) || (texture == NULL) || (vertex_pool.get_data() == NULL)) {
+        return INVALID_SURFACE_HANDLE;
+    }
 
-    const D3DRENDERSTATETYPE type = state.drstRenderStateType;
-    if (type >= RenderStateSet::RENDER_STATE_COUNT) {
-        logKA(MSG_ERROR, 0, "Setting unknown or unsupported render state %u", type);
-        return;
+    const HWSurfaceHandle surface = texture->get_hw_surface(false);
+    if ((active_render_states.get_rs_dw(D3DRENDERSTATE_WRAPU) != 0) || (active_render_states.get_rs_dw(D3DRENDERSTATE_WRAPV) != 0)) {
+        hw_layer.exclude_from_atlas(surface);
+        return INVALID_SURFACE_HANDLE;
     }
 
-    // Report changes of unsupported render states. Supported states are checked
-    // for correct values during upload.
+    HWSurfaceHandle page = INVALID_SURFACE_HANDLE;
+    AtlasTransform transform;
+    if (! hw_layer.get_atlas_placement(surface, page, transform)) {
+        return INVALID_SURFACE_HANDLE;
+    }
 
-    if (! supported_states[type]) {
-        logKA(MSG_ERROR, 0, "Setting unsupported render state %u", type);
+    // Find the used range of the window and check that it samples only
+    // inside of the texture.
+
+    const TLVertex * const window = vertex_pool.get_data() + vertex_pool.get_base();
+    size_t min_vertex = ~static_cast<size_t>(0);
+    size_t max_vertex = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned short * const record = records + (i * TRIANGLE_RECORD_WORDS);
+        for (size_t j = 0; j < 3; ++j) {
+            const size_t index = record[j];
+            if (index >= vertex_pool.get_count()) {
+                return INVALID_SURFACE_HANDLE;
+            }
+            if (! is_sampled_inside(window[index])) {
+                hw_layer.exclude_from_atlas(surface);
+                return INVALID_SURFACE_HANDLE;
+            }
+            min_vertex = std::min(min_vertex, index);
+            max_vertex = std::max(max_vertex, index);
+        }
     }
 
-    // Apply the new value to the live copy.
+    const size_t copy_count = (max_vertex - min_vertex) + 1;
+    if (! vertex_pool.can_append_vertices(copy_count)) {
+        return INVALID_SURFACE_HANDLE;
+    }
 
-    active_render_states.set_rs_dw(type, state.dwArg[0]);
-}
+    // The append moves the window into the pool memory so the source
+    // is read from there.
 
-/**
- * @brief Starts drawing of geometry with specified number of vertices.
- */
-void DirectDrawSurfaceEmu::begin_geometry(const size_t count)
-{
-    assert(find_back_buffer() == this);
-    queued_geometry.reset();
-    queued_overlay_geometry.reset();
-    vertices.resize(count);
+    TLVertex * const copies = vertex_pool.append_vertices(copy_count);
+    const size_t first_copy = vertex_pool.get_total_count() - copy_count;
+    remap_to_atlas(transform, vertex_pool.get_data() + vertex_pool.get_base() + min_vertex, copy_count, copies);
+    base = first_copy - min_vertex;
+
+    info.atlased_block_count++;
+    info.atlas_vertex_count += copy_count;
+    return page;
 }
 
 /**
- * @brief Set specified range of vertices using specified source vertices.
+ * @brief Determines if the triangles added with the active render states
+ * can be culled on the CPU.
+ *
+ * Dropping the triangles must not change the KA hacks which depend
+ * on presence of the geometry, the skybox override and the glow.
  */
-bool DirectDrawSurfaceEmu::set_vertices(const size_t start, const D3DTLVERTEX * const new_vertices, const size_t count)
+bool DirectDrawSurfaceEmu::can_cull_triangles(void)
 {
-    if (count == 0) {
-        return true;
-    }
-    HWEVENT(hw_layer, L"set_vertices");
-
-    // Check that the parameters make sense.
-
-    if ((start + count) > vertices.size()) {
-        logKA(MSG_ERROR, 0, "Attempting to set %u vertices from %u when only %u vertices should be present.", count, start, vertices.size());
+    EmulationInfo &info = get_emulation_info();
+    if ((! info.cpu_culling) || (vertex_pool.get_data() == NULL)) {
         return false;
     }
-
-    assert(sizeof(TLVertex) == sizeof(D3DTLVERTEX));
-    const TLVertex * const input = reinterpret_cast<const TLVertex *>(new_vertices);
-
-    // Copy the content.
-
-    for (size_t i = 0; i < count; ++i) {
-        vertices[start + i] = input[i];
+    if ((info.emulation_state == EmulationInfo::EMULATION_STATE_3D_SCENE) || (info.emulation_state == EmulationInfo::EMULATION_STATE_3D_SCENE_POINT_GEOMETRY_DRAWN)) {
+        return false;
     }
 
-    // HACK: KA sets all vertices in single operation so we can upload
-    // them directly to the HW for triangle drawing. We need to keep in
-    // memory copy for point drawing.
+    const DWORD shade_mode = active_render_states.get_rs_dw(D3DRENDERSTATE_SHADEMODE);
+    return (shade_mode != GLOW_HACK_SHADING_MODE_BASE) && (shade_mode != GLOW_HACK_SHADING_MODE_OVERLAY);
+}
 
-    assert(count == vertices.size());
-    hw_layer.set_triangle_vertices(&vertices[0], count);
-    return true;
+/**
+ * @brief Describes the area of the render target within which
+ * the triangles can produce pixels.
+ */
+CullParameters DirectDrawSurfaceEmu::get_cull_parameters(void) const
+{
+    CullParameters parameters;
+    parameters.min_x = -CULL_MARGIN;
+    parameters.min_y = -CULL_MARGIN;
+    parameters.max_x = static_cast<float>(desc.dwWidth) + CULL_MARGIN;
+    parameters.max_y = static_cast<float>(desc.dwHeight) + CULL_MARGIN;
+    return parameters;
 }
 
 /**
- * @brief Adds triangle with specified indices to the array of vertices.
+ * @brief Selects geometry object to which the next triangle should be added.
+ *
+ * Flushes the queued geometry if the triangle can not be added to it.
  */
-void DirectDrawSurfaceEmu::add_triangle(const unsigned short v0, const unsigned short v1, const unsigned short v2)
+DirectDrawSurfaceEmu::GeometryInfo &DirectDrawSurfaceEmu::prepare_triangle_geometry(const HWSurfaceHandle atlas_page)
 {
     // If the overlay mode is active without correct underlying geometry, deactivate it.
+    // Geometry carried over from previous execute is never the underlying one.
 
     if (active_render_states.get_rs_dw(D3DRENDERSTATE_SHADEMODE) == GLOW_HACK_SHADING_MODE_OVERLAY) {
-        if (queued_geometry.is_empty() || (queued_geometry.get_shade_mode_render_state() != GLOW_HACK_SHADING_MODE_BASE)) {
+        if (queued_geometry.is_empty() || geometry_carried || (queued_geometry.get_shade_mode_render_state() != GLOW_HACK_SHADING_MODE_BASE)) {
             logKA(MSG_ULTRA_VERBOSE, 0, "Switching from overlay mode because no underlying geometry is present");
             active_render_states.set_rs_dw(D3DRENDERSTATE_SHADEMODE, D3DSHADE_FLAT);
         }
@@ -1292,10 +1695,10 @@ void DirectDrawSurfaceEmu::add_triangle(const unsigned short v0, const unsigned
         flush_geometry();
     }
 
-    // Or if the state configuration changed since last time.
+    // Or if the state configuration of the HW changed since last time.
 
     if (! target_geometry.is_empty()) {
-        if (! target_geometry.is_state_set_unchanged(active_render_states)) {
+        if (! can_extend_batch(target_geometry, atlas_page)) {
             flush_geometry();
         }
     }
@@ -1306,11 +1709,60 @@ void DirectDrawSurfaceEmu::add_triangle(const unsigned short v0, const unsigned
     if (target_geometry.is_empty()) {
         target_geometry.set_mode(GEOMETRY_MODE_TRIANGLES);
         target_geometry.set_state_set(active_render_states);
+        target_geometry.set_atlas_page(atlas_page);
+    }
+    return target_geometry;
+}
+
+/**
+ * @brief Determines if geometry using the active render states and
+ * specified atlas page can be added to specified geometry.
+ */
+bool DirectDrawSurfaceEmu::can_extend_batch(GeometryInfo &geometry, const HWSurfaceHandle atlas_page)
+{
+    if (geometry.get_atlas_page() != atlas_page) {
+        return false;
+    }
+
+    EmulationInfo &info = get_emulation_info();
+    const bool extend =
+        info.hw_state_batching ?
+        geometry.is_hw_state_unchanged(active_render_states, info.avoided_flush_count) :
+        geometry.is_state_set_unchanged(active_render_states)
+    ;
+
+    // Extending geometry carried over from previous execute saves its draw.
+
+    if (extend && geometry_carried) {
+        geometry_carried = false;
+        info.merged_batch_count++;
+        if (info.execute_profiler.is_enabled()) {
+            info.execute_profiler.record_merged_batch();
+        }
+    }
+    return extend;
+}
+
+/**
+ * @brief Determines if the queued geometry can be kept pending after
+ * end of current execute.
+ */
+bool DirectDrawSurfaceEmu::can_defer_geometry(void)
+{
+    EmulationInfo &info = get_emulation_info();
+    if ((! info.execute_merging) || (! scene_active)) {
+        return false;
     }
 
-    // Queue the triangle.
+    // The KA skybox override applies to the first triangle geometry
+    // of the scene so that geometry must be drawn alone.
 
-    target_geometry.add_triangle(v0, v1, v2);
+    if (! is_inside_sfad3d()) {
+        if ((info.emulation_state == EmulationInfo::EMULATION_STATE_3D_SCENE) || (info.emulation_state == EmulationInfo::EMULATION_STATE_3D_SCENE_POINT_GEOMETRY_DRAWN)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 /**
@@ -1331,10 +1783,10 @@ void DirectDrawSurfaceEmu::add_line(const size_t first, const size_t second)
         flush_geometry();
     }
 
-    // Or if the state configuration changed since last time.
+    // Or if the state configuration of the HW changed since last time.
 
     if (! queued_geometry.is_empty()) {
-        if (! queued_geometry.is_state_set_unchanged(active_render_states)) {
+        if (! can_extend_batch(queued_geometry, INVALID_SURFACE_HANDLE)) {
             flush_geometry();
         }
     }
@@ -1349,10 +1801,11 @@ void DirectDrawSurfaceEmu::add_line(const size_t first, const size_t second)
 
     // Queue the line.
 
-    assert(static_cast<unsigned short>(first) == first);
-    assert(static_cast<unsigned short>(second) == second);
+    const size_t base = vertex_pool.get_base();
+    assert(static_cast<unsigned short>(base + first) == (base + first));
+    assert(static_cast<unsigned short>(base + second) == (base + second));
 
-    queued_geometry.add_line(static_cast<unsigned short>(first), static_cast<unsigned short>(second));
+    queued_geometry.add_line(static_cast<unsigned short>(base + first), static_cast<unsigned short>(base + second));
 }
 
 /**
@@ -1377,10 +1830,10 @@ void DirectDrawSurfaceEmu::add_points(const size_t first, const size_t count)
         flush_geometry();
     }
 
-    // Or if the state configuration changed since last time.
+    // Or if the state configuration of the HW changed since last time.
 
     if (! queued_geometry.is_empty()) {
-        if (! queued_geometry.is_state_set_unchanged(active_render_states)) {
+        if (! can_extend_batch(queued_geometry, INVALID_SURFACE_HANDLE)) {
             flush_geometry();
         }
     }
@@ -1395,7 +1848,7 @@ void DirectDrawSurfaceEmu::add_points(const size_t first, const size_t count)
 
     // Queue the points.
 
-    queued_geometry.add_points(first, count);
+    queued_geometry.add_points(vertex_pool.get_base() + first, count);
 }
 
 /**
@@ -1413,6 +1866,46 @@ void DirectDrawSurfaceEmu::flush_geometry(void)
         return;
     }
     HWEVENT(hw_layer, L"flush_geometry");
+    geometry_carried = false;
+
+    // The geometry references vertices which were never set.
+
+    const TLVertex * const vertex_data = vertex_pool.get_data();
+    if (vertex_data == NULL) {
+        logKA(MSG_ERROR, 0, "Attempting to draw geometry without vertices.");
+        queued_geometry.reset();
+        queued_overlay_geometry.reset();
+        return;
+    }
+
+    // Opaque geometry is collected for the sorted drawing. Any other
+    // geometry depends on the order so the collected one is drawn first.
+
+    if (can_sort_geometry()) {
+        submit_blend_list();
+        if (! queued_geometry.move_to_draw_list(draw_list, draw_list_states.size(), vertex_data, false)) {
+            submit_draw_list();
+            queued_geometry.move_to_draw_list(draw_list, draw_list_states.size(), vertex_data, false);
+        }
+        draw_list_states.push_back(queued_geometry.get_state_set());
+        draw_list_pages.push_back(queued_geometry.get_atlas_page());
+        return;
+    }
+    submit_draw_list();
+
+    // Blended geometry is collected in its order so it can join earlier
+    // geometry with the same state.
+
+    if (can_merge_blended_geometry()) {
+        if (! queued_geometry.move_to_draw_list(blend_list, blend_list_states.size(), vertex_data, true)) {
+            submit_blend_list();
+            queued_geometry.move_to_draw_list(blend_list, blend_list_states.size(), vertex_data, true);
+        }
+        blend_list_states.push_back(queued_geometry.get_state_set());
+        blend_list_pages.push_back(queued_geometry.get_atlas_page());
+        return;
+    }
+    submit_blend_list();
 
     // Upload the back buffer to the HW if it was changed since last time.
     // The GPU copy will now become master.
@@ -1447,9 +1940,19 @@ void DirectDrawSurfaceEmu::flush_geometry(void)
         }
     }
 
+    // Upload the vertices changed since the previous draw.
+
+    if (vertex_pool.is_upload_pending()) {
+        hw_layer.set_triangle_vertices(vertex_data, vertex_pool.get_total_count());
+        vertex_pool.mark_uploaded();
+    }
+
     // Draw it.
 
-    queued_geometry.draw_geometry(hw_layer, &vertices[0]);
+    if (info.execute_profiler.is_enabled()) {
+        info.execute_profiler.record_draw(queued_geometry.get_primitive_count());
+    }
+    queued_geometry.draw_geometry(hw_layer, vertex_data, info);
     assert(queued_geometry.is_empty());
 
     // Draw the overlay geometry if any.
@@ -1458,21 +1961,293 @@ void DirectDrawSurfaceEmu::flush_geometry(void)
         return;
     }
 
+    if (info.execute_profiler.is_enabled()) {
+        info.execute_profiler.record_draw(queued_overlay_geometry.get_primitive_count());
+    }
     queued_overlay_geometry.apply_state(hw_layer);
-    queued_overlay_geometry.draw_geometry(hw_layer, &vertices[0]);
+    queued_overlay_geometry.draw_geometry(hw_layer, vertex_data, info);
     assert(queued_overlay_geometry.is_empty());
 }
 
 /**
  * @brief Completes the geometry.
  *
- * Flushes any pending draws.
+ * The pending geometry is kept queued so the following execute with
+ * compatible state can extend it. Otherwise it is drawn.
  */
 void DirectDrawSurfaceEmu::end_geometry(void)
 {
     assert(find_back_buffer() == this);
+
+    if ((! queued_geometry.is_empty()) && (vertex_pool.get_data() != NULL) && can_defer_geometry()) {
+
+        // The vertices must outlive the execute buffer. The next
+        // execute places its vertices behind ours.
+
+        vertex_pool.carry_window();
+        geometry_carried = true;
+        deferred_geometry_device = this;
+        return;
+    }
+
     flush_geometry();
-    vertices.clear();
+    vertex_pool.clear();
+
+    // The sorted and blended drawing continues with the next execute.
+
+    if ((! draw_list.is_empty()) || (! blend_list.is_empty())) {
+        deferred_geometry_device = this;
+    }
+}
+
+/**
+ * @brief Determines if the queued geometry can be drawn out of order
+ * by the sorted drawing.
+ */
+bool DirectDrawSurfaceEmu::can_sort_geometry(void)
+{
+    EmulationInfo &info = get_emulation_info();
+    if ((! info.draw_sorting) || (! scene_active)) {
+        return false;
+    }
+    if ((queued_geometry.get_mode() != GEOMETRY_MODE_TRIANGLES) || (! queued_overlay_geometry.is_empty())) {
+        return false;
+    }
+
+    if (! is_emulation_state_final()) {
+        return false;
+    }
+
+    // Only opaque geometry which writes the depth produces the same
+    // result in any order, apart from pixels with equal depth (see the
+    // DrawList). The glow base must stay before its overlay.
+
+    const HWStateKey &key = queued_geometry.get_hw_state_key();
+    if ((key.depth_test != DEPTH_TEST_ON) || (key.alpha_blend != BLEND_NONE)) {
+        return false;
+    }
+    if ((key.shade_mode == GLOW_HACK_SHADING_MODE_BASE) || (key.shade_mode == GLOW_HACK_SHADING_MODE_OVERLAY)) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Determines if the queued geometry can be collected
+ * in the blend list.
+ */
+bool DirectDrawSurfaceEmu::can_merge_blended_geometry(void)
+{
+    EmulationInfo &info = get_emulation_info();
+    if ((! info.blend_merging) || (! scene_active)) {
+        return false;
+    }
+    if ((queued_geometry.get_mode() != GEOMETRY_MODE_TRIANGLES) || (! queued_overlay_geometry.is_empty())) {
+        return false;
+    }
+    if (! is_emulation_state_final()) {
+        return false;
+    }
+
+    // The glow base must stay directly before its overlay.
+
+    const HWStateKey &key = queued_geometry.get_hw_state_key();
+    if (key.alpha_blend == BLEND_NONE) {
+        return false;
+    }
+    if ((key.shade_mode == GLOW_HACK_SHADING_MODE_BASE) || (key.shade_mode == GLOW_HACK_SHADING_MODE_OVERLAY)) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Determines if drawing of triangles can neither be subject
+ * of the emulation hacks nor advance the emulation state.
+ */
+bool DirectDrawSurfaceEmu::is_emulation_state_final(void)
+{
+    EmulationInfo &info = get_emulation_info();
+    return
+        (info.emulation_state == EmulationInfo::EMULATION_STATE_3D_SCENE_TRIANGLE_GEOMETRY_DRAWN) ||
+        (is_inside_sfad3d() && (info.emulation_state == EmulationInfo::EMULATION_STATE_3D_SCENE_POINT_GEOMETRY_DRAWN))
+    ;
+}
+
+/**
+ * @brief Draws the geometry collected in the draw list sorted by its state.
+ */
+void DirectDrawSurfaceEmu::submit_draw_list(void)
+{
+    if (draw_list.is_empty()) {
+        return;
+    }
+    HWEVENT(hw_layer, L"submit_draw_list");
+
+    EmulationInfo &info = get_emulation_info();
+    info.sorted_batch_count += draw_list.get_batches().size();
+    info.fixed_batch_count += draw_list.get_fixed_count();
+    draw_list.sort();
+    info.sorted_draw_count += draw_list_groups(draw_list, draw_list_states, draw_list_pages);
+}
+
+/**
+ * @brief Draws the geometry collected in the blend list in its order.
+ */
+void DirectDrawSurfaceEmu::submit_blend_list(void)
+{
+    if (blend_list.is_empty()) {
+        return;
+    }
+    HWEVENT(hw_layer, L"submit_blend_list");
+
+    EmulationInfo &info = get_emulation_info();
+    info.joined_blend_batch_count += blend_list.get_joined_count();
+    draw_list_groups(blend_list, blend_list_states, blend_list_pages);
+}
+
+/**
+ * @brief Draws batches of specified list and clears it.
+ *
+ * Consecutive batches with the same state are drawn by single draw.
+ * Returns number of the draws.
+ */
+size_t DirectDrawSurfaceEmu::draw_list_groups(DrawList &list, std::vector<RenderStateSet> &states, std::vector<HWSurfaceHandle> &pages)
+{
+    EmulationInfo &info = get_emulation_info();
+    synchronize_hw();
+    master = MASTER_HW;
+
+    // The list replaces the vertices of the queued geometry on the HW.
+
+    hw_layer.set_triangle_vertices(list.get_vertices(), list.get_vertex_count());
+    vertex_pool.invalidate_upload();
+
+    size_t draw_count = 0;
+    const DrawList::BatchList &batches = list.get_batches();
+    for (size_t first = 0; first < batches.size(); ) {
+        const size_t end = list.get_group_end(first);
+
+        sorted_geometry.reset();
+        sorted_geometry.set_mode(GEOMETRY_MODE_TRIANGLES);
+        sorted_geometry.set_state_set(states[batches[first].tag]);
+        sorted_geometry.set_atlas_page(pages[batches[first].tag]);
+        for (size_t i = first; i < end; ++i) {
+            const DrawList::Batch &batch = batches[i];
+            sorted_geometry.add_triangle_indices(list.get_indices() + batch.first_index, batch.index_count, batch.min_vertex, batch.max_vertex);
+        }
+
+        if (info.execute_profiler.is_enabled()) {
+            info.execute_profiler.record_draw(sorted_geometry.get_primitive_count());
+        }
+        sorted_geometry.apply_state(hw_layer);
+        sorted_geometry.draw_geometry(hw_layer, list.get_vertices(), info);
+        draw_count++;
+        first = end;
+    }
+
+    list.clear();
+    states.clear();
+    pages.clear();
+    return draw_count;
+}
+
+/**
+ * @brief Allocates the transient geometry storage in advance so it does
+ * not grow during the frames.
+ *
+ * All arrays keep their memory when cleared so after they reach their
+ * peak size, the frames are drawn without allocations.
+ */
+void DirectDrawSurfaceEmu::reserve_geometry_storage(void)
+{
+    EmulationInfo &info = get_emulation_info();
+    const size_t vertex_count = info.geometry_reserve;
+    const size_t index_count = vertex_count * 3;
+    const size_t batch_count = vertex_count / VERTICES_PER_RESERVED_BATCH;
+    if (vertex_pool.get_capacity() >= vertex_count) {
+        return;
+    }
+
+    vertex_pool.reserve(vertex_count);
+    queued_geometry.reserve(index_count);
+    queued_overlay_geometry.reserve(index_count);
+    info.strip_indices.reserve(info.triangle_strips ? index_count : 0);
+    info.culled_records.reserve(info.cpu_culling ? ((index_count / 3) * TRIANGLE_RECORD_WORDS) : 0);
+    if (info.draw_sorting || info.blend_merging) {
+        sorted_geometry.reserve(index_count);
+    }
+    if (info.draw_sorting) {
+        draw_list.reserve(vertex_count, index_count, batch_count);
+        draw_list_states.reserve(batch_count);
+        draw_list_pages.reserve(batch_count);
+    }
+    if (info.blend_merging) {
+        blend_list.reserve(vertex_count, index_count, batch_count);
+        blend_list_states.reserve(batch_count);
+        blend_list_pages.reserve(batch_count);
+    }
+    info.geometry_storage_bytes = get_geometry_storage_bytes();
+}
+
+/**
+ * @brief Returns size of memory allocated by the transient geometry storage.
+ *
+ * The HW layer keeps no per-frame geometry of its own, the vertices
+ * and indices are written directly to its dynamic buffers.
+ */
+size_t DirectDrawSurfaceEmu::get_geometry_storage_bytes(void)
+{
+    EmulationInfo &info = get_emulation_info();
+    return
+        (vertex_pool.get_capacity() * sizeof(TLVertex)) +
+        queued_geometry.get_capacity_bytes() +
+        queued_overlay_geometry.get_capacity_bytes() +
+        sorted_geometry.get_capacity_bytes() +
+        (info.strip_indices.capacity() * sizeof(unsigned short)) +
+        (info.culled_records.capacity() * sizeof(unsigned short)) +
+        draw_list.get_capacity_bytes() +
+        (draw_list_states.capacity() * sizeof(RenderStateSet)) +
+        (draw_list_pages.capacity() * sizeof(HWSurfaceHandle)) +
+        blend_list.get_capacity_bytes() +
+        (blend_list_states.capacity() * sizeof(RenderStateSet)) +
+        (blend_list_pages.capacity() * sizeof(HWSurfaceHandle))
+    ;
+}
+
+/**
+ * @brief Detects growth of the transient geometry storage during the last frame.
+ *
+ * Called at the end of each frame.
+ */
+void DirectDrawSurfaceEmu::update_geometry_storage_statistics(void)
+{
+    EmulationInfo &info = get_emulation_info();
+    const size_t bytes = get_geometry_storage_bytes();
+    if (bytes == info.geometry_storage_bytes) {
+        return;
+    }
+    logKA(MSG_VERBOSE, 0, "Geometry storage grew to %u KB", bytes / 1024);
+    info.geometry_storage_bytes = bytes;
+    info.geometry_storage_growth_count++;
+}
+
+/**
+ * @brief Draws the geometry kept pending after the end of the last execute.
+ *
+ * Must be called before any operation which might affect the result
+ * of that geometry or depend on it.
+ */
+void DirectDrawSurfaceEmu::flush_deferred_geometry(void)
+{
+    DirectDrawSurfaceEmu * const device = deferred_geometry_device;
+    if (device == NULL) {
+        return;
+    }
+    deferred_geometry_device = NULL;
+    device->flush_geometry();
+    device->submit_draw_list();
+    device->submit_blend_list();
 }
 
 /**
@@ -1550,6 +2325,7 @@ STDMETHODIMP DirectDrawSurfaceEmu::BltFast(DWORD x,DWORD y,LPDIRECTDRAWSURFACE s
         logKA(MSG_ERROR, 0, "Blit inside one surface is not supported");
         return DDERR_UNSUPPORTED;
     }
+    flush_deferred_geometry();
 
     // Ensure that the content is in the video memory. This allows us to do full
     // 24 bit blit.
@@ -1593,12 +2369,11 @@ STDMETHODIMP DirectDrawSurfaceEmu::Flip(LPDIRECTDRAWSURFACE surface_override, DW
         logKA(MSG_ERROR, 0, "Flip: Called on non-flippable surface.");
         return DDERR_NOTFLIPPABLE;
     }
+    flush_deferred_geometry();
 
     // Flip memory content of both surfaces.
 
-    void * const tmp_memory = front->memory;
-    front->memory = back->memory;
-    back->memory = tmp_memory;
+    front->memory.swap(back->memory);
 
     const HWSurfaceHandle tmp_hw_surface = front->hw_surface;
     front->hw_surface = back->hw_surface;
@@ -1619,6 +2394,10 @@ STDMETHODIMP DirectDrawSurfaceEmu::Flip(LPDIRECTDRAWSURFACE surface_override, DW
     if (info) {
         info->emulation_state = EmulationInfo::EMULATION_STATE_WAITING_FOR_3D_SCENE;
         info->emulation_timeout_start = timeGetTime();
+        back->update_geometry_storage_statistics();
+        if (info->execute_profiler.is_enabled()) {
+            info->execute_profiler.end_frame();
+        }
     }
     return DD_OK;
 }
@@ -1740,6 +2519,10 @@ STDMETHODIMP DirectDrawSurfaceEmu::Lock(LPRECT rect, LPDDSURFACEDESC desc, DWORD
         logKA(MSG_VERBOSE, 1, "Lock %u %x %08x", flags, handle, caller);
     }
 
+    // Draw geometry which might use the surface.
+
+    flush_deferred_geometry();
+
     // Update the lock counter.
 
     lock_count++;
@@ -1752,11 +2535,19 @@ STDMETHODIMP DirectDrawSurfaceEmu::Lock(LPRECT rect, LPDDSURFACEDESC desc, DWORD
     desc->lPitch = this->desc.lPitch;
     desc->ddpfPixelFormat = this->desc.ddpfPixelFormat;
 
+    // Unless the surface is only read, drop its background conversion and
+    // stop sharing the memory with other surfaces (see Load()).
+
+    if ((flags & DDLOCK_READONLY) == 0) {
+        discard_hw_update();
+        memory.make_unique();
+    }
+
     // Calculate location of the memory.
 
     const size_t x_offset = rect ? (rect->left * this->desc.ddpfPixelFormat.dwRGBBitCount / 8) : 0;
     const size_t y_offset = rect ? (rect->top * this->desc.lPitch) : 0;
-    desc->lpSurface = (rect == NULL) ? memory : (static_cast<char *>(memory) + x_offset + y_offset);
+    desc->lpSurface = (rect == NULL) ? memory.get() : (static_cast<char *>(memory.get()) + x_offset + y_offset);
 
     // For backbuffer ensure that any queued geometry is present on the screen.
 
@@ -1786,7 +2577,7 @@ STDMETHODIMP DirectDrawSurfaceEmu::Lock(LPRECT rect, LPDDSURFACEDESC desc, DWORD
 
                 if ((master != MASTER_COMPOSITION) && (master != MASTER_COMPOSITION_NONKEY)) {
                     assert(KA_COMPOSITION_KEY_MEMORY == 0);
-                    memset(memory, 0, desc->lPitch * desc->dwHeight);
+                    memset(memory.get(), 0, desc->lPitch * desc->dwHeight);
                 }
 
                 active_lock_hack = LOCK_HACK_COMPOSITION;
@@ -1803,7 +2594,7 @@ STDMETHODIMP DirectDrawSurfaceEmu::Lock(LPRECT rect, LPDDSURFACEDESC desc, DWORD
             if (info.emulation_state == EmulationInfo::EMULATION_STATE_3D_SCENE) {
                 if (is_cpu_starfield_enabled() && (master != MASTER_COMPOSITION) && (master != MASTER_COMPOSITION_NONKEY)) {
                     assert(KA_COMPOSITION_KEY_MEMORY == 0);
-                    memset(memory, 0, desc->lPitch * desc->dwHeight);
+                    memset(memory.get(), 0, desc->lPitch * desc->dwHeight);
                 }
                 active_lock_hack = LOCK_HACK_STARFIELD;
                 logKA(MSG_VERBOSE, 1, "Starfield hack activated");
@@ -1828,7 +2619,7 @@ STDMETHODIMP DirectDrawSurfaceEmu::Lock(LPRECT rect, LPDDSURFACEDESC desc, DWORD
                 assert((desc->lPitch % 4) == 0);
                 const DWORD clear_dword = ((SFA_COMPOSITION_KEY_MEMORY << 16) | (SFA_COMPOSITION_KEY_MEMORY));
                 const size_t dword_count = desc->lPitch * desc->dwHeight / 4;
-                const void * const memory_to_set = memory;
+                const void * const memory_to_set = memory.get();
                 __asm {
                     mov eax, clear_dword
                     mov edi, memory_to_set
@@ -1935,6 +2726,12 @@ STDMETHODIMP DirectDrawSurfaceEmu::Unlock(LPVOID addr)
         }
     }
 
+    // Start conversion of the new content once the last lock is released.
+
+    if (lock_count == 0) {
+        prepare_hw_update();
+    }
+
     update_presentation_emulation();
     return DD_OK;
 }
@@ -2092,6 +2889,7 @@ STDMETHODIMP DirectDrawSurfaceEmu::BeginScene()
     );
 
     scene_active = true;
+    reserve_geometry_storage();
 
     // From now on we will be using flip as presentation
     // event.
@@ -2107,6 +2905,7 @@ STDMETHODIMP DirectDrawSurfaceEmu::EndScene()
 {
     LOG_METHOD();
     assert(find_back_buffer() == this);
+    flush_deferred_geometry();
     hw_layer.end_scene();
     hw_layer.set_render_target(NULL, NULL);
     scene_active = false;
@@ -2135,12 +2934,28 @@ STDMETHODIMP DirectDrawSurfaceEmu::Load(LPDIRECT3DTEXTURE texture)
     assert(desc.dwWidth == impl->desc.dwWidth);
     assert(desc.dwHeight == impl->desc.dwHeight);
     assert(memcmp(&desc.ddpfPixelFormat, &impl->desc.ddpfPixelFormat, sizeof(desc.ddpfPixelFormat)) == 0);
+    flush_deferred_geometry();
 
-    // Copy the data.
+    // Share the memory instead of copying it. Both surfaces copy it
+    // when they are locked for writing.
 
-    const size_t memory_size = desc.dwHeight * desc.lPitch;
-    memcpy(memory, impl->memory, memory_size);
-    master = MASTER_MEMORY;
+    discard_hw_update();
+    memory.share(impl->memory);
+
+    // If the source is uploaded, share its HW surface as well.
+
+    const bool render_target = (desc.ddsCaps.dwCaps & DDSCAPS_3DDEVICE) != 0;
+    if ((impl->master == MASTER_SYNCHRONIZED) && impl->hw_surface && (! render_target)) {
+        if (hw_surface) {
+            hw_layer.destroy_surface(hw_surface);
+        }
+        hw_surface = hw_layer.share_surface(impl->hw_surface);
+        master = MASTER_SYNCHRONIZED;
+    }
+    else {
+        master = MASTER_MEMORY;
+        prepare_hw_update();
+    }
 
     update_presentation_emulation();
     return DD_OK;
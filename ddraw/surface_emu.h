@@ -3,6 +3,13 @@
 
 #include "../helpers/interface.h"
 #include "../helpers/log.h"
+#include "../helpers/shared_memory.h"
+#include "draw_list.h"
+#include "hw_state_key.h"
+#include "render_state_set.h"
+#include "triangle_culling.h"
+#include "vertex_pool.h"
+#include "execute_profiler.h"
 #include "ddraw_emu.h"
 #include "ddraw.h"
 #include "d3d.h"
@@ -70,6 +77,126 @@ struct EmulationInfo {
      */
     HWND timer_window;
 
+    /**
+     * @brief Statistics about the executed geometry.
+     */
+    ExecuteProfiler execute_profiler;
+
+    /**
+     * @brief Should the batches continue across render state changes
+     * which do not affect the HW?
+     */
+    bool hw_state_batching;
+
+    /**
+     * @brief Number of render state changes which did not end the batch
+     * thanks to the hw_state_batching.
+     */
+    size_t avoided_flush_count;
+
+    /**
+     * @brief Should the geometry pending at the end of execute be kept
+     * for merging with the following executes?
+     */
+    bool execute_merging;
+
+    /**
+     * @brief Number of batches which were merged with the following
+     * execute instead of being drawn at the end of their own execute.
+     */
+    size_t merged_batch_count;
+
+    /**
+     * @brief Should the opaque geometry be collected and drawn sorted
+     * by its state?
+     *
+     * Opt-in as coplanar geometry with varying depth (decals) might
+     * change which batch wins at equal depth.
+     */
+    bool draw_sorting;
+
+    /**
+     * @name Statistics of the sorted drawing.
+     */
+    //@{
+    size_t sorted_batch_count;
+    size_t sorted_draw_count;
+    size_t fixed_batch_count;
+    //@}
+
+    /**
+     * @brief Should the blended geometry join earlier geometry with
+     * the same state when it does not overlap geometry drawn in between?
+     */
+    bool blend_merging;
+
+    /**
+     * @brief Number of blended batches which joined earlier batch.
+     */
+    size_t joined_blend_batch_count;
+
+    /**
+     * @brief Number of vertices for which the transient geometry storage
+     * is allocated before the first scene.
+     */
+    size_t geometry_reserve;
+
+    /**
+     * @brief Memory allocated by the transient geometry storage at the end
+     * of the last frame. The storage never shrinks so it is also the peak.
+     */
+    size_t geometry_storage_bytes;
+
+    /**
+     * @brief Number of frames during which the transient geometry storage grew.
+     */
+    size_t geometry_storage_growth_count;
+
+    /**
+     * @brief Should the triangles which can not produce any pixel be dropped
+     * before they are queued?
+     */
+    bool cpu_culling;
+
+    /**
+     * @name Statistics of the culling.
+     */
+    //@{
+    size_t tested_triangle_count;
+    size_t culled_triangle_count;
+    //@}
+
+    /**
+     * @brief Work buffer receiving the D3DTRIANGLE records which survived
+     * the culling.
+     */
+    std::vector<unsigned short> culled_records;
+
+    /**
+     * @brief Should the triangles using textures placed into the atlas be
+     * drawn from the atlas page so they batch with other textures of
+     * the page?
+     */
+    bool texture_atlas;
+
+    /**
+     * @name Statistics of the atlas drawing.
+     */
+    //@{
+    size_t atlased_block_count;
+    size_t atlas_vertex_count;
+    //@}
+
+    /**
+     * @brief Should the triangle lists be converted to strips when it saves indices?
+     */
+    bool triangle_strips;
+
+    /**
+     * @brief Work buffer for the strip conversion.
+     */
+    std::vector<unsigned short> strip_indices;
+
     EmulationInfo(const HINSTANCE instance, DirectDrawSurfaceEmu &surface);
     ~EmulationInfo();
 };
@@ -121,14 +248,24 @@ private:
 
     /**
      * @brief Backing memory for the surface.
+     *
+     * Might be shared with other surfaces after Load() so it must
+     * be made unique before it is modified.
      */
-    void * memory;
+    SharedMemory memory;
 
     /**
      * @brief Handle of the hardware surface, if allocated.
      */
     HWSurfaceHandle hw_surface;
 
+    /**
+     * @brief Background conversion of the memory copy, if started.
+     *
+     * The memory copy must not be modified while it exists.
+     */
+    HWPreparedUpdate prepared_update;
+
     enum Master {
         MASTER_NONE,            // The surface is in a freshly initialized state.
         MASTER_MEMORY,          // The system memory contains the latest data.
@@ -178,88 +315,17 @@ private:
     LockHack active_lock_hack;
 
     /**
-     * @brief Emulated render states.
-     *
-     * Used by apply_render_states() to apply the state to the HW.
+     * @brief Live render states set by the executes.
      */
-    struct RenderStateInfo {
-
-        /**
-         * @brief Value of the state.
-         */
-        union {
-            DWORD dw_value;
-            D3DVALUE float_value;
-        } value ;
-    };
+    RenderStateSet active_render_states;
 
     /**
-     * @brief Set of render states.
+     * @name Translation of the render states to the HW states.
      */
-    struct RenderStateSet {
-
-    public:
-
-        enum {
-            RENDER_STATE_COUNT = D3DRENDERSTATE_FOGTABLEDENSITY + 1
-        };
-
-    private:
-
-        /**
-         * @brief State values.
-         */
-        RenderStateInfo states[RENDER_STATE_COUNT];
-
-        /**
-         * @brief Hash of the state.
-         *
-         * If two state sets have different value of the hash, they are
-         * different. The opposite is not true.
-         */
-        unsigned __int64 hash;
-
-        /**
-         * @brief Set sequence number.
-         *
-         * Increased during each change of stored value. If one
-         * set is created by copying another set, they will have
-         * the same value.
-         */
-        unsigned sequence_number;
-
-    public:
-
-        RenderStateSet();
-
-        // Changes.
-
-        bool set_rs_dw(const D3DRENDERSTATETYPE type, const DWORD value);
-        bool set_rs_float(const D3DRENDERSTATETYPE type, const float value);
-
-        // Queries.
-
-        size_t get_rs_dw(const D3DRENDERSTATETYPE type) const;
-        bool get_rs_bool(const D3DRENDERSTATETYPE type) const;
-        float get_rs_float(const D3DRENDERSTATETYPE type) const;
-
-        // Comparison.
-
-        bool compare_states(const RenderStateSet &other) const;
-        bool equals(const RenderStateSet &other) const;
-        bool equals_with_sequence(const RenderStateSet &other) const;
-
-        // Application to the hardware.
-
-        void apply_render_states(HWLayer &hw_layer) const;
-
-        DepthTest get_depth_test_state(void) const;
-        AlphaTest get_alpha_test_state(void) const;
-        Blend get_alpha_blend_state(void) const;
-        Fog get_fog_state(void) const;
-        TextureBlend get_texture_blend(void) const;
-
-    } active_render_states;
+    //@{
+    static void apply_render_states(const RenderStateSet &set, const HWSurfaceHandle atlas_page, HWLayer &hw_layer);
+    static void log_unsupported_render_states(const RenderStateSet &set);
+    //@}
 
     /**
      * @brief Indication which states we support for automatic error reporting.
@@ -275,9 +341,17 @@ private:
     };
 
     /**
-     * @brief Vertices from current execute buffer.
+     * @brief Vertices of the queued geometry.
+     *
+     * The execute buffer memory stays valid until the end_geometry().
      */
-    std::vector<TLVertex> vertices;
+    VertexPool vertex_pool;
+
+    /**
+     * @brief Was the queued geometry carried over from previous execute
+     * without being extended by the current one yet?
+     */
+    bool geometry_carried;
 
     /**
      * @brief Information about geometry queued for rendering.
@@ -311,25 +385,55 @@ private:
          */
         RenderStateSet state_set;
 
+        /**
+         * @brief HW state corresponding to the state_set.
+         */
+        HWStateKey hw_state_key;
+
+        /**
+         * @brief Sequence number of the last set found to have the same HW state.
+         */
+        unsigned equivalent_sequence_number;
+
+        /**
+         * @brief Atlas page bound instead of the texture of the state set.
+         *
+         * The page replaces the texture in the hw_state_key so geometry of
+         * all textures from the page forms single batch.
+         */
+        HWSurfaceHandle atlas_page;
+
     public:
 
         GeometryInfo();
         void reset(void);
+        void reserve(const size_t index_count);
+        size_t get_capacity_bytes(void) const;
 
         bool is_empty(void) const;
         GeometryMode get_mode(void) const;
+        size_t get_primitive_count(void) const;
+        bool uses_vertices(const VertexPool &pool, const size_t start, const size_t count) const;
 
         void set_mode(const GeometryMode mode);
         void set_state_set(const RenderStateSet &set);
+        void set_atlas_page(const HWSurfaceHandle page);
+        HWSurfaceHandle get_atlas_page(void) const;
+        const RenderStateSet &get_state_set(void) const;
+        const HWStateKey &get_hw_state_key(void) const;
         bool is_state_set_unchanged(const RenderStateSet &set) const;
+        bool is_hw_state_unchanged(const RenderStateSet &set, size_t &avoided_flush_count);
         size_t get_shade_mode_render_state(void) const;
 
         void add_triangle(const unsigned short v0, const unsigned short v1, const unsigned short v2);
+        void add_triangles(const D3DTRIANGLE * const triangles, const size_t count, const size_t base);
         void add_line(const unsigned short v0, const unsigned short v1);
         void add_points(const size_t first, const size_t count);
+        void add_triangle_indices(const unsigned short * const source, const size_t count, const size_t first_vertex, const size_t last_vertex);
+        bool move_to_draw_list(DrawList &list, const size_t tag, const TLVertex * const vertices, const bool ordered);
 
         void apply_state(HWLayer &hw_layer);
-        void draw_geometry(HWLayer &hw_layer, const TLVertex * const vertices);
+        void draw_geometry(HWLayer &hw_layer, const TLVertex * const vertices, EmulationInfo &info);
     };
 
     /**
@@ -345,6 +449,46 @@ private:
      */
     GeometryInfo queued_overlay_geometry;
 
+    /**
+     * @brief Device whose geometry was kept pending after end of its execute.
+     */
+    static DirectDrawSurfaceEmu *deferred_geometry_device;
+
+    /**
+     * @brief Opaque geometry waiting for the sorted submission.
+     */
+    DrawList draw_list;
+
+    /**
+     * @brief States of the draw list batches indexed by their tags.
+     */
+    std::vector<RenderStateSet> draw_list_states;
+
+    /**
+     * @brief Atlas pages of the draw list batches indexed by their tags.
+     */
+    std::vector<HWSurfaceHandle> draw_list_pages;
+
+    /**
+     * @brief Blended geometry waiting for the ordered submission.
+     */
+    DrawList blend_list;
+
+    /**
+     * @brief States of the blend list batches indexed by their tags.
+     */
+    std::vector<RenderStateSet> blend_list_states;
+
+    /**
+     * @brief Atlas pages of the blend list batches indexed by their tags.
+     */
+    std::vector<HWSurfaceHandle> blend_list_pages;
+
+    /**
+     * @brief Geometry used to draw group of the draw or blend list batches.
+     */
+    GeometryInfo sorted_geometry;
+
 public:
 
     DirectDrawSurfaceEmu(HWLayer &the_hw_layer, const HINSTANCE the_instance);
@@ -374,6 +518,9 @@ public:
 
     void synchronize_memory(void);
     void synchronize_hw(void);
+    void prepare_hw_update(void);
+    void discard_hw_update(void);
+    void unshare_hw_surface(void);
     HWSurfaceHandle get_hw_surface(const bool for_rendering_into);
     HWFormat get_hw_format(void) const;
 
@@ -388,11 +535,34 @@ public:
     void begin_geometry(const size_t count);
     bool set_vertices(const size_t start, const D3DTLVERTEX * const vertices, const size_t count);
     void add_triangle(const unsigned short v0, const unsigned short v1, const unsigned short v2);
+    void add_triangles(const D3DTRIANGLE * const triangles, const size_t count);
     void add_line(const size_t first, const size_t second);
     void add_points(const size_t first, const size_t count);
     void flush_geometry(void);
     void end_geometry(void);
 
+    static void flush_deferred_geometry(void);
+
+private:
+
+    HWSurfaceHandle place_triangles_in_atlas(const unsigned short * const records, const size_t count, size_t &base);
+    GeometryInfo &prepare_triangle_geometry(const HWSurfaceHandle atlas_page);
+    bool can_extend_batch(GeometryInfo &geometry, const HWSurfaceHandle atlas_page);
+    bool can_defer_geometry(void);
+    bool can_cull_triangles(void);
+    CullParameters get_cull_parameters(void) const;
+    bool can_sort_geometry(void);
+    bool can_merge_blended_geometry(void);
+    bool is_emulation_state_final(void);
+    void submit_draw_list(void);
+    void submit_blend_list(void);
+    size_t draw_list_groups(DrawList &list, std::vector<RenderStateSet> &states, std::vector<HWSurfaceHandle> &pages);
+    void reserve_geometry_storage(void);
+    size_t get_geometry_storage_bytes(void);
+    void update_geometry_storage_statistics(void);
+
+public:
+
     // IUnknown.
 
     IUNKNOWN_IMPLEMENTATION()
@@ -0,0 +1,187 @@
+#include "triangle_culling.h"
+#include "triangle_indices.h"
+#include "../helpers/cpu_features.h"
+#include <emmintrin.h>
+#include <assert.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief Copies the D3DTRIANGLE record to the destination.
+ */
+void copy_record(const unsigned short * const triangle, unsigned short * const destination)
+{
+    for (size_t i = 0; i < TRIANGLE_RECORD_WORDS; ++i) {
+        destination[i] = triangle[i];
+    }
+}
+
+/**
+ * @brief Determines if the triangle uses single vertex more than once.
+ */
+bool has_repeated_index(const unsigned short * const triangle)
+{
+    return (triangle[0] == triangle[1]) || (triangle[1] == triangle[2]) || (triangle[0] == triangle[2]);
+}
+
+bool has_index_out_of_range(const unsigned short * const triangle, const size_t vertex_count)
+{
+    return (triangle[0] >= vertex_count) || (triangle[1] >= vertex_count) || (triangle[2] >= vertex_count);
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Determines if the triangle can not produce any pixel.
+ *
+ * Such triangles use single vertex more than once, have two vertices
+ * at the same position or lie entirely on one side outside of the screen
+ * area. Comparisons with NaN positions fail so such triangles
+ * are kept. Triangles referencing missing vertices are kept as well.
+ */
+bool is_triangle_culled(const unsigned short * const triangle, const TLVertex * const vertices, const size_t vertex_count, const CullParameters &parameters)
+{
+    if (has_index_out_of_range(triangle, vertex_count)) {
+        return false;
+    }
+    if (has_repeated_index(triangle)) {
+        return true;
+    }
+
+    const TLVertex &v0 = vertices[triangle[0]];
+    const TLVertex &v1 = vertices[triangle[1]];
+    const TLVertex &v2 = vertices[triangle[2]];
+
+    // Zero area because of coincident vertices.
+
+    if (
+        ((v0.sx == v1.sx) && (v0.sy == v1.sy)) ||
+        ((v1.sx == v2.sx) && (v1.sy == v2.sy)) ||
+        ((v0.sx == v2.sx) && (v0.sy == v2.sy))
+    ) {
+        return true;
+    }
+
+    // Outside of the screen.
+
+    return
+        ((v0.sx < parameters.min_x) && (v1.sx < parameters.min_x) && (v2.sx < parameters.min_x)) ||
+        ((v0.sy < parameters.min_y) && (v1.sy < parameters.min_y) && (v2.sy < parameters.min_y)) ||
+        ((v0.sx > parameters.max_x) && (v1.sx > parameters.max_x) && (v2.sx > parameters.max_x)) ||
+        ((v0.sy > parameters.max_y) && (v1.sy > parameters.max_y) && (v2.sy > parameters.max_y))
+    ;
+}
+
+/**
+ * @brief Copies D3DTRIANGLE records of triangles which might produce
+ * pixels to the destination.
+ *
+ * Returns number of the copied triangles. The destination must have
+ * space for all records.
+ */
+size_t cull_triangles(const unsigned short * const triangles, const size_t count, const TLVertex * const vertices, const size_t vertex_count, const CullParameters &parameters, unsigned short * const destination)
+{
+    if (has_sse2()) {
+        return cull_triangles_sse2(triangles, count, vertices, vertex_count, parameters, destination);
+    }
+    else {
+        return cull_triangles_scalar(triangles, count, vertices, vertex_count, parameters, destination);
+    }
+}
+
+size_t cull_triangles_scalar(const unsigned short * const triangles, const size_t count, const TLVertex * const vertices, const size_t vertex_count, const CullParameters &parameters, unsigned short * const destination)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned short * const triangle = triangles + (i * TRIANGLE_RECORD_WORDS);
+        if (! is_triangle_culled(triangle, vertices, vertex_count, parameters)) {
+            copy_record(triangle, destination + (kept * TRIANGLE_RECORD_WORDS));
+            kept++;
+        }
+    }
+    return kept;
+}
+
+/**
+ * @brief Tests four triangles at once.
+ *
+ * The positions are gathered into one lane per triangle. The index
+ * checks are done for each triangle separately, triangles with missing
+ * vertices read the first vertex instead and are always kept.
+ */
+size_t cull_triangles_sse2(const unsigned short * const triangles, const size_t count, const TLVertex * const vertices, const size_t vertex_count, const CullParameters &parameters, unsigned short * const destination)
+{
+    if (vertex_count == 0) {
+        return cull_triangles_scalar(triangles, count, vertices, vertex_count, parameters, destination);
+    }
+
+    const __m128 min_x = _mm_set1_ps(parameters.min_x);
+    const __m128 min_y = _mm_set1_ps(parameters.min_y);
+    const __m128 max_x = _mm_set1_ps(parameters.max_x);
+    const __m128 max_y = _mm_set1_ps(parameters.max_y);
+
+    size_t kept = 0;
+    const size_t group_count = count / 4;
+    for (size_t group = 0; group < group_count; ++group) {
+        const unsigned short * const records = triangles + (group * 4 * TRIANGLE_RECORD_WORDS);
+
+        // Gather the positions.
+
+        float x[3][4];
+        float y[3][4];
+        int keep_mask = 0;
+        int repeat_mask = 0;
+        for (size_t lane = 0; lane < 4; ++lane) {
+            const unsigned short * const triangle = records + (lane * TRIANGLE_RECORD_WORDS);
+            const bool missing = has_index_out_of_range(triangle, vertex_count);
+            keep_mask |= (missing ? 1 : 0) << lane;
+            repeat_mask |= (has_repeated_index(triangle) ? 1 : 0) << lane;
+            for (size_t corner = 0; corner < 3; ++corner) {
+                const TLVertex &vertex = vertices[missing ? 0 : triangle[corner]];
+                x[corner][lane] = vertex.sx;
+                y[corner][lane] = vertex.sy;
+            }
+        }
+
+        const __m128 x0 = _mm_loadu_ps(x[0]);
+        const __m128 x1 = _mm_loadu_ps(x[1]);
+        const __m128 x2 = _mm_loadu_ps(x[2]);
+        const __m128 y0 = _mm_loadu_ps(y[0]);
+        const __m128 y1 = _mm_loadu_ps(y[1]);
+        const __m128 y2 = _mm_loadu_ps(y[2]);
+
+        // Zero area because of coincident vertices.
+
+        __m128 culled = _mm_and_ps(_mm_cmpeq_ps(x0, x1), _mm_cmpeq_ps(y0, y1));
+        culled = _mm_or_ps(culled, _mm_and_ps(_mm_cmpeq_ps(x1, x2), _mm_cmpeq_ps(y1, y2)));
+        culled = _mm_or_ps(culled, _mm_and_ps(_mm_cmpeq_ps(x0, x2), _mm_cmpeq_ps(y0, y2)));
+
+        // Outside of the screen.
+
+        culled = _mm_or_ps(culled, _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(x0, min_x), _mm_cmplt_ps(x1, min_x)), _mm_cmplt_ps(x2, min_x)));
+        culled = _mm_or_ps(culled, _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(y0, min_y), _mm_cmplt_ps(y1, min_y)), _mm_cmplt_ps(y2, min_y)));
+        culled = _mm_or_ps(culled, _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(x0, max_x), _mm_cmpgt_ps(x1, max_x)), _mm_cmpgt_ps(x2, max_x)));
+        culled = _mm_or_ps(culled, _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(y0, max_y), _mm_cmpgt_ps(y1, max_y)), _mm_cmpgt_ps(y2, max_y)));
+
+        // Copy the survivors.
+
+        const int culled_mask = (_mm_movemask_ps(culled) | repeat_mask) & (~keep_mask);
+        for (size_t lane = 0; lane < 4; ++lane) {
+            if ((culled_mask & (1 << lane)) == 0) {
+                copy_record(records + (lane * TRIANGLE_RECORD_WORDS), destination + (kept * TRIANGLE_RECORD_WORDS));
+                kept++;
+            }
+        }
+    }
+
+    // The remaining triangles.
+
+    const size_t done = group_count * 4;
+    return kept + cull_triangles_scalar(triangles + (done * TRIANGLE_RECORD_WORDS), count - done, vertices, vertex_count, parameters, destination + (kept * TRIANGLE_RECORD_WORDS));
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,44 @@
+#ifndef TRIANGLE_CULLING_H
+#define TRIANGLE_CULLING_H
+
+#include "../hw/hw_types.h"
+#include <cstddef>
+
+namespace emu {
+
+/**
+ * @brief Description of the area which can produce pixels.
+ *
+ * There is no face culling. The HW draws with D3DCULL_NONE and the
+ * CULLMODE the game sets is not honored, so dropping the back faces
+ * would remove geometry which is visible now.
+ */
+struct CullParameters {
+
+    /**
+     * @name Screen area extended by margin for the rasterization rules.
+     */
+    //@{
+    float min_x;
+    float min_y;
+    float max_x;
+    float max_y;
+    //@}
+};
+
+bool is_triangle_culled(const unsigned short * const triangle, const TLVertex * const vertices, const size_t vertex_count, const CullParameters &parameters);
+size_t cull_triangles(const unsigned short * const triangles, const size_t count, const TLVertex * const vertices, const size_t vertex_count, const CullParameters &parameters, unsigned short * const destination);
+
+// Scalar reference implementation.
+
+size_t cull_triangles_scalar(const unsigned short * const triangles, const size_t count, const TLVertex * const vertices, const size_t vertex_count, const CullParameters &parameters, unsigned short * const destination);
+
+// SSE2 implementation.
+
+size_t cull_triangles_sse2(const unsigned short * const triangles, const size_t count, const TLVertex * const vertices, const size_t vertex_count, const CullParameters &parameters, unsigned short * const destination);
+
+} // namespace emu
+
+#endif // TRIANGLE_CULLING_H
+
+// EOF //
@@ -0,0 +1,133 @@
+#include "triangle_indices.h"
+#include "../helpers/cpu_features.h"
+#include <emmintrin.h>
+#include <assert.h>
+
+namespace emu {
+
+/**
+ * @brief Copies vertex indices of block of D3DTRIANGLE records to the
+ * destination and extends the [min_index, max_index] range by them.
+ *
+ * The flags of the triangles only describe edges and strips which
+ * are not used by the emulation so they are dropped. The destination
+ * must have space for one index past the copied ones.
+ */
+void append_triangle_indices(const unsigned short * const triangles, const size_t count, unsigned short * const destination, size_t &min_index, size_t &max_index)
+{
+    if (has_sse2()) {
+        append_triangle_indices_sse2(triangles, count, destination, min_index, max_index);
+    }
+    else {
+        append_triangle_indices_scalar(triangles, count, destination, min_index, max_index);
+    }
+}
+
+/**
+ * @brief Same as append_triangle_indices but adds the base to the copied
+ * indices, used when the vertices follow vertices of previous executes.
+ */
+void append_rebased_triangle_indices(const unsigned short * const triangles, const size_t count, const size_t base, unsigned short * const destination, size_t &min_index, size_t &max_index)
+{
+    if (base == 0) {
+        append_triangle_indices(triangles, count, destination, min_index, max_index);
+        return;
+    }
+    size_t block_min = ~static_cast<size_t>(0);
+    size_t block_max = 0;
+    append_triangle_indices(triangles, count, destination, block_min, block_max);
+    for (size_t i = 0; i < (count * 3); ++i) {
+        destination[i] = static_cast<unsigned short>(destination[i] + base);
+    }
+    if (count == 0) {
+        return;
+    }
+    if ((block_min + base) < min_index) {
+        min_index = block_min + base;
+    }
+    if ((block_max + base) > max_index) {
+        max_index = block_max + base;
+    }
+}
+
+void append_triangle_indices_scalar(const unsigned short * const triangles, const size_t count, unsigned short * const destination, size_t &min_index, size_t &max_index)
+{
+    size_t minimum = min_index;
+    size_t maximum = max_index;
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned short * const triangle = triangles + (i * TRIANGLE_RECORD_WORDS);
+        unsigned short * const output = destination + (i * 3);
+        for (size_t j = 0; j < 3; ++j) {
+            const unsigned short index = triangle[j];
+            output[j] = index;
+            if (index < minimum) {
+                minimum = index;
+            }
+            if (index > maximum) {
+                maximum = index;
+            }
+        }
+    }
+    min_index = minimum;
+    max_index = maximum;
+}
+
+/**
+ * @brief Processes two triangles at once.
+ *
+ * Each triangle is stored as four indices with the flags overwritten
+ * by the next one. The range is tracked on indices biased to the signed
+ * range as SSE2 has only signed 16 bit min/max.
+ */
+void append_triangle_indices_sse2(const unsigned short * const triangles, const size_t count, unsigned short * const destination, size_t &min_index, size_t &max_index)
+{
+    const size_t pair_count = count / 2;
+    if (pair_count > 0) {
+        const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+        __m128i minimum = _mm_set1_epi16(0x7FFF);
+        __m128i maximum = _mm_set1_epi16(static_cast<short>(0x8000));
+
+        for (size_t i = 0; i < pair_count; ++i) {
+            const __m128i pair = _mm_loadu_si128(reinterpret_cast<const __m128i *>(triangles + (i * 2 * TRIANGLE_RECORD_WORDS)));
+            unsigned short * const output = destination + (i * 6);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(output), pair);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(output + 3), _mm_srli_si128(pair, 8));
+
+            // Replace the flags by the first index so they do not affect the range.
+
+            __m128i indices = _mm_shufflelo_epi16(pair, _MM_SHUFFLE(0, 2, 1, 0));
+            indices = _mm_shufflehi_epi16(indices, _MM_SHUFFLE(0, 2, 1, 0));
+            indices = _mm_xor_si128(indices, bias);
+            minimum = _mm_min_epi16(minimum, indices);
+            maximum = _mm_max_epi16(maximum, indices);
+        }
+
+        // Reduce the lanes.
+
+        short minimum_lanes[8];
+        short maximum_lanes[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(minimum_lanes), minimum);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(maximum_lanes), maximum);
+
+        int lowest = minimum_lanes[0];
+        int highest = maximum_lanes[0];
+        for (size_t i = 1; i < 8; ++i) {
+            lowest = (minimum_lanes[i] < lowest) ? minimum_lanes[i] : lowest;
+            highest = (maximum_lanes[i] > highest) ? maximum_lanes[i] : highest;
+        }
+
+        const size_t lowest_index = static_cast<size_t>(lowest + 0x8000);
+        const size_t highest_index = static_cast<size_t>(highest + 0x8000);
+        min_index = (lowest_index < min_index) ? lowest_index : min_index;
+        max_index = (highest_index > max_index) ? highest_index : max_index;
+    }
+
+    // The remaining triangle.
+
+    const size_t done = pair_count * 2;
+    append_triangle_indices_scalar(triangles + (done * TRIANGLE_RECORD_WORDS), count - done, destination + (done * 3), min_index, max_index);
+}
+
+} // namespace emu
+
+// EOF //
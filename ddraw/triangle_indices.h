@@ -0,0 +1,30 @@
+#ifndef TRIANGLE_INDICES_H
+#define TRIANGLE_INDICES_H
+
+#include <cstddef>
+
+namespace emu {
+
+/**
+ * @brief Number of 16 bit words in single D3DTRIANGLE record.
+ *
+ * Three vertex indices followed by the flags.
+ */
+const size_t TRIANGLE_RECORD_WORDS = 4;
+
+void append_triangle_indices(const unsigned short * const triangles, const size_t count, unsigned short * const destination, size_t &min_index, size_t &max_index);
+void append_rebased_triangle_indices(const unsigned short * const triangles, const size_t count, const size_t base, unsigned short * const destination, size_t &min_index, size_t &max_index);
+
+// Scalar reference implementation.
+
+void append_triangle_indices_scalar(const unsigned short * const triangles, const size_t count, unsigned short * const destination, size_t &min_index, size_t &max_index);
+
+// SSE2 implementation, requires space for one additional index in the destination.
+
+void append_triangle_indices_sse2(const unsigned short * const triangles, const size_t count, unsigned short * const destination, size_t &min_index, size_t &max_index);
+
+} // namespace emu
+
+#endif // TRIANGLE_INDICES_H
+
+// EOF //
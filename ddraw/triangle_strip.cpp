@@ -0,0 +1,97 @@
+#include "triangle_strip.h"
+#include <assert.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief Appends triangle to the strip if it shares edge with
+ * the last triangle of the strip and has the same winding and
+ * the same first vertex it would get at that position.
+ *
+ * Triangle K of the strip starts with vertex K which provides the color
+ * for flat shading. Odd triangles are drawn with the first two vertices
+ * swapped so (A, B, C) at odd position is drawn as its rotation (C, A, B).
+ */
+bool extend_strip(std::vector<unsigned short> &strip, const unsigned short * const triangle)
+{
+    const size_t size = strip.size();
+    if (size < 2) {
+        return false;
+    }
+
+    const bool odd = ((size % 2) != 0);
+    if (triangle[0] != strip[size - 2]) {
+        return false;
+    }
+    if ((! odd) && (triangle[1] == strip[size - 1])) {
+        strip.push_back(triangle[2]);
+        return true;
+    }
+    if (odd && (triangle[2] == strip[size - 1])) {
+        strip.push_back(triangle[1]);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Starts new part of the strip with specified triangle.
+ *
+ * The parts are stitched by repeating the last index of the previous
+ * part and the first index of the new one which creates only degenerate
+ * triangles. The last index is repeated once more if the triangle would
+ * land on an odd position so each part starts with an even triangle and
+ * keeps both its winding and its first vertex.
+ */
+void restart_strip(std::vector<unsigned short> &strip, const unsigned short * const triangle)
+{
+    if (! strip.empty()) {
+        strip.push_back(strip.back());
+        if ((strip.size() % 2) == 0) {
+            strip.push_back(strip.back());
+        }
+        strip.push_back(triangle[0]);
+    }
+    strip.push_back(triangle[0]);
+    strip.push_back(triangle[1]);
+    strip.push_back(triangle[2]);
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Converts list of triangles to single triangle strip.
+ *
+ * The order and winding of the triangles is preserved. Each triangle
+ * also keeps its first vertex so the flat shading, which takes the color
+ * from the first vertex, does not change. The connectivity
+ * is derived from the indices themselves so the D3DTRIFLAG hints of the
+ * game do not need to be trusted. Returns false if the strip would not
+ * be shorter than the list, in which case the content of the strip is
+ * undefined.
+ */
+bool build_triangle_strip(const unsigned short * const indices, const size_t triangle_count, std::vector<unsigned short> &strip)
+{
+    strip.clear();
+    const size_t list_size = triangle_count * 3;
+
+    for (size_t i = 0; i < triangle_count; ++i) {
+        const unsigned short * const triangle = indices + (i * 3);
+        if (! extend_strip(strip, triangle)) {
+            restart_strip(strip, triangle);
+        }
+
+        // Give up as soon as the list is better.
+
+        if (strip.size() >= list_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace emu
+
+// EOF //
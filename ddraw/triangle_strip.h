@@ -0,0 +1,15 @@
+#ifndef TRIANGLE_STRIP_H
+#define TRIANGLE_STRIP_H
+
+#include <cstddef>
+#include <vector>
+
+namespace emu {
+
+bool build_triangle_strip(const unsigned short * const indices, const size_t triangle_count, std::vector<unsigned short> &strip);
+
+} // namespace emu
+
+#endif // TRIANGLE_STRIP_H
+
+// EOF //
@@ -0,0 +1,139 @@
+#include "vertex_bounds.h"
+#include "../helpers/cpu_features.h"
+#include <emmintrin.h>
+#include <float.h>
+#include <assert.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief Distance in pixels by which the rasterized primitives might
+ * exceed the bounds of their vertices.
+ */
+const float RASTER_MARGIN = 1.0f;
+
+/**
+ * @brief Sets bounds covering everything. Used when the positions are invalid.
+ */
+void set_infinite_bounds(VertexBounds &bounds)
+{
+    bounds.min_x = -FLT_MAX;
+    bounds.min_y = -FLT_MAX;
+    bounds.min_z = -FLT_MAX;
+    bounds.max_x = FLT_MAX;
+    bounds.max_y = FLT_MAX;
+    bounds.max_z = FLT_MAX;
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Calculates bounds of screen positions of specified vertices.
+ *
+ * Bounds of vertices with NaN position cover everything.
+ */
+void get_vertex_bounds(const TLVertex * const vertices, const size_t count, VertexBounds &bounds)
+{
+    if (has_sse2()) {
+        get_vertex_bounds_sse2(vertices, count, bounds);
+    }
+    else {
+        get_vertex_bounds_scalar(vertices, count, bounds);
+    }
+}
+
+/**
+ * @brief Determines if the primitives rasterized within the bounds
+ * might touch the same pixel.
+ */
+bool are_bounds_overlapping(const VertexBounds &first, const VertexBounds &second)
+{
+    return
+        (first.min_x <= (second.max_x + RASTER_MARGIN)) &&
+        (second.min_x <= (first.max_x + RASTER_MARGIN)) &&
+        (first.min_y <= (second.max_y + RASTER_MARGIN)) &&
+        (second.min_y <= (first.max_y + RASTER_MARGIN))
+    ;
+}
+
+/**
+ * @brief Determines if all vertices within the bounds have the same depth.
+ */
+bool is_depth_constant(const VertexBounds &bounds)
+{
+    return bounds.min_z == bounds.max_z;
+}
+
+void get_vertex_bounds_scalar(const TLVertex * const vertices, const size_t count, VertexBounds &bounds)
+{
+    assert(count > 0);
+    bounds.min_x = FLT_MAX;
+    bounds.min_y = FLT_MAX;
+    bounds.min_z = FLT_MAX;
+    bounds.max_x = -FLT_MAX;
+    bounds.max_y = -FLT_MAX;
+    bounds.max_z = -FLT_MAX;
+
+    for (size_t i = 0; i < count; ++i) {
+        const float x = vertices[i].sx;
+        const float y = vertices[i].sy;
+        const float z = vertices[i].sz;
+        if ((x != x) || (y != y) || (z != z)) {
+            set_infinite_bounds(bounds);
+            return;
+        }
+        bounds.min_x = (x < bounds.min_x) ? x : bounds.min_x;
+        bounds.min_y = (y < bounds.min_y) ? y : bounds.min_y;
+        bounds.min_z = (z < bounds.min_z) ? z : bounds.min_z;
+        bounds.max_x = (x > bounds.max_x) ? x : bounds.max_x;
+        bounds.max_y = (y > bounds.max_y) ? y : bounds.max_y;
+        bounds.max_z = (z > bounds.max_z) ? z : bounds.max_z;
+    }
+}
+
+/**
+ * @brief Processes position of one vertex per iteration.
+ *
+ * The first four floats of the vertex are loaded together, only the
+ * x, y and z lanes are used. The NaN positions are tracked separately
+ * as the min/max operations would drop them.
+ */
+void get_vertex_bounds_sse2(const TLVertex * const vertices, const size_t count, VertexBounds &bounds)
+{
+    assert(count > 0);
+    assert(offsetof(TLVertex, sy) == (offsetof(TLVertex, sx) + sizeof(float)));
+    assert(offsetof(TLVertex, sz) == (offsetof(TLVertex, sx) + (2 * sizeof(float))));
+
+    __m128 minimum = _mm_set1_ps(FLT_MAX);
+    __m128 maximum = _mm_set1_ps(-FLT_MAX);
+    __m128 invalid = _mm_setzero_ps();
+
+    for (size_t i = 0; i < count; ++i) {
+        const __m128 position = _mm_loadu_ps(&vertices[i].sx);
+        minimum = _mm_min_ps(minimum, position);
+        maximum = _mm_max_ps(maximum, position);
+        invalid = _mm_or_ps(invalid, _mm_cmpunord_ps(position, position));
+    }
+
+    if ((_mm_movemask_ps(invalid) & 0x7) != 0) {
+        set_infinite_bounds(bounds);
+        return;
+    }
+
+    float minimum_lanes[4];
+    float maximum_lanes[4];
+    _mm_storeu_ps(minimum_lanes, minimum);
+    _mm_storeu_ps(maximum_lanes, maximum);
+    bounds.min_x = minimum_lanes[0];
+    bounds.min_y = minimum_lanes[1];
+    bounds.min_z = minimum_lanes[2];
+    bounds.max_x = maximum_lanes[0];
+    bounds.max_y = maximum_lanes[1];
+    bounds.max_z = maximum_lanes[2];
+}
+
+} // namespace emu
+
+// EOF //
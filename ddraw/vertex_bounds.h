@@ -0,0 +1,37 @@
+#ifndef VERTEX_BOUNDS_H
+#define VERTEX_BOUNDS_H
+
+#include "../hw/hw_types.h"
+#include <cstddef>
+
+namespace emu {
+
+/**
+ * @brief Screen space box containing positions of vertices.
+ */
+struct VertexBounds {
+    float min_x;
+    float min_y;
+    float min_z;
+    float max_x;
+    float max_y;
+    float max_z;
+};
+
+void get_vertex_bounds(const TLVertex * const vertices, const size_t count, VertexBounds &bounds);
+bool are_bounds_overlapping(const VertexBounds &first, const VertexBounds &second);
+bool is_depth_constant(const VertexBounds &bounds);
+
+// Scalar reference implementation.
+
+void get_vertex_bounds_scalar(const TLVertex * const vertices, const size_t count, VertexBounds &bounds);
+
+// SSE2 implementation.
+
+void get_vertex_bounds_sse2(const TLVertex * const vertices, const size_t count, VertexBounds &bounds);
+
+} // namespace emu
+
+#endif // VERTEX_BOUNDS_H
+
+// EOF //
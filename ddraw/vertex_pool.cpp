@@ -0,0 +1,241 @@
+#include "vertex_pool.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace emu {
+
+VertexPool::VertexPool()
+    : data(NULL)
+    , base(0)
+    , count(0)
+    , appended_count(0)
+    , vertices()
+    , upload_pending(false)
+    , copied_count(0)
+    , uploaded_count(0)
+{
+}
+
+/**
+ * @brief Forgets all windows. The pool memory is kept.
+ */
+void VertexPool::clear(void)
+{
+    data = NULL;
+    base = 0;
+    count = 0;
+    appended_count = 0;
+    upload_pending = false;
+}
+
+/**
+ * @brief Determines if window of specified size fits behind the current
+ * windows.
+ */
+bool VertexPool::can_append_window(const size_t window_count) const
+{
+    return (base + window_count) <= MAXIMAL_MERGED_VERTEX_COUNT;
+}
+
+/**
+ * @brief Starts window of specified size behind the current windows.
+ */
+void VertexPool::begin_window(const size_t window_count)
+{
+    assert(appended_count == 0);
+    count = window_count;
+}
+
+/**
+ * @brief Sets specified range of the current window.
+ *
+ * HACK: KA sets all vertices in single operation. The execute buffer
+ * already uses the HW vertex layout so the vertices are uploaded
+ * directly from it and the point drawing reads them from there too.
+ */
+void VertexPool::set_vertices(const size_t start, const TLVertex * const input, const size_t input_count)
+{
+    assert((start + input_count) <= count);
+
+    if ((base == 0) && (start == 0) && (input_count == count) && (appended_count == 0)) {
+        data = input;
+    }
+    else {
+
+        // Copy the window into the pool, preserving vertices set
+        // by previous operations and previous executes.
+
+        const size_t total_count = get_total_count();
+        const bool pooled = is_pooled();
+        vertices.resize(total_count);
+        if ((data != NULL) && (! pooled)) {
+            std::copy(data, data + total_count, vertices.begin());
+            copied_count += total_count;
+        }
+        std::copy(input, input + input_count, vertices.begin() + base + start);
+        copied_count += input_count;
+        data = &vertices[0];
+    }
+
+    // The upload is delayed until the draw so multiple windows
+    // are uploaded together.
+
+    upload_pending = true;
+}
+
+/**
+ * @brief Determines if specified number of vertices fits behind the current
+ * window and the vertices already appended to it.
+ */
+bool VertexPool::can_append_vertices(const size_t append_count) const
+{
+    return (get_total_count() + append_count) <= MAXIMAL_MERGED_VERTEX_COUNT;
+}
+
+/**
+ * @brief Appends specified number of vertices behind the current window
+ * and returns them to be filled.
+ *
+ * The pool memory is used from now on, so the returned vertices and those
+ * of the windows are not moved by the append.
+ */
+TLVertex *VertexPool::append_vertices(const size_t append_count)
+{
+    assert(data != NULL);
+    assert(can_append_vertices(append_count));
+
+    const size_t total_count = get_total_count();
+    if (! is_pooled()) {
+        vertices.assign(data, data + total_count);
+        copied_count += total_count;
+    }
+    vertices.resize(total_count + append_count);
+    data = &vertices[0];
+    appended_count += append_count;
+    upload_pending = true;
+    return &vertices[total_count];
+}
+
+/**
+ * @brief Determines if setting specified range of the current window
+ * overwrites vertex from specified range of the pool.
+ *
+ * The range is given by its first and last vertex, empty range has the
+ * first vertex past the last one.
+ */
+bool VertexPool::overwrites(const size_t start, const size_t input_count, const size_t min_vertex, const size_t max_vertex) const
+{
+    if ((input_count == 0) || (min_vertex > max_vertex)) {
+        return false;
+    }
+    const size_t first = base + start;
+    return (first <= max_vertex) && ((first + input_count - 1) >= min_vertex);
+}
+
+/**
+ * @brief Keeps the current window for the geometry which outlives its
+ * execute. The next window is placed behind it.
+ */
+void VertexPool::carry_window(void)
+{
+    assert(data != NULL);
+    const size_t total_count = get_total_count();
+    if (! is_pooled()) {
+        vertices.assign(data, data + total_count);
+        copied_count += total_count;
+        data = &vertices[0];
+    }
+    base = total_count;
+    count = 0;
+    appended_count = 0;
+}
+
+/**
+ * @brief Allocates the pool memory in advance.
+ */
+void VertexPool::reserve(const size_t capacity)
+{
+    vertices.reserve(capacity);
+}
+
+/**
+ * @brief Returns the vertices, NULL if none were set.
+ */
+const TLVertex *VertexPool::get_data(void) const
+{
+    return data;
+}
+
+size_t VertexPool::get_base(void) const
+{
+    return base;
+}
+
+size_t VertexPool::get_count(void) const
+{
+    return count;
+}
+
+/**
+ * @brief Returns number of vertices of all windows, including the appended
+ * ones.
+ */
+size_t VertexPool::get_total_count(void) const
+{
+    return base + count + appended_count;
+}
+
+/**
+ * @brief Are the vertices stored in the pool memory?
+ */
+bool VertexPool::is_pooled(void) const
+{
+    return (data != NULL) && (! vertices.empty()) && (data == &vertices[0]);
+}
+
+size_t VertexPool::get_capacity(void) const
+{
+    return vertices.capacity();
+}
+
+bool VertexPool::is_upload_pending(void) const
+{
+    return upload_pending;
+}
+
+/**
+ * @brief Records upload of all windows to the HW.
+ */
+void VertexPool::mark_uploaded(void)
+{
+    upload_pending = false;
+    uploaded_count += get_total_count();
+}
+
+/**
+ * @brief Records that the HW vertices were replaced by other ones.
+ */
+void VertexPool::invalidate_upload(void)
+{
+    upload_pending = (data != NULL);
+}
+
+/**
+ * @brief Returns number of vertices copied by the pool since its creation.
+ */
+size_t VertexPool::get_copied_count(void) const
+{
+    return copied_count;
+}
+
+/**
+ * @brief Returns number of vertices uploaded since creation of the pool.
+ */
+size_t VertexPool::get_uploaded_count(void) const
+{
+    return uploaded_count;
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,103 @@
+#ifndef VERTEX_POOL_H
+#define VERTEX_POOL_H
+
+#include "../hw/hw_types.h"
+#include <cstddef>
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Maximal number of vertices of merged executes.
+ *
+ * All must be addressable by the 16 bit indices.
+ */
+const size_t MAXIMAL_MERGED_VERTEX_COUNT = 65536;
+
+/**
+ * @brief Vertices of the geometry queued by the executes.
+ *
+ * Each execute sets a window of vertices behind the windows of previous
+ * executes whose geometry is still queued. When all vertices of an execute
+ * are set by single operation and nothing is queued before them, the pool
+ * references them directly in the execute buffer. Otherwise the windows are
+ * copied into the pool memory.
+ *
+ * Vertices derived from the current window, such as the ones remapped to
+ * a texture atlas, are appended behind it and carried with it.
+ */
+class VertexPool {
+
+    /**
+     * @brief Either the execute buffer vertices or the pool memory.
+     */
+    const TLVertex * data;
+
+    /**
+     * @brief Index of the first vertex of the current window.
+     */
+    size_t base;
+
+    /**
+     * @brief Number of vertices of the current window.
+     */
+    size_t count;
+
+    /**
+     * @brief Number of vertices appended behind the current window.
+     */
+    size_t appended_count;
+
+    /**
+     * @brief Pool memory, kept between the executes to avoid reallocations.
+     */
+    std::vector<TLVertex> vertices;
+
+    /**
+     * @brief Were the vertices changed since their last upload to the HW?
+     */
+    bool upload_pending;
+
+    /**
+     * @name Number of vertices moved by the pool and uploaded to the HW.
+     */
+    //@{
+    size_t copied_count;
+    size_t uploaded_count;
+    //@}
+
+public:
+
+    VertexPool();
+
+    void clear(void);
+    bool can_append_window(const size_t window_count) const;
+    void begin_window(const size_t window_count);
+    void set_vertices(const size_t start, const TLVertex * const input, const size_t input_count);
+    bool can_append_vertices(const size_t append_count) const;
+    TLVertex *append_vertices(const size_t append_count);
+    void carry_window(void);
+    void reserve(const size_t capacity);
+
+    bool overwrites(const size_t start, const size_t input_count, const size_t min_vertex, const size_t max_vertex) const;
+
+    const TLVertex *get_data(void) const;
+    size_t get_base(void) const;
+    size_t get_count(void) const;
+    size_t get_total_count(void) const;
+    bool is_pooled(void) const;
+    size_t get_capacity(void) const;
+
+    bool is_upload_pending(void) const;
+    void mark_uploaded(void);
+    void invalidate_upload(void);
+
+    size_t get_copied_count(void) const;
+    size_t get_uploaded_count(void) const;
+};
+
+} // namespace emu
+
+#endif // VERTEX_POOL_H
+
+// EOF //
@@ -1,5 +1,6 @@
 #include "viewport_emu.h"
 #include "material_emu.h"
+#include "surface_emu.h"
 #include "structure_log.h"
 #include <assert.h>
 #include "../helpers/config.h"
@@ -144,6 +145,10 @@ STDMETHODIMP Direct3DViewportEmu::Clear(DWORD count,LPD3DRECT rects, DWORD flags
         }
     }
 
+    // Geometry kept pending after the last execute must be drawn first.
+
+    DirectDrawSurfaceEmu::flush_deferred_geometry();
+
     hw_layer.clear(
         rect,
         (flags & D3DCLEAR_TARGET) != 0,
@@ -22,6 +22,26 @@ int hw_surface_cache_enabled = -1;
 size_t msaa_quality_level = static_cast<size_t>(-1);
 int inside_sfad3d = -1;
 
+/**
+ * @brief Reads non-negative numeric value of specified option.
+ *
+ * Returns the default value if the option is not defined or is not valid.
+ */
+size_t get_size_option(const char * const name, const size_t default_value)
+{
+    const char * const env_value = getenv(name);
+    if (env_value == NULL) {
+        return default_value;
+    }
+
+    const int value = atoi(env_value);
+    if ((value < 0) || ((value == 0) && (env_value[0] != '0'))) {
+        return default_value;
+    }
+
+    return static_cast<size_t>(value);
+}
+
 } // anonymous namespace
 
 /**
@@ -168,6 +188,116 @@ bool is_surface_cache_enabled(void)
     return (hw_surface_cache_enabled > 0);
 }
 
+/**
+ * @brief Returns maximal memory in bytes used by the HW surface cache.
+ *
+ * Zero means that the size is not limited.
+ */
+size_t get_surface_cache_byte_limit(void)
+{
+    const size_t limit_mb = get_size_option("D3DEMU_HW_SURFACE_CACHE_MB", 256);
+    logKA(MSG_INFORM, 0, "HW surface cache limit is %u MB - use D3DEMU_HW_SURFACE_CACHE_MB to change it (0 = unlimited).", limit_mb)
+    return limit_mb * 1024 * 1024;
+}
+
+/**
+ * @brief Returns maximal number of surfaces cached for single combination of parameters.
+ *
+ * Zero means that the number is not limited.
+ */
+size_t get_surface_cache_slot_limit(void)
+{
+    const size_t limit = get_size_option("D3DEMU_HW_SURFACE_CACHE_SLOT_LIMIT", 256);
+    logKA(MSG_INFORM, 0, "HW surface cache slot limit is %u - use D3DEMU_HW_SURFACE_CACHE_SLOT_LIMIT to change it (0 = unlimited).", limit)
+    return limit;
+}
+
+/**
+ * @brief Returns number of frames after which surfaces which were not reused are removed from the HW surface cache.
+ *
+ * Zero means that the cache is never trimmed.
+ */
+size_t get_surface_cache_trim_interval(void)
+{
+    const size_t interval = get_size_option("D3DEMU_HW_SURFACE_CACHE_TRIM", 3600);
+    logKA(MSG_INFORM, 0, "HW surface cache trim interval is %u frames - use D3DEMU_HW_SURFACE_CACHE_TRIM to change it (0 = never).", interval)
+    return interval;
+}
+
+/**
+ * @brief Returns maximal memory in bytes used by the pool of released HW resources.
+ *
+ * Zero means that the size is not limited.
+ */
+size_t get_resource_pool_byte_limit(void)
+{
+    const size_t limit_mb = get_size_option("D3DEMU_HW_RESOURCE_POOL_MB", 128);
+    logKA(MSG_INFORM, 0, "HW resource pool limit is %u MB - use D3DEMU_HW_RESOURCE_POOL_MB to change it (0 = unlimited).", limit_mb)
+    return limit_mb * 1024 * 1024;
+}
+
+/**
+ * @brief Returns quality of the background texture compression.
+ *
+ * Returns 0 if the compression is disabled (default). Otherwise
+ * 1 (fast), 2 (normal) or 3 (high).
+ */
+size_t get_texture_compression_quality(void)
+{
+    const char * const env_value = getenv("D3DEMU_TEXTURE_COMPRESSION");
+    if (env_value == NULL) {
+        logKA(MSG_INFORM, 0, "Texture compression disabled - define D3DEMU_TEXTURE_COMPRESSION as fast, normal or high to enable it")
+        return 0;
+    }
+
+    size_t quality = 2;
+    if (strcmp(env_value, "fast") == 0) {
+        quality = 1;
+    }
+    else if (strcmp(env_value, "high") == 0) {
+        quality = 3;
+    }
+    logKA(MSG_INFORM, 0, "Texture compression enabled with quality %u", quality)
+    return quality;
+}
+
+/**
+ * @brief Returns minimal width and height of texture to compress.
+ */
+size_t get_texture_compression_min_size(void)
+{
+    return get_size_option("D3DEMU_TEXTURE_COMPRESSION_MIN_SIZE", 128);
+}
+
+/**
+ * @brief Returns maximal width and height of texture to place into the texture atlas.
+ */
+size_t get_texture_atlas_max_size(void)
+{
+    return get_size_option("D3DEMU_TEXTURE_ATLAS_MAX_SIZE", 64);
+}
+
+/**
+ * @brief Returns maximal memory in bytes used by the static geometry buffers.
+ */
+size_t get_static_geometry_byte_limit(void)
+{
+    const size_t limit_mb = get_size_option("D3DEMU_STATIC_GEOMETRY_MB", 16);
+    logKA(MSG_INFORM, 0, "Static geometry limit is %u MB - use D3DEMU_STATIC_GEOMETRY_MB to change it.", limit_mb)
+    return limit_mb * 1024 * 1024;
+}
+
+/**
+ * @brief Returns number of vertices for which the transient geometry
+ * storage is allocated in advance.
+ */
+size_t get_geometry_reserve_vertex_count(void)
+{
+    const size_t count = get_size_option("D3DEMU_GEOMETRY_RESERVE", 16384);
+    logKA(MSG_INFORM, 0, "Geometry storage is reserved for %u vertices - use D3DEMU_GEOMETRY_RESERVE to change it.", count)
+    return count;
+}
+
 /**
  * @brief Detects desired level of anisotropic filtering.
  *
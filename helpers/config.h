@@ -13,6 +13,15 @@ bool is_log_flush_enabled(void);
 bool is_composition_compare_enabled(void);
 bool is_hw_color_conversion_enabled(void);
 bool is_surface_cache_enabled(void);
+size_t get_surface_cache_byte_limit(void);
+size_t get_surface_cache_slot_limit(void);
+size_t get_surface_cache_trim_interval(void);
+size_t get_resource_pool_byte_limit(void);
+size_t get_texture_compression_quality(void);
+size_t get_texture_compression_min_size(void);
+size_t get_texture_atlas_max_size(void);
+size_t get_static_geometry_byte_limit(void);
+size_t get_geometry_reserve_vertex_count(void);
 size_t get_anisotropy_level(void);
 size_t get_msaa_quality_level(void);
 
@@ -0,0 +1,43 @@
+#include "cpu_features.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief Bit of the EDX register returned by CPUID function 1.
+ */
+const int CPUID_EDX_SSE2 = 1 << 26;
+
+bool detect_sse2(void)
+{
+#if defined(_MSC_VER)
+    int registers[4];
+    __cpuid(registers, 1);
+    return (registers[3] & CPUID_EDX_SSE2) != 0;
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    return __builtin_cpu_supports("sse2") != 0;
+#else
+    return false;
+#endif
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Indicates if the SSE2 code paths can be used.
+ *
+ * The detection is done only once.
+ */
+bool has_sse2(void)
+{
+    static const bool result = detect_sse2();
+    return result;
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,12 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+namespace emu {
+
+bool has_sse2(void);
+
+} // namespace emu
+
+#endif // CPU_FEATURES_H
+
+// EOF //
@@ -0,0 +1,114 @@
+#include "hash.h"
+#include <string.h>
+
+namespace emu {
+
+namespace {
+
+const ContentHash FNV_PRIME = 0x100000001b3ULL;
+
+inline unsigned int rotate_left(const unsigned int value, const int count)
+{
+    return (value << count) | (value >> (32 - count));
+}
+
+/**
+ * @brief Mixes single word into the lane in MurmurHash3 fashion.
+ */
+inline unsigned int mix_word(const unsigned int lane, const unsigned int word)
+{
+    unsigned int key = word * 0xcc9e2d51U;
+    key = rotate_left(key, 15);
+    key *= 0x1b873593U;
+    const unsigned int result = rotate_left(lane ^ key, 13);
+    return (result * 5) + 0xe6546b64U;
+}
+
+inline unsigned int finalize_lane(unsigned int lane)
+{
+    lane ^= lane >> 16;
+    lane *= 0x85ebca6bU;
+    lane ^= lane >> 13;
+    lane *= 0xc2b2ae35U;
+    lane ^= lane >> 16;
+    return lane;
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Computes FNV-1a hash of specified memory.
+ *
+ * The seed can be result of previous call to hash discontinuous data.
+ */
+ContentHash hash_content(const void * const data, const size_t size, const ContentHash seed)
+{
+    const unsigned char * bytes = static_cast<const unsigned char *>(data);
+    ContentHash result = seed;
+    for (size_t i = 0; i < size; ++i) {
+        result ^= bytes[i];
+        result *= FNV_PRIME;
+    }
+    return result;
+}
+
+/**
+ * @brief Computes hash of specified memory in two independent 32 bit lanes.
+ *
+ * Much faster than hash_content() on the 32 bit target, intended for data
+ * hashed every frame. The result differs from the hash_content() of the
+ * same data.
+ */
+ContentHash hash_words(const void * const data, const size_t size, const ContentHash seed)
+{
+    const unsigned int * const words = static_cast<const unsigned int *>(data);
+    const size_t pair_count = size / 8;
+
+    unsigned int low = static_cast<unsigned int>(seed);
+    unsigned int high = static_cast<unsigned int>(seed >> 32);
+    for (size_t i = 0; i < pair_count; ++i) {
+        low = mix_word(low, words[(i * 2) + 0]);
+        high = mix_word(high, words[(i * 2) + 1]);
+    }
+
+    // Remaining bytes padded by zeros.
+
+    const size_t done = pair_count * 8;
+    if (done < size) {
+        const unsigned char * const bytes = static_cast<const unsigned char *>(data) + done;
+        unsigned int tail[2] = { 0, 0 };
+        memcpy(tail, bytes, (size - done));
+        low = mix_word(low, tail[0]);
+        high = mix_word(high, tail[1]);
+    }
+
+    // Make the lanes depend on each other and on the size.
+
+    low ^= static_cast<unsigned int>(size);
+    high ^= static_cast<unsigned int>(size);
+    low += high;
+    high += low;
+    low = finalize_lane(low);
+    high = finalize_lane(high);
+    low += high;
+    high += low;
+    return (static_cast<ContentHash>(high) << 32) | low;
+}
+
+/**
+ * @brief Computes hash of rectangular area, skipping the unused bytes at end of each row.
+ */
+ContentHash hash_rows(const void * const data, const size_t row_size, const size_t pitch, const size_t row_count, const ContentHash seed)
+{
+    const unsigned char * row = static_cast<const unsigned char *>(data);
+    ContentHash result = seed;
+    for (size_t i = 0; i < row_count; ++i) {
+        result = hash_content(row, row_size, result);
+        row += pitch;
+    }
+    return result;
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,26 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+
+namespace emu {
+
+/**
+ * @brief 64 bit content hash.
+ */
+typedef unsigned long long ContentHash;
+
+/**
+ * @brief Initial value of the content hash.
+ */
+const ContentHash CONTENT_HASH_SEED = 0xcbf29ce484222325ULL;
+
+ContentHash hash_content(const void * const data, const size_t size, const ContentHash seed = CONTENT_HASH_SEED);
+ContentHash hash_rows(const void * const data, const size_t row_size, const size_t pitch, const size_t row_count, const ContentHash seed = CONTENT_HASH_SEED);
+ContentHash hash_words(const void * const data, const size_t size, const ContentHash seed = CONTENT_HASH_SEED);
+
+} // namespace emu
+
+#endif // HASH_H
+
+// EOF //
@@ -0,0 +1,25 @@
+#ifndef JOB_H
+#define JOB_H
+
+namespace emu {
+
+/**
+ * @brief Unit of work executed by the JobQueue.
+ *
+ * The job must not touch any state shared with the game thread
+ * except its own members.
+ */
+class Job {
+
+public:
+
+    virtual ~Job() {}
+
+    virtual void run(void) = 0;
+};
+
+} // namespace emu
+
+#endif // JOB_H
+
+// EOF //
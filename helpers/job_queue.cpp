@@ -0,0 +1,184 @@
+#include "job_queue.h"
+#include <assert.h>
+#include <system_error>
+
+namespace emu {
+
+JobQueue::JobQueue()
+    : lock()
+    , work_available()
+    , job_done()
+    , thread()
+    , stopping(false)
+    , pending()
+    , running(NULL)
+{
+}
+
+JobQueue::~JobQueue()
+{
+    stop();
+}
+
+/**
+ * @brief Starts the background thread.
+ *
+ * Returns false if the thread can not be started. The queue
+ * executes the jobs synchronously in that case.
+ */
+bool JobQueue::start(void)
+{
+    if (thread.joinable()) {
+        return true;
+    }
+
+    stopping = false;
+    try {
+        thread = std::thread(&JobQueue::process_jobs, this);
+    }
+    catch (const std::system_error &) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Stops the background thread.
+ *
+ * Waits for the currently executed job. Jobs which were not started yet
+ * are removed from the queue without execution.
+ */
+void JobQueue::stop(void)
+{
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+            pending.clear();
+        }
+        work_available.notify_one();
+        thread.join();
+    }
+
+    pending.clear();
+    running = NULL;
+}
+
+/**
+ * @brief Adds the job to the end of the queue.
+ */
+void JobQueue::submit(Job * const job)
+{
+    assert(job);
+
+    if (! thread.joinable()) {
+        job->run();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending.push_back(job);
+    }
+    work_available.notify_one();
+}
+
+/**
+ * @brief Ensures that the job is finished.
+ *
+ * Job which was not started yet is removed from the queue and
+ * executed on the calling thread so we do not need to wait for jobs
+ * before it.
+ */
+void JobQueue::wait(Job * const job)
+{
+    assert(job);
+    if (remove_pending(job)) {
+        job->run();
+        return;
+    }
+    wait_for_running(job);
+}
+
+/**
+ * @brief Ensures that the queue does not reference the job.
+ *
+ * Job which was not started yet is removed without execution. If the job
+ * is being executed, waits until it finishes.
+ */
+void JobQueue::cancel(Job * const job)
+{
+    assert(job);
+    if (remove_pending(job)) {
+        return;
+    }
+    wait_for_running(job);
+}
+
+/**
+ * @brief Checks if the job is neither waiting nor being executed.
+ */
+bool JobQueue::is_finished(Job * const job)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    bool finished = (running != job);
+    for (size_t i = 0; finished && (i < pending.size()); ++i) {
+        finished = (pending[i] != job);
+    }
+    return finished;
+}
+
+/**
+ * @brief Removes the job from list of waiting jobs.
+ *
+ * Returns false if the job was not waiting.
+ */
+bool JobQueue::remove_pending(Job * const job)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (std::deque<Job *>::iterator it = pending.begin(); it != pending.end(); ++it) {
+        if (*it == job) {
+            pending.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Waits until the thread is not executing the job.
+ */
+void JobQueue::wait_for_running(Job * const job)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (running == job) {
+        job_done.wait(guard);
+    }
+}
+
+void JobQueue::process_jobs(void)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        while ((! stopping) && pending.empty()) {
+            work_available.wait(guard);
+        }
+        if (stopping) {
+            return;
+        }
+        Job * const job = pending.front();
+        pending.pop_front();
+        running = job;
+
+        guard.unlock();
+        job->run();
+        guard.lock();
+
+        running = NULL;
+        job_done.notify_all();
+    }
+}
+
+} // namespace emu
+
+// EOF //
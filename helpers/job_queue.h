@@ -0,0 +1,82 @@
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+#include "job.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace emu {
+
+/**
+ * @brief Queue of jobs processed by single background thread.
+ *
+ * The jobs are owned by the caller which must ensure that the job
+ * is finished or canceled before it is destroyed. If the thread is not
+ * running, the jobs are executed immediately during submit.
+ */
+class JobQueue {
+
+    /**
+     * @brief Protects all members below except the thread itself,
+     * which is touched only by the owner.
+     */
+    std::mutex lock;
+
+    /**
+     * @brief Signaled when a job is submitted or the thread should end.
+     */
+    std::condition_variable work_available;
+
+    /**
+     * @brief Signaled whenever the thread finishes a job.
+     */
+    std::condition_variable job_done;
+
+    std::thread thread;
+
+    /**
+     * @brief Request for the thread to end.
+     */
+    bool stopping;
+
+    /**
+     * @brief Jobs waiting for execution in order of submission.
+     */
+    std::deque<Job *> pending;
+
+    /**
+     * @brief Job currently executed by the thread.
+     */
+    Job * running;
+
+public:
+
+    JobQueue();
+    ~JobQueue();
+
+    bool start(void);
+    void stop(void);
+
+    void submit(Job * const job);
+    void wait(Job * const job);
+    void cancel(Job * const job);
+    bool is_finished(Job * const job);
+
+private:
+
+    JobQueue(const JobQueue &);
+    JobQueue &operator=(const JobQueue &);
+
+    bool remove_pending(Job * const job);
+    void wait_for_running(Job * const job);
+
+    void process_jobs(void);
+};
+
+} // namespace emu
+
+#endif // JOB_QUEUE_H
+
+// EOF //
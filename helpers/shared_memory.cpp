@@ -0,0 +1,132 @@
+#include "shared_memory.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief Size of the block header. Keeps alignment of the data the same
+ * as the malloc() provides.
+ */
+const size_t HEADER_SIZE = 16;
+
+} // anonymous namespace
+
+SharedMemory::SharedMemory()
+    : block(NULL)
+{
+}
+
+SharedMemory::~SharedMemory()
+{
+    release();
+}
+
+/**
+ * @brief Allocates new zero filled block.
+ */
+bool SharedMemory::allocate(const size_t size)
+{
+    release();
+    block = create_block(size);
+    if (block == NULL) {
+        return false;
+    }
+    memset(get(), 0, size);
+    return true;
+}
+
+/**
+ * @brief Drops reference to the block.
+ */
+void SharedMemory::release(void)
+{
+    if (block == NULL) {
+        return;
+    }
+
+    assert(block->reference_count > 0);
+    block->reference_count--;
+    if (block->reference_count == 0) {
+        free(block);
+    }
+    block = NULL;
+}
+
+/**
+ * @brief Starts using the same block as the other owner. O(1).
+ */
+void SharedMemory::share(const SharedMemory &other)
+{
+    if (block == other.block) {
+        return;
+    }
+    release();
+    block = other.block;
+    if (block) {
+        block->reference_count++;
+    }
+}
+
+/**
+ * @brief Ensures that this owner is the only one so it can modify the content.
+ *
+ * Returns true if the content had to be copied. The address returned
+ * by get() changes in that case.
+ */
+bool SharedMemory::make_unique(void)
+{
+    if (! is_shared()) {
+        return false;
+    }
+
+    Block * const copy = create_block(block->size);
+    if (copy == NULL) {
+        return false;
+    }
+    memcpy(reinterpret_cast<char *>(copy) + HEADER_SIZE, get(), block->size);
+    release();
+    block = copy;
+    return true;
+}
+
+void SharedMemory::swap(SharedMemory &other)
+{
+    Block * const tmp = block;
+    block = other.block;
+    other.block = tmp;
+}
+
+void *SharedMemory::get(void) const
+{
+    return (block == NULL) ? NULL : (reinterpret_cast<char *>(block) + HEADER_SIZE);
+}
+
+size_t SharedMemory::get_size(void) const
+{
+    return (block == NULL) ? 0 : block->size;
+}
+
+bool SharedMemory::is_shared(void) const
+{
+    return (block != NULL) && (block->reference_count > 1);
+}
+
+SharedMemory::Block *SharedMemory::create_block(const size_t size)
+{
+    assert(sizeof(Block) <= HEADER_SIZE);
+    Block * const result = static_cast<Block *>(malloc(HEADER_SIZE + size));
+    if (result == NULL) {
+        return NULL;
+    }
+    result->reference_count = 1;
+    result->size = size;
+    return result;
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,52 @@
+#ifndef SHARED_MEMORY_H
+#define SHARED_MEMORY_H
+
+#include <cstddef>
+
+namespace emu {
+
+/**
+ * @brief Memory block which can be shared by several owners and is copied
+ * on write.
+ *
+ * The owner must call make_unique() before it modifies the content. The
+ * reference counting is not thread safe, readers on other threads must
+ * be finished before the last owner releases the block.
+ */
+class SharedMemory {
+
+    struct Block {
+        size_t reference_count;
+        size_t size;
+    };
+
+    Block * block;
+
+    SharedMemory(const SharedMemory &);
+    SharedMemory &operator=(const SharedMemory &);
+
+public:
+
+    SharedMemory();
+    ~SharedMemory();
+
+    bool allocate(const size_t size);
+    void release(void);
+    void share(const SharedMemory &other);
+    bool make_unique(void);
+    void swap(SharedMemory &other);
+
+    void *get(void) const;
+    size_t get_size(void) const;
+    bool is_shared(void) const;
+
+private:
+
+    static Block *create_block(const size_t size);
+};
+
+} // namespace emu
+
+#endif // SHARED_MEMORY_H
+
+// EOF //
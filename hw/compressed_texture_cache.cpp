@@ -0,0 +1,181 @@
+#include "compressed_texture_cache.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief Identification of the file format. Change the version
+ * if the encoder output or the layout changes.
+ */
+const unsigned int FILE_MAGIC = 0x5844414B; // "KADX"
+const unsigned int FILE_VERSION = 2;
+
+/**
+ * @brief Sanity limit for size of the stored data.
+ */
+const unsigned int MAX_DATA_SIZE = 64 * 1024 * 1024;
+
+/**
+ * @brief Header of the cache file.
+ */
+struct FileHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int hash_low;
+    unsigned int hash_high;
+    unsigned int format;
+    unsigned int quality;
+    unsigned int width;
+    unsigned int height;
+    unsigned int levels;
+    unsigned int data_size;
+};
+
+void fill_header(FileHeader &header, const CompressedTextureKey &key, const size_t data_size)
+{
+    memset(&header, 0, sizeof(header));
+    header.magic = FILE_MAGIC;
+    header.version = FILE_VERSION;
+    header.hash_low = static_cast<unsigned int>(key.hash & 0xFFFFFFFF);
+    header.hash_high = static_cast<unsigned int>(key.hash >> 32);
+    header.format = key.format;
+    header.quality = key.quality;
+    header.width = key.width;
+    header.height = key.height;
+    header.levels = key.levels;
+    header.data_size = static_cast<unsigned int>(data_size);
+}
+
+} // anonymous namespace
+
+CompressedTextureKey::CompressedTextureKey()
+    : hash(0)
+    , format(0)
+    , quality(0)
+    , width(0)
+    , height(0)
+    , levels(0)
+{
+}
+
+bool CompressedTextureKey::operator==(const CompressedTextureKey &other) const
+{
+    return (hash == other.hash) && (format == other.format) && (quality == other.quality) && (width == other.width) && (height == other.height) && (levels == other.levels);
+}
+
+CompressedTextureCache::CompressedTextureCache()
+    : directory()
+{
+}
+
+/**
+ * @brief Sets directory used to store the files. Empty name disables the cache.
+ *
+ * The directory must exist.
+ */
+void CompressedTextureCache::set_directory(const std::string &the_directory)
+{
+    directory = the_directory;
+}
+
+bool CompressedTextureCache::is_enabled(void) const
+{
+    return ! directory.empty();
+}
+
+/**
+ * @brief Loads compressed data for specified key.
+ *
+ * Returns false if the cache does not contain valid entry for the key.
+ */
+bool CompressedTextureCache::load(const CompressedTextureKey &key, std::vector<unsigned char> &data) const
+{
+    data.clear();
+    if (! is_enabled()) {
+        return false;
+    }
+
+    FILE * const file = fopen(get_file_name(key).c_str(), "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    // Verify that the file belongs to the key.
+
+    FileHeader header;
+    FileHeader expected_header;
+    fill_header(expected_header, key, 0);
+    const bool header_valid =
+        (fread(&header, sizeof(header), 1, file) == 1) &&
+        (header.data_size > 0) && (header.data_size <= MAX_DATA_SIZE) &&
+        (memcmp(&header, &expected_header, sizeof(header) - sizeof(header.data_size)) == 0)
+    ;
+    if (! header_valid) {
+        fclose(file);
+        return false;
+    }
+
+    data.resize(header.data_size);
+    const bool data_valid = (fread(&data[0], 1, data.size(), file) == data.size());
+    fclose(file);
+
+    if (! data_valid) {
+        data.clear();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Stores compressed data for specified key.
+ */
+bool CompressedTextureCache::store(const CompressedTextureKey &key, const std::vector<unsigned char> &data) const
+{
+    if ((! is_enabled()) || data.empty()) {
+        return false;
+    }
+
+    // Write into temporary file first so other instances never
+    // see partially written entry.
+
+    const std::string file_name = get_file_name(key);
+    const std::string temporary_name = file_name + ".tmp";
+    FILE * const file = fopen(temporary_name.c_str(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    FileHeader header;
+    fill_header(header, key, data.size());
+    const bool written =
+        (fwrite(&header, sizeof(header), 1, file) == 1) &&
+        (fwrite(&data[0], 1, data.size(), file) == data.size())
+    ;
+    const bool closed = (fclose(file) == 0);
+
+    if ((! written) || (! closed)) {
+        remove(temporary_name.c_str());
+        return false;
+    }
+
+    remove(file_name.c_str());
+    if (rename(temporary_name.c_str(), file_name.c_str()) != 0) {
+        remove(temporary_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::string CompressedTextureCache::get_file_name(const CompressedTextureKey &key) const
+{
+    char name[64];
+    sprintf(name, "%08x%08x_%u_%u.dxt", static_cast<unsigned int>(key.hash >> 32), static_cast<unsigned int>(key.hash & 0xFFFFFFFF), key.format, key.quality);
+    return directory + "/" + name;
+}
+
+} // namespace emu
+
+// EOF //
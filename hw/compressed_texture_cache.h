@@ -0,0 +1,63 @@
+#ifndef COMPRESSED_TEXTURE_CACHE_H
+#define COMPRESSED_TEXTURE_CACHE_H
+
+#include "../helpers/hash.h"
+#include <string>
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Identification of compressed texture.
+ */
+struct CompressedTextureKey {
+
+    /**
+     * @brief Hash of the uncompressed content.
+     */
+    ContentHash hash;
+
+    unsigned int format;
+    unsigned int quality;
+    unsigned int width;
+    unsigned int height;
+    unsigned int levels;
+
+    CompressedTextureKey();
+
+    bool operator==(const CompressedTextureKey &other) const;
+};
+
+/**
+ * @brief On-disk cache of compressed textures.
+ *
+ * Each texture is stored in separate file named by its key. The object is
+ * not modified by load/store so it can be used from worker threads.
+ */
+class CompressedTextureCache {
+
+    /**
+     * @brief Directory with the files. Empty if the cache is disabled.
+     */
+    std::string directory;
+
+public:
+
+    CompressedTextureCache();
+
+    void set_directory(const std::string &the_directory);
+    bool is_enabled(void) const;
+
+    bool load(const CompressedTextureKey &key, std::vector<unsigned char> &data) const;
+    bool store(const CompressedTextureKey &key, const std::vector<unsigned char> &data) const;
+
+private:
+
+    std::string get_file_name(const CompressedTextureKey &key) const;
+};
+
+} // namespace emu
+
+#endif // COMPRESSED_TEXTURE_CACHE_H
+
+// EOF //
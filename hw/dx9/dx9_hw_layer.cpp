@@ -1,6 +1,10 @@
 #include "dx9_hw_layer.h"
 #include "../../helpers/log.h"
 #include "../../helpers/config.h"
+#include "../texel_conversion.h"
+#include "../mipmap.h"
+#include "../../helpers/hash.h"
+#include <algorithm>
 #include <stdlib.h>
 #include <assert.h>
 
@@ -8,6 +12,28 @@ namespace emu {
 
 namespace {
 
+/**
+ * @brief Size of the texture atlas pages.
+ */
+const size_t ATLAS_PAGE_SIZE = 1024;
+
+/**
+ * @brief Maximal number of atlas pages for each texture format.
+ */
+const size_t ATLAS_MAX_PAGES = 8;
+
+/**
+ * @brief Number of texels replicated around each texture in the atlas
+ * so the filtering does not pick the neighbors.
+ */
+const size_t ATLAS_PADDING = 2;
+
+/**
+ * @brief Number of consecutive frames in which geometry must be drawn
+ * unchanged to be moved to static buffers.
+ */
+const size_t STATIC_GEOMETRY_PROMOTE_FRAMES = 3;
+
 /**
  * @brief Format to use for backbuffer.
  */
@@ -26,6 +52,41 @@ const DWORD STANDARD_FVF_NORMAL = D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_SPECUL
  */
 const DWORD STANDARD_FVF_VISION = D3DFVF_XYZW | D3DFVF_DIFFUSE | D3DFVF_SPECULAR | D3DFVF_TEX1 | D3DFVF_TEXCOORDSIZE2(0);
 
+/**
+ * @brief File storing the surface profile used to prewarm the surface cache.
+ *
+ * Stored in the same directory as the log.
+ */
+const char * const SURFACE_PROFILE_FILE_NAME = "d3demu_surfaces.txt";
+
+/**
+ * @brief File storing order of first use of the textures.
+ */
+const char * const TEXTURE_HISTORY_FILE_NAME = "d3demu_textures.txt";
+
+/**
+ * @brief Maximal number of textures remembered by the history.
+ */
+const size_t MAX_TEXTURE_HISTORY_COUNT = 8192;
+
+/**
+ * @brief Time after presentation of each frame which can be spent by the prefetch.
+ */
+const double TEXTURE_PREFETCH_BUDGET_MS = 1.0;
+
+/**
+ * @brief Minimal number of surfaces created or destroyed between two
+ * presentations for the interval to be measured as transition.
+ */
+const size_t TRANSITION_SURFACE_COUNT = 16;
+
+/**
+ * @brief Directory storing the compressed textures.
+ *
+ * Stored in the same directory as the log.
+ */
+const char * const COMPRESSED_TEXTURE_CACHE_DIRECTORY = "d3demu_cache";
+
 /**
  * @brief Maximal number of vertices in single execute buffer.
  */
@@ -218,6 +279,133 @@ size_t get_cache_slot(const size_t width, const size_t height, const HWFormat fo
     return ((height_cache_index * SURFACE_CACHE_SIZE_SLOTS) + width_cache_index) * SURFACE_CACHE_FORMAT_SLOTS + format_cache_index + 1;
 }
 
+/**
+ * @brief Inverse of the get_cache_slot.
+ */
+void decode_cache_slot(const size_t slot, size_t &width, size_t &height, HWFormat &format)
+{
+    assert(slot != 0);
+    const size_t index = slot - 1;
+    format = static_cast<HWFormat>(HWFORMAT_R5G6B5 + (index % SURFACE_CACHE_FORMAT_SLOTS));
+    width = (1u << ((index / SURFACE_CACHE_FORMAT_SLOTS) % SURFACE_CACHE_SIZE_SLOTS));
+    height = (1u << ((index / SURFACE_CACHE_FORMAT_SLOTS) / SURFACE_CACHE_SIZE_SLOTS));
+}
+
+/**
+ * @brief Returns size of texel of specified format in bytes.
+ */
+size_t get_format_texel_size(const D3DFORMAT format)
+{
+    switch (format) {
+        case D3DFMT_R5G6B5:
+        case D3DFMT_A4R4G4B4:
+        case D3DFMT_D16:
+        case D3DFMT_D16_LOCKABLE:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+/**
+ * @brief Returns D3D format corresponding to the storage.
+ */
+D3DFORMAT get_storage_format(const TextureStorage storage)
+{
+    switch (storage) {
+        case TEXTURE_STORAGE_X8R8G8B8: return D3DFMT_X8R8G8B8;
+        case TEXTURE_STORAGE_A8R8G8B8: return D3DFMT_A8R8G8B8;
+        case TEXTURE_STORAGE_R5G6B5: return D3DFMT_R5G6B5;
+        case TEXTURE_STORAGE_A4R4G4B4: return D3DFMT_A4R4G4B4;
+        default: return D3DFMT_UNKNOWN;
+    }
+}
+
+/**
+ * @brief Returns source format corresponding to the texture format.
+ */
+TextureSource get_texture_source(const HWFormat format)
+{
+    assert((format == HWFORMAT_R5G6B5) || (format == HWFORMAT_R4G4B4A4));
+    return (format == HWFORMAT_R5G6B5) ? TEXTURE_SOURCE_565 : TEXTURE_SOURCE_4444;
+}
+
+/**
+ * @brief Estimates video memory used by cacheable surface of specified size.
+ *
+ * The mipmap chain adds approximatelly one third.
+ */
+size_t get_cached_surface_memory_size(const size_t width, const size_t height, const size_t texel_size)
+{
+    const size_t level_0_size = width * height * texel_size;
+    return level_0_size + (level_0_size / 3);
+}
+
+/**
+ * @brief Builds pool key for texture with specified parameters.
+ */
+ResourceKey get_texture_key(const size_t width, const size_t height, const size_t levels, const DWORD usage, const D3DFORMAT format, const D3DPOOL pool)
+{
+    ResourceKey key;
+    key.type = D3DRTYPE_TEXTURE;
+    key.format = format;
+    key.usage = usage;
+    key.pool = pool;
+    key.levels = levels;
+    key.multisample = 0;
+    key.width = width;
+    key.height = height;
+    return key;
+}
+
+/**
+ * @brief Builds pool key for standalone surface with specified parameters.
+ */
+ResourceKey get_surface_key(const size_t width, const size_t height, const DWORD usage, const D3DFORMAT format, const D3DMULTISAMPLE_TYPE multisample_type, const size_t multisample_quality)
+{
+    ResourceKey key;
+    key.type = D3DRTYPE_SURFACE;
+    key.format = format;
+    key.usage = usage;
+    key.pool = D3DPOOL_DEFAULT;
+    key.levels = 1;
+    key.multisample = (static_cast<unsigned int>(multisample_type) << 16) | multisample_quality;
+    key.width = width;
+    key.height = height;
+    return key;
+}
+
+/**
+ * @brief Estimates memory used by resource with specified key.
+ */
+size_t get_resource_memory_size(const ResourceKey &key)
+{
+    const size_t level_0_size = key.width * key.height * get_format_texel_size(static_cast<D3DFORMAT>(key.format));
+    return (key.levels == 1) ? level_0_size : (level_0_size + (level_0_size / 3));
+}
+
+/**
+ * @brief Returns current value of the high resolution timer.
+ */
+LONGLONG get_time_ticks(void)
+{
+    LARGE_INTEGER value;
+    QueryPerformanceCounter(&value);
+    return value.QuadPart;
+}
+
+/**
+ * @brief Converts difference of get_time_ticks() values to milliseconds.
+ */
+double ticks_to_ms(const LONGLONG ticks)
+{
+    LARGE_INTEGER frequency;
+    if ((! QueryPerformanceFrequency(&frequency)) || (frequency.QuadPart == 0)) {
+        return 0.0;
+    }
+    return (static_cast<double>(ticks) * 1000.0) / static_cast<double>(frequency.QuadPart);
+}
+
 inline HRESULT log_d3d_error_helper(const int line, const char * const action, const HRESULT value)
 {
     if (FAILED(value)) {
@@ -276,6 +464,15 @@ static size_t fill_buffer(BufferType &buffer, size_t & free_index, const size_t
     return start_index;
 }
 
+/**
+ * @brief Identifies 16 bit texture content in the texture history.
+ */
+ContentHash hash_texture(const void * const memory, const size_t width, const size_t height, const size_t stride, const HWFormat format)
+{
+    const ContentHash hash = hash_rows(memory, width * 2, stride, height);
+    return hash_content(&format, sizeof(format), hash);
+}
+
 /**
  * @brief Creates D3D event for lifetime of this object.
  */
@@ -297,6 +494,7 @@ class D3DEventGuard {
 DX9HWLayer::HWSurfaceInfo::HWSurfaceInfo()
     : width(0)
     , height(0)
+    , mono_width(0)
     , mono_height(0)
     , stride(0)
     , format(HWFORMAT_NONE)
@@ -314,8 +512,31 @@ DX9HWLayer::HWSurfaceInfo::HWSurfaceInfo()
     , msaa_render_target()
     , msaa_sync(MSAA_SYNC_TEXTURE)
     , cache_slot(0)
-    , next_in_cache(NULL)
+    , share_count(0)
+    , upload_count(0)
+    , texture_job(NULL)
+    , texture_job_format(D3DFMT_UNKNOWN)
+    , prepared_texture()
+    , atlas_page(NULL)
+    , atlas_excluded(false)
+    , atlas_region()
+    , atlas_transform()
+    , content_hash(0)
+    , first_use_pending(false)
+    , prefetched(false)
+    , upload_ticks(0)
+{
+}
+
+/**
+ * @brief Returns texture which should be used for sampling from the surface.
+ */
+IDirect3DTexture9 *DX9HWLayer::HWSurfaceInfo::get_sampled_texture(void) const
 {
+    if (prepared_texture) {
+        return prepared_texture;
+    }
+    return texture;
 }
 
 DX9HWLayer::HWState::HWState()
@@ -332,6 +553,7 @@ DX9HWLayer::HWState::HWState(const DX9HWLayer::HWState &other)
     , flat(other.flat)
     , texture_blend(other.texture_blend)
     , texture(other.texture)
+    , texture_info(other.texture_info)
     , color_info(other.color_info)
     , depth_info(other.depth_info)
 {
@@ -347,6 +569,7 @@ void DX9HWLayer::HWState::reset(void)
     flat = false;
     texture_blend = TEXTURE_BLEND_MODULATE;
     texture = NULL;
+    texture_info = NULL;
     color_info = NULL;
     depth_info = NULL;
 }
@@ -361,6 +584,7 @@ DX9HWLayer::DX9HWLayer()
     , max_anisotropy(1)
     , multisample_type(D3DMULTISAMPLE_NONE)
     , multisample_quality(0)
+    , texture_formats()
     , device()
     , device_ex()
     , default_color()
@@ -370,11 +594,67 @@ DX9HWLayer::DX9HWLayer()
     , vertex_buffer_free_index(0)
     , index_buffer()
     , index_buffer_free_index(0)
+    , vertex_reuse_enabled(false)
+    , vertex_block_cache()
+    , frame_vertex_upload_count(0)
+    , frame_vertex_reuse_count(0)
+    , frame_vertex_reuse_bytes(0)
+    , vertex_reuse_frame_count(0)
+    , vertex_upload_count(0)
+    , vertex_reuse_count(0)
+    , vertex_reuse_bytes(0)
+    , vertex_block_hash(0)
+    , vertex_block_hashed(false)
     , state()
     , active_combination(-1)
     , scene_active(false)
+    , surface_cache(SURFACE_CACHE_SLOTS)
+    , job_queue()
+    , compression_enabled(false)
+    , compression_quality(DXT_QUALITY_NORMAL)
+    , compression_min_size(0)
+    , dxt1_supported(false)
+    , dxt3_supported(false)
+    , compressed_texture_cache()
+    , compressed_count(0)
+    , compressed_from_cache_count(0)
+    , cpu_mipmaps_enabled(false)
+    , cpu_mipmapped_count(0)
+    , preparing_surfaces()
+    , texture_job_discard_count(0)
+    , async_upload_enabled(false)
+    , prepared_update_count(0)
+    , prepared_update_wait_count(0)
+    , prepared_update_discard_count(0)
+    , static_geometry_enabled(false)
+    , static_geometry_cache()
+    , atlas_enabled(false)
+    , atlas_max_size(0)
+    , atlased_count(0)
+    , atlas_excluded_count(0)
+    , atlas_placement_count(0)
+    , texture_prefetch_enabled(false)
+    , texture_history_loaded(false)
+    , texture_history()
+    , predicted_updates()
+    , prefetched_count(0)
+    , first_use_count(0)
+    , first_use_stall_count(0)
+    , first_use_stall_ticks(0)
+    , resource_pool()
+    , live_surface_counts(SURFACE_CACHE_SLOTS, 0)
+    , surface_profile()
+    , surface_profile_loaded(false)
+    , surface_creation_ticks(0)
+    , surface_creation_count(0)
+    , driver_allocation_ticks(0)
+    , driver_allocation_count(0)
+    , frame_surface_ticks(0)
+    , frame_surface_count(0)
+    , transition_count(0)
+    , transition_ticks(0)
+    , longest_transition_ticks(0)
 {
-    memset(cache, 0, sizeof(cache));
 }
 
 DX9HWLayer::~DX9HWLayer()
@@ -539,6 +819,51 @@ bool DX9HWLayer::initialize(const HWND window, const size_t width, const size_t
     detect_slow_z_readback(adapter);
     detect_anisotropy(adapter, device_type);
     detect_msaa(adapter, device_type);
+    detect_texture_formats(adapter, device_type);
+    detect_texture_compression(adapter, device_type);
+
+    // Mipmaps of static textures can be generated on the CPU which
+    // allows filtering with respect to alpha.
+
+    cpu_mipmaps_enabled = is_option_enabled("D3DEMU_CPU_MIPMAPS");
+    if (cpu_mipmaps_enabled) {
+        logKA(MSG_INFORM, 0, "HW:Generating mipmaps of static textures on the CPU");
+    }
+
+    // Conversion of the 16 bit textures can overlap with the game.
+
+    async_upload_enabled = ! is_option_enabled("D3DEMU_NO_ASYNC_UPLOAD");
+    if (! async_upload_enabled) {
+        logKA(MSG_INFORM, 0, "HW:Background texture conversion disabled");
+    }
+    if (compression_enabled || cpu_mipmaps_enabled || async_upload_enabled) {
+        if (! job_queue.start()) {
+            logKA(MSG_ERROR, 0, "HW:Unable to start job queue thread, textures are converted synchronously");
+        }
+    }
+
+    // Small static textures can share atlas pages so the ddraw layer
+    // can batch draws which use them.
+
+    atlas_enabled = is_option_enabled("D3DEMU_TEXTURE_ATLAS");
+    if (atlas_enabled) {
+        atlas_max_size = get_texture_atlas_max_size();
+        for (size_t i = 0; i < SIZE_OF_TEXTURE_SOURCE; ++i) {
+            atlases[i].configure(ATLAS_PAGE_SIZE, ATLAS_MAX_PAGES, ATLAS_PADDING);
+        }
+        logKA(MSG_INFORM, 0, "HW:Texture atlas enabled for textures up to %ux%u", atlas_max_size, atlas_max_size);
+    }
+
+    // Textures used during previous runs are made resident between
+    // frames before they are drawn.
+
+    texture_prefetch_enabled = ! is_option_enabled("D3DEMU_NO_TEXTURE_PREFETCH");
+    if (texture_prefetch_enabled) {
+        load_texture_history();
+    }
+    else {
+        logKA(MSG_INFORM, 0, "HW:Texture prefetch disabled");
+    }
 
     // Enable the 3d vision support if requested. It is not enabled by default
     // as it results in bigger texture which needs to be transfered across
@@ -603,6 +928,22 @@ bool DX9HWLayer::initialize(const HWND window, const size_t width, const size_t
             direct3d = NULL;
             return false;
         }
+
+        // Static geometry such as HUD sends identical vertices every frame.
+
+        vertex_block_cache.invalidate();
+        vertex_reuse_enabled = is_option_enabled("D3DEMU_VERTEX_REUSE");
+        if (vertex_reuse_enabled) {
+            logKA(MSG_INFORM, 0, "HW:Reuse of unchanged vertex blocks enabled");
+        }
+
+        // Geometry of still scenes is moved into static buffers.
+
+        static_geometry_enabled = is_option_enabled("D3DEMU_STATIC_GEOMETRY");
+        if (static_geometry_enabled) {
+            static_geometry_cache.configure(STATIC_GEOMETRY_PROMOTE_FRAMES, get_static_geometry_byte_limit());
+            logKA(MSG_INFORM, 0, "HW:Static geometry enabled for geometry unchanged in %u frames", STATIC_GEOMETRY_PROMOTE_FRAMES);
+        }
     }
 
     // Find the default render targets. The default swap chain
@@ -615,6 +956,12 @@ bool DX9HWLayer::initialize(const HWND window, const size_t width, const size_t
 
     set_default_states();
 
+    // Configure limits of the surface cache.
+
+    surface_cache.set_limits(get_surface_cache_slot_limit(), get_surface_cache_byte_limit(), get_surface_cache_trim_interval());
+    resource_pool.set_limit(get_resource_pool_byte_limit());
+    prewarm_surface_cache();
+
     this->width = width;
     this->height = height;
     return true;
@@ -710,6 +1057,83 @@ void DX9HWLayer::detect_msaa(const size_t adapter, const D3DDEVTYPE device_type)
     }
 }
 
+/**
+ * @brief Selects texture formats based on device capabilities.
+ */
+void DX9HWLayer::detect_texture_formats(const size_t adapter, const D3DDEVTYPE device_type)
+{
+    for (int i = TEXTURE_STORAGE_NONE + 1; i < SIZE_OF_TEXTURE_STORAGE; ++i) {
+        const TextureStorage storage = static_cast<TextureStorage>(i);
+        const D3DFORMAT d3d_format = get_storage_format(storage);
+        const bool texture = SUCCEEDED(direct3d->CheckDeviceFormat(adapter, device_type, BACKBUFFER_FORMAT, 0, D3DRTYPE_TEXTURE, d3d_format));
+        const bool autogen_mipmap = (direct3d->CheckDeviceFormat(adapter, device_type, BACKBUFFER_FORMAT, D3DUSAGE_AUTOGENMIPMAP, D3DRTYPE_TEXTURE, d3d_format) == D3D_OK);
+        texture_formats.set_capabilities(storage, texture, autogen_mipmap);
+    }
+
+    const TextureStorage old_storage_565 = texture_formats.get_storage(TEXTURE_SOURCE_565);
+    const TextureStorage old_storage_4444 = texture_formats.get_storage(TEXTURE_SOURCE_4444);
+
+    const bool native_allowed = ! is_option_enabled("D3DEMU_NO_NATIVE_16BIT");
+    texture_formats.set_native_allowed(native_allowed);
+    texture_formats.resolve();
+
+    // Report the choice. Reinitialization with the same device does not change it
+    // so it is reported only once.
+
+    const TextureStorage storage_565 = texture_formats.get_storage(TEXTURE_SOURCE_565);
+    const TextureStorage storage_4444 = texture_formats.get_storage(TEXTURE_SOURCE_4444);
+    if ((storage_565 == old_storage_565) && (storage_4444 == old_storage_4444)) {
+        return;
+    }
+    logKA(MSG_INFORM, 0, "HW:565 textures stored as %s%s", TextureFormatTable::get_storage_name(storage_565), texture_formats.has_autogen_mipmap(TEXTURE_SOURCE_565) ? " with mipmaps" : "");
+    logKA(MSG_INFORM, 0, "HW:4444 textures stored as %s%s", TextureFormatTable::get_storage_name(storage_4444), texture_formats.has_autogen_mipmap(TEXTURE_SOURCE_4444) ? " with mipmaps" : "");
+    if (native_allowed) {
+        logKA(MSG_INFORM, 0, "HW:Native 16 bit textures allowed - use D3DEMU_NO_NATIVE_16BIT to disable them");
+    }
+    else {
+        logKA(MSG_INFORM, 0, "HW:Native 16 bit textures disabled");
+    }
+}
+
+/**
+ * @brief Configures the background texture compression.
+ */
+void DX9HWLayer::detect_texture_compression(const size_t adapter, const D3DDEVTYPE device_type)
+{
+    const size_t quality = get_texture_compression_quality();
+    compression_enabled = false;
+    if (quality == 0) {
+        return;
+    }
+
+    compression_quality = static_cast<DXTQuality>(quality - 1);
+    compression_min_size = get_texture_compression_min_size();
+    dxt1_supported = SUCCEEDED(direct3d->CheckDeviceFormat(adapter, device_type, BACKBUFFER_FORMAT, 0, D3DRTYPE_TEXTURE, D3DFMT_DXT1));
+    dxt3_supported = SUCCEEDED(direct3d->CheckDeviceFormat(adapter, device_type, BACKBUFFER_FORMAT, 0, D3DRTYPE_TEXTURE, D3DFMT_DXT3));
+    if ((! dxt1_supported) && (! dxt3_supported)) {
+        logKA(MSG_ERROR, 0, "HW:Texture compression not supported by the device");
+        return;
+    }
+
+    // The compressed textures are cached in directory next to the log.
+
+    if (is_option_enabled("D3DEMU_NO_TEXTURE_COMPRESSION_CACHE")) {
+        compressed_texture_cache.set_directory("");
+        logKA(MSG_INFORM, 0, "HW:Disk cache of compressed textures disabled");
+    }
+    else if (CreateDirectoryA(COMPRESSED_TEXTURE_CACHE_DIRECTORY, NULL) || (GetLastError() == ERROR_ALREADY_EXISTS)) {
+        compressed_texture_cache.set_directory(COMPRESSED_TEXTURE_CACHE_DIRECTORY);
+        logKA(MSG_INFORM, 0, "HW:Compressed textures cached in %s - use D3DEMU_NO_TEXTURE_COMPRESSION_CACHE to disable it", COMPRESSED_TEXTURE_CACHE_DIRECTORY);
+    }
+    else {
+        compressed_texture_cache.set_directory("");
+        logKA(MSG_ERROR, 0, "HW:Unable to create directory %s for compressed textures", COMPRESSED_TEXTURE_CACHE_DIRECTORY);
+    }
+
+    compression_enabled = true;
+    logKA(MSG_INFORM, 0, "HW:Compressing textures of at least %ux%u - use D3DEMU_TEXTURE_COMPRESSION_MIN_SIZE to change it", compression_min_size, compression_min_size);
+}
+
 void DX9HWLayer::deinitialize(void)
 {
     if (direct3d == NULL) {
@@ -718,17 +1142,68 @@ void DX9HWLayer::deinitialize(void)
 
     logKA(MSG_INFORM, 0, "HW:Deinitializing DX9 emu");
 
-    // Destroy surface cache. We do not care to keep the list
-    // consistent after each operation.
+    // Stop preparation of textures of the old device.
 
-    for (size_t i = 0; i < SURFACE_CACHE_SLOTS; ++i) {
-        while (cache[i].head) {
-            HWSurfaceInfo *const head = cache[i].head;
-            cache[i].head = head->next_in_cache;
-            delete head;
-        }
-        cache[i].tail = NULL;
+    while (! preparing_surfaces.empty()) {
+        discard_texture_job(*preparing_surfaces.back());
+    }
+    job_queue.stop();
+    if (async_upload_enabled) {
+        logKA(MSG_INFORM, 0, "HW:Background texture conversion: %u updates prepared, %u waited for, %u discarded", prepared_update_count, prepared_update_wait_count, prepared_update_discard_count);
+    }
+    if (compression_enabled || cpu_mipmaps_enabled) {
+        logKA(MSG_INFORM, 0, "HW:Texture preparation: %u textures compressed, %u loaded from disk cache, %u mipmapped, %u discarded", compressed_count, compressed_from_cache_count, cpu_mipmapped_count, texture_job_discard_count);
+    }
+
+    // Destroy the texture atlas.
+
+    if (atlas_enabled) {
+        logKA(MSG_INFORM, 0, "HW:Texture atlas: %u textures added, %u excluded for wrapping, %u placements used for drawing", atlased_count, atlas_excluded_count, atlas_placement_count);
     }
+    release_atlas_pages();
+
+    // Remember order of textures for the next run.
+
+    if (texture_prefetch_enabled) {
+        logKA(MSG_INFORM, 0, "HW:Texture prefetch: %u textures prefetched, %u first uses, %u stalled for %.2f ms", prefetched_count, first_use_count, first_use_stall_count, ticks_to_ms(first_use_stall_ticks));
+        save_texture_history();
+    }
+    release_predicted_updates();
+
+    if (vertex_reuse_enabled && (vertex_reuse_frame_count > 0)) {
+        const double saved_kb = static_cast<double>(vertex_reuse_bytes) / 1024.0;
+        logKA(MSG_INFORM, 0, "HW:Vertex reuse: %u of %u blocks reused, %.1f KB saved per frame over %u frames", vertex_reuse_count, (vertex_reuse_count + vertex_upload_count), (saved_kb / vertex_reuse_frame_count), vertex_reuse_frame_count);
+    }
+    vertex_reuse_enabled = false;
+
+    // Destroy the static geometry.
+
+    if (static_geometry_enabled) {
+        const StaticGeometryCache::Statistics &statistics = static_geometry_cache.get_statistics();
+        logKA(MSG_INFORM, 0, "HW:Static geometry: %u draws from static buffers, %u streamed, %u promoted, %u evicted, %u KB used", statistics.resident, statistics.streamed, statistics.promotions, statistics.evictions, static_geometry_cache.get_total_bytes() / 1024);
+    }
+    StaticGeometryCache::EntryList static_geometry;
+    static_geometry_cache.clear(static_geometry);
+    delete_static_geometry(static_geometry);
+    static_geometry_enabled = false;
+
+    // Destroy surface cache.
+
+    log_cache_statistics();
+    save_surface_profile();
+
+    SurfaceCache::EntryList cached_surfaces;
+    surface_cache.clear(cached_surfaces);
+    delete_cached_surfaces(cached_surfaces);
+    std::fill(live_surface_counts.begin(), live_surface_counts.end(), 0);
+
+    // Destroy pooled resources. They can not survive destruction of the device.
+
+    log_pool_statistics();
+
+    ResourcePool::EntryList pooled_resources;
+    resource_pool.clear(pooled_resources);
+    release_pooled_resources(pooled_resources);
 
     // Free all shaders we have.
 
@@ -780,6 +1255,36 @@ HWSurfaceHandle DX9HWLayer::create_surface(const size_t width, const size_t heig
 {
     D3DEVENT(L"create_surface");
 
+    const LONGLONG start = get_time_ticks();
+    const HWSurfaceHandle result = create_surface_internal(width, height, format, memory, render_target, true);
+    const LONGLONG duration = get_time_ticks() - start;
+    surface_creation_ticks += duration;
+    surface_creation_count++;
+    frame_surface_ticks += duration;
+    frame_surface_count++;
+
+    HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(result);
+    if (info && memory) {
+        add_upload_time(*info, start);
+    }
+
+    // Update the surface profile.
+
+    if (info && (info->cache_slot != 0)) {
+        const size_t count = ++live_surface_counts[info->cache_slot];
+        surface_profile.record(format, width, height, count);
+    }
+    return result;
+}
+
+/**
+ * @brief Creates surface reusing pooled resources where possible.
+ *
+ * If use_cache is set, the surface is taken from the surface cache if there
+ * is one available.
+ */
+HWSurfaceHandle DX9HWLayer::create_surface_internal(const size_t width, const size_t height, const HWFormat format, const void * const memory, const bool render_target, const bool use_cache)
+{
     // Depth buffers are handled in special way.
 
     if (format == HWFORMAT_ZBUFFER) {
@@ -789,16 +1294,9 @@ HWSurfaceHandle DX9HWLayer::create_surface(const size_t width, const size_t heig
     // Try to find existing entry in the cache.
 
     const size_t cache_slot = ((! render_target) && is_surface_cache_enabled()) ? get_cache_slot(width, height, format) : 0;
-    if ((cache_slot != 0) && cache[cache_slot].head) {
-
-        // Remove entry from the cache.
-
-        HWSurfaceInfo * const info = cache[cache_slot].head;
-        cache[cache_slot].head = info->next_in_cache;
-        info->next_in_cache = NULL;
-        if (cache[cache_slot].head == NULL) {
-            cache[cache_slot].tail = NULL;
-        }
+    HWSurfaceInfo * const cached_info = ((cache_slot != 0) && use_cache) ? static_cast<HWSurfaceInfo *>(surface_cache.acquire(cache_slot)) : NULL;
+    if (cached_info) {
+        HWSurfaceInfo * const info = cached_info;
 
         // Check that we got surface with the expected parameters.
 
@@ -811,6 +1309,8 @@ HWSurfaceHandle DX9HWLayer::create_surface(const size_t width, const size_t heig
         // Note that render targets are not cached so there
         // is no need to manage synchronization.
 
+        info->upload_count = 0;
+        info->atlas_excluded = false;
         if (memory) {
             update_surface(info, memory);
         }
@@ -841,12 +1341,20 @@ HWSurfaceHandle DX9HWLayer::create_surface(const size_t width, const size_t heig
     else {
         usage = managed_usage;
         pool = managed_memory_pool;
-        d3d_format = (format == HWFORMAT_R5G6B5) ? D3DFMT_X8R8G8B8 : D3DFMT_A8R8G8B8;
         mipmap_count = 1;
 
+        // Use format selected during initialization.
+
+        const TextureSource source = get_texture_source(format);
+        d3d_format = get_storage_format(texture_formats.get_storage(source));
+        if (d3d_format == D3DFMT_UNKNOWN) {
+            logKA(MSG_ERROR, 0, "HW:No texture format available");
+            return NULL;
+        }
+
         // Enable mipmap autogen if available.
 
-        if (direct3d->CheckDeviceFormat(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, D3DFMT_X8R8G8B8, D3DUSAGE_AUTOGENMIPMAP, D3DRTYPE_TEXTURE, d3d_format) == D3D_OK) {
+        if (texture_formats.has_autogen_mipmap(source)) {
             usage |= D3DUSAGE_AUTOGENMIPMAP;
             mipmap_count = 0;
         }
@@ -855,7 +1363,7 @@ HWSurfaceHandle DX9HWLayer::create_surface(const size_t width, const size_t heig
     // Create the texture.
 
     CComPtr<IDirect3DTexture9> texture;
-    const HRESULT result = device->CreateTexture(width, height, mipmap_count, usage, d3d_format, pool, &texture, NULL);
+    const HRESULT result = create_pooled_texture(width, height, mipmap_count, usage, d3d_format, pool, false, texture);
     if (FAILED(result)) {
         logKA(MSG_ERROR, 0, "HW:Unable to create texture %08x", result);
         return NULL;
@@ -863,13 +1371,14 @@ HWSurfaceHandle DX9HWLayer::create_surface(const size_t width, const size_t heig
 
     // For render targets we need special texture for transfer.
 
+    size_t mono_width = width;
     size_t mono_height = height;
     CComPtr<IDirect3DTexture9> transfer_texture;
     CComPtr<IDirect3DTexture9> composition_texture;
     CComPtr<IDirect3DTexture9> read_16b_texture_rt;
     CComPtr<IDirect3DTexture9> read_16b_texture;
     if (render_target) {
-        const HRESULT result = device->CreateTexture(width, height, 1, 0, d3d_format, D3DPOOL_SYSTEMMEM, &transfer_texture, NULL);
+        const HRESULT result = create_pooled_texture(width, height, 1, 0, d3d_format, D3DPOOL_SYSTEMMEM, false, transfer_texture);
         if (FAILED(result)) {
             logKA(MSG_ERROR, 0, "HW:Unable to create transfer texture %08x", result);
             return NULL;
@@ -879,24 +1388,33 @@ HWSurfaceHandle DX9HWLayer::create_surface(const size_t width, const size_t heig
         // stereo and which are mono. If our composition texture is detected as stereo one,
         // the hud is missing in the left eye. For this reason we make it a square one
         // so the driver will not stereo-ize it.
+        //
+        // Only part of the composition texture is used so larger pooled texture
+        // can be used instead, unless we need to keep the square shape.
 
         mono_height = (vision_3d && (height < width)) ? width : height;
-        const HRESULT comp_result = device->CreateTexture(width, mono_height, 1, managed_usage, D3DFMT_R5G6B5, managed_memory_pool, &composition_texture, NULL);
+        const HRESULT comp_result = create_pooled_texture(width, mono_height, 1, managed_usage, D3DFMT_R5G6B5, managed_memory_pool, ! vision_3d, composition_texture);
         if (FAILED(comp_result)) {
             logKA(MSG_ERROR, 0, "HW:Unable to create composition texture %08x", comp_result);
             return NULL;
         }
 
+        D3DSURFACE_DESC composition_desc;
+        if (SUCCEEDED(log_error(composition_texture->GetLevelDesc(0, &composition_desc)))) {
+            mono_width = composition_desc.Width;
+            mono_height = composition_desc.Height;
+        }
+
         // Optional 32->16 conversion textures.
 
         if (is_hw_color_conversion_enabled()) {
-            const HRESULT t16_result = device->CreateTexture(width, height, 1, D3DUSAGE_RENDERTARGET, D3DFMT_R5G6B5, D3DPOOL_DEFAULT, &read_16b_texture_rt, NULL);
+            const HRESULT t16_result = create_pooled_texture(width, height, 1, D3DUSAGE_RENDERTARGET, D3DFMT_R5G6B5, D3DPOOL_DEFAULT, false, read_16b_texture_rt);
             if (FAILED(t16_result)) {
                 logKA(MSG_ERROR, 0, "HW:Unable to create 16 bit conversion render target texture %08x", t16_result);
                 return NULL;
             }
 
-            const HRESULT mt16_result = device->CreateTexture(width, height, 1, 0, D3DFMT_R5G6B5, D3DPOOL_SYSTEMMEM, &read_16b_texture, NULL);
+            const HRESULT mt16_result = create_pooled_texture(width, height, 1, 0, D3DFMT_R5G6B5, D3DPOOL_SYSTEMMEM, false, read_16b_texture);
             if (FAILED(mt16_result)) {
                 logKA(MSG_ERROR, 0, "HW:Unable to create 16 bit conversion memory texture %08x", mt16_result);
                 return NULL;
@@ -911,7 +1429,7 @@ HWSurfaceHandle DX9HWLayer::create_surface(const size_t width, const size_t heig
 
     CComPtr<IDirect3DSurface9> msaa_render_target;
     if (render_target && (multisample_type != D3DMULTISAMPLE_NONE)) {
-        const HRESULT result = device->CreateRenderTarget(width, height, d3d_format, multisample_type, multisample_quality, FALSE, &msaa_render_target, NULL);
+        const HRESULT result = create_pooled_surface(width, height, D3DUSAGE_RENDERTARGET, d3d_format, msaa_render_target);
         if (FAILED(result)) {
             logKA(MSG_ERROR, 0, "HW:Unable to create MSAA render target surface %08x", result);
             return NULL;
@@ -923,6 +1441,7 @@ HWSurfaceHandle DX9HWLayer::create_surface(const size_t width, const size_t heig
     HWSurfaceInfo * const info = new HWSurfaceInfo();
     info->width = width;
     info->height = height;
+    info->mono_width = mono_width;
     info->mono_height = mono_height;
     info->stride = width * 2;
     info->format = format;
@@ -994,7 +1513,7 @@ HWSurfaceHandle DX9HWLayer::create_depth_surface(const size_t width, const size_
     }
 
     CComPtr<IDirect3DSurface9> surface;
-    const HRESULT result = device->CreateDepthStencilSurface(width, height, d3d_format, multisample_type, multisample_quality, FALSE, &surface, NULL);
+    const HRESULT result = create_pooled_surface(width, height, D3DUSAGE_DEPTHSTENCIL, d3d_format, surface);
     if (FAILED(result)) {
         logKA(MSG_ERROR, 0, "HW:Unable to create depth surface %08x", result);
         return NULL;
@@ -1026,8 +1545,27 @@ void DX9HWLayer::destroy_surface(const HWSurfaceHandle surface)
     assert(surface);
     D3DEVENT(L"destroy_surface");
 
+    const LONGLONG start = get_time_ticks();
+    destroy_surface_internal(surface);
+    frame_surface_ticks += get_time_ticks() - start;
+    frame_surface_count++;
+}
+
+void DX9HWLayer::destroy_surface_internal(const HWSurfaceHandle surface)
+{
+    // Shared surface is destroyed by its last owner.
+
+    HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(surface);
+    if (info->share_count > 0) {
+        info->share_count--;
+        return;
+    }
+
     // Unbind the surface we are going to destroy.
 
+    if (state.texture_info == surface) {
+        set_texture_surface_internal(NULL);
+    }
     if (state.color_info == surface) {
         logKA(MSG_ERROR, 0, "HW:destroying surface 0x08x which is bound as color render target", surface);
         set_render_target(NULL, state.depth_info);
@@ -1037,185 +1575,333 @@ void DX9HWLayer::destroy_surface(const HWSurfaceHandle surface)
         set_render_target(state.color_info, NULL);
     }
 
-    // Insert the surface to the cache if it is cacheable. We insert it at the end
-    // so it is reused last as the internal HW copy might be still in use.
+    // Insert the surface to the cache if it is cacheable. The cache
+    // might evict older surfaces to stay within its limits.
 
-    HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(surface);
+    discard_texture_job(*info);
+    remove_from_atlas(*info);
+    info->first_use_pending = false;
     if (info->cache_slot != 0) {
+        assert(live_surface_counts[info->cache_slot] > 0);
+        live_surface_counts[info->cache_slot]--;
 
-        // TODO: Maybe limit size of the cache. This should be not necessary given the difference between
-        // size of memory of current GPUs, the KA/SFA requirements and the low variability of KA textures.
-
-        if (cache[info->cache_slot].tail) {
-            cache[info->cache_slot].tail->next_in_cache = info;
-        }
-        else {
-            cache[info->cache_slot].head = info;
-        }
-        cache[info->cache_slot].tail = info;
+        SurfaceCache::EntryList evicted;
+        surface_cache.release(info->cache_slot, info, get_cached_surface_memory_size(info->width, info->height, get_format_texel_size(info->dx_format)), evicted);
+        delete_cached_surfaces(evicted);
     }
     else {
-        delete info;
+        recycle_surface_resources(info);
     }
 }
 
 /**
- * @brief Reads content of specified 8888 memory into destination 565.
+ * @brief Creates texture, reusing pooled one if available.
+ *
+ * If allow_larger is set, the texture might be bigger than requested.
  */
-void read8888_as_565(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height)
+HRESULT DX9HWLayer::create_pooled_texture(const size_t width, const size_t height, const size_t levels, const DWORD usage, const D3DFORMAT format, const D3DPOOL pool, const bool allow_larger, CComPtr<IDirect3DTexture9> &texture)
 {
-    unsigned char * line_dest = static_cast<unsigned char *>(destination);
-    const unsigned char * line_src = static_cast<const unsigned char *>(source);
-
-    for (size_t y = 0; y < height; ++y) {
-
-        unsigned short * dest = reinterpret_cast<unsigned short *>(line_dest);
-        const unsigned int * src = reinterpret_cast<const unsigned int *>(line_src);
-
-        // Line conversion.
-
-        for (size_t x = 0; x < width; ++x, ++src, ++dest) {
-            const unsigned int color = *src;
+    assert(! texture);
 
-            const unsigned int masked_red_5 = ((color >> (5 + 3)) & 0x0000F800);
-            const unsigned int masked_green_6 = ((color >> (3 + 2)) & 0x000007E0);
-            const unsigned int masked_blue_5 = ((color >> (0 + 3)) & 0x0000001F);
+    const ResourceKey key = get_texture_key(width, height, levels, usage, format, pool);
+    IUnknown * const pooled = static_cast<IUnknown *>(resource_pool.acquire(key, allow_larger, NULL));
+    if (pooled) {
+        texture.Attach(static_cast<IDirect3DTexture9 *>(pooled));
+        return D3D_OK;
+    }
 
-            *dest = static_cast<unsigned short>(masked_red_5 | masked_green_6 | masked_blue_5);
-        }
+    const LONGLONG start = get_time_ticks();
+    const HRESULT result = device->CreateTexture(width, height, levels, usage, format, pool, &texture, NULL);
+    driver_allocation_ticks += get_time_ticks() - start;
+    driver_allocation_count++;
+    return result;
+}
 
-        // Skip unused bytes in the surfaces.
+/**
+ * @brief Creates standalone render target or depth surface using current multisampling
+ * settings, reusing pooled one if available.
+ */
+HRESULT DX9HWLayer::create_pooled_surface(const size_t width, const size_t height, const DWORD usage, const D3DFORMAT format, CComPtr<IDirect3DSurface9> &surface)
+{
+    assert(! surface);
+    assert((usage == D3DUSAGE_RENDERTARGET) || (usage == D3DUSAGE_DEPTHSTENCIL));
 
-        line_dest += pitch_dest;
-        line_src += pitch_src;
+    const ResourceKey key = get_surface_key(width, height, usage, format, multisample_type, multisample_quality);
+    IUnknown * const pooled = static_cast<IUnknown *>(resource_pool.acquire(key, false, NULL));
+    if (pooled) {
+        surface.Attach(static_cast<IDirect3DSurface9 *>(pooled));
+        return D3D_OK;
     }
+
+    const LONGLONG start = get_time_ticks();
+    const HRESULT result = (usage == D3DUSAGE_RENDERTARGET) ?
+        device->CreateRenderTarget(width, height, format, multisample_type, multisample_quality, FALSE, &surface, NULL) :
+        device->CreateDepthStencilSurface(width, height, format, multisample_type, multisample_quality, FALSE, &surface, NULL)
+    ;
+    driver_allocation_ticks += get_time_ticks() - start;
+    driver_allocation_count++;
+    return result;
 }
 
 /**
- * @brief Reads content of specified 8888 memory into destination 4444.
+ * @brief Moves the texture to the resource pool.
  */
-void read8888_as_4444(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height)
+void DX9HWLayer::recycle_texture(CComPtr<IDirect3DTexture9> &texture)
 {
-    unsigned char * line_dest = static_cast<unsigned char *>(destination);
-    const unsigned char * line_src = static_cast<const unsigned char *>(source);
+    if (! texture) {
+        return;
+    }
 
-    for (size_t y = 0; y < height; ++y) {
+    D3DSURFACE_DESC desc;
+    if (FAILED(log_error(texture->GetLevelDesc(0, &desc)))) {
+        texture = NULL;
+        return;
+    }
 
-        unsigned short * dest = reinterpret_cast<unsigned short *>(line_dest);
-        const unsigned int * src = reinterpret_cast<const unsigned int *>(line_src);
+    // Textures with generated mipmaps were created with zero level count.
 
-        // Line conversion.
+    const size_t levels = (desc.Usage & D3DUSAGE_AUTOGENMIPMAP) ? 0 : texture->GetLevelCount();
+    const ResourceKey key = get_texture_key(desc.Width, desc.Height, levels, desc.Usage, desc.Format, desc.Pool);
 
-        for (size_t x = 0; x < width; ++x, ++src, ++dest) {
-            const unsigned int color = *src;
+    IUnknown * const object = texture.Detach();
+    ResourcePool::EntryList evicted;
+    resource_pool.release(key, object, get_resource_memory_size(key), evicted);
+    release_pooled_resources(evicted);
+}
 
-            const unsigned int masked_red_4 = ((color >> (8 + 4)) & 0x00000F00);
-            const unsigned int masked_green_4 = ((color >> (4 + 4)) & 0x000000F0);
-            const unsigned int masked_blue_4 = ((color >> (0 + 4)) & 0x0000000F);
-            const unsigned int masked_alpha_4 = ((color >> (12 + 4)) & 0x0000F000);
+/**
+ * @brief Moves the standalone surface to the resource pool.
+ */
+void DX9HWLayer::recycle_surface(CComPtr<IDirect3DSurface9> &surface)
+{
+    if (! surface) {
+        return;
+    }
 
-            *dest = static_cast<unsigned short>(masked_red_4 | masked_green_4 | masked_blue_4 | masked_alpha_4);
-        }
+    D3DSURFACE_DESC desc;
+    if (FAILED(log_error(surface->GetDesc(&desc)))) {
+        surface = NULL;
+        return;
+    }
 
-        // Skip unused bytes in the surfaces.
+    const DWORD usage = desc.Usage & (D3DUSAGE_RENDERTARGET | D3DUSAGE_DEPTHSTENCIL);
+    const ResourceKey key = get_surface_key(desc.Width, desc.Height, usage, desc.Format, desc.MultiSampleType, desc.MultiSampleQuality);
 
-        line_dest += pitch_dest;
-        line_src += pitch_src;
-    }
+    IUnknown * const object = surface.Detach();
+    ResourcePool::EntryList evicted;
+    resource_pool.release(key, object, get_resource_memory_size(key), evicted);
+    release_pooled_resources(evicted);
 }
 
 /**
- * @brief Reads opaque 565 texture as 8888 texture.
+ * @brief Moves all D3D resources of the surface to the resource pool and
+ * deletes the surface.
  */
-void read565_as_8888(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height)
+void DX9HWLayer::recycle_surface_resources(HWSurfaceInfo * const info)
 {
-    unsigned char * line_dest = static_cast<unsigned char *>(destination);
-    const unsigned char * line_src = static_cast<const unsigned char *>(source);
-
-    for (size_t y = 0; y < height; ++y) {
-
-        unsigned int * dest = reinterpret_cast<unsigned int *>(line_dest);
-        const unsigned short * src = reinterpret_cast<const unsigned short *>(line_src);
+    assert(info);
 
-        for (size_t x = 0; x < width; ++x, ++src, ++dest) {
-            const unsigned short color = *src;
+    // Release references to individual levels so the pool is the only owner.
 
-            // Move the value to the right place.
-
-            const unsigned int masked_red = ((color & 0x0000F800) << (5 + 3));
-            const unsigned int masked_green = ((color & 0x000007E0) << (3 + 2));
-            const unsigned int masked_blue = ((color & 0x0000001F) << (0 + 3));
+    info->transfer_surface_0 = NULL;
+    info->read_16b_rt_surface_0 = NULL;
+    info->read_16b_surface_0 = NULL;
+    if (info->texture) {
+        info->surface_0 = NULL;
+    }
+    else {
 
-            // Ensure proper content of low end bits so the result is not biased towards zero.
+        // Depth buffers use standalone surface.
 
-            const unsigned int replicated_red = (masked_red | (masked_red >> 5)) & 0x00ff0000;
-            const unsigned int replicated_green = (masked_green | (masked_green >> 6)) & 0x0000ff00;
-            const unsigned int replicated_blue = (masked_blue | (masked_blue >> 5)) & 0x000000ff;
+        recycle_surface(info->surface_0);
+    }
 
-            *dest = 0xff000000 | replicated_red | replicated_green | replicated_blue;
-        }
+    if (info->transfer_texture == info->texture) {
+        info->transfer_texture = NULL;
+    }
 
-        // Skip to next line.
+    recycle_texture(info->texture);
+    recycle_texture(info->transfer_texture);
+    recycle_texture(info->read_16b_texture_rt);
+    recycle_texture(info->read_16b_texture);
+    recycle_texture(info->composition_texture);
+    recycle_surface(info->msaa_render_target);
+    delete info;
+}
 
-        line_dest += pitch_dest;
-        line_src += pitch_src;
+/**
+ * @brief Releases resources removed from the resource pool.
+ */
+void DX9HWLayer::release_pooled_resources(const ResourcePool::EntryList &resources)
+{
+    for (size_t i = 0; i < resources.size(); ++i) {
+        static_cast<IUnknown *>(resources[i])->Release();
     }
 }
 
 /**
- * @brief Reads 4444 texture as 8888 texture.
+ * @brief Destroys surfaces removed from the surface cache.
  */
-void read4444_as_8888(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height)
+void DX9HWLayer::delete_cached_surfaces(const SurfaceCache::EntryList &surfaces)
 {
-    unsigned char * line_dest = static_cast<unsigned char *>(destination);
-    const unsigned char * line_src = static_cast<const unsigned char *>(source);
-
-    for (size_t y = 0; y < height; ++y) {
-
-        unsigned int * dest = reinterpret_cast<unsigned int *>(line_dest);
-        const unsigned short * src = reinterpret_cast<const unsigned short *>(line_src);
+    for (size_t i = 0; i < surfaces.size(); ++i) {
+        HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(surfaces[i]);
+        logKA(MSG_VERBOSE, 0, "HW:evicting cached surface %08x", info);
+        delete info;
+    }
+}
+
+/**
+ * @brief Reports usage of the surface cache.
+ */
+void DX9HWLayer::log_cache_statistics(void)
+{
+    logKA(MSG_INFORM, 0, "HW:Surface cache statistics: %u KB used, %u KB peak", surface_cache.get_total_bytes() / 1024, surface_cache.get_peak_bytes() / 1024);
+
+    size_t total_hits = 0;
+    size_t total_prewarm_hits = 0;
+    size_t total_misses = 0;
+    size_t total_evictions = 0;
+    for (size_t i = 1; i < surface_cache.get_slot_count(); ++i) {
+        const SurfaceCache::SlotStatistics &statistics = surface_cache.get_statistics(i);
+        total_hits += statistics.hits;
+        total_prewarm_hits += statistics.prewarm_hits;
+        total_misses += statistics.misses;
+        total_evictions += statistics.evictions;
+        if ((statistics.hits == 0) && (statistics.misses == 0)) {
+            continue;
+        }
+
+        size_t slot_width;
+        size_t slot_height;
+        HWFormat slot_format;
+        decode_cache_slot(i, slot_width, slot_height, slot_format);
+        logKA(MSG_INFORM, 0, "HW:  %ux%u %s: %u hits, %u misses, %u evictions, %u cached (%u peak)", slot_width, slot_height, (slot_format == HWFORMAT_R5G6B5) ? "565" : "4444", statistics.hits, statistics.misses, statistics.evictions, statistics.count, statistics.peak_count);
+    }
+
+    logKA(MSG_INFORM, 0, "HW:Surface cache total: %u hits (%u prewarmed), %u misses, %u evictions", total_hits, total_prewarm_hits, total_misses, total_evictions);
+}
+
+/**
+ * @brief Fills the surface cache with surfaces based on the surface profile
+ * so the surfaces do not need to be created during mission load.
+ *
+ * The profile recorded during previous runs is loaded during first call.
+ */
+void DX9HWLayer::prewarm_surface_cache(void)
+{
+    if (! is_surface_cache_enabled()) {
+        return;
+    }
 
-        for (size_t x = 0; x < width; ++x, ++src, ++dest) {
-            const unsigned short color = *src;
+    if (! surface_profile_loaded) {
+        surface_profile_loaded = true;
 
-            // Move the value to the right place.
+        SurfaceProfile stored_profile;
+        if (stored_profile.load(SURFACE_PROFILE_FILE_NAME)) {
+            stored_profile.validate(HWFORMAT_R5G6B5, HWFORMAT_R4G4B4A4, MAX_CACHED_SURFACE_SIZE, 0);
+            surface_profile.merge(stored_profile);
+            logKA(MSG_INFORM, 0, "HW:Loaded surface profile %s with %u surfaces", SURFACE_PROFILE_FILE_NAME, stored_profile.get_total_count());
+        }
+        else {
+            logKA(MSG_INFORM, 0, "HW:Surface profile %s not found or not valid", SURFACE_PROFILE_FILE_NAME);
+        }
+    }
 
-            const unsigned int masked_red = ((color & 0x00000F00) << (8 + 4));
-            const unsigned int masked_green = ((color & 0x000000F0) << (4 + 4));
-            const unsigned int masked_blue = ((color & 0x0000000F) << (0 + 4));
-            const unsigned int masked_alpha = ((color & 0x0000F000) << (12 + 4));
+    if (is_option_enabled("D3DEMU_NO_SURFACE_PREWARM")) {
+        logKA(MSG_INFORM, 0, "HW:Surface cache prewarm disabled");
+        return;
+    }
 
-            // Ensure proper content of low end bits so the result is not biased towards zero.
+    D3DEVENT(L"prewarm_surface_cache");
+    const LONGLONG start = get_time_ticks();
+    size_t created = 0;
 
-            const unsigned int replicated_red = (masked_red | (masked_red >> 4));
-            const unsigned int replicated_green = (masked_green | (masked_green >> 4));
-            const unsigned int replicated_blue = (masked_blue | (masked_blue >> 4));
-            const unsigned int replicated_alpha = (masked_alpha | (masked_alpha >> 4));
+    // Create the surfaces directly into the cache while the cache limits allow it.
 
-            *dest = replicated_alpha | replicated_red | replicated_green | replicated_blue;
+    const SurfaceProfile::EntryList &entries = surface_profile.get_entries();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const SurfaceProfile::Entry &entry = entries[i];
+        const HWFormat format = static_cast<HWFormat>(entry.format);
+        const size_t cache_slot = get_cache_slot(entry.width, entry.height, format);
+        if (cache_slot == 0) {
+            continue;
         }
 
-        // Skip to next line.
+        const size_t texel_size = TextureFormatTable::get_texel_size(texture_formats.get_storage(get_texture_source(format)));
+        const size_t bytes = get_cached_surface_memory_size(entry.width, entry.height, texel_size);
+        for (size_t count = surface_cache.get_statistics(cache_slot).count; count < entry.count; ++count) {
+            if (! surface_cache.can_insert(cache_slot, bytes)) {
+                break;
+            }
 
-        line_dest += pitch_dest;
-        line_src += pitch_src;
+            HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(create_surface_internal(entry.width, entry.height, format, NULL, false, false));
+            if (info == NULL) {
+                break;
+            }
+            assert(info->cache_slot == cache_slot);
+
+            SurfaceCache::EntryList evicted;
+            surface_cache.prewarm(cache_slot, info, bytes, evicted);
+            delete_cached_surfaces(evicted);
+            created++;
+        }
     }
+
+    logKA(MSG_INFORM, 0, "HW:Prewarmed surface cache with %u surfaces in %.2f ms - use D3DEMU_NO_SURFACE_PREWARM to disable it", created, ticks_to_ms(get_time_ticks() - start));
 }
 
 /**
- * @brief Copies one surface to another without format conversion.
+ * @brief Stores the surface profile for use by next run.
  */
-void read_same_format(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height, const size_t texel_size)
+void DX9HWLayer::save_surface_profile(void)
 {
-        char * dest = static_cast<char *>(destination);
-        const char * src = static_cast<const char *>(source);
-        const size_t bytes_per_line = width * texel_size;
+    if ((! is_surface_cache_enabled()) || surface_profile.get_entries().empty()) {
+        return;
+    }
+
+    surface_profile.validate(HWFORMAT_R5G6B5, HWFORMAT_R4G4B4A4, MAX_CACHED_SURFACE_SIZE, 0);
+    if (surface_profile.save(SURFACE_PROFILE_FILE_NAME)) {
+        logKA(MSG_INFORM, 0, "HW:Saved surface profile %s with %u surfaces", SURFACE_PROFILE_FILE_NAME, surface_profile.get_total_count());
+    }
+    else {
+        logKA(MSG_ERROR, 0, "HW:Unable to save surface profile %s", SURFACE_PROFILE_FILE_NAME);
+    }
+}
 
-        for (size_t i = 0; i < height; ++i) {
-            memcpy(dest, src, bytes_per_line);
-            dest += pitch_dest;
-            src += pitch_src;
+/**
+ * @brief Reports usage of the resource pool and time spent creating surfaces.
+ *
+ * All times are measured. The benefit of the pool is visible by comparing
+ * the transition times with a run using smaller pool limit.
+ */
+void DX9HWLayer::log_pool_statistics(void)
+{
+    const ResourcePool::Statistics &statistics = resource_pool.get_statistics();
+    logKA(MSG_INFORM, 0, "HW:Resource pool statistics: %u hits (%u larger), %u misses, %u evictions, %u KB used, %u KB peak", statistics.hits, statistics.larger_hits, statistics.misses, statistics.evictions, statistics.bytes / 1024, statistics.peak_bytes / 1024);
+
+    logKA(MSG_INFORM, 0, "HW:Surface creation: %u surfaces in %.2f ms, %u driver allocations in %.2f ms", surface_creation_count, ticks_to_ms(surface_creation_ticks), driver_allocation_count, ticks_to_ms(driver_allocation_ticks));
+
+    const double average_transition_ms = (transition_count != 0) ? (ticks_to_ms(transition_ticks) / transition_count) : 0.0;
+    logKA(MSG_INFORM, 0, "HW:Surface transitions: %u with at least %u surfaces created or destroyed, %.2f ms average, %.2f ms longest", transition_count, TRANSITION_SURFACE_COUNT, average_transition_ms, ticks_to_ms(longest_transition_ticks));
+    logKA(MSG_INFORM, 0, "HW:The resource pool is emptied with the device so switches of the display mode do not benefit from it");
+}
+
+/**
+ * @brief Measures time spent by the surface changes since the previous
+ * presentation if there were enough of them to be a transition.
+ */
+void DX9HWLayer::record_surface_transition(void)
+{
+    if (frame_surface_count >= TRANSITION_SURFACE_COUNT) {
+        transition_count++;
+        transition_ticks += frame_surface_ticks;
+        if (frame_surface_ticks > longest_transition_ticks) {
+            longest_transition_ticks = frame_surface_ticks;
         }
+    }
+    frame_surface_ticks = 0;
+    frame_surface_count = 0;
 }
 
 void DX9HWLayer::update_surface(const HWSurfaceHandle surface, const void * const memory)
@@ -1240,46 +1926,754 @@ void DX9HWLayer::update_surface(const HWSurfaceHandle surface, const void * cons
         return;
     }
 
+    const LONGLONG start = get_time_ticks();
+    update_surface_internal(*info, memory);
+    add_upload_time(*info, start);
+}
+
+/**
+ * @brief Uploads content of non render target surface.
+ */
+void DX9HWLayer::update_surface_internal(HWSurfaceInfo &info, const void * const memory)
+{
     // Lock the surface.
 
     D3DLOCKED_RECT rect;
-    if (FAILED(log_error(info->transfer_texture->LockRect(0, &rect, NULL, 0)))) {
+    if (FAILED(log_error(info.transfer_texture->LockRect(0, &rect, NULL, 0)))) {
         return;
     }
 
     // Copy all lines.
 
-    if (info->dx_format == D3DFMT_X8R8G8B8) {
-        assert(info->format == HWFORMAT_R5G6B5);
-        read565_as_8888(rect.pBits, rect.Pitch, memory, info->stride, info->width, info->height);
+    if (info.dx_format == D3DFMT_X8R8G8B8) {
+        assert(info.format == HWFORMAT_R5G6B5);
+        read565_as_8888(rect.pBits, rect.Pitch, memory, info.stride, info.width, info.height);
     }
-    else if (info->dx_format == D3DFMT_A8R8G8B8) {
-        assert(info->format == HWFORMAT_R4G4B4A4);
-        read4444_as_8888(rect.pBits, rect.Pitch, memory, info->stride, info->width, info->height);
+    else if (info.dx_format == D3DFMT_A8R8G8B8) {
+        assert(info.format == HWFORMAT_R4G4B4A4);
+        read4444_as_8888(rect.pBits, rect.Pitch, memory, info.stride, info.width, info.height);
     }
     else {
         assert(
-            ((info->format == HWFORMAT_R5G6B5) && (info->dx_format == D3DFMT_R5G6B5)) ||
-            ((info->format == HWFORMAT_R4G4B4A4) && (info->dx_format == D3DFMT_A4R4G4B4))
+            ((info.format == HWFORMAT_R5G6B5) && (info.dx_format == D3DFMT_R5G6B5)) ||
+            ((info.format == HWFORMAT_R4G4B4A4) && (info.dx_format == D3DFMT_A4R4G4B4))
         );
-        read_same_format(rect.pBits, rect.Pitch, memory, info->stride, info->width, info->height, 2);
+        read_same_format(rect.pBits, rect.Pitch, memory, info.stride, info.width, info.height, 2);
     }
 
     // Done.
 
-    log_error(info->transfer_texture->UnlockRect(0));
+    log_error(info.transfer_texture->UnlockRect(0));
+    finish_texture_update(info, memory);
+}
+
+/**
+ * @brief Accounts time spent by upload of the texture which was not used yet.
+ */
+void DX9HWLayer::add_upload_time(HWSurfaceInfo &info, const LONGLONG start)
+{
+    if (info.first_use_pending) {
+        info.upload_ticks += get_time_ticks() - start;
+    }
+}
+
+/**
+ * @brief Adds owner to the surface.
+ */
+HWSurfaceHandle DX9HWLayer::share_surface(const HWSurfaceHandle surface)
+{
+    assert(surface);
+    HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(surface);
+    assert(! info->render_target);
+    info->share_count++;
+    logKA(MSG_VERBOSE, 0, "HW:share surface %08x", surface);
+    return surface;
+}
+
+bool DX9HWLayer::is_surface_shared(const HWSurfaceHandle surface)
+{
+    assert(surface);
+    return static_cast<HWSurfaceInfo *>(surface)->share_count > 0;
+}
+
+/**
+ * @brief Starts conversion of texture content on the background thread.
+ *
+ * Native 16 bit storage is not converted at all so it is uploaded directly,
+ * unless the content is predicted to be used by the texture history. Such
+ * update is kept for the prefetch which uploads it ahead of its first use.
+ */
+HWPreparedUpdate DX9HWLayer::prepare_update(const size_t width, const size_t height, const HWFormat format, const void * const memory)
+{
+    assert(memory);
+    if ((! async_upload_enabled) || (format == HWFORMAT_ZBUFFER)) {
+        return INVALID_PREPARED_UPDATE;
+    }
+
+    const TextureSource source = get_texture_source(format);
+    const TextureStorage storage = texture_formats.get_storage(source);
+    if (storage == TEXTURE_STORAGE_NONE) {
+        return INVALID_PREPARED_UPDATE;
+    }
+
+    size_t position = 0;
+    const bool predicted = texture_prefetch_enabled && (texture_history.get_predicted_count() > 0) &&
+        texture_history.get_predicted_position(hash_texture(memory, width, height, width * 2, format), position);
+    if (texture_formats.is_native(source) && (! predicted)) {
+        return INVALID_PREPARED_UPDATE;
+    }
+
+    TextureConversionJob * const job = new TextureConversionJob(source, storage, width, height, memory, width * 2);
+    job_queue.submit(job);
+    prepared_update_count++;
+    if (predicted) {
+        const PredictedUpdate predicted_update = {job, width, height, format, position, NULL};
+        predicted_updates.push_back(predicted_update);
+    }
+    logKA(MSG_VERBOSE, 0, "HW:prepared update %08x from %08x", job, memory);
+    return job;
+}
+
+/**
+ * @brief Uploads result of the background conversion.
+ */
+void DX9HWLayer::apply_prepared_update(const HWSurfaceHandle surface, const HWPreparedUpdate update)
+{
+    D3DEVENT(L"apply_prepared_update");
+    assert(update != INVALID_PREPARED_UPDATE);
+    logKA(MSG_VERBOSE, 0, "HW:apply prepared update %08x to surface %08x", update, surface);
+
+    const LONGLONG start = get_time_ticks();
+    TextureConversionJob * const job = static_cast<TextureConversionJob *>(update);
+    forget_predicted_update(job);
+
+    HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(surface);
+    if (info->render_target) {
+        job_queue.cancel(job);
+        update_surface(surface, job->get_source_memory());
+        delete job;
+        return;
+    }
+    upload_converted_texture(*info, *job);
+    delete job;
+    add_upload_time(*info, start);
+}
+
+/**
+ * @brief Creates texture with result of the background conversion.
+ *
+ * The surface uploaded by the prefetch is used if there is one.
+ */
+HWSurfaceHandle DX9HWLayer::create_surface_from_update(const size_t width, const size_t height, const HWFormat format, const HWPreparedUpdate update)
+{
+    D3DEVENT(L"create_surface_from_update");
+    assert(update != INVALID_PREPARED_UPDATE);
+
+    TextureConversionJob * const job = static_cast<TextureConversionJob *>(update);
+    for (size_t i = 0; i < predicted_updates.size(); ++i) {
+        HWSurfaceInfo * const prefetched = predicted_updates[i].surface;
+        if ((predicted_updates[i].job == job) && prefetched) {
+            predicted_updates.erase(predicted_updates.begin() + i);
+            delete job;
+            logKA(MSG_VERBOSE, 0, "HW:use prefetched surface %08x for update %08x", prefetched, update);
+            return prefetched;
+        }
+    }
+
+    const LONGLONG start = get_time_ticks();
+    HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(create_surface(width, height, format, NULL, false));
+    forget_predicted_update(job);
+    if (info == NULL) {
+        job_queue.cancel(job);
+        delete job;
+        return NULL;
+    }
+    upload_converted_texture(*info, *job);
+    delete job;
+    add_upload_time(*info, start);
+    return info;
+}
+
+/**
+ * @brief Copies result of the background conversion to the texture.
+ *
+ * Takes over the conversion if the thread did not get to it yet.
+ */
+void DX9HWLayer::upload_converted_texture(HWSurfaceInfo &info, TextureConversionJob &job)
+{
+    if (! job_queue.is_finished(&job)) {
+        prepared_update_wait_count++;
+    }
+    job_queue.wait(&job);
+
+    // The storage might have changed when the device was recreated.
+
+    if ((! job.is_converted()) || (info.dx_format != get_storage_format(job.get_storage()))) {
+        update_surface_internal(info, job.get_source_memory());
+        return;
+    }
+
+    D3DLOCKED_RECT rect;
+    if (SUCCEEDED(log_error(info.transfer_texture->LockRect(0, &rect, NULL, 0)))) {
+        read_same_format(rect.pBits, rect.Pitch, job.get_data(), job.get_pitch(), job.get_pitch(), info.height, 1);
+        log_error(info.transfer_texture->UnlockRect(0));
+        finish_texture_update(info, job.get_source_memory());
+    }
+}
+
+/**
+ * @brief Releases background conversion which is no longer needed.
+ */
+void DX9HWLayer::discard_prepared_update(const HWPreparedUpdate update)
+{
+    assert(update != INVALID_PREPARED_UPDATE);
+    TextureConversionJob * const job = static_cast<TextureConversionJob *>(update);
+    forget_predicted_update(job);
+    job_queue.cancel(job);
+    delete job;
+    prepared_update_discard_count++;
+}
 
+/**
+ * @brief Propagates new content of the transfer texture to the sampled ones.
+ */
+void DX9HWLayer::finish_texture_update(HWSurfaceInfo &info, const void * const memory)
+{
     // Do upload to the target texture if necessary.
 
-    if (info->transfer_texture != info->texture) {
-        log_error(device->UpdateTexture(info->transfer_texture, info->texture));
+    if (info.transfer_texture != info.texture) {
+        log_error(device->UpdateTexture(info.transfer_texture, info.texture));
     }
 
     // Ensure that the driver will regenerate the texture.
 
     else {
-        info->texture->SetAutoGenFilterType(D3DTEXF_POINT);
-        info->texture->SetAutoGenFilterType(D3DTEXF_LINEAR);
+        info.texture->SetAutoGenFilterType(D3DTEXF_POINT);
+        info.texture->SetAutoGenFilterType(D3DTEXF_LINEAR);
+    }
+
+    // Prepare textures which are uploaded only once. Prepared
+    // copy of relocked texture is no longer valid. Small ones are
+    // copied into the atlas too, the original is still used by the
+    // draws which wrap the texture.
+
+    info.upload_count++;
+    discard_texture_job(info);
+    remove_from_atlas(info);
+    if (info.upload_count == 1) {
+        record_texture_upload(info, memory);
+        add_to_atlas(info, memory);
+        schedule_texture_job(info, memory);
+    }
+}
+
+/**
+ * @brief Starts background preparation of the surface if it is suitable for it.
+ *
+ * The compression is preferred as it generates the mipmaps as well.
+ */
+void DX9HWLayer::schedule_texture_job(HWSurfaceInfo &info, const void * const memory)
+{
+    assert(info.texture_job == NULL);
+    if (info.render_target) {
+        return;
+    }
+
+    TextureLevelsJob *job = create_compression_job(info, memory);
+    if (job == NULL) {
+        job = create_mipmap_job(info, memory);
+    }
+    if (job == NULL) {
+        return;
+    }
+
+    info.texture_job = job;
+    preparing_surfaces.push_back(&info);
+    job_queue.submit(job);
+}
+
+/**
+ * @brief Creates compression job if the surface can be compressed.
+ */
+TextureLevelsJob *DX9HWLayer::create_compression_job(HWSurfaceInfo &info, const void * const memory)
+{
+    if (! compression_enabled) {
+        return NULL;
+    }
+
+    const TextureSource source = get_texture_source(info.format);
+    if (! ((source == TEXTURE_SOURCE_565) ? dxt1_supported : dxt3_supported)) {
+        return NULL;
+    }
+
+    // The top level of DXT textures must consist of whole blocks.
+
+    if ((info.width < compression_min_size) || (info.height < compression_min_size) || ((info.width % 4) != 0) || ((info.height % 4) != 0)) {
+        return NULL;
+    }
+
+    TextureCompressionJob * const job = new TextureCompressionJob(source, info.width, info.height, memory, info.stride, compression_quality, &compressed_texture_cache);
+    info.texture_job_format = (job->get_format() == DXT_FORMAT_DXT1) ? D3DFMT_DXT1 : D3DFMT_DXT3;
+    return job;
+}
+
+/**
+ * @brief Creates job generating the mipmaps if enabled.
+ */
+TextureLevelsJob *DX9HWLayer::create_mipmap_job(HWSurfaceInfo &info, const void * const memory)
+{
+    if ((! cpu_mipmaps_enabled) || (get_mipmap_level_count(info.width, info.height) < 2)) {
+        return NULL;
+    }
+
+    const TextureSource source = get_texture_source(info.format);
+    const TextureStorage storage = texture_formats.get_storage(source);
+    if (storage == TEXTURE_STORAGE_NONE) {
+        return NULL;
+    }
+
+    info.texture_job_format = get_storage_format(storage);
+    return new TextureMipmapJob(source, storage, info.width, info.height, memory, info.stride);
+}
+
+/**
+ * @brief Cancels preparation in progress and drops the prepared texture.
+ */
+void DX9HWLayer::discard_texture_job(HWSurfaceInfo &info)
+{
+    if (info.texture_job) {
+        job_queue.cancel(info.texture_job);
+        delete info.texture_job;
+        info.texture_job = NULL;
+        texture_job_discard_count++;
+
+        for (size_t i = 0; i < preparing_surfaces.size(); ++i) {
+            if (preparing_surfaces[i] == &info) {
+                preparing_surfaces[i] = preparing_surfaces.back();
+                preparing_surfaces.pop_back();
+                break;
+            }
+        }
+    }
+
+    if (info.prepared_texture) {
+        if (state.texture == info.prepared_texture) {
+            set_texture_surface_internal(NULL);
+        }
+        recycle_texture(info.prepared_texture);
+    }
+}
+
+/**
+ * @brief Uses results of finished texture jobs.
+ */
+void DX9HWLayer::finish_texture_jobs(void)
+{
+    for (size_t i = 0; i < preparing_surfaces.size();) {
+        HWSurfaceInfo &info = *preparing_surfaces[i];
+        assert(info.texture_job);
+        if (! job_queue.is_finished(info.texture_job)) {
+            ++i;
+            continue;
+        }
+
+        apply_texture_job(info);
+        delete info.texture_job;
+        info.texture_job = NULL;
+
+        preparing_surfaces[i] = preparing_surfaces.back();
+        preparing_surfaces.pop_back();
+    }
+}
+
+/**
+ * @brief Creates the prepared texture from result of finished texture job.
+ */
+void DX9HWLayer::apply_texture_job(HWSurfaceInfo &info)
+{
+    D3DEVENT(L"apply_texture_job");
+
+    const TextureLevelsJob &job = *info.texture_job;
+    if (! job.is_valid()) {
+        return;
+    }
+
+    // The prepared textures are never locked again so the default
+    // pool textures are filled from system memory copy.
+
+    const D3DFORMAT d3d_format = info.texture_job_format;
+    const size_t level_count = job.get_level_count();
+    const D3DPOOL pool = (direct3d_ex != NULL) ? D3DPOOL_DEFAULT : D3DPOOL_MANAGED;
+
+    CComPtr<IDirect3DTexture9> texture;
+    if (FAILED(log_error(create_pooled_texture(info.width, info.height, level_count, 0, d3d_format, pool, false, texture)))) {
+        return;
+    }
+
+    CComPtr<IDirect3DTexture9> staging_texture = texture;
+    if (pool == D3DPOOL_DEFAULT) {
+        staging_texture = NULL;
+        if (FAILED(log_error(create_pooled_texture(info.width, info.height, level_count, 0, d3d_format, D3DPOOL_SYSTEMMEM, false, staging_texture)))) {
+            recycle_texture(texture);
+            return;
+        }
+    }
+
+    // Fill all levels.
+
+    for (size_t level = 0; level < level_count; ++level) {
+        D3DLOCKED_RECT rect;
+        if (FAILED(log_error(staging_texture->LockRect(level, &rect, NULL, 0)))) {
+            if (staging_texture != texture) {
+                recycle_texture(staging_texture);
+            }
+            recycle_texture(texture);
+            return;
+        }
+        const size_t row_size = job.get_level_row_size(level);
+        read_same_format(rect.pBits, rect.Pitch, job.get_level_data(level), row_size, row_size, job.get_level_row_count(level), 1);
+        log_error(staging_texture->UnlockRect(level));
+    }
+
+    if (staging_texture != texture) {
+        log_error(device->UpdateTexture(staging_texture, texture));
+        recycle_texture(staging_texture);
+    }
+
+    info.prepared_texture = texture;
+    bool from_cache = false;
+    if ((d3d_format == D3DFMT_DXT1) || (d3d_format == D3DFMT_DXT3)) {
+        from_cache = static_cast<const TextureCompressionJob &>(job).was_loaded_from_cache();
+        compressed_count++;
+        if (from_cache) {
+            compressed_from_cache_count++;
+        }
+    }
+    else {
+        cpu_mipmapped_count++;
+    }
+    logKA(MSG_VERBOSE, 0, "HW:prepared surface %08x %ux%u with %u levels%s", &info, info.width, info.height, level_count, from_cache ? " from cache" : "");
+}
+
+/**
+ * @brief Copies the surface into the texture atlas if it is suitable for it.
+ */
+bool DX9HWLayer::add_to_atlas(HWSurfaceInfo &info, const void * const memory)
+{
+    assert(info.atlas_page == NULL);
+    if ((! atlas_enabled) || info.render_target || info.atlas_excluded) {
+        return false;
+    }
+    if ((info.width > atlas_max_size) || (info.height > atlas_max_size)) {
+        return false;
+    }
+
+    const TextureSource source = get_texture_source(info.format);
+    TextureAtlas &atlas = atlases[source];
+
+    AtlasRegion region;
+    if (! atlas.allocate(info.width, info.height, region)) {
+        return false;
+    }
+    while (region.page >= atlas_pages[source].size()) {
+        if (! create_atlas_page(source, info.format)) {
+            atlas.release(region);
+            return false;
+        }
+    }
+
+    // Lock the region including its padding. The lock marks it
+    // as dirty so only the region is transfered by the update.
+
+    D3DEVENT(L"add_to_atlas");
+    AtlasPage &page = atlas_pages[source][region.page];
+
+    RECT lock_rect;
+    lock_rect.left = static_cast<LONG>(region.x - ATLAS_PADDING);
+    lock_rect.top = static_cast<LONG>(region.y - ATLAS_PADDING);
+    lock_rect.right = static_cast<LONG>(region.x + region.width + ATLAS_PADDING);
+    lock_rect.bottom = static_cast<LONG>(region.y + region.height + ATLAS_PADDING);
+
+    D3DLOCKED_RECT rect;
+    if (FAILED(log_error(page.staging_texture->LockRect(0, &rect, &lock_rect, 0)))) {
+        atlas.release(region);
+        return false;
+    }
+
+    const TextureStorage storage = texture_formats.get_storage(source);
+    const size_t texel_size = TextureFormatTable::get_texel_size(storage);
+    char * const content = static_cast<char *>(rect.pBits) + (ATLAS_PADDING * rect.Pitch) + (ATLAS_PADDING * texel_size);
+    read_as_storage(source, storage, content, rect.Pitch, memory, info.stride, info.width, info.height);
+    extend_region_border(content, rect.Pitch, info.width, info.height, texel_size, ATLAS_PADDING);
+
+    log_error(page.staging_texture->UnlockRect(0));
+    if (page.staging_texture != page.surface->texture) {
+        log_error(device->UpdateTexture(page.staging_texture, page.surface->texture));
+    }
+
+    info.atlas_page = page.surface;
+    info.atlas_region = region;
+    info.atlas_transform = atlas.get_transform(region);
+    atlased_count++;
+    logKA(MSG_VERBOSE, 0, "HW:atlased surface %08x %ux%u to page %u at %u,%u", &info, info.width, info.height, region.page, region.x, region.y);
+    return true;
+}
+
+/**
+ * @brief Creates next page of the atlas for specified format.
+ */
+bool DX9HWLayer::create_atlas_page(const TextureSource source, const HWFormat format)
+{
+    const D3DFORMAT d3d_format = get_storage_format(texture_formats.get_storage(source));
+    const D3DPOOL pool = (direct3d_ex != NULL) ? D3DPOOL_DEFAULT : D3DPOOL_MANAGED;
+
+    CComPtr<IDirect3DTexture9> texture;
+    if (FAILED(log_error(create_pooled_texture(ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, 1, 0, d3d_format, pool, false, texture)))) {
+        return false;
+    }
+
+    AtlasPage page;
+    page.staging_texture = texture;
+    if (pool == D3DPOOL_DEFAULT) {
+        page.staging_texture = NULL;
+        if (FAILED(log_error(create_pooled_texture(ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, 1, 0, d3d_format, D3DPOOL_SYSTEMMEM, false, page.staging_texture)))) {
+            recycle_texture(texture);
+            return false;
+        }
+    }
+
+    // The page is bound as any other surface.
+
+    page.surface = new HWSurfaceInfo();
+    page.surface->width = ATLAS_PAGE_SIZE;
+    page.surface->height = ATLAS_PAGE_SIZE;
+    page.surface->stride = ATLAS_PAGE_SIZE * 2;
+    page.surface->format = format;
+    page.surface->dx_format = d3d_format;
+    page.surface->texture = texture;
+
+    atlas_pages[source].push_back(page);
+    logKA(MSG_INFORM, 0, "HW:created atlas page %u for %s textures", atlas_pages[source].size(), TextureFormatTable::get_storage_name(texture_formats.get_storage(source)));
+    return true;
+}
+
+/**
+ * @brief Releases space of the surface in the atlas.
+ *
+ * The ddraw layer draws queued geometry before the texture changes, so
+ * nothing drawn from the region is pending.
+ */
+void DX9HWLayer::remove_from_atlas(HWSurfaceInfo &info)
+{
+    if (info.atlas_page == NULL) {
+        return;
+    }
+    atlases[get_texture_source(info.format)].release(info.atlas_region);
+    info.atlas_page = NULL;
+}
+
+/**
+ * @brief Destroys all atlas pages.
+ */
+void DX9HWLayer::release_atlas_pages(void)
+{
+    for (size_t i = 0; i < SIZE_OF_TEXTURE_SOURCE; ++i) {
+        atlases[i].clear();
+        std::vector<AtlasPage> &pages = atlas_pages[i];
+        for (size_t j = 0; j < pages.size(); ++j) {
+            HWSurfaceInfo * const surface = pages[j].surface;
+            if (state.texture_info == surface) {
+                set_texture_surface_internal(NULL);
+            }
+            if (pages[j].staging_texture != surface->texture) {
+                recycle_texture(pages[j].staging_texture);
+            }
+            pages[j].staging_texture = NULL;
+            recycle_texture(surface->texture);
+            delete surface;
+        }
+        pages.clear();
+    }
+}
+
+bool DX9HWLayer::get_atlas_placement(const HWSurfaceHandle surface, HWSurfaceHandle &page, AtlasTransform &transform)
+{
+    const HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(surface);
+    if ((info == NULL) || (info->atlas_page == NULL)) {
+        return false;
+    }
+    page = info->atlas_page;
+    transform = info->atlas_transform;
+    atlas_placement_count++;
+    return true;
+}
+
+void DX9HWLayer::exclude_from_atlas(const HWSurfaceHandle surface)
+{
+    HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(surface);
+    if ((info == NULL) || info->atlas_excluded) {
+        return;
+    }
+    info->atlas_excluded = true;
+    if (info->atlas_page != NULL) {
+        remove_from_atlas(*info);
+        atlas_excluded_count++;
+        logKA(MSG_VERBOSE, 0, "HW:excluded wrapped surface %08x from atlas", info);
+    }
+}
+
+/**
+ * @brief Loads order of first use of the textures from the previous runs.
+ */
+void DX9HWLayer::load_texture_history(void)
+{
+    if (texture_history_loaded) {
+        return;
+    }
+    texture_history_loaded = true;
+
+    if (texture_history.load(TEXTURE_HISTORY_FILE_NAME)) {
+        logKA(MSG_INFORM, 0, "HW:Loaded texture history %s with %u textures - use D3DEMU_NO_TEXTURE_PREFETCH to disable prefetch", TEXTURE_HISTORY_FILE_NAME, texture_history.get_predicted_count());
+    }
+    else {
+        logKA(MSG_INFORM, 0, "HW:Texture history %s not found or not valid", TEXTURE_HISTORY_FILE_NAME);
+    }
+}
+
+/**
+ * @brief Stores order of first use of the textures for use by next run.
+ */
+void DX9HWLayer::save_texture_history(void)
+{
+    if (texture_history.get_recorded_count() == 0) {
+        return;
+    }
+
+    if (texture_history.save(TEXTURE_HISTORY_FILE_NAME, MAX_TEXTURE_HISTORY_COUNT)) {
+        logKA(MSG_INFORM, 0, "HW:Saved texture history %s with %u textures used during this run", TEXTURE_HISTORY_FILE_NAME, texture_history.get_recorded_count());
+    }
+    else {
+        logKA(MSG_ERROR, 0, "HW:Unable to save texture history %s", TEXTURE_HISTORY_FILE_NAME);
+    }
+}
+
+/**
+ * @brief Identifies content of newly uploaded texture.
+ */
+void DX9HWLayer::record_texture_upload(HWSurfaceInfo &info, const void * const memory)
+{
+    if ((! texture_prefetch_enabled) || info.render_target) {
+        return;
+    }
+
+    info.content_hash = hash_texture(memory, info.width, info.height, info.stride, info.format);
+    info.first_use_pending = true;
+    info.prefetched = false;
+    info.upload_ticks = 0;
+}
+
+/**
+ * @brief Records first use of the texture for drawing.
+ *
+ * Texture which was not prefetched is made resident now. Its upload
+ * and the residency are the stall the prefetch is supposed to avoid.
+ */
+void DX9HWLayer::record_texture_first_use(HWSurfaceInfo &info)
+{
+    if (! info.first_use_pending) {
+        return;
+    }
+    info.first_use_pending = false;
+    first_use_count++;
+    texture_history.record(info.content_hash);
+
+    if (! info.prefetched) {
+        const LONGLONG start = get_time_ticks();
+        info.get_sampled_texture()->PreLoad();
+        first_use_stall_ticks += info.upload_ticks + (get_time_ticks() - start);
+        first_use_stall_count++;
+    }
+}
+
+/**
+ * @brief Removes prepared update from the prefetch and destroys
+ * the surface created for it.
+ */
+void DX9HWLayer::forget_predicted_update(const TextureConversionJob * const job)
+{
+    for (size_t i = 0; i < predicted_updates.size(); ++i) {
+        if (predicted_updates[i].job == job) {
+            HWSurfaceInfo * const surface = predicted_updates[i].surface;
+            predicted_updates.erase(predicted_updates.begin() + i);
+            if (surface) {
+                destroy_surface_internal(surface);
+            }
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Destroys surfaces created by the prefetch.
+ *
+ * The updates themselves are still owned by the ddraw layer.
+ */
+void DX9HWLayer::release_predicted_updates(void)
+{
+    while (! predicted_updates.empty()) {
+        forget_predicted_update(predicted_updates.back().job);
+    }
+}
+
+/**
+ * @brief Creates and uploads the predicted textures in order of their
+ * expected use and makes them resident.
+ *
+ * Called after presentation of the frame, stops when the time budget is
+ * spent. Only updates whose background conversion is finished are taken
+ * so the prefetch never waits for the conversion thread.
+ */
+void DX9HWLayer::prefetch_textures(void)
+{
+    if (predicted_updates.empty()) {
+        return;
+    }
+
+    D3DEVENT(L"prefetch_textures");
+    const LONGLONG start = get_time_ticks();
+    while (ticks_to_ms(get_time_ticks() - start) < TEXTURE_PREFETCH_BUDGET_MS) {
+
+        // Select the update which is expected to be used first.
+
+        size_t best = predicted_updates.size();
+        for (size_t i = 0; i < predicted_updates.size(); ++i) {
+            const PredictedUpdate &update = predicted_updates[i];
+            if ((update.surface != NULL) || (! job_queue.is_finished(update.job))) {
+                continue;
+            }
+            if ((best == predicted_updates.size()) || (update.position < predicted_updates[best].position)) {
+                best = i;
+            }
+        }
+        if (best == predicted_updates.size()) {
+            break;
+        }
+
+        // Upload it the same way as on its first use. This also schedules
+        // compression or mipmap generation of the texture.
+
+        PredictedUpdate &update = predicted_updates[best];
+        HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(create_surface(update.width, update.height, update.format, NULL, false));
+        if (info == NULL) {
+            predicted_updates.erase(predicted_updates.begin() + best);
+            continue;
+        }
+        upload_converted_texture(*info, *update.job);
+        info->get_sampled_texture()->PreLoad();
+        info->prefetched = true;
+        info->upload_ticks = 0;
+        update.surface = info;
+        prefetched_count++;
     }
 }
 
@@ -1361,7 +2755,7 @@ void DX9HWLayer::compose_or_update_render_target(HWSurfaceInfo &info, const void
     // Transfer the data to the composition surface.
 
     const RECT lock_rect = {0, 0, info.width, info.height};
-    const bool use_lock_rect = info.mono_height != info.height;
+    const bool use_lock_rect = (info.mono_width != info.width) || (info.mono_height != info.height);
 
     D3DLOCKED_RECT rect;
     if (FAILED(log_error(info.composition_texture->LockRect(0, &rect, use_lock_rect ? &lock_rect : NULL, 0)))) {
@@ -1436,7 +2830,7 @@ void DX9HWLayer::compose_or_update_render_target(HWSurfaceInfo &info, const void
 
     // Draw the geometry.
 
-    draw_fullscreen_quad(width, height, 0.0f, 0.0f, 1.0f, static_cast<float>(info.height) / static_cast<float>(info.mono_height));
+    draw_fullscreen_quad(width, height, 0.0f, 0.0f, static_cast<float>(info.width) / static_cast<float>(info.mono_width), static_cast<float>(info.height) / static_cast<float>(info.mono_height));
 
     // Restore previous state.
 
@@ -1657,13 +3051,14 @@ void DX9HWLayer::set_texture_blend(const TextureBlend blend)
 void DX9HWLayer::set_texture_surface(const HWSurfaceHandle surface)
 {
     if (surface == NULL) {
-        if (state.texture != NULL) {
+        if ((state.texture_info != NULL) || (state.texture != NULL)) {
             set_texture_surface_internal(NULL);
         }
     }
     else {
         HWSurfaceInfo * const info = static_cast<HWSurfaceInfo *>(surface);
-        if (state.texture != info->texture) {
+        if ((state.texture_info != info) || (state.texture != info->get_sampled_texture())) {
+            record_texture_first_use(*info);
             set_texture_surface_internal(info);
         }
     }
@@ -1787,11 +3182,12 @@ void DX9HWLayer::set_texture_blend_internal(const TextureBlend blend)
 
 void DX9HWLayer::set_texture_surface_internal(const HWSurfaceInfo * const surface)
 {
+    state.texture_info = surface;
     if (surface == NULL) {
         state.texture = NULL;
     }
     else {
-        state.texture = surface->texture;
+        state.texture = surface->get_sampled_texture();
     }
     log_error(device->SetTexture(0, state.texture));
 }
@@ -1833,14 +3229,60 @@ void DX9HWLayer::clear(const RECT &rect, const bool color, const bool depth, con
 void DX9HWLayer::set_triangle_vertices(const TLVertex * const vertices, const size_t count)
 {
     D3DEVENT(L"set_triangle_vertices");
-    if (vertex_buffer != NULL) {
+    vertex_block_hashed = false;
+    if (vertex_buffer == NULL) {
+        return;
+    }
+    if (((! vertex_reuse_enabled) && (! static_geometry_enabled)) || (count == 0)) {
         vertex_data_start_index = fill_buffer(*vertex_buffer, vertex_buffer_free_index, MAXIMAL_VERTEX_COUNT, vertices, count);
+        return;
+    }
+
+    // The hash identifies the block for the reuse and for the static geometry.
+
+    vertex_block_hash = hash_words(vertices, (count * sizeof(TLVertex)));
+    vertex_block_hashed = true;
+
+    // Point to identical block if it is still present in the buffer.
+
+    size_t start = 0;
+    if (vertex_reuse_enabled && vertex_block_cache.find(vertex_block_hash, count, start)) {
+        vertex_data_start_index = start;
+        frame_vertex_reuse_count++;
+        frame_vertex_reuse_bytes += (count * sizeof(TLVertex));
+        return;
+    }
+
+    // Upload it. Blocks written before the buffer was discarded are gone.
+
+    vertex_data_start_index = fill_buffer(*vertex_buffer, vertex_buffer_free_index, MAXIMAL_VERTEX_COUNT, vertices, count);
+    if (vertex_reuse_enabled) {
+        if (vertex_data_start_index == 0) {
+            vertex_block_cache.invalidate();
+        }
+        vertex_block_cache.insert(vertex_block_hash, count, vertex_data_start_index);
+        frame_vertex_upload_count++;
     }
 }
 
 void DX9HWLayer::draw_triangles(const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t triangle_count)
 {
     D3DEVENT(L"draw_triangles");
+    draw_indexed_triangles(D3DPT_TRIANGLELIST, vertices, vertex_start, vertex_count, indices, (triangle_count * 3), triangle_count);
+}
+
+void DX9HWLayer::draw_triangle_strip(const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t index_count)
+{
+    D3DEVENT(L"draw_triangle_strip");
+    assert(index_count >= 3);
+    draw_indexed_triangles(D3DPT_TRIANGLESTRIP, vertices, vertex_start, vertex_count, indices, index_count, (index_count - 2));
+}
+
+/**
+ * @brief Draws indexed triangle list or strip.
+ */
+void DX9HWLayer::draw_indexed_triangles(const D3DPRIMITIVETYPE type, const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t index_count, const size_t primitive_count)
+{
     assert(vertices);
     assert(indices);
 
@@ -1856,14 +3298,22 @@ void DX9HWLayer::draw_triangles(const TLVertex * const vertices, const size_t ve
     const int index = get_shader_index((state.texture != NULL), state.texture_blend, state.fog_mode);
     activate_shader_combination(index);
 
+    // Draw geometry which did not change for several frames from the static buffers.
+
+    if (static_geometry_enabled && vertex_block_hashed) {
+        if (draw_static_geometry(type, vertices, vertex_start, vertex_count, indices, index_count, primitive_count)) {
+            return;
+        }
+    }
+
     // Draw.
 
     if (vertex_buffer == NULL) {
         log_error(device->DrawIndexedPrimitiveUP(
-            D3DPT_TRIANGLELIST,
+            type,
             vertex_start,
             vertex_count,
-            triangle_count,
+            primitive_count,
             indices,
             D3DFMT_INDEX16,
             vertices,
@@ -1872,15 +3322,137 @@ void DX9HWLayer::draw_triangles(const TLVertex * const vertices, const size_t ve
         return;
     }
 
-    const size_t starting_index = fill_buffer(*index_buffer, index_buffer_free_index, MAXIMAL_INDEX_COUNT, indices, (triangle_count * 3));
+    const size_t starting_index = fill_buffer(*index_buffer, index_buffer_free_index, MAXIMAL_INDEX_COUNT, indices, index_count);
     log_error(device->DrawIndexedPrimitive(
-        D3DPT_TRIANGLELIST,
+        type,
         vertex_data_start_index,
         vertex_start,
         vertex_count,
         starting_index,
-        triangle_count
+        primitive_count
+    ));
+}
+
+/**
+ * @brief Draws the geometry from the static buffers if it is resident
+ * or if it was promoted to them by this draw.
+ *
+ * Returns false if the geometry should be drawn from the dynamic buffers.
+ */
+bool DX9HWLayer::draw_static_geometry(const D3DPRIMITIVETYPE type, const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t index_count, const size_t primitive_count)
+{
+    GeometryKey key;
+    key.vertex_hash = vertex_block_hash;
+    key.index_hash = hash_words(indices, (index_count * sizeof(unsigned short)));
+    key.vertex_start = vertex_start;
+    key.vertex_count = vertex_count;
+    key.index_count = index_count;
+    key.type = type;
+
+    const size_t bytes = (vertex_count * sizeof(TLVertex)) + (index_count * sizeof(unsigned short));
+
+    StaticGeometryCache::Entry entry = NULL;
+    switch (static_geometry_cache.lookup(key, bytes, entry)) {
+        case StaticGeometryCache::DECISION_STREAM: {
+            return false;
+        }
+        case StaticGeometryCache::DECISION_PROMOTE: {
+            StaticGeometry * const geometry = create_static_geometry(vertices, vertex_start, vertex_count, indices, index_count);
+            if (geometry == NULL) {
+                return false;
+            }
+            StaticGeometryCache::EntryList evicted;
+            static_geometry_cache.insert(key, geometry, bytes, evicted);
+            delete_static_geometry(evicted);
+            entry = geometry;
+            break;
+        }
+        case StaticGeometryCache::DECISION_RESIDENT: {
+            break;
+        }
+    }
+    assert(entry != NULL);
+
+    // The indices were rebased to the buffer which starts with
+    // the first used vertex.
+
+    D3DEVENT(L"draw_static_geometry");
+    const StaticGeometry &geometry = *static_cast<StaticGeometry *>(entry);
+    log_error(device->SetStreamSource(0, geometry.vertex_buffer, 0, sizeof(TLVertex)));
+    log_error(device->SetIndices(geometry.index_buffer));
+    log_error(device->DrawIndexedPrimitive(
+        type,
+        0,
+        0,
+        vertex_count,
+        0,
+        primitive_count
     ));
+
+    // Restore the dynamic buffers.
+
+    bind_buffers();
+    return true;
+}
+
+/**
+ * @brief Creates static buffers with copy of specified vertices and indices.
+ *
+ * The vertex buffer holds only the used range of the vertices and the
+ * indices are rebased to it, so the draw needs no negative base index
+ * which some drivers handle poorly. Returns NULL on failure.
+ */
+DX9HWLayer::StaticGeometry *DX9HWLayer::create_static_geometry(const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t index_count)
+{
+    D3DEVENT(L"create_static_geometry");
+    const size_t vertex_size = vertex_count * sizeof(TLVertex);
+    const size_t index_size = index_count * sizeof(unsigned short);
+
+    StaticGeometry * const geometry = new StaticGeometry();
+    HRESULT result = device->CreateVertexBuffer(vertex_size, D3DUSAGE_WRITEONLY, vision_3d ? STANDARD_FVF_VISION : STANDARD_FVF_NORMAL, D3DPOOL_DEFAULT, &geometry->vertex_buffer, NULL);
+    if (SUCCEEDED(result)) {
+        result = device->CreateIndexBuffer(index_size, D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_DEFAULT, &geometry->index_buffer, NULL);
+    }
+
+    // Fill them.
+
+    void *data = NULL;
+    if (SUCCEEDED(result)) {
+        result = geometry->vertex_buffer->Lock(0, 0, &data, 0);
+        if (SUCCEEDED(result)) {
+            memcpy(data, vertices + vertex_start, vertex_size);
+            geometry->vertex_buffer->Unlock();
+        }
+    }
+    if (SUCCEEDED(result)) {
+        result = geometry->index_buffer->Lock(0, 0, &data, 0);
+        if (SUCCEEDED(result)) {
+            unsigned short * const output = static_cast<unsigned short *>(data);
+            for (size_t i = 0; i < index_count; ++i) {
+                assert(indices[i] >= vertex_start);
+                output[i] = static_cast<unsigned short>(indices[i] - vertex_start);
+            }
+            geometry->index_buffer->Unlock();
+        }
+    }
+
+    if (FAILED(result)) {
+        logKA(MSG_ERROR, 0, "HW:Unable to create static geometry buffers: %08x", result);
+        delete geometry;
+        return NULL;
+    }
+
+    logKA(MSG_VERBOSE, 0, "HW:static geometry %08x with %u vertices and %u indices", geometry, vertex_count, index_count);
+    return geometry;
+}
+
+void DX9HWLayer::delete_static_geometry(const StaticGeometryCache::EntryList &entries)
+{
+    for (size_t i = 0; i < entries.size(); ++i) {
+        StaticGeometry * const geometry = static_cast<StaticGeometry *>(entries[i]);
+        logKA(MSG_VERBOSE, 0, "HW:evicting static geometry %08x", geometry);
+        delete geometry;
+    }
 }
 
 void DX9HWLayer::draw_lines(const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t line_count)
@@ -2103,6 +3675,39 @@ void DX9HWLayer::display_surface(const HWSurfaceHandle surface)
     // Restore previous state.
 
     apply_state(old_state, false);
+
+    // Start using textures prepared during the last frame and make
+    // resident the ones expected to be used soon.
+
+    finish_texture_jobs();
+    prefetch_textures();
+
+    // Candidates for the static geometry must appear in consecutive frames.
+
+    if (static_geometry_enabled) {
+        static_geometry_cache.advance_frame();
+    }
+
+    // Report the vertex reuse of the finished frame.
+
+    if (vertex_reuse_enabled) {
+        logKA(MSG_VERBOSE, 0, "HW:Vertex blocks reused %u of %u, %u bytes saved", frame_vertex_reuse_count, (frame_vertex_reuse_count + frame_vertex_upload_count), frame_vertex_reuse_bytes);
+        vertex_reuse_frame_count++;
+        vertex_upload_count += frame_vertex_upload_count;
+        vertex_reuse_count += frame_vertex_reuse_count;
+        vertex_reuse_bytes += frame_vertex_reuse_bytes;
+        frame_vertex_upload_count = 0;
+        frame_vertex_reuse_count = 0;
+        frame_vertex_reuse_bytes = 0;
+    }
+
+    // Trim surfaces which were not reused for a long time.
+
+    SurfaceCache::EntryList evicted;
+    surface_cache.advance_frame(evicted);
+    delete_cached_surfaces(evicted);
+
+    record_surface_transition();
 }
 
 /**
@@ -2285,6 +3890,7 @@ void DX9HWLayer::apply_state(const HWState &state, const bool force)
     // Directly set states for which there is no proper setter.
 
     this->state.texture = state.texture;
+    this->state.texture_info = state.texture_info;
     log_error(device->SetTexture(0, state.texture));
 
     // Set the render targets.
@@ -2,6 +2,18 @@
 #define DX9_HW_LAYER_H
 
 #include "../hw_layer.h"
+#include "../surface_cache.h"
+#include "../resource_pool.h"
+#include "../surface_profile.h"
+#include "../texture_format.h"
+#include "../texture_compression_job.h"
+#include "../texture_mipmap_job.h"
+#include "../texture_conversion_job.h"
+#include "../texture_atlas.h"
+#include "../texture_history.h"
+#include "../vertex_block_cache.h"
+#include "../static_geometry_cache.h"
+#include "../../helpers/job_queue.h"
 #include <windows.h>
 #include <d3d9.h>
 #include <atlbase.h>
@@ -80,6 +92,11 @@ private:
      */
     size_t multisample_quality;
 
+    /**
+     * @brief Storage formats used for the game textures.
+     */
+    TextureFormatTable texture_formats;
+
     /**
      * @brief Device to use.
      *
@@ -138,6 +155,31 @@ private:
      */
     size_t index_buffer_free_index;
 
+    /**
+     * @name Reuse of vertex blocks which are still resident in the vertex buffer.
+     */
+    //@{
+    bool vertex_reuse_enabled;
+    VertexBlockCache vertex_block_cache;
+
+    size_t frame_vertex_upload_count;
+    size_t frame_vertex_reuse_count;
+    size_t frame_vertex_reuse_bytes;
+
+    size_t vertex_reuse_frame_count;
+    size_t vertex_upload_count;
+    size_t vertex_reuse_count;
+    ULONGLONG vertex_reuse_bytes;
+    //@}
+
+    /**
+     * @brief Hash of the block uploaded by last set_triangle_vertices() call.
+     *
+     * Calculated only if some feature needs it, see vertex_block_hashed.
+     */
+    ContentHash vertex_block_hash;
+    bool vertex_block_hashed;
+
 private:
 
     /**
@@ -148,6 +190,13 @@ private:
         size_t width;
         size_t height;
 
+        /**
+         * @brief Width of the composition texture of render-target surfaces.
+         *
+         * Can be bigger than the width if pooled texture was reused.
+         */
+        size_t mono_width;
+
         /**
          * @brief Height used for mono render-target surfaces.
          */
@@ -265,11 +314,77 @@ private:
         size_t cache_slot;
 
         /**
-         * @brief List containing surfaces of equivalent parameters in cache.
+         * @brief Number of owners in addition to the creator.
          */
-        HWSurfaceInfo *next_in_cache;
+        size_t share_count;
+
+        // Background texture preparation (compression or mipmap generation).
+
+        /**
+         * @brief Number of uploads since creation of the surface.
+         *
+         * Only surfaces uploaded once are prepared.
+         */
+        size_t upload_count;
+
+        /**
+         * @brief Preparation in progress or NULL.
+         */
+        TextureLevelsJob * texture_job;
+
+        /**
+         * @brief Format of the texture produced by the texture_job.
+         */
+        D3DFORMAT texture_job_format;
+
+        /**
+         * @brief Prepared copy of the texture used for sampling.
+         *
+         * The original texture is kept for readback.
+         */
+        CComPtr<IDirect3DTexture9> prepared_texture;
+
+        // Texture atlas support.
+
+        /**
+         * @brief Page holding copy of the texture or NULL.
+         */
+        HWSurfaceInfo * atlas_page;
+
+        /**
+         * @brief Indicates that the texture is drawn with wrapping so it
+         * must not be placed into the atlas.
+         */
+        bool atlas_excluded;
+
+        AtlasRegion atlas_region;
+        AtlasTransform atlas_transform;
+
+        // Texture prefetch support.
+
+        /**
+         * @brief Hash of the first uploaded content.
+         */
+        ContentHash content_hash;
+
+        /**
+         * @brief Indicates that the surface was uploaded but not used for drawing yet.
+         */
+        bool first_use_pending;
+
+        /**
+         * @brief Indicates that the texture was made resident ahead of its first use.
+         */
+        bool prefetched;
+
+        /**
+         * @brief Time spent by upload of the content before its first use.
+         */
+        LONGLONG upload_ticks;
 
         HWSurfaceInfo();
+
+        IDirect3DTexture9 *get_sampled_texture(void) const;
     };
 
     // Last set state.
@@ -286,8 +401,17 @@ private:
         bool flat;
 
         TextureBlend texture_blend;
+
+        /**
+         * @brief Texture bound to the device.
+         */
         CComPtr<IDirect3DTexture9> texture;
 
+        /**
+         * @brief Surface selected for texturing.
+         */
+        const HWSurfaceInfo * texture_info;
+
         HWSurfaceInfo * color_info;
         HWSurfaceInfo * depth_info;
 
@@ -310,19 +434,192 @@ private:
      */
     bool scene_active;
 
-public:
+    /**
+     * @brief Cache of available surfaces.
+     *
+     * Slot 0 is not used.
+     */
+    SurfaceCache surface_cache;
+
+    /**
+     * @brief Background thread for texture processing.
+     */
+    JobQueue job_queue;
+
+    /**
+     * @name Texture compression.
+     */
+    //@{
+    bool compression_enabled;
+    DXTQuality compression_quality;
+    size_t compression_min_size;
+    bool dxt1_supported;
+    bool dxt3_supported;
+    CompressedTextureCache compressed_texture_cache;
+
+    size_t compressed_count;
+    size_t compressed_from_cache_count;
+    //@}
+
+    /**
+     * @brief Generate mipmaps of static textures on the CPU.
+     */
+    bool cpu_mipmaps_enabled;
+    size_t cpu_mipmapped_count;
+
+    /**
+     * @brief Surfaces with texture_job in progress.
+     */
+    std::vector<HWSurfaceInfo *> preparing_surfaces;
+    size_t texture_job_discard_count;
 
-    struct CacheSlot {
-        HWSurfaceInfo *head;
-        HWSurfaceInfo *tail;
+    /**
+     * @name Background conversion of uploads.
+     */
+    //@{
+    bool async_upload_enabled;
+    size_t prepared_update_count;
+    size_t prepared_update_wait_count;
+    size_t prepared_update_discard_count;
+    //@}
+
+    /**
+     * @brief Geometry drawn unchanged for several frames.
+     *
+     * Contains the vertices used by the draw starting at index 0 and
+     * the original indices.
+     */
+    struct StaticGeometry {
+        CComPtr<IDirect3DVertexBuffer9> vertex_buffer;
+        CComPtr<IDirect3DIndexBuffer9> index_buffer;
     };
 
     /**
-     * @brief Cache of available surfaces.
+     * @name Static buffers of geometry which does not change.
+     */
+    //@{
+    bool static_geometry_enabled;
+    StaticGeometryCache static_geometry_cache;
+    //@}
+
+    /**
+     * @brief Page of the texture atlas.
      *
-     * Slot 0 is not used.
+     * The page is bound as regular surface by the draws of the textures
+     * placed into it.
      */
-    CacheSlot cache[SURFACE_CACHE_SLOTS];
+    struct AtlasPage {
+        HWSurfaceInfo * surface;
+
+        /**
+         * @brief System memory copy used to fill default pool texture.
+         *
+         * Same as the page texture if it can be locked directly.
+         */
+        CComPtr<IDirect3DTexture9> staging_texture;
+    };
+
+    /**
+     * @name Atlas of small static textures.
+     */
+    //@{
+    bool atlas_enabled;
+    size_t atlas_max_size;
+    TextureAtlas atlases[SIZE_OF_TEXTURE_SOURCE];
+    std::vector<AtlasPage> atlas_pages[SIZE_OF_TEXTURE_SOURCE];
+
+    size_t atlased_count;
+    size_t atlas_excluded_count;
+    size_t atlas_placement_count;
+    //@}
+
+    /**
+     * @name Prefetch of textures predicted from the previous runs.
+     */
+    //@{
+    bool texture_prefetch_enabled;
+    bool texture_history_loaded;
+    TextureHistory texture_history;
+
+    /**
+     * @brief Prepared update of content predicted to be used.
+     *
+     * The surface is created and uploaded by the prefetch, it is handed
+     * over to the owner of the update by create_surface_from_update().
+     */
+    struct PredictedUpdate {
+        TextureConversionJob * job;
+        size_t width;
+        size_t height;
+        HWFormat format;
+        size_t position;
+        HWSurfaceInfo * surface;
+    };
+
+    std::vector<PredictedUpdate> predicted_updates;
+
+    size_t prefetched_count;
+    size_t first_use_count;
+    size_t first_use_stall_count;
+    LONGLONG first_use_stall_ticks;
+    //@}
+
+    /**
+     * @brief Pool of D3D resources which are not handled by the surface cache.
+     *
+     * The resources can not outlive the device so the pool is emptied by
+     * the deinitialize(). As the SetDisplayMode() recreates the device, only
+     * transitions within single display mode can reuse the resources.
+     */
+    ResourcePool resource_pool;
+
+    /**
+     * @brief Number of existing surfaces for each slot of the surface cache.
+     */
+    std::vector<size_t> live_surface_counts;
+
+    /**
+     * @brief Peak numbers of existing cacheable surfaces.
+     *
+     * Contains values loaded from previous runs merged with values recorded
+     * during this run.
+     */
+    SurfaceProfile surface_profile;
+
+    /**
+     * @brief Indicates that the profile from previous runs was already loaded.
+     */
+    bool surface_profile_loaded;
+
+    /**
+     * @name Time spent creating surfaces and allocating resources from the driver.
+     */
+    //@{
+    LONGLONG surface_creation_ticks;
+    size_t surface_creation_count;
+    LONGLONG driver_allocation_ticks;
+    size_t driver_allocation_count;
+    //@}
+
+    /**
+     * @name Time spent creating and destroying surfaces since the last
+     * presentation.
+     */
+    //@{
+    LONGLONG frame_surface_ticks;
+    size_t frame_surface_count;
+    //@}
+
+    /**
+     * @name Measured transitions, intervals between presentations during
+     * which many surfaces were created or destroyed (menu and flight
+     * switches, mission loads).
+     */
+    //@{
+    size_t transition_count;
+    LONGLONG transition_ticks;
+    LONGLONG longest_transition_ticks;
+    //@}
 
 public:
 
@@ -338,6 +635,8 @@ private:
     void detect_slow_z_readback(const size_t adapter);
     void detect_anisotropy(const size_t adapter, const D3DDEVTYPE device_type);
     void detect_msaa(const size_t adapter, const D3DDEVTYPE device_type);
+    void detect_texture_formats(const size_t adapter, const D3DDEVTYPE device_type);
+    void detect_texture_compression(const size_t adapter, const D3DDEVTYPE device_type);
 
 public:
 
@@ -350,17 +649,71 @@ public:
 
 private:
 
+    HWSurfaceHandle create_surface_internal(const size_t width, const size_t height, const HWFormat format, const void * const memory, const bool render_target, const bool use_cache);
     HWSurfaceHandle create_depth_surface(const size_t width, const size_t height);
+    void delete_cached_surfaces(const SurfaceCache::EntryList &surfaces);
+    void log_cache_statistics(void);
+    void prewarm_surface_cache(void);
+    void save_surface_profile(void);
+
+    HRESULT create_pooled_texture(const size_t width, const size_t height, const size_t levels, const DWORD usage, const D3DFORMAT format, const D3DPOOL pool, const bool allow_larger, CComPtr<IDirect3DTexture9> &texture);
+    HRESULT create_pooled_surface(const size_t width, const size_t height, const DWORD usage, const D3DFORMAT format, CComPtr<IDirect3DSurface9> &surface);
+    void recycle_texture(CComPtr<IDirect3DTexture9> &texture);
+    void recycle_surface(CComPtr<IDirect3DSurface9> &surface);
+    void recycle_surface_resources(HWSurfaceInfo * const info);
+    void release_pooled_resources(const ResourcePool::EntryList &resources);
+    void log_pool_statistics(void);
+    void record_surface_transition(void);
+
+    void finish_texture_update(HWSurfaceInfo &info, const void * const memory);
+    void schedule_texture_job(HWSurfaceInfo &info, const void * const memory);
+    TextureLevelsJob *create_compression_job(HWSurfaceInfo &info, const void * const memory);
+    TextureLevelsJob *create_mipmap_job(HWSurfaceInfo &info, const void * const memory);
+    void discard_texture_job(HWSurfaceInfo &info);
+    void finish_texture_jobs(void);
+    void apply_texture_job(HWSurfaceInfo &info);
+
+    bool add_to_atlas(HWSurfaceInfo &info, const void * const memory);
+    bool create_atlas_page(const TextureSource source, const HWFormat format);
+    void remove_from_atlas(HWSurfaceInfo &info);
+    void release_atlas_pages(void);
+
+    void load_texture_history(void);
+    void save_texture_history(void);
+    void record_texture_upload(HWSurfaceInfo &info, const void * const memory);
+    void record_texture_first_use(HWSurfaceInfo &info);
+    void forget_predicted_update(const TextureConversionJob * const job);
+    void release_predicted_updates(void);
+    void prefetch_textures(void);
 
 public:
 
     virtual void destroy_surface(const HWSurfaceHandle surface);
+
+private:
+
+    void destroy_surface_internal(const HWSurfaceHandle surface);
+
+public:
+
+    virtual HWSurfaceHandle share_surface(const HWSurfaceHandle surface);
+    virtual bool is_surface_shared(const HWSurfaceHandle surface);
     virtual void update_surface(const HWSurfaceHandle surface, const void * const memory);
+    virtual HWPreparedUpdate prepare_update(const size_t width, const size_t height, const HWFormat format, const void * const memory);
+    virtual void apply_prepared_update(const HWSurfaceHandle surface, const HWPreparedUpdate update);
+    virtual HWSurfaceHandle create_surface_from_update(const size_t width, const size_t height, const HWFormat format, const HWPreparedUpdate update);
+    virtual void discard_prepared_update(const HWPreparedUpdate update);
     virtual void read_surface(const HWSurfaceHandle surface, void * const memory);
     virtual void compose_render_target(const HWSurfaceHandle surface, const void * const memory, const float * const color_key);
+    virtual bool get_atlas_placement(const HWSurfaceHandle surface, HWSurfaceHandle &page, AtlasTransform &transform);
+    virtual void exclude_from_atlas(const HWSurfaceHandle surface);
 
 private:
 
+    void update_surface_internal(HWSurfaceInfo &info, const void * const memory);
+    void upload_converted_texture(HWSurfaceInfo &info, TextureConversionJob &job);
+    void add_upload_time(HWSurfaceInfo &info, const LONGLONG start);
+
     void compose_or_update_render_target(HWSurfaceInfo &info, const void * const memory, const bool update, const float * const color_key);
     void update_render_target(HWSurfaceInfo &info, const void * const memory);
 
@@ -393,9 +746,19 @@ public:
     virtual void clear(const RECT &rect, const bool color, const bool depth, const DWORD color_value, const float depth_value);
     virtual void set_triangle_vertices(const TLVertex * const vertices, const size_t count);
     virtual void draw_triangles(const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t triangle_count);
+    virtual void draw_triangle_strip(const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t index_count);
     virtual void draw_lines(const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t line_count);
     virtual void draw_points(const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t point_count);
 
+private:
+
+    void draw_indexed_triangles(const D3DPRIMITIVETYPE type, const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t index_count, const size_t primitive_count);
+    bool draw_static_geometry(const D3DPRIMITIVETYPE type, const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t index_count, const size_t primitive_count);
+    StaticGeometry *create_static_geometry(const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t index_count);
+    void delete_static_geometry(const StaticGeometryCache::EntryList &entries);
+
+public:
+
     virtual void bitblt(const HWSurfaceHandle destination, const HWSurfaceHandle source, const size_t x, const size_t y, const size_t src_x, const size_t src_y, const size_t src_width, const size_t src_height);
 
     virtual void display_surface(const HWSurfaceHandle surface);
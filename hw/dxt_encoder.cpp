@@ -0,0 +1,464 @@
+#include "dxt_encoder.h"
+#include <assert.h>
+#include <math.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief Number of texels in one block.
+ */
+const size_t BLOCK_TEXELS = 16;
+
+/**
+ * @brief Colors of single 4x4 block split into channels.
+ */
+struct ColorBlock {
+    int red[BLOCK_TEXELS];
+    int green[BLOCK_TEXELS];
+    int blue[BLOCK_TEXELS];
+    int alpha[BLOCK_TEXELS];
+};
+
+int clamp_channel(const int value)
+{
+    return (value < 0) ? 0 : ((value > 255) ? 255 : value);
+}
+
+int round_channel(const float value)
+{
+    return clamp_channel(static_cast<int>(value + 0.5f));
+}
+
+unsigned short pack_565(const int red, const int green, const int blue)
+{
+    const int red_5 = (clamp_channel(red) * 31 + 127) / 255;
+    const int green_6 = (clamp_channel(green) * 63 + 127) / 255;
+    const int blue_5 = (clamp_channel(blue) * 31 + 127) / 255;
+    return static_cast<unsigned short>((red_5 << 11) | (green_6 << 5) | blue_5);
+}
+
+void unpack_565(const unsigned short color, int &red, int &green, int &blue)
+{
+    const int red_5 = (color >> 11) & 0x1F;
+    const int green_6 = (color >> 5) & 0x3F;
+    const int blue_5 = color & 0x1F;
+    red = (red_5 << 3) | (red_5 >> 2);
+    green = (green_6 << 2) | (green_6 >> 4);
+    blue = (blue_5 << 3) | (blue_5 >> 2);
+}
+
+/**
+ * @brief Builds the four color palette used by blocks with color0 > color1.
+ */
+void build_palette(const unsigned short color0, const unsigned short color1, int red[4], int green[4], int blue[4])
+{
+    unpack_565(color0, red[0], green[0], blue[0]);
+    unpack_565(color1, red[1], green[1], blue[1]);
+    red[2] = (2 * red[0] + red[1]) / 3;
+    green[2] = (2 * green[0] + green[1]) / 3;
+    blue[2] = (2 * blue[0] + blue[1]) / 3;
+    red[3] = (red[0] + 2 * red[1]) / 3;
+    green[3] = (green[0] + 2 * green[1]) / 3;
+    blue[3] = (blue[0] + 2 * blue[1]) / 3;
+}
+
+/**
+ * @brief Selects the nearest palette entry for each texel.
+ *
+ * Returns sum of squared errors.
+ */
+unsigned int assign_indices(const ColorBlock &block, const unsigned short color0, const unsigned short color1, unsigned int &indices)
+{
+    int red[4];
+    int green[4];
+    int blue[4];
+    build_palette(color0, color1, red, green, blue);
+
+    unsigned int total_error = 0;
+    indices = 0;
+    for (size_t i = 0; i < BLOCK_TEXELS; ++i) {
+        unsigned int best_error = 0xFFFFFFFF;
+        unsigned int best_index = 0;
+        for (unsigned int j = 0; j < 4; ++j) {
+            const int delta_red = block.red[i] - red[j];
+            const int delta_green = block.green[i] - green[j];
+            const int delta_blue = block.blue[i] - blue[j];
+            const unsigned int error = static_cast<unsigned int>(delta_red * delta_red + delta_green * delta_green + delta_blue * delta_blue);
+            if (error < best_error) {
+                best_error = error;
+                best_index = j;
+            }
+        }
+        indices |= best_index << (2 * i);
+        total_error += best_error;
+    }
+    return total_error;
+}
+
+/**
+ * @brief Endpoints from the minimal and maximal value of each channel.
+ */
+void fit_bounding_box(const ColorBlock &block, float low[3], float high[3])
+{
+    int minimum[3] = {255, 255, 255};
+    int maximum[3] = {0, 0, 0};
+    for (size_t i = 0; i < BLOCK_TEXELS; ++i) {
+        const int values[3] = {block.red[i], block.green[i], block.blue[i]};
+        for (size_t c = 0; c < 3; ++c) {
+            minimum[c] = (values[c] < minimum[c]) ? values[c] : minimum[c];
+            maximum[c] = (values[c] > maximum[c]) ? values[c] : maximum[c];
+        }
+    }
+    for (size_t c = 0; c < 3; ++c) {
+        low[c] = static_cast<float>(minimum[c]);
+        high[c] = static_cast<float>(maximum[c]);
+    }
+}
+
+/**
+ * @brief Endpoints from the extremes of the colors projected onto the principal axis.
+ */
+void fit_principal_axis(const ColorBlock &block, float low[3], float high[3])
+{
+    // Mean and covariance.
+
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (size_t i = 0; i < BLOCK_TEXELS; ++i) {
+        mean[0] += static_cast<float>(block.red[i]);
+        mean[1] += static_cast<float>(block.green[i]);
+        mean[2] += static_cast<float>(block.blue[i]);
+    }
+    for (size_t c = 0; c < 3; ++c) {
+        mean[c] /= static_cast<float>(BLOCK_TEXELS);
+    }
+
+    float covariance[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    for (size_t i = 0; i < BLOCK_TEXELS; ++i) {
+        const float r = static_cast<float>(block.red[i]) - mean[0];
+        const float g = static_cast<float>(block.green[i]) - mean[1];
+        const float b = static_cast<float>(block.blue[i]) - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+
+    // Power iteration starting from the bounding box diagonal.
+
+    fit_bounding_box(block, low, high);
+    float axis[3] = {high[0] - low[0], high[1] - low[1], high[2] - low[2]};
+    for (size_t iteration = 0; iteration < 8; ++iteration) {
+        const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        const float length = sqrtf(x * x + y * y + z * z);
+        if (length < 1e-6f) {
+
+            // Single color or degenerate distribution, keep the bounding box.
+
+            return;
+        }
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+
+    // Project the colors.
+
+    float minimum = 0.0f;
+    float maximum = 0.0f;
+    for (size_t i = 0; i < BLOCK_TEXELS; ++i) {
+        const float projection =
+            (static_cast<float>(block.red[i]) - mean[0]) * axis[0] +
+            (static_cast<float>(block.green[i]) - mean[1]) * axis[1] +
+            (static_cast<float>(block.blue[i]) - mean[2]) * axis[2]
+        ;
+        minimum = (projection < minimum) ? projection : minimum;
+        maximum = (projection > maximum) ? projection : maximum;
+    }
+
+    for (size_t c = 0; c < 3; ++c) {
+        low[c] = mean[c] + axis[c] * minimum;
+        high[c] = mean[c] + axis[c] * maximum;
+    }
+}
+
+/**
+ * @brief Moves the endpoints slightly inwards so the interpolated
+ * colors cover the block better.
+ */
+void inset_endpoints(float low[3], float high[3])
+{
+    for (size_t c = 0; c < 3; ++c) {
+        const float inset = (high[c] - low[c]) / 16.0f;
+        low[c] += inset;
+        high[c] -= inset;
+    }
+}
+
+/**
+ * @brief Computes endpoints minimizing the error for given assignment of indices.
+ *
+ * Returns false if the system is singular (all texels use the same weight).
+ */
+bool refine_endpoints(const ColorBlock &block, const unsigned int indices, float low[3], float high[3])
+{
+    static const float WEIGHTS[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+
+    float alpha_alpha = 0.0f;
+    float alpha_beta = 0.0f;
+    float beta_beta = 0.0f;
+    float alpha_x[3] = {0.0f, 0.0f, 0.0f};
+    float beta_x[3] = {0.0f, 0.0f, 0.0f};
+
+    for (size_t i = 0; i < BLOCK_TEXELS; ++i) {
+        const float alpha = WEIGHTS[(indices >> (2 * i)) & 3];
+        const float beta = 1.0f - alpha;
+        const float values[3] = {static_cast<float>(block.red[i]), static_cast<float>(block.green[i]), static_cast<float>(block.blue[i])};
+
+        alpha_alpha += alpha * alpha;
+        alpha_beta += alpha * beta;
+        beta_beta += beta * beta;
+        for (size_t c = 0; c < 3; ++c) {
+            alpha_x[c] += alpha * values[c];
+            beta_x[c] += beta * values[c];
+        }
+    }
+
+    const float determinant = alpha_alpha * beta_beta - alpha_beta * alpha_beta;
+    if (fabsf(determinant) < 1e-6f) {
+        return false;
+    }
+
+    const float inverse = 1.0f / determinant;
+    for (size_t c = 0; c < 3; ++c) {
+        high[c] = (alpha_x[c] * beta_beta - beta_x[c] * alpha_beta) * inverse;
+        low[c] = (beta_x[c] * alpha_alpha - alpha_x[c] * alpha_beta) * inverse;
+    }
+    return true;
+}
+
+void write_16(unsigned char * const destination, const unsigned int value)
+{
+    destination[0] = static_cast<unsigned char>(value & 0xFF);
+    destination[1] = static_cast<unsigned char>((value >> 8) & 0xFF);
+}
+
+void write_32(unsigned char * const destination, const unsigned int value)
+{
+    write_16(destination, value & 0xFFFF);
+    write_16(destination + 2, value >> 16);
+}
+
+unsigned int read_16(const unsigned char * const source)
+{
+    return static_cast<unsigned int>(source[0]) | (static_cast<unsigned int>(source[1]) << 8);
+}
+
+unsigned int read_32(const unsigned char * const source)
+{
+    return read_16(source) | (read_16(source + 2) << 16);
+}
+
+/**
+ * @brief Encodes color part of the block in four color mode.
+ */
+void encode_color_block(const ColorBlock &block, const DXTQuality quality, unsigned char * const destination)
+{
+    float low[3];
+    float high[3];
+    if (quality == DXT_QUALITY_FAST) {
+        fit_bounding_box(block, low, high);
+    }
+    else {
+        fit_principal_axis(block, low, high);
+    }
+    inset_endpoints(low, high);
+
+    unsigned short color0 = pack_565(round_channel(high[0]), round_channel(high[1]), round_channel(high[2]));
+    unsigned short color1 = pack_565(round_channel(low[0]), round_channel(low[1]), round_channel(low[2]));
+    unsigned int indices;
+    unsigned int error = assign_indices(block, color0, color1, indices);
+
+    // Improve the endpoints for the selected indices.
+
+    if (quality == DXT_QUALITY_HIGH) {
+        for (size_t iteration = 0; (iteration < 2) && (error != 0); ++iteration) {
+            if (! refine_endpoints(block, indices, low, high)) {
+                break;
+            }
+            const unsigned short refined_color0 = pack_565(round_channel(high[0]), round_channel(high[1]), round_channel(high[2]));
+            const unsigned short refined_color1 = pack_565(round_channel(low[0]), round_channel(low[1]), round_channel(low[2]));
+            unsigned int refined_indices;
+            const unsigned int refined_error = assign_indices(block, refined_color0, refined_color1, refined_indices);
+            if (refined_error >= error) {
+                break;
+            }
+            color0 = refined_color0;
+            color1 = refined_color1;
+            indices = refined_indices;
+            error = refined_error;
+        }
+    }
+
+    // The four color mode requires color0 > color1. Swapping the colors
+    // swaps the meaning of indices 0<->1 and 2<->3.
+
+    if (color0 < color1) {
+        const unsigned short swap = color0;
+        color0 = color1;
+        color1 = swap;
+        indices ^= 0x55555555;
+    }
+    else if (color0 == color1) {
+        indices = 0;
+    }
+
+    write_16(destination, color0);
+    write_16(destination + 2, color1);
+    write_32(destination + 4, indices);
+}
+
+/**
+ * @brief Encodes explicit 4 bit alpha of the block.
+ */
+void encode_alpha_block(const ColorBlock &block, unsigned char * const destination)
+{
+    for (size_t i = 0; i < BLOCK_TEXELS; i += 2) {
+        const int alpha_low = (block.alpha[i] * 15 + 127) / 255;
+        const int alpha_high = (block.alpha[i + 1] * 15 + 127) / 255;
+        destination[i / 2] = static_cast<unsigned char>(alpha_low | (alpha_high << 4));
+    }
+}
+
+/**
+ * @brief Gathers texels of the block, replicating the edge texels for
+ * blocks crossing border of the image.
+ */
+void read_block(const unsigned int * const pixels, const size_t width, const size_t height, const size_t block_x, const size_t block_y, ColorBlock &block)
+{
+    for (size_t y = 0; y < 4; ++y) {
+        const size_t source_y = ((block_y + y) < height) ? (block_y + y) : (height - 1);
+        for (size_t x = 0; x < 4; ++x) {
+            const size_t source_x = ((block_x + x) < width) ? (block_x + x) : (width - 1);
+            const unsigned int color = pixels[source_y * width + source_x];
+            const size_t index = y * 4 + x;
+            block.alpha[index] = (color >> 24) & 0xFF;
+            block.red[index] = (color >> 16) & 0xFF;
+            block.green[index] = (color >> 8) & 0xFF;
+            block.blue[index] = color & 0xFF;
+        }
+    }
+}
+
+/**
+ * @brief Decodes color part of the block.
+ *
+ * Three color mode with transparent black is used for DXT1 blocks with color0 <= color1.
+ */
+void decode_color_block(const unsigned char * const source, const bool allow_three_color, unsigned int colors[BLOCK_TEXELS])
+{
+    const unsigned short color0 = static_cast<unsigned short>(read_16(source));
+    const unsigned short color1 = static_cast<unsigned short>(read_16(source + 2));
+    const unsigned int indices = read_32(source + 4);
+
+    int red[4];
+    int green[4];
+    int blue[4];
+    build_palette(color0, color1, red, green, blue);
+    unsigned int palette[4];
+    for (size_t i = 0; i < 4; ++i) {
+        palette[i] = 0xFF000000 | (red[i] << 16) | (green[i] << 8) | blue[i];
+    }
+
+    if (allow_three_color && (color0 <= color1)) {
+        palette[2] = 0xFF000000 | (((red[0] + red[1]) / 2) << 16) | (((green[0] + green[1]) / 2) << 8) | ((blue[0] + blue[1]) / 2);
+        palette[3] = 0x00000000;
+    }
+
+    for (size_t i = 0; i < BLOCK_TEXELS; ++i) {
+        colors[i] = palette[(indices >> (2 * i)) & 3];
+    }
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Returns size of compressed image in bytes.
+ */
+size_t get_dxt_size(const DXTFormat format, const size_t width, const size_t height)
+{
+    const size_t block_count = ((width + 3) / 4) * ((height + 3) / 4);
+    return block_count * ((format == DXT_FORMAT_DXT1) ? 8 : 16);
+}
+
+/**
+ * @brief Compresses image of 8888 (ARGB) texels.
+ *
+ * The destination must have get_dxt_size() bytes. Alpha is ignored for DXT1.
+ */
+void encode_dxt(const DXTFormat format, const DXTQuality quality, const unsigned int * const pixels, const size_t width, const size_t height, void * const destination)
+{
+    assert(pixels);
+    assert(destination);
+    assert((width > 0) && (height > 0));
+
+    unsigned char * output = static_cast<unsigned char *>(destination);
+    ColorBlock block;
+    for (size_t block_y = 0; block_y < height; block_y += 4) {
+        for (size_t block_x = 0; block_x < width; block_x += 4) {
+            read_block(pixels, width, height, block_x, block_y, block);
+            if (format == DXT_FORMAT_DXT3) {
+                encode_alpha_block(block, output);
+                output += 8;
+            }
+            encode_color_block(block, quality, output);
+            output += 8;
+        }
+    }
+}
+
+/**
+ * @brief Decompresses image into 8888 (ARGB) texels.
+ */
+void decode_dxt(const DXTFormat format, const void * const source, const size_t width, const size_t height, unsigned int * const pixels)
+{
+    assert(source);
+    assert(pixels);
+
+    const unsigned char * input = static_cast<const unsigned char *>(source);
+    unsigned int colors[BLOCK_TEXELS];
+    for (size_t block_y = 0; block_y < height; block_y += 4) {
+        for (size_t block_x = 0; block_x < width; block_x += 4) {
+            const unsigned char * const alpha = input;
+            if (format == DXT_FORMAT_DXT3) {
+                input += 8;
+            }
+            decode_color_block(input, format == DXT_FORMAT_DXT1, colors);
+            input += 8;
+
+            for (size_t y = 0; y < 4; ++y) {
+                for (size_t x = 0; x < 4; ++x) {
+                    if (((block_x + x) >= width) || ((block_y + y) >= height)) {
+                        continue;
+                    }
+                    const size_t index = y * 4 + x;
+                    unsigned int color = colors[index];
+                    if (format == DXT_FORMAT_DXT3) {
+                        const unsigned int alpha_4 = (alpha[index / 2] >> (4 * (index & 1))) & 0xF;
+                        color = (color & 0x00FFFFFF) | (((alpha_4 << 4) | alpha_4) << 24);
+                    }
+                    pixels[(block_y + y) * width + block_x + x] = color;
+                }
+            }
+        }
+    }
+}
+
+} // namespace emu
+
+// EOF //
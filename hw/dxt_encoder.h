@@ -0,0 +1,33 @@
+#ifndef DXT_ENCODER_H
+#define DXT_ENCODER_H
+
+#include <cstddef>
+
+namespace emu {
+
+enum DXTFormat {
+    DXT_FORMAT_DXT1, // Opaque color.
+    DXT_FORMAT_DXT3, // Color with explicit 4 bit alpha.
+};
+
+/**
+ * @brief Tradeoff between speed and quality of the encoder.
+ */
+enum DXTQuality {
+    DXT_QUALITY_FAST,   // Endpoints from bounding box of the block colors.
+    DXT_QUALITY_NORMAL, // Endpoints along the principal axis of the block colors.
+    DXT_QUALITY_HIGH,   // Principal axis with least squares refinement of the endpoints.
+
+    SIZE_OF_DXT_QUALITY
+};
+
+size_t get_dxt_size(const DXTFormat format, const size_t width, const size_t height);
+
+void encode_dxt(const DXTFormat format, const DXTQuality quality, const unsigned int * const pixels, const size_t width, const size_t height, void * const destination);
+void decode_dxt(const DXTFormat format, const void * const source, const size_t width, const size_t height, unsigned int * const pixels);
+
+} // namespace emu
+
+#endif // DXT_ENCODER_H
+
+// EOF //
@@ -6,65 +6,11 @@
 #include <cstdlib> //<stdlib.h>
 #include <list>
 #include "../helpers/common.h"
+#include "hw_types.h"
+#include "texture_atlas.h"
 
 namespace emu {
 
-enum HWFormat {
-    HWFORMAT_NONE, // Used to indicate error states.
-    HWFORMAT_R5G6B5,
-    HWFORMAT_R4G4B4A4,
-    HWFORMAT_ZBUFFER,
-
-    SIZE_OF_HWFORMAT,
-};
-
-enum AlphaTest {
-    ALPHA_TEST_NONE,
-    ALPHA_TEST_NOEQUAL,
-};
-
-enum Blend {
-    BLEND_NONE,
-    BLEND_OVER,
-    BLEND_ADD,
-};
-
-enum Fog {
-    FOG_NONE,
-    FOG_VERTEX,
-    FOG_TABLE,
-
-    SIZE_OF_FOG
-};
-
-enum TextureBlend {
-    TEXTURE_BLEND_MODULATE,
-    TEXTURE_BLEND_MODULATEALPHA
-};
-
-enum DepthTest {
-    DEPTH_TEST_NONE,
-    DEPTH_TEST_ON,
-    DEPTH_TEST_NOZWRITE
-};
-
-typedef void * HWSurfaceHandle;
-const HWSurfaceHandle INVALID_SURFACE_HANDLE = NULL;
-
-/**
- * @brief Vertex passed to the triangle rendering function.
- */
-struct TLVertex {
-    float sx;
-    float sy;
-    float sz;
-    float rhw;
-    DWORD color;
-    DWORD specular;
-    float tu;
-    float tv;
-};
-
 /**
  * @brief Description of single display mode.
  */
@@ -148,14 +94,57 @@ public:
 
     /**
      * @brief Destroys specified surface.
+     *
+     * Shared surface is destroyed when its last owner destroys it.
      */
     virtual void destroy_surface(const HWSurfaceHandle surface) = 0;
 
+    /**
+     * @brief Adds owner to non render target surface and returns its handle.
+     *
+     * The shared surface must not be updated or rendered into.
+     */
+    virtual HWSurfaceHandle share_surface(const HWSurfaceHandle surface) = 0;
+
+    /**
+     * @brief Checks if the surface has more than one owner.
+     */
+    virtual bool is_surface_shared(const HWSurfaceHandle surface) = 0;
+
     /**
      * @brief Sets content of the surface from specified memory block.
      */
     virtual void update_surface(const HWSurfaceHandle surface, const void * const memory) = 0;
 
+    /**
+     * @brief Starts conversion of memory block for later update of non render target surface.
+     *
+     * The conversion runs in background. The memory must not be modified until
+     * the update is applied or discarded. Returns INVALID_PREPARED_UPDATE if
+     * the layer does not benefit from the preparation.
+     */
+    virtual HWPreparedUpdate prepare_update(const size_t width, const size_t height, const HWFormat format, const void * const memory) = 0;
+
+    /**
+     * @brief Sets content of the surface from prepared update and releases the update.
+     *
+     * Waits for the conversion if it is not finished yet.
+     */
+    virtual void apply_prepared_update(const HWSurfaceHandle surface, const HWPreparedUpdate update) = 0;
+
+    /**
+     * @brief Creates non render target surface with content of prepared update and releases the update.
+     *
+     * The layer might return surface created ahead of time for content
+     * which is expected to be used.
+     */
+    virtual HWSurfaceHandle create_surface_from_update(const size_t width, const size_t height, const HWFormat format, const HWPreparedUpdate update) = 0;
+
+    /**
+     * @brief Releases prepared update without applying it.
+     */
+    virtual void discard_prepared_update(const HWPreparedUpdate update) = 0;
+
     /**
      * @brief Loads content of specified surface to specified memory block.
      */
@@ -171,6 +160,22 @@ public:
      */
     virtual void compose_render_target(const HWSurfaceHandle surface, const void * const memory, const float * const color_key) = 0;
 
+    /**
+     * @brief Returns the texture atlas page holding copy of specified surface
+     * and the mapping of its texture coordinates to the page.
+     *
+     * Returns false if the surface is not in the atlas. The page can be set
+     * by set_texture_surface instead of the surface for draws which sample
+     * only inside of the surface.
+     */
+    virtual bool get_atlas_placement(const HWSurfaceHandle surface, HWSurfaceHandle &page, AtlasTransform &transform) = 0;
+
+    /**
+     * @brief Removes specified surface from the texture atlas and keeps
+     * it out of it because it is drawn with wrapping.
+     */
+    virtual void exclude_from_atlas(const HWSurfaceHandle surface) = 0;
+
     // State setup.
 
     /**
@@ -254,6 +259,14 @@ public:
      */
     virtual void draw_triangles(const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t triangle_count) = 0;
 
+    /**
+     * @brief Draws specified triangle strip.
+     *
+     * The vertices array points to the same vertices which were provided to last set_triangle_vertices()
+     * call. The strip may contain degenerate triangles.
+     */
+    virtual void draw_triangle_strip(const TLVertex * const vertices, const size_t vertex_start, const size_t vertex_count, const unsigned short * const indices, const size_t index_count) = 0;
+
     /**
      * @brief Draws specified vertices.
      *
@@ -0,0 +1,73 @@
+#ifndef HW_TYPES_H
+#define HW_TYPES_H
+
+#include <cstddef>
+
+namespace emu {
+
+enum HWFormat {
+    HWFORMAT_NONE, // Used to indicate error states.
+    HWFORMAT_R5G6B5,
+    HWFORMAT_R4G4B4A4,
+    HWFORMAT_ZBUFFER,
+
+    SIZE_OF_HWFORMAT,
+};
+
+enum AlphaTest {
+    ALPHA_TEST_NONE,
+    ALPHA_TEST_NOEQUAL,
+};
+
+enum Blend {
+    BLEND_NONE,
+    BLEND_OVER,
+    BLEND_ADD,
+};
+
+enum Fog {
+    FOG_NONE,
+    FOG_VERTEX,
+    FOG_TABLE,
+
+    SIZE_OF_FOG
+};
+
+enum TextureBlend {
+    TEXTURE_BLEND_MODULATE,
+    TEXTURE_BLEND_MODULATEALPHA
+};
+
+enum DepthTest {
+    DEPTH_TEST_NONE,
+    DEPTH_TEST_ON,
+    DEPTH_TEST_NOZWRITE
+};
+
+typedef void * HWSurfaceHandle;
+const HWSurfaceHandle INVALID_SURFACE_HANDLE = NULL;
+
+typedef void * HWPreparedUpdate;
+const HWPreparedUpdate INVALID_PREPARED_UPDATE = NULL;
+
+/**
+ * @brief Vertex passed to the triangle rendering function.
+ *
+ * Has the layout of D3DTLVERTEX.
+ */
+struct TLVertex {
+    float sx;
+    float sy;
+    float sz;
+    float rhw;
+    unsigned int color;
+    unsigned int specular;
+    float tu;
+    float tv;
+};
+
+} // namespace emu
+
+#endif // HW_TYPES_H
+
+// EOF //
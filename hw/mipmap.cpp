@@ -0,0 +1,258 @@
+#include "mipmap.h"
+#include "../helpers/cpu_features.h"
+#include <emmintrin.h>
+#include <assert.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief Averages four 8888 texels with rounding.
+ */
+inline unsigned int average_box(const unsigned int * const texels)
+{
+    unsigned int result = 0;
+    for (unsigned int shift = 0; shift < 32; shift += 8) {
+        unsigned int sum = 2;
+        for (size_t i = 0; i < 4; ++i) {
+            sum += (texels[i] >> shift) & 0xFF;
+        }
+        result |= (sum / 4) << shift;
+    }
+    return result;
+}
+
+/**
+ * @brief Averages four 8888 texels with color weighted by alpha.
+ *
+ * Color of fully transparent texels does not bleed into visible ones.
+ * If all texels are transparent, the colors are averaged evenly.
+ */
+inline unsigned int average_alpha_weighted(const unsigned int * const texels)
+{
+    unsigned int alpha_sum = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        alpha_sum += texels[i] >> 24;
+    }
+    if (alpha_sum == 0) {
+        return average_box(texels);
+    }
+
+    unsigned int result = ((alpha_sum + 2) / 4) << 24;
+    for (unsigned int shift = 0; shift < 24; shift += 8) {
+        unsigned int sum = alpha_sum / 2;
+        for (size_t i = 0; i < 4; ++i) {
+            sum += ((texels[i] >> shift) & 0xFF) * (texels[i] >> 24);
+        }
+        result |= (sum / alpha_sum) << shift;
+    }
+    return result;
+}
+
+/**
+ * @brief Applies the averaging function to each 2x2 block of the source.
+ */
+typedef unsigned int (*AverageFunction)(const unsigned int * const texels);
+
+void downsample_scalar(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination, const AverageFunction average)
+{
+    assert(source);
+    assert(destination);
+
+    const size_t dest_width = get_mipmap_level_size(width, 1);
+    const size_t dest_height = get_mipmap_level_size(height, 1);
+    const size_t step_x = (width > 1) ? 1 : 0;
+    const size_t step_y = (height > 1) ? width : 0;
+
+    for (size_t y = 0; y < dest_height; ++y) {
+        const unsigned int * src = source + (y * 2 * width);
+        unsigned int * dest = destination + (y * dest_width);
+        for (size_t x = 0; x < dest_width; ++x, src += 2 * step_x, ++dest) {
+            const unsigned int texels[4] = {src[0], src[step_x], src[step_y], src[step_y + step_x]};
+            *dest = average(texels);
+        }
+    }
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Returns number of levels of full mipmap chain down to 1x1.
+ */
+size_t get_mipmap_level_count(const size_t width, const size_t height)
+{
+    size_t count = 1;
+    for (size_t size = (width > height) ? width : height; size > 1; size /= 2) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Returns width or height of specified level.
+ */
+size_t get_mipmap_level_size(const size_t size, const size_t level)
+{
+    const size_t result = size >> level;
+    return (result > 0) ? result : 1;
+}
+
+/**
+ * @brief Creates next mipmap level of 8888 image.
+ *
+ * Uses the SSE2 implementation when possible. The result is the same
+ * as the one of the scalar implementation.
+ */
+void downsample(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination, const bool alpha_weighted)
+{
+    const bool use_sse2 = (width > 1) && (height > 1) && has_sse2();
+    if (alpha_weighted) {
+        if (use_sse2) {
+            downsample_alpha_weighted_sse2(source, width, height, destination);
+        }
+        else {
+            downsample_alpha_weighted(source, width, height, destination);
+        }
+    }
+    else {
+        if (use_sse2) {
+            downsample_box_sse2(source, width, height, destination);
+        }
+        else {
+            downsample_box(source, width, height, destination);
+        }
+    }
+}
+
+/**
+ * @brief Creates next mipmap level of 8888 image using 2x2 box filter.
+ *
+ * The destination has half of the size in each dimension (at least 1).
+ * Dimension which is already 1 is not filtered.
+ */
+void downsample_box(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination)
+{
+    downsample_scalar(source, width, height, destination, average_box);
+}
+
+/**
+ * @brief Creates next mipmap level of 8888 image using 2x2 box filter
+ * with color weighted by alpha.
+ *
+ * Intended for textures with transparent parts, whose color is usually
+ * garbage.
+ */
+void downsample_alpha_weighted(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination)
+{
+    downsample_scalar(source, width, height, destination, average_alpha_weighted);
+}
+
+/**
+ * @brief SSE2 version of downsample_box().
+ *
+ * Produces two texels per iteration.
+ */
+void downsample_box_sse2(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination)
+{
+    assert(source);
+    assert(destination);
+    assert((width > 1) && (height > 1));
+
+    const size_t dest_width = width / 2;
+    const size_t dest_height = height / 2;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16(2);
+
+    for (size_t y = 0; y < dest_height; ++y) {
+        const unsigned int * src = source + (y * 2 * width);
+        unsigned int * dest = destination + (y * dest_width);
+        size_t x = 0;
+        for (; (x + 2) <= dest_width; x += 2, src += 4, dest += 2) {
+
+            // Sum the rows, each 16 bit half holds pair of texels.
+
+            const __m128i row_0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+            const __m128i row_1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + width));
+            const __m128i sum_lo = _mm_add_epi16(_mm_unpacklo_epi8(row_0, zero), _mm_unpacklo_epi8(row_1, zero));
+            const __m128i sum_hi = _mm_add_epi16(_mm_unpackhi_epi8(row_0, zero), _mm_unpackhi_epi8(row_1, zero));
+
+            // Sum the pairs.
+
+            const __m128i pair_lo = _mm_add_epi16(sum_lo, _mm_srli_si128(sum_lo, 8));
+            const __m128i pair_hi = _mm_add_epi16(sum_hi, _mm_srli_si128(sum_hi, 8));
+            const __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(pair_lo, pair_hi), rounding);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dest), _mm_packus_epi16(_mm_srli_epi16(sum, 2), zero));
+        }
+
+        // Odd texel at the end.
+
+        if (x < dest_width) {
+            const unsigned int texels[4] = {src[0], src[1], src[width], src[width + 1]};
+            *dest = average_box(texels);
+        }
+    }
+}
+
+/**
+ * @brief SSE2 version of downsample_alpha_weighted().
+ *
+ * Produces one texel per iteration. The division is done in floating
+ * point which gives the same results as the integer one for this range.
+ */
+void downsample_alpha_weighted_sse2(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination)
+{
+    assert(source);
+    assert(destination);
+    assert((width > 1) && (height > 1));
+
+    const size_t dest_width = width / 2;
+    const size_t dest_height = height / 2;
+    const __m128i zero = _mm_setzero_si128();
+
+    // Alpha channel is multiplied by one so its sum is the sum of weights.
+
+    const __m128i color_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i alpha_one = _mm_set_epi16(1, 0, 0, 0, 1, 0, 0, 0);
+    const __m128 half = _mm_set1_ps(0.5f);
+
+    for (size_t y = 0; y < dest_height; ++y) {
+        const unsigned int * src = source + (y * 2 * width);
+        unsigned int * dest = destination + (y * dest_width);
+        for (size_t x = 0; x < dest_width; ++x, src += 2, ++dest) {
+            const __m128i row_0 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src)), zero);
+            const __m128i row_1 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + width)), zero);
+
+            // Broadcast alpha of each texel to all its channels.
+
+            const __m128i alpha_0 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(row_0, 0xFF), 0xFF);
+            const __m128i alpha_1 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(row_1, 0xFF), 0xFF);
+            const __m128i weight_0 = _mm_or_si128(_mm_and_si128(alpha_0, color_mask), alpha_one);
+            const __m128i weight_1 = _mm_or_si128(_mm_and_si128(alpha_1, color_mask), alpha_one);
+
+            // The products fit to unsigned 16 bits, their sums need 32 bits.
+
+            const __m128i product_0 = _mm_mullo_epi16(row_0, weight_0);
+            const __m128i product_1 = _mm_mullo_epi16(row_1, weight_1);
+            const __m128i sum = _mm_add_epi32(
+                _mm_add_epi32(_mm_unpacklo_epi16(product_0, zero), _mm_unpackhi_epi16(product_0, zero)),
+                _mm_add_epi32(_mm_unpacklo_epi16(product_1, zero), _mm_unpackhi_epi16(product_1, zero)));
+
+            const int alpha_sum = _mm_cvtsi128_si32(_mm_srli_si128(sum, 12));
+            if (alpha_sum == 0) {
+                const unsigned int texels[4] = {src[0], src[1], src[width], src[width + 1]};
+                *dest = average_box(texels);
+                continue;
+            }
+
+            const __m128 color = _mm_add_ps(_mm_div_ps(_mm_cvtepi32_ps(sum), _mm_set1_ps(static_cast<float>(alpha_sum))), half);
+            const __m128i color_16 = _mm_packs_epi32(_mm_cvttps_epi32(color), zero);
+            const unsigned int color_8 = static_cast<unsigned int>(_mm_cvtsi128_si32(_mm_packus_epi16(color_16, zero)));
+            *dest = (color_8 & 0x00FFFFFF) | (static_cast<unsigned int>((alpha_sum + 2) / 4) << 24);
+        }
+    }
+}
+
+} // namespace emu
+
+// EOF //
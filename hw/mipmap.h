@@ -0,0 +1,27 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <cstddef>
+
+namespace emu {
+
+size_t get_mipmap_level_count(const size_t width, const size_t height);
+size_t get_mipmap_level_size(const size_t size, const size_t level);
+
+void downsample(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination, const bool alpha_weighted);
+
+// Scalar reference implementations.
+
+void downsample_box(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination);
+void downsample_alpha_weighted(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination);
+
+// SSE2 implementations, require both dimensions of at least 2.
+
+void downsample_box_sse2(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination);
+void downsample_alpha_weighted_sse2(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination);
+
+} // namespace emu
+
+#endif // MIPMAP_H
+
+// EOF //
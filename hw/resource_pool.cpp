@@ -0,0 +1,176 @@
+#include "resource_pool.h"
+#include <assert.h>
+
+namespace emu {
+
+ResourceKey::ResourceKey()
+    : type(0)
+    , format(0)
+    , usage(0)
+    , pool(0)
+    , levels(0)
+    , multisample(0)
+    , width(0)
+    , height(0)
+{
+}
+
+/**
+ * @brief Checks if the resources differ at most in their size.
+ */
+bool ResourceKey::is_compatible(const ResourceKey &other) const
+{
+    return (type == other.type) && (format == other.format) && (usage == other.usage) && (pool == other.pool) && (levels == other.levels) && (multisample == other.multisample);
+}
+
+bool ResourceKey::is_exact(const ResourceKey &other) const
+{
+    return is_compatible(other) && (width == other.width) && (height == other.height);
+}
+
+ResourcePool::Statistics::Statistics()
+    : hits(0)
+    , larger_hits(0)
+    , misses(0)
+    , evictions(0)
+    , count(0)
+    , bytes(0)
+    , peak_bytes(0)
+{
+}
+
+ResourcePool::ResourcePool()
+    : entries()
+    , byte_limit(0)
+    , statistics()
+{
+}
+
+/**
+ * @brief Sets maximal memory used by the pooled entries.
+ *
+ * Zero value disables the limit. The new limit is enforced during next
+ * release of an entry.
+ */
+void ResourcePool::set_limit(const size_t the_byte_limit)
+{
+    byte_limit = the_byte_limit;
+}
+
+/**
+ * @brief Removes entry best matching the key from the pool.
+ *
+ * If the allow_larger is set, the smallest compatible entry at least as big
+ * as the requested size is returned. Exact match is preferred. Among equally good
+ * entries the least recently released one is used as its internal HW copy is
+ * the least likely to be still in use.
+ *
+ * Returns NULL if there is no suitable entry. Otherwise the found_key (if not NULL)
+ * receives the parameters of the returned entry.
+ */
+ResourcePool::Entry ResourcePool::acquire(const ResourceKey &key, const bool allow_larger, ResourceKey * const found_key)
+{
+    size_t best_index = entries.size();
+    size_t best_area = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const ResourceKey &candidate = entries[i].key;
+        if (candidate.is_exact(key)) {
+            best_index = i;
+            break;
+        }
+        if ((! allow_larger) || (! candidate.is_compatible(key))) {
+            continue;
+        }
+        if ((candidate.width < key.width) || (candidate.height < key.height)) {
+            continue;
+        }
+        const size_t area = candidate.width * candidate.height;
+        if ((best_index == entries.size()) || (area < best_area)) {
+            best_index = i;
+            best_area = area;
+        }
+    }
+
+    if (best_index == entries.size()) {
+        statistics.misses++;
+        return NULL;
+    }
+
+    const PooledEntry found = entries[best_index];
+    remove_entry(best_index);
+
+    statistics.hits++;
+    if (! found.key.is_exact(key)) {
+        statistics.larger_hits++;
+    }
+    if (found_key) {
+        *found_key = found.key;
+    }
+    return found.entry;
+}
+
+/**
+ * @brief Inserts entry into the pool.
+ *
+ * Least recently released entries which had to be removed to satisfy the
+ * memory limit are appended to the evicted list. The inserted entry itself
+ * can be evicted if it alone exceeds the limit.
+ */
+void ResourcePool::release(const ResourceKey &key, const Entry entry, const size_t bytes, EntryList &evicted)
+{
+    assert(entry);
+
+    PooledEntry pooled;
+    pooled.key = key;
+    pooled.entry = entry;
+    pooled.bytes = bytes;
+    entries.push_back(pooled);
+
+    statistics.count++;
+    statistics.bytes += bytes;
+    if (statistics.bytes > statistics.peak_bytes) {
+        statistics.peak_bytes = statistics.bytes;
+    }
+
+    // Enforce the limit.
+
+    if (byte_limit != 0) {
+        while ((statistics.bytes > byte_limit) && (! entries.empty())) {
+            evicted.push_back(entries.front().entry);
+            remove_entry(0);
+            statistics.evictions++;
+        }
+    }
+}
+
+/**
+ * @brief Removes all entries from the pool.
+ *
+ * The statistics are preserved.
+ */
+void ResourcePool::clear(EntryList &removed)
+{
+    for (size_t i = 0; i < entries.size(); ++i) {
+        removed.push_back(entries[i].entry);
+    }
+    entries.clear();
+    statistics.count = 0;
+    statistics.bytes = 0;
+}
+
+const ResourcePool::Statistics &ResourcePool::get_statistics(void) const
+{
+    return statistics;
+}
+
+void ResourcePool::remove_entry(const size_t index)
+{
+    assert(index < entries.size());
+    statistics.count--;
+    statistics.bytes -= entries[index].bytes;
+    entries.erase(entries.begin() + index);
+}
+
+} // namespace emu
+
+// EOF //
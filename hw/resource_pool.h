@@ -0,0 +1,155 @@
+#ifndef RESOURCE_POOL_H
+#define RESOURCE_POOL_H
+
+#include <cstddef>
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Parameters identifying compatible resources.
+ *
+ * The values are API specific, the pool only compares them.
+ */
+struct ResourceKey {
+
+    /**
+     * @brief Kind of the resource (texture, standalone surface, ...).
+     */
+    unsigned int type;
+
+    unsigned int format;
+    unsigned int usage;
+    unsigned int pool;
+    unsigned int levels;
+
+    /**
+     * @brief Multisampling type and quality packed together.
+     */
+    unsigned int multisample;
+
+    size_t width;
+    size_t height;
+
+    ResourceKey();
+
+    bool is_compatible(const ResourceKey &other) const;
+    bool is_exact(const ResourceKey &other) const;
+};
+
+/**
+ * @brief Pool of released resources for reuse.
+ *
+ * Unlike the SurfaceCache, the resources can have arbitrary size and
+ * resource larger than requested can be returned if the caller allows it.
+ * The entries are opaque to the pool, the owner is responsible for destruction
+ * of entries which are evicted from the pool.
+ */
+class ResourcePool {
+
+public:
+
+    /**
+     * @brief Opaque pooled object.
+     */
+    typedef void * Entry;
+
+    /**
+     * @brief List of entries removed from the pool.
+     */
+    typedef std::vector<Entry> EntryList;
+
+    /**
+     * @brief Usage statistics of the pool.
+     */
+    struct Statistics {
+
+        /**
+         * @brief Number of requests satisfied from the pool.
+         */
+        size_t hits;
+
+        /**
+         * @brief Number of hits which returned larger resource.
+         */
+        size_t larger_hits;
+
+        /**
+         * @brief Number of requests which did not find compatible resource.
+         */
+        size_t misses;
+
+        /**
+         * @brief Number of entries removed because of the memory limit.
+         */
+        size_t evictions;
+
+        /**
+         * @brief Number of entries currently in the pool.
+         */
+        size_t count;
+
+        /**
+         * @brief Memory currently used by the entries.
+         */
+        size_t bytes;
+
+        /**
+         * @brief Maximal value of the bytes.
+         */
+        size_t peak_bytes;
+
+        Statistics();
+    };
+
+private:
+
+    struct PooledEntry {
+        ResourceKey key;
+        Entry entry;
+
+        /**
+         * @brief Memory used by the entry.
+         */
+        size_t bytes;
+    };
+
+    /**
+     * @brief Entries ordered from the least recently released to the most
+     * recently released one.
+     */
+    std::vector<PooledEntry> entries;
+
+    /**
+     * @brief Maximal memory used by all entries. Zero means no limit.
+     */
+    size_t byte_limit;
+
+    Statistics statistics;
+
+public:
+
+    ResourcePool();
+
+    void set_limit(const size_t the_byte_limit);
+
+    // Pool operations.
+
+    Entry acquire(const ResourceKey &key, const bool allow_larger, ResourceKey * const found_key);
+    void release(const ResourceKey &key, const Entry entry, const size_t bytes, EntryList &evicted);
+    void clear(EntryList &removed);
+
+    // Queries.
+
+    const Statistics &get_statistics(void) const;
+
+private:
+
+    void remove_entry(const size_t index);
+};
+
+} // namespace emu
+
+#endif // RESOURCE_POOL_H
+
+// EOF //
@@ -0,0 +1,238 @@
+#include "static_geometry_cache.h"
+#include <assert.h>
+
+namespace emu {
+
+GeometryKey::GeometryKey()
+    : vertex_hash(0)
+    , index_hash(0)
+    , vertex_start(0)
+    , vertex_count(0)
+    , index_count(0)
+    , type(0)
+{
+}
+
+bool GeometryKey::operator<(const GeometryKey &other) const
+{
+    if (vertex_hash != other.vertex_hash) {
+        return vertex_hash < other.vertex_hash;
+    }
+    if (index_hash != other.index_hash) {
+        return index_hash < other.index_hash;
+    }
+    if (vertex_start != other.vertex_start) {
+        return vertex_start < other.vertex_start;
+    }
+    if (vertex_count != other.vertex_count) {
+        return vertex_count < other.vertex_count;
+    }
+    if (index_count != other.index_count) {
+        return index_count < other.index_count;
+    }
+    return type < other.type;
+}
+
+StaticGeometryCache::Statistics::Statistics()
+    : streamed(0)
+    , resident(0)
+    , promotions(0)
+    , evictions(0)
+{
+}
+
+StaticGeometryCache::StaticGeometryCache()
+    : records()
+    , promote_frames(3)
+    , byte_limit(0)
+    , total_bytes(0)
+    , resident_count(0)
+    , frame(0)
+    , next_sequence(0)
+    , statistics()
+{
+}
+
+/**
+ * @brief Sets number of consecutive frames after which the geometry is
+ * promoted and maximal memory used by the promoted geometry.
+ */
+void StaticGeometryCache::configure(const size_t the_promote_frames, const size_t the_byte_limit)
+{
+    assert(the_promote_frames > 0);
+    promote_frames = the_promote_frames;
+    byte_limit = the_byte_limit;
+}
+
+/**
+ * @brief Records draw of specified geometry and decides from where it should be drawn.
+ *
+ * The promotion is requested only once, when the geometry reaches the required
+ * number of frames. If the owner fails to create the buffers, the geometry
+ * continues to be streamed.
+ */
+StaticGeometryCache::Decision StaticGeometryCache::lookup(const GeometryKey &key, const size_t bytes, Entry &entry)
+{
+    entry = NULL;
+
+    RecordMap::iterator it = records.find(key);
+    if (it == records.end()) {
+        Record record;
+        record.streak = 0;
+        record.frame = frame;
+        record.sequence = 0;
+        record.entry = NULL;
+        record.bytes = 0;
+        it = records.insert(RecordMap::value_type(key, record)).first;
+    }
+
+    // Update the streak, multiple draws in single frame count once.
+
+    Record &record = it->second;
+    if (record.streak == 0) {
+        record.streak = 1;
+    }
+    else if ((record.frame + 1) == frame) {
+        record.streak++;
+    }
+    else if (record.frame != frame) {
+        record.streak = 1;
+    }
+    record.frame = frame;
+    record.sequence = next_sequence++;
+
+    // Resident geometry.
+
+    if (record.entry != NULL) {
+        entry = record.entry;
+        statistics.resident++;
+        return DECISION_RESIDENT;
+    }
+
+    // Geometry which is static long enough and fits into the budget.
+
+    if ((record.streak == promote_frames) && (bytes <= byte_limit)) {
+        return DECISION_PROMOTE;
+    }
+
+    statistics.streamed++;
+    return DECISION_STREAM;
+}
+
+/**
+ * @brief Stores entry created for geometry for which the lookup() requested promotion.
+ *
+ * Evicts the least recently used entries to fit into the byte limit.
+ */
+void StaticGeometryCache::insert(const GeometryKey &key, const Entry entry, const size_t bytes, EntryList &evicted)
+{
+    assert(entry != NULL);
+
+    const RecordMap::iterator it = records.find(key);
+    assert(it != records.end());
+    assert(it->second.entry == NULL);
+    if ((it == records.end()) || (it->second.entry != NULL)) {
+        evicted.push_back(entry);
+        return;
+    }
+
+    it->second.entry = entry;
+    it->second.bytes = bytes;
+    total_bytes += bytes;
+    resident_count++;
+    statistics.promotions++;
+
+    while (total_bytes > byte_limit) {
+        if (! evict_least_recently_used(it, evicted)) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Ends the current frame.
+ *
+ * Forgets the candidates which were not drawn in it as their streak is broken.
+ */
+void StaticGeometryCache::advance_frame(void)
+{
+    RecordMap::iterator it = records.begin();
+    while (it != records.end()) {
+        if ((it->second.entry == NULL) && (it->second.frame != frame)) {
+            records.erase(it++);
+        }
+        else {
+            ++it;
+        }
+    }
+    frame++;
+}
+
+/**
+ * @brief Removes all entries and candidates.
+ */
+void StaticGeometryCache::clear(EntryList &removed)
+{
+    for (RecordMap::iterator it = records.begin(); it != records.end(); ++it) {
+        if (it->second.entry != NULL) {
+            removed.push_back(it->second.entry);
+        }
+    }
+    records.clear();
+    total_bytes = 0;
+    resident_count = 0;
+}
+
+size_t StaticGeometryCache::get_total_bytes(void) const
+{
+    return total_bytes;
+}
+
+size_t StaticGeometryCache::get_resident_count(void) const
+{
+    return resident_count;
+}
+
+/**
+ * @brief Returns number of tracked geometries including the resident ones.
+ */
+size_t StaticGeometryCache::get_candidate_count(void) const
+{
+    return records.size();
+}
+
+const StaticGeometryCache::Statistics &StaticGeometryCache::get_statistics(void) const
+{
+    return statistics;
+}
+
+/**
+ * @brief Evicts resident entry with the oldest use, except the specified one.
+ */
+bool StaticGeometryCache::evict_least_recently_used(const RecordMap::iterator &keep, EntryList &evicted)
+{
+    RecordMap::iterator oldest = records.end();
+    for (RecordMap::iterator it = records.begin(); it != records.end(); ++it) {
+        if ((it == keep) || (it->second.entry == NULL)) {
+            continue;
+        }
+        if ((oldest == records.end()) || (it->second.sequence < oldest->second.sequence)) {
+            oldest = it;
+        }
+    }
+    if (oldest == records.end()) {
+        return false;
+    }
+
+    evicted.push_back(oldest->second.entry);
+    assert(total_bytes >= oldest->second.bytes);
+    total_bytes -= oldest->second.bytes;
+    resident_count--;
+    statistics.evictions++;
+    records.erase(oldest);
+    return true;
+}
+
+} // namespace emu
+
+// EOF //
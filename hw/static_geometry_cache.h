@@ -0,0 +1,134 @@
+#ifndef STATIC_GEOMETRY_CACHE_H
+#define STATIC_GEOMETRY_CACHE_H
+
+#include "../helpers/hash.h"
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Identification of single draw of indexed geometry.
+ */
+struct GeometryKey {
+    ContentHash vertex_hash;
+    ContentHash index_hash;
+    size_t vertex_start;
+    size_t vertex_count;
+    size_t index_count;
+
+    /**
+     * @brief API specific primitive type.
+     */
+    unsigned int type;
+
+    GeometryKey();
+
+    bool operator<(const GeometryKey &other) const;
+};
+
+/**
+ * @brief Decides which geometry should be moved to static buffers.
+ *
+ * Geometry drawn in the given number of consecutive frames is promoted.
+ * The promoted geometry is kept until the byte limit forces eviction of
+ * the least recently used one. The entries are opaque to the cache and
+ * the owner is responsible for destruction of entries which are evicted.
+ */
+class StaticGeometryCache {
+
+public:
+
+    /**
+     * @brief Opaque object holding the static buffers.
+     */
+    typedef void * Entry;
+
+    /**
+     * @brief List of entries removed from the cache.
+     */
+    typedef std::vector<Entry> EntryList;
+
+    enum Decision {
+        DECISION_STREAM,   // Draw from the dynamic buffers.
+        DECISION_PROMOTE,  // Create the static buffers and insert() them.
+        DECISION_RESIDENT, // Draw from the returned entry.
+    };
+
+    struct Statistics {
+        size_t streamed;
+        size_t resident;
+        size_t promotions;
+        size_t evictions;
+
+        Statistics();
+    };
+
+private:
+
+    struct Record {
+
+        /**
+         * @brief Number of consecutive frames in which the geometry was drawn.
+         */
+        size_t streak;
+
+        /**
+         * @brief Last frame in which the geometry was drawn.
+         */
+        size_t frame;
+
+        /**
+         * @brief Order of the last use, used to find the least recently used entry.
+         */
+        size_t sequence;
+
+        Entry entry;
+        size_t bytes;
+    };
+
+    typedef std::map<GeometryKey, Record> RecordMap;
+
+    RecordMap records;
+
+    size_t promote_frames;
+    size_t byte_limit;
+
+    size_t total_bytes;
+    size_t resident_count;
+    size_t frame;
+    size_t next_sequence;
+
+    Statistics statistics;
+
+public:
+
+    StaticGeometryCache();
+
+    void configure(const size_t the_promote_frames, const size_t the_byte_limit);
+
+    // Cache operations.
+
+    Decision lookup(const GeometryKey &key, const size_t bytes, Entry &entry);
+    void insert(const GeometryKey &key, const Entry entry, const size_t bytes, EntryList &evicted);
+    void advance_frame(void);
+    void clear(EntryList &removed);
+
+    // Queries.
+
+    size_t get_total_bytes(void) const;
+    size_t get_resident_count(void) const;
+    size_t get_candidate_count(void) const;
+    const Statistics &get_statistics(void) const;
+
+private:
+
+    bool evict_least_recently_used(const RecordMap::iterator &keep, EntryList &evicted);
+};
+
+} // namespace emu
+
+#endif // STATIC_GEOMETRY_CACHE_H
+
+// EOF //
@@ -0,0 +1,306 @@
+#include "surface_cache.h"
+#include <assert.h>
+
+namespace emu {
+
+SurfaceCache::SlotStatistics::SlotStatistics()
+    : hits(0)
+    , prewarm_hits(0)
+    , misses(0)
+    , evictions(0)
+    , count(0)
+    , peak_count(0)
+    , bytes(0)
+{
+}
+
+SurfaceCache::SurfaceCache(const size_t slot_count)
+    : slots(slot_count)
+    , slot_capacity(0)
+    , byte_limit(0)
+    , trim_interval(0)
+    , total_bytes(0)
+    , peak_bytes(0)
+    , frame(0)
+    , last_trim_frame(0)
+    , next_sequence(0)
+{
+}
+
+/**
+ * @brief Sets limits of the cache.
+ *
+ * @param the_slot_capacity Maximal number of entries in single slot.
+ * @param the_byte_limit Maximal memory used by all entries.
+ * @param the_trim_interval Number of frames after which unused entries are trimmed.
+ *
+ * Zero value disables corresponding limit. The new limits are enforced
+ * during next release of an entry.
+ */
+void SurfaceCache::set_limits(const size_t the_slot_capacity, const size_t the_byte_limit, const size_t the_trim_interval)
+{
+    slot_capacity = the_slot_capacity;
+    byte_limit = the_byte_limit;
+    trim_interval = the_trim_interval;
+}
+
+/**
+ * @brief Removes the least recently released entry from specified slot.
+ *
+ * Returns NULL if the slot is empty. The recently released entries are reused
+ * last as their internal HW copy might be still in use.
+ */
+SurfaceCache::Entry SurfaceCache::acquire(const size_t slot)
+{
+    assert(slot != 0);
+    assert(slot < slots.size());
+    Slot &info = slots[slot];
+
+    if (info.entries.empty()) {
+        info.statistics.misses++;
+        return NULL;
+    }
+
+    const CachedEntry cached = info.entries.front();
+    info.entries.pop_front();
+
+    info.statistics.hits++;
+    if (cached.prewarmed) {
+        info.statistics.prewarm_hits++;
+    }
+    info.statistics.count--;
+    info.statistics.bytes -= cached.bytes;
+    total_bytes -= cached.bytes;
+    return cached.entry;
+}
+
+/**
+ * @brief Inserts entry to specified slot.
+ *
+ * Entries which had to be removed to satisfy the limits are appended
+ * to the evicted list. The inserted entry itself can be evicted if it
+ * alone exceeds the limits.
+ */
+void SurfaceCache::release(const size_t slot, const Entry entry, const size_t bytes, EntryList &evicted)
+{
+    insert(slot, entry, bytes, false, evicted);
+}
+
+/**
+ * @brief Inserts entry created ahead of its first use to specified slot.
+ *
+ * The entry is exempt from the trimming until it is acquired. The limits
+ * apply to it as to any other entry.
+ */
+void SurfaceCache::prewarm(const size_t slot, const Entry entry, const size_t bytes, EntryList &evicted)
+{
+    insert(slot, entry, bytes, true, evicted);
+}
+
+void SurfaceCache::insert(const size_t slot, const Entry entry, const size_t bytes, const bool prewarmed, EntryList &evicted)
+{
+    assert(slot != 0);
+    assert(slot < slots.size());
+    assert(entry);
+    Slot &info = slots[slot];
+
+    // Make place in the slot.
+
+    if (slot_capacity != 0) {
+        while (info.entries.size() >= slot_capacity) {
+            evict_oldest_entry(info, evicted);
+        }
+    }
+
+    // Insert at the end so it is reused last.
+
+    CachedEntry cached;
+    cached.entry = entry;
+    cached.bytes = bytes;
+    cached.frame = frame;
+    cached.sequence = next_sequence++;
+    cached.prewarmed = prewarmed;
+    info.entries.push_back(cached);
+
+    info.statistics.count++;
+    info.statistics.bytes += bytes;
+    if (info.statistics.count > info.statistics.peak_count) {
+        info.statistics.peak_count = info.statistics.count;
+    }
+    total_bytes += bytes;
+
+    // Enforce the global limit.
+
+    if (byte_limit != 0) {
+        while (total_bytes > byte_limit) {
+            if (! evict_globally_oldest_entry(evicted)) {
+                break;
+            }
+        }
+    }
+
+    if (total_bytes > peak_bytes) {
+        peak_bytes = total_bytes;
+    }
+}
+
+/**
+ * @brief Notifies the cache about end of a frame.
+ *
+ * Once per trim interval removes entries which were not reused
+ * during the whole interval.
+ */
+void SurfaceCache::advance_frame(EntryList &evicted)
+{
+    frame++;
+    if (trim_interval == 0) {
+        return;
+    }
+    if ((frame - last_trim_frame) < trim_interval) {
+        return;
+    }
+    last_trim_frame = frame;
+    trim(evicted);
+}
+
+/**
+ * @brief Removes all entries from the cache.
+ *
+ * The statistics are preserved.
+ */
+void SurfaceCache::clear(EntryList &removed)
+{
+    for (size_t i = 0; i < slots.size(); ++i) {
+        Slot &info = slots[i];
+        while (! info.entries.empty()) {
+            removed.push_back(info.entries.front().entry);
+            info.entries.pop_front();
+        }
+        info.statistics.count = 0;
+        info.statistics.bytes = 0;
+    }
+    total_bytes = 0;
+}
+
+/**
+ * @brief Checks if entry of specified size can be inserted into the slot
+ * without evicting anything.
+ */
+bool SurfaceCache::can_insert(const size_t slot, const size_t bytes) const
+{
+    assert(slot != 0);
+    assert(slot < slots.size());
+
+    if ((slot_capacity != 0) && (slots[slot].entries.size() >= slot_capacity)) {
+        return false;
+    }
+    if ((byte_limit != 0) && ((total_bytes + bytes) > byte_limit)) {
+        return false;
+    }
+    return true;
+}
+
+size_t SurfaceCache::get_slot_count(void) const
+{
+    return slots.size();
+}
+
+const SurfaceCache::SlotStatistics &SurfaceCache::get_statistics(const size_t slot) const
+{
+    assert(slot < slots.size());
+    return slots[slot].statistics;
+}
+
+size_t SurfaceCache::get_total_bytes(void) const
+{
+    return total_bytes;
+}
+
+size_t SurfaceCache::get_peak_bytes(void) const
+{
+    return peak_bytes;
+}
+
+/**
+ * @brief Evicts the oldest entry from specified slot.
+ */
+void SurfaceCache::evict_oldest_entry(Slot &slot, EntryList &evicted)
+{
+    assert(! slot.entries.empty());
+    evict_entry(slot, 0, evicted);
+}
+
+/**
+ * @brief Evicts entry at specified position of the slot.
+ */
+void SurfaceCache::evict_entry(Slot &slot, const size_t index, EntryList &evicted)
+{
+    assert(index < slot.entries.size());
+    const CachedEntry cached = slot.entries[index];
+    slot.entries.erase(slot.entries.begin() + index);
+
+    slot.statistics.evictions++;
+    slot.statistics.count--;
+    slot.statistics.bytes -= cached.bytes;
+    total_bytes -= cached.bytes;
+    evicted.push_back(cached.entry);
+}
+
+/**
+ * @brief Evicts the entry which was inserted first regardless of its slot.
+ *
+ * Returns false if the cache is empty.
+ */
+bool SurfaceCache::evict_globally_oldest_entry(EntryList &evicted)
+{
+    // The number of slots is small and evictions are rare so linear
+    // search over heads of the slots is sufficient.
+
+    Slot * oldest = NULL;
+    for (size_t i = 0; i < slots.size(); ++i) {
+        Slot &info = slots[i];
+        if (info.entries.empty()) {
+            continue;
+        }
+        if ((oldest == NULL) || (info.entries.front().sequence < oldest->entries.front().sequence)) {
+            oldest = &info;
+        }
+    }
+
+    if (oldest == NULL) {
+        return false;
+    }
+    evict_oldest_entry(*oldest, evicted);
+    return true;
+}
+
+/**
+ * @brief Evicts entries which were inserted before start of the last trim interval.
+ *
+ * The prewarmed entries are kept.
+ */
+void SurfaceCache::trim(EntryList &evicted)
+{
+    assert(frame >= trim_interval);
+    const size_t oldest_allowed_frame = frame - trim_interval;
+
+    for (size_t i = 0; i < slots.size(); ++i) {
+        Slot &info = slots[i];
+
+        // The entries are ordered by their frame.
+
+        size_t index = 0;
+        while ((index < info.entries.size()) && (info.entries[index].frame < oldest_allowed_frame)) {
+            if (info.entries[index].prewarmed) {
+                index++;
+            }
+            else {
+                evict_entry(info, index, evicted);
+            }
+        }
+    }
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,187 @@
+#ifndef SURFACE_CACHE_H
+#define SURFACE_CACHE_H
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Bounded container of recycled surfaces.
+ *
+ * Surfaces with equivalent parameters share one slot. The container only does
+ * the bookkeeping, the entries are opaque to it and the owner is responsible
+ * for destruction of entries which are evicted from the cache.
+ *
+ * Slot 0 is reserved for surfaces which can not be cached.
+ */
+class SurfaceCache {
+
+public:
+
+    /**
+     * @brief Opaque cached object.
+     */
+    typedef void * Entry;
+
+    /**
+     * @brief List of entries removed from the cache.
+     */
+    typedef std::vector<Entry> EntryList;
+
+    /**
+     * @brief Usage statistics of single slot.
+     */
+    struct SlotStatistics {
+
+        /**
+         * @brief Number of requests satisfied from the cache.
+         */
+        size_t hits;
+
+        /**
+         * @brief Number of hits which returned prewarmed entry.
+         */
+        size_t prewarm_hits;
+
+        /**
+         * @brief Number of requests which found the slot empty.
+         */
+        size_t misses;
+
+        /**
+         * @brief Number of entries removed because of the limits or trimming.
+         */
+        size_t evictions;
+
+        /**
+         * @brief Number of entries currently stored in the slot.
+         */
+        size_t count;
+
+        /**
+         * @brief Maximal number of entries stored in the slot at once.
+         */
+        size_t peak_count;
+
+        /**
+         * @brief Memory currently used by the entries.
+         */
+        size_t bytes;
+
+        SlotStatistics();
+    };
+
+private:
+
+    struct CachedEntry {
+
+        Entry entry;
+
+        /**
+         * @brief Memory used by the entry.
+         */
+        size_t bytes;
+
+        /**
+         * @brief Frame in which the entry was inserted.
+         */
+        size_t frame;
+
+        /**
+         * @brief Global insertion order used to find the oldest entry.
+         */
+        size_t sequence;
+
+        /**
+         * @brief Was the entry created ahead of its first use? Such entries
+         * are never trimmed as they are expected to wait for a long time.
+         */
+        bool prewarmed;
+    };
+
+    struct Slot {
+
+        /**
+         * @brief Entries ordered from the oldest to the newest.
+         */
+        std::deque<CachedEntry> entries;
+
+        SlotStatistics statistics;
+    };
+
+    std::vector<Slot> slots;
+
+    /**
+     * @name Limits.
+     *
+     * Zero value means that the limit is not used.
+     */
+    //@{
+    size_t slot_capacity;
+    size_t byte_limit;
+    size_t trim_interval;
+    //@}
+
+    /**
+     * @brief Memory used by all entries in the cache.
+     */
+    size_t total_bytes;
+
+    /**
+     * @brief Maximal value of the total_bytes.
+     */
+    size_t peak_bytes;
+
+    /**
+     * @brief Number of frames since construction of the cache.
+     */
+    size_t frame;
+
+    /**
+     * @brief Frame in which the last trim happened.
+     */
+    size_t last_trim_frame;
+
+    /**
+     * @brief Sequence number to assign to next inserted entry.
+     */
+    size_t next_sequence;
+
+public:
+
+    SurfaceCache(const size_t slot_count);
+
+    void set_limits(const size_t the_slot_capacity, const size_t the_byte_limit, const size_t the_trim_interval);
+
+    // Cache operations.
+
+    Entry acquire(const size_t slot);
+    void release(const size_t slot, const Entry entry, const size_t bytes, EntryList &evicted);
+    void prewarm(const size_t slot, const Entry entry, const size_t bytes, EntryList &evicted);
+    void advance_frame(EntryList &evicted);
+    void clear(EntryList &removed);
+
+    // Queries.
+
+    bool can_insert(const size_t slot, const size_t bytes) const;
+    size_t get_slot_count(void) const;
+    const SlotStatistics &get_statistics(const size_t slot) const;
+    size_t get_total_bytes(void) const;
+    size_t get_peak_bytes(void) const;
+
+private:
+
+    void insert(const size_t slot, const Entry entry, const size_t bytes, const bool prewarmed, EntryList &evicted);
+    void evict_oldest_entry(Slot &slot, EntryList &evicted);
+    void evict_entry(Slot &slot, const size_t index, EntryList &evicted);
+    bool evict_globally_oldest_entry(EntryList &evicted);
+    void trim(EntryList &evicted);
+};
+
+} // namespace emu
+
+#endif // SURFACE_CACHE_H
+
+// EOF //
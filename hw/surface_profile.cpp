@@ -0,0 +1,254 @@
+#include "surface_profile.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief First line of the serialized profile.
+ *
+ * Contains version which needs to be changed if meaning of the values changes.
+ */
+const char * const PROFILE_HEADER = "KA_DDRAW surface profile 1";
+
+/**
+ * @brief Maximal size of profile file we are willing to read.
+ */
+const size_t MAX_PROFILE_FILE_SIZE = 64 * 1024;
+
+bool is_power_of_two(const size_t value)
+{
+    return (value != 0) && ((value & (value - 1)) == 0);
+}
+
+} // anonymous namespace
+
+SurfaceProfile::SurfaceProfile()
+    : entries()
+{
+}
+
+void SurfaceProfile::clear(void)
+{
+    entries.clear();
+}
+
+/**
+ * @brief Records that specified number of surfaces was alive at the same time.
+ *
+ * The profile keeps the maximum of the recorded values.
+ */
+void SurfaceProfile::record(const unsigned int format, const size_t width, const size_t height, const size_t count)
+{
+    Entry * const existing = find(format, width, height);
+    if (existing) {
+        if (existing->count < count) {
+            existing->count = count;
+        }
+        return;
+    }
+
+    Entry entry;
+    entry.format = format;
+    entry.width = width;
+    entry.height = height;
+    entry.count = count;
+    entries.push_back(entry);
+}
+
+/**
+ * @brief Merges other profile into this one keeping the maximal counts.
+ */
+void SurfaceProfile::merge(const SurfaceProfile &other)
+{
+    for (size_t i = 0; i < other.entries.size(); ++i) {
+        const Entry &entry = other.entries[i];
+        record(entry.format, entry.width, entry.height, entry.count);
+    }
+}
+
+/**
+ * @brief Removes entries which can not be satisfied and clamps the counts.
+ *
+ * Only power of two sizes up to max_size and formats within specified inclusive
+ * range are kept. Entries with zero count are removed.
+ */
+void SurfaceProfile::validate(const unsigned int min_format, const unsigned int max_format, const size_t max_size, const size_t max_count)
+{
+    EntryList valid_entries;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        Entry entry = entries[i];
+        if ((entry.format < min_format) || (entry.format > max_format)) {
+            continue;
+        }
+        if ((! is_power_of_two(entry.width)) || (entry.width > max_size)) {
+            continue;
+        }
+        if ((! is_power_of_two(entry.height)) || (entry.height > max_size)) {
+            continue;
+        }
+        if (entry.count == 0) {
+            continue;
+        }
+        if ((max_count != 0) && (entry.count > max_count)) {
+            entry.count = max_count;
+        }
+        valid_entries.push_back(entry);
+    }
+    entries.swap(valid_entries);
+}
+
+/**
+ * @brief Replaces content of the profile with serialized profile.
+ *
+ * Malformed lines are ignored. Returns false and leaves the profile empty
+ * if the header does not match.
+ */
+bool SurfaceProfile::parse(const std::string &text)
+{
+    entries.clear();
+
+    size_t line_start = 0;
+    bool header_found = false;
+    while (line_start < text.size()) {
+        size_t line_end = text.find('\n', line_start);
+        if (line_end == std::string::npos) {
+            line_end = text.size();
+        }
+
+        std::string line = text.substr(line_start, line_end - line_start);
+        line_start = line_end + 1;
+        if ((! line.empty()) && (line[line.size() - 1] == '\r')) {
+            line.erase(line.size() - 1);
+        }
+
+        // The header must be the first line.
+
+        if (! header_found) {
+            if (line != PROFILE_HEADER) {
+                return false;
+            }
+            header_found = true;
+            continue;
+        }
+
+        unsigned int format;
+        unsigned int width;
+        unsigned int height;
+        unsigned int count;
+        char trailing;
+        if (sscanf(line.c_str(), "%u %u %u %u %c", &format, &width, &height, &count, &trailing) != 4) {
+            continue;
+        }
+        record(format, width, height, count);
+    }
+    return header_found;
+}
+
+std::string SurfaceProfile::serialize(void) const
+{
+    std::string result = PROFILE_HEADER;
+    result += "\n";
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const Entry &entry = entries[i];
+        char line[64];
+        sprintf(line, "%u %u %u %u\n", entry.format, static_cast<unsigned int>(entry.width), static_cast<unsigned int>(entry.height), static_cast<unsigned int>(entry.count));
+        result += line;
+    }
+    return result;
+}
+
+/**
+ * @brief Loads the profile from specified file.
+ *
+ * Returns false and leaves the profile empty if the file does not
+ * exist or is not valid.
+ */
+bool SurfaceProfile::load(const char * const file_name)
+{
+    entries.clear();
+
+    FILE * const file = fopen(file_name, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    std::string text;
+    char buffer[1024];
+    size_t read_size;
+    while ((read_size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, read_size);
+        if (text.size() > MAX_PROFILE_FILE_SIZE) {
+            fclose(file);
+            return false;
+        }
+    }
+    fclose(file);
+
+    return parse(text);
+}
+
+/**
+ * @brief Stores the profile into specified file.
+ */
+bool SurfaceProfile::save(const char * const file_name) const
+{
+    FILE * const file = fopen(file_name, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    const std::string text = serialize();
+    const bool written = (fwrite(text.data(), 1, text.size(), file) == text.size());
+    const bool closed = (fclose(file) == 0);
+    return written && closed;
+}
+
+const SurfaceProfile::EntryList &SurfaceProfile::get_entries(void) const
+{
+    return entries;
+}
+
+/**
+ * @brief Returns recorded count for specified combination or 0 if there is none.
+ */
+size_t SurfaceProfile::get_count(const unsigned int format, const size_t width, const size_t height) const
+{
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const Entry &entry = entries[i];
+        if ((entry.format == format) && (entry.width == width) && (entry.height == height)) {
+            return entry.count;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns sum of counts of all entries.
+ */
+size_t SurfaceProfile::get_total_count(void) const
+{
+    size_t result = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        result += entries[i].count;
+    }
+    return result;
+}
+
+SurfaceProfile::Entry *SurfaceProfile::find(const unsigned int format, const size_t width, const size_t height)
+{
+    for (size_t i = 0; i < entries.size(); ++i) {
+        Entry &entry = entries[i];
+        if ((entry.format == format) && (entry.width == width) && (entry.height == height)) {
+            return &entry;
+        }
+    }
+    return NULL;
+}
+
+} // namespace emu
+
+// EOF //
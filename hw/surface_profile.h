@@ -0,0 +1,70 @@
+#ifndef SURFACE_PROFILE_H
+#define SURFACE_PROFILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Number of surfaces of each combination of format and size
+ * which were alive at the same time.
+ *
+ * Recorded during run of the game and used during next start to prewarm
+ * the surface cache. The format is opaque to the profile.
+ */
+class SurfaceProfile {
+
+public:
+
+    struct Entry {
+        unsigned int format;
+        size_t width;
+        size_t height;
+
+        /**
+         * @brief Peak number of surfaces.
+         */
+        size_t count;
+    };
+
+    typedef std::vector<Entry> EntryList;
+
+private:
+
+    EntryList entries;
+
+public:
+
+    SurfaceProfile();
+
+    void clear(void);
+    void record(const unsigned int format, const size_t width, const size_t height, const size_t count);
+    void merge(const SurfaceProfile &other);
+    void validate(const unsigned int min_format, const unsigned int max_format, const size_t max_size, const size_t max_count);
+
+    // Serialization.
+
+    bool parse(const std::string &text);
+    std::string serialize(void) const;
+
+    bool load(const char * const file_name);
+    bool save(const char * const file_name) const;
+
+    // Queries.
+
+    const EntryList &get_entries(void) const;
+    size_t get_count(const unsigned int format, const size_t width, const size_t height) const;
+    size_t get_total_count(void) const;
+
+private:
+
+    Entry *find(const unsigned int format, const size_t width, const size_t height);
+};
+
+} // namespace emu
+
+#endif // SURFACE_PROFILE_H
+
+// EOF //
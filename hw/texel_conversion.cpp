@@ -0,0 +1,186 @@
+#include "texel_conversion.h"
+#include <string.h>
+#include <assert.h>
+
+namespace emu {
+
+/**
+ * @brief Reads content of specified 8888 memory into destination 565.
+ */
+void read8888_as_565(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height)
+{
+    unsigned char * line_dest = static_cast<unsigned char *>(destination);
+    const unsigned char * line_src = static_cast<const unsigned char *>(source);
+
+    for (size_t y = 0; y < height; ++y) {
+
+        unsigned short * dest = reinterpret_cast<unsigned short *>(line_dest);
+        const unsigned int * src = reinterpret_cast<const unsigned int *>(line_src);
+
+        // Line conversion.
+
+        for (size_t x = 0; x < width; ++x, ++src, ++dest) {
+            const unsigned int color = *src;
+
+            const unsigned int masked_red_5 = ((color >> (5 + 3)) & 0x0000F800);
+            const unsigned int masked_green_6 = ((color >> (3 + 2)) & 0x000007E0);
+            const unsigned int masked_blue_5 = ((color >> (0 + 3)) & 0x0000001F);
+
+            *dest = static_cast<unsigned short>(masked_red_5 | masked_green_6 | masked_blue_5);
+        }
+
+        // Skip unused bytes in the surfaces.
+
+        line_dest += pitch_dest;
+        line_src += pitch_src;
+    }
+}
+
+/**
+ * @brief Reads content of specified 8888 memory into destination 4444.
+ */
+void read8888_as_4444(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height)
+{
+    unsigned char * line_dest = static_cast<unsigned char *>(destination);
+    const unsigned char * line_src = static_cast<const unsigned char *>(source);
+
+    for (size_t y = 0; y < height; ++y) {
+
+        unsigned short * dest = reinterpret_cast<unsigned short *>(line_dest);
+        const unsigned int * src = reinterpret_cast<const unsigned int *>(line_src);
+
+        // Line conversion.
+
+        for (size_t x = 0; x < width; ++x, ++src, ++dest) {
+            const unsigned int color = *src;
+
+            const unsigned int masked_red_4 = ((color >> (8 + 4)) & 0x00000F00);
+            const unsigned int masked_green_4 = ((color >> (4 + 4)) & 0x000000F0);
+            const unsigned int masked_blue_4 = ((color >> (0 + 4)) & 0x0000000F);
+            const unsigned int masked_alpha_4 = ((color >> (12 + 4)) & 0x0000F000);
+
+            *dest = static_cast<unsigned short>(masked_red_4 | masked_green_4 | masked_blue_4 | masked_alpha_4);
+        }
+
+        // Skip unused bytes in the surfaces.
+
+        line_dest += pitch_dest;
+        line_src += pitch_src;
+    }
+}
+
+/**
+ * @brief Reads opaque 565 texture as 8888 texture.
+ */
+void read565_as_8888(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height)
+{
+    unsigned char * line_dest = static_cast<unsigned char *>(destination);
+    const unsigned char * line_src = static_cast<const unsigned char *>(source);
+
+    for (size_t y = 0; y < height; ++y) {
+
+        unsigned int * dest = reinterpret_cast<unsigned int *>(line_dest);
+        const unsigned short * src = reinterpret_cast<const unsigned short *>(line_src);
+
+        for (size_t x = 0; x < width; ++x, ++src, ++dest) {
+            const unsigned short color = *src;
+
+            // Move the value to the right place.
+
+            const unsigned int masked_red = ((color & 0x0000F800) << (5 + 3));
+            const unsigned int masked_green = ((color & 0x000007E0) << (3 + 2));
+            const unsigned int masked_blue = ((color & 0x0000001F) << (0 + 3));
+
+            // Ensure proper content of low end bits so the result is not biased towards zero.
+
+            const unsigned int replicated_red = (masked_red | (masked_red >> 5)) & 0x00ff0000;
+            const unsigned int replicated_green = (masked_green | (masked_green >> 6)) & 0x0000ff00;
+            const unsigned int replicated_blue = (masked_blue | (masked_blue >> 5)) & 0x000000ff;
+
+            *dest = 0xff000000 | replicated_red | replicated_green | replicated_blue;
+        }
+
+        // Skip to next line.
+
+        line_dest += pitch_dest;
+        line_src += pitch_src;
+    }
+}
+
+/**
+ * @brief Reads 4444 texture as 8888 texture.
+ */
+void read4444_as_8888(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height)
+{
+    unsigned char * line_dest = static_cast<unsigned char *>(destination);
+    const unsigned char * line_src = static_cast<const unsigned char *>(source);
+
+    for (size_t y = 0; y < height; ++y) {
+
+        unsigned int * dest = reinterpret_cast<unsigned int *>(line_dest);
+        const unsigned short * src = reinterpret_cast<const unsigned short *>(line_src);
+
+        for (size_t x = 0; x < width; ++x, ++src, ++dest) {
+            const unsigned short color = *src;
+
+            // Move the value to the right place.
+
+            const unsigned int masked_red = ((color & 0x00000F00) << (8 + 4));
+            const unsigned int masked_green = ((color & 0x000000F0) << (4 + 4));
+            const unsigned int masked_blue = ((color & 0x0000000F) << (0 + 4));
+            const unsigned int masked_alpha = ((color & 0x0000F000) << (12 + 4));
+
+            // Ensure proper content of low end bits so the result is not biased towards zero.
+
+            const unsigned int replicated_red = (masked_red | (masked_red >> 4));
+            const unsigned int replicated_green = (masked_green | (masked_green >> 4));
+            const unsigned int replicated_blue = (masked_blue | (masked_blue >> 4));
+            const unsigned int replicated_alpha = (masked_alpha | (masked_alpha >> 4));
+
+            *dest = replicated_alpha | replicated_red | replicated_green | replicated_blue;
+        }
+
+        // Skip to next line.
+
+        line_dest += pitch_dest;
+        line_src += pitch_src;
+    }
+}
+
+/**
+ * @brief Copies one surface to another without format conversion.
+ */
+void read_same_format(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height, const size_t texel_size)
+{
+        char * dest = static_cast<char *>(destination);
+        const char * src = static_cast<const char *>(source);
+        const size_t bytes_per_line = width * texel_size;
+
+        for (size_t i = 0; i < height; ++i) {
+            memcpy(dest, src, bytes_per_line);
+            dest += pitch_dest;
+            src += pitch_src;
+        }
+}
+
+/**
+ * @brief Converts 16 bit game texture to specified storage format.
+ */
+void read_as_storage(const TextureSource source_format, const TextureStorage storage, void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height)
+{
+    if (storage == TEXTURE_STORAGE_X8R8G8B8) {
+        assert(source_format == TEXTURE_SOURCE_565);
+        read565_as_8888(destination, pitch_dest, source, pitch_src, width, height);
+    }
+    else if (storage == TEXTURE_STORAGE_A8R8G8B8) {
+        assert(source_format == TEXTURE_SOURCE_4444);
+        read4444_as_8888(destination, pitch_dest, source, pitch_src, width, height);
+    }
+    else {
+        read_same_format(destination, pitch_dest, source, pitch_src, width, height, TextureFormatTable::get_texel_size(storage));
+    }
+}
+
+} // namespace emu
+
+// EOF //
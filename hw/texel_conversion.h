@@ -0,0 +1,20 @@
+#ifndef TEXEL_CONVERSION_H
+#define TEXEL_CONVERSION_H
+
+#include "texture_format.h"
+#include <cstddef>
+
+namespace emu {
+
+void read8888_as_565(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height);
+void read8888_as_4444(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height);
+void read565_as_8888(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height);
+void read4444_as_8888(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height);
+void read_same_format(void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height, const size_t texel_size);
+void read_as_storage(const TextureSource source_format, const TextureStorage storage, void * const destination, const size_t pitch_dest, const void * const source, const size_t pitch_src, const size_t width, const size_t height);
+
+} // namespace emu
+
+#endif // TEXEL_CONVERSION_H
+
+// EOF //
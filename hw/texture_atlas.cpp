@@ -0,0 +1,344 @@
+#include "texture_atlas.h"
+#include <algorithm>
+#include <string.h>
+#include <assert.h>
+
+namespace emu {
+
+SkylinePacker::SkylinePacker()
+    : width(0)
+    , height(0)
+    , skyline()
+    , used_area(0)
+{
+}
+
+/**
+ * @brief Forgets all rectangles and sets size of the area.
+ */
+void SkylinePacker::reset(const size_t the_width, const size_t the_height)
+{
+    width = the_width;
+    height = the_height;
+    used_area = 0;
+    skyline.clear();
+
+    const Segment ground = {0, 0, width};
+    skyline.push_back(ground);
+}
+
+/**
+ * @brief Finds position for rectangle of specified size.
+ *
+ * Selects the position with the lowest top edge, the narrowest
+ * segment on tie.
+ */
+bool SkylinePacker::insert(const size_t rect_width, const size_t rect_height, size_t &x, size_t &y)
+{
+    if ((rect_width == 0) || (rect_height == 0)) {
+        return false;
+    }
+
+    size_t best_index = skyline.size();
+    size_t best_top = ~static_cast<size_t>(0);
+    size_t best_width = ~static_cast<size_t>(0);
+    size_t best_y = 0;
+
+    for (size_t i = 0; i < skyline.size(); ++i) {
+        size_t candidate_y = 0;
+        if (! fits(i, rect_width, rect_height, candidate_y)) {
+            continue;
+        }
+
+        const size_t top = candidate_y + rect_height;
+        if ((top < best_top) || ((top == best_top) && (skyline[i].width < best_width))) {
+            best_index = i;
+            best_top = top;
+            best_width = skyline[i].width;
+            best_y = candidate_y;
+        }
+    }
+
+    if (best_index == skyline.size()) {
+        return false;
+    }
+
+    x = skyline[best_index].x;
+    y = best_y;
+    add_segment(best_index, x, best_y + rect_height, rect_width);
+    used_area += rect_width * rect_height;
+    return true;
+}
+
+size_t SkylinePacker::get_used_area(void) const
+{
+    return used_area;
+}
+
+/**
+ * @brief Checks if the rectangle fits with left edge at start of the segment.
+ *
+ * Returns the lowest possible position of its bottom edge.
+ */
+bool SkylinePacker::fits(const size_t index, const size_t rect_width, const size_t rect_height, size_t &y) const
+{
+    const size_t x = skyline[index].x;
+    if ((x + rect_width) > width) {
+        return false;
+    }
+
+    y = 0;
+    size_t remaining = rect_width;
+    for (size_t i = index; remaining > 0; ++i) {
+        assert(i < skyline.size());
+        if (skyline[i].y > y) {
+            y = skyline[i].y;
+        }
+        if ((y + rect_height) > height) {
+            return false;
+        }
+        remaining = (skyline[i].width >= remaining) ? 0 : (remaining - skyline[i].width);
+    }
+    return true;
+}
+
+/**
+ * @brief Raises the skyline under newly placed rectangle.
+ */
+void SkylinePacker::add_segment(const size_t index, const size_t x, const size_t y, const size_t rect_width)
+{
+    const Segment segment = {x, y, rect_width};
+    skyline.insert(skyline.begin() + index, segment);
+
+    // Shrink or remove the segments covered by the new one.
+
+    const size_t end = x + rect_width;
+    for (size_t i = index + 1; i < skyline.size();) {
+        Segment &current = skyline[i];
+        if (current.x >= end) {
+            break;
+        }
+
+        const size_t current_end = current.x + current.width;
+        if (current_end <= end) {
+            skyline.erase(skyline.begin() + i);
+            continue;
+        }
+        current.width = current_end - end;
+        current.x = end;
+        break;
+    }
+
+    // Merge neighbors at the same height.
+
+    for (size_t i = 0; (i + 1) < skyline.size();) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+            continue;
+        }
+        ++i;
+    }
+}
+
+TextureAtlas::TextureAtlas()
+    : page_size(0)
+    , max_page_count(0)
+    , padding(0)
+    , pages()
+{
+}
+
+/**
+ * @brief Sets the layout and forgets all regions.
+ */
+void TextureAtlas::configure(const size_t the_page_size, const size_t the_max_page_count, const size_t the_padding)
+{
+    page_size = the_page_size;
+    max_page_count = the_max_page_count;
+    padding = the_padding;
+    clear();
+}
+
+void TextureAtlas::clear(void)
+{
+    pages.clear();
+}
+
+/**
+ * @brief Finds space for texture of specified size.
+ *
+ * Adds new page if the texture does not fit into the existing ones.
+ */
+bool TextureAtlas::allocate(const size_t width, const size_t height, AtlasRegion &region)
+{
+    const size_t padded_width = width + (padding * 2);
+    const size_t padded_height = height + (padding * 2);
+    if ((padded_width > page_size) || (padded_height > page_size)) {
+        return false;
+    }
+
+    for (size_t i = 0; i <= pages.size(); ++i) {
+        if (i == pages.size()) {
+            if (pages.size() >= max_page_count) {
+                return false;
+            }
+            pages.push_back(Page());
+            pages.back().packer.reset(page_size, page_size);
+            pages.back().region_count = 0;
+        }
+
+        size_t x = 0;
+        size_t y = 0;
+        if (pages[i].packer.insert(padded_width, padded_height, x, y)) {
+            pages[i].region_count++;
+            region.page = i;
+            region.x = x + padding;
+            region.y = y + padding;
+            region.width = width;
+            region.height = height;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Releases the region. The space is reused once the whole page is free.
+ *
+ * Regions of pages destroyed by clear() are ignored.
+ */
+void TextureAtlas::release(const AtlasRegion &region)
+{
+    if (region.page >= pages.size()) {
+        return;
+    }
+    Page &page = pages[region.page];
+    assert(page.region_count > 0);
+    page.region_count--;
+    if (page.region_count == 0) {
+        page.packer.reset(page_size, page_size);
+    }
+}
+
+size_t TextureAtlas::get_page_size(void) const
+{
+    return page_size;
+}
+
+size_t TextureAtlas::get_padding(void) const
+{
+    return padding;
+}
+
+size_t TextureAtlas::get_page_count(void) const
+{
+    return pages.size();
+}
+
+size_t TextureAtlas::get_region_count(void) const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < pages.size(); ++i) {
+        count += pages[i].region_count;
+    }
+    return count;
+}
+
+/**
+ * @brief Returns area occupied by the regions including their padding.
+ */
+size_t TextureAtlas::get_used_area(void) const
+{
+    size_t area = 0;
+    for (size_t i = 0; i < pages.size(); ++i) {
+        area += pages[i].packer.get_used_area();
+    }
+    return area;
+}
+
+AtlasTransform TextureAtlas::get_transform(const AtlasRegion &region) const
+{
+    assert(page_size > 0);
+    const float page_scale = 1.0f / static_cast<float>(page_size);
+
+    AtlasTransform result;
+    result.scale_u = static_cast<float>(region.width) * page_scale;
+    result.scale_v = static_cast<float>(region.height) * page_scale;
+    result.offset_u = static_cast<float>(region.x) * page_scale;
+    result.offset_v = static_cast<float>(region.y) * page_scale;
+    return result;
+}
+
+/**
+ * @brief Fills the padding around texture content by replicating its edge texels.
+ *
+ * The content points to the first texel of the texture, the padding must
+ * be accessible in the memory around it.
+ */
+void extend_region_border(void * const content, const size_t pitch, const size_t width, const size_t height, const size_t texel_size, const size_t padding)
+{
+    char * const first_row = static_cast<char *>(content);
+
+    // Extend each row to the left and right.
+
+    for (size_t y = 0; y < height; ++y) {
+        char * const row = first_row + (y * pitch);
+        for (size_t i = 1; i <= padding; ++i) {
+            memcpy(row - (i * texel_size), row, texel_size);
+            memcpy(row + ((width - 1 + i) * texel_size), row + ((width - 1) * texel_size), texel_size);
+        }
+    }
+
+    // Extend the first and last rows including the corners.
+
+    const size_t padded_row_size = (width + (padding * 2)) * texel_size;
+    char * const padded_first_row = first_row - (padding * texel_size);
+    char * const padded_last_row = padded_first_row + ((height - 1) * pitch);
+    for (size_t i = 1; i <= padding; ++i) {
+        memcpy(padded_first_row - (i * pitch), padded_first_row, padded_row_size);
+        memcpy(padded_last_row + (i * pitch), padded_last_row, padded_row_size);
+    }
+}
+
+/**
+ * @brief Converts texture coordinates of the original texture to the atlas page.
+ */
+void apply_atlas_transform(const AtlasTransform &transform, float &u, float &v)
+{
+    u = (u * transform.scale_u) + transform.offset_u;
+    v = (v * transform.scale_v) + transform.offset_v;
+}
+
+/**
+ * @brief Determines if the vertex samples inside of its texture, so the
+ * texture can be drawn from the atlas without wrapping.
+ */
+bool is_sampled_inside(const TLVertex &vertex)
+{
+    const float low = -ATLAS_COORDINATE_EPSILON;
+    const float high = 1.0f + ATLAS_COORDINATE_EPSILON;
+    return (vertex.tu >= low) && (vertex.tu <= high) && (vertex.tv >= low) && (vertex.tv <= high);
+}
+
+/**
+ * @brief Copies the vertices with texture coordinates converted from the
+ * original texture to its region of the atlas page.
+ *
+ * The coordinates are clamped to the texture first so those within the
+ * tolerance do not reach into the padding.
+ */
+void remap_to_atlas(const AtlasTransform &transform, const TLVertex * const source, const size_t count, TLVertex * const target)
+{
+    for (size_t i = 0; i < count; ++i) {
+        TLVertex vertex = source[i];
+        vertex.tu = std::min(std::max(vertex.tu, 0.0f), 1.0f);
+        vertex.tv = std::min(std::max(vertex.tv, 0.0f), 1.0f);
+        apply_atlas_transform(transform, vertex.tu, vertex.tv);
+        target[i] = vertex;
+    }
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,126 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include "hw_types.h"
+#include <cstddef>
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Tolerance of the texture coordinates still considered to sample
+ * inside of the texture.
+ *
+ * Covers the rounding of coordinates computed by the game for the texture
+ * edges.
+ */
+const float ATLAS_COORDINATE_EPSILON = 0.001f;
+
+/**
+ * @brief Packs rectangles into fixed size area using the skyline
+ * bottom-left heuristic.
+ *
+ * Individual rectangles can not be freed, only the whole area.
+ */
+class SkylinePacker {
+
+    /**
+     * @brief Horizontal segment of the skyline.
+     */
+    struct Segment {
+        size_t x;
+        size_t y;
+        size_t width;
+    };
+
+    size_t width;
+    size_t height;
+    std::vector<Segment> skyline;
+    size_t used_area;
+
+public:
+
+    SkylinePacker();
+
+    void reset(const size_t the_width, const size_t the_height);
+    bool insert(const size_t rect_width, const size_t rect_height, size_t &x, size_t &y);
+
+    size_t get_used_area(void) const;
+
+private:
+
+    bool fits(const size_t index, const size_t rect_width, const size_t rect_height, size_t &y) const;
+    void add_segment(const size_t index, const size_t x, const size_t y, const size_t rect_width);
+};
+
+/**
+ * @brief Location of texture inside of the atlas.
+ *
+ * The position is of the texture content, the padding surrounds it.
+ */
+struct AtlasRegion {
+    size_t page;
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+};
+
+/**
+ * @brief Maps texture coordinates of the original texture to the atlas page.
+ */
+struct AtlasTransform {
+    float scale_u;
+    float scale_v;
+    float offset_u;
+    float offset_v;
+};
+
+/**
+ * @brief Allocates regions for small textures in square pages.
+ *
+ * Each region is surrounded by padding so bilinear filtering at its
+ * edges does not sample the neighbors. Page is reused once all its
+ * regions are released.
+ */
+class TextureAtlas {
+
+    struct Page {
+        SkylinePacker packer;
+        size_t region_count;
+    };
+
+    size_t page_size;
+    size_t max_page_count;
+    size_t padding;
+    std::vector<Page> pages;
+
+public:
+
+    TextureAtlas();
+
+    void configure(const size_t the_page_size, const size_t the_max_page_count, const size_t the_padding);
+    void clear(void);
+
+    bool allocate(const size_t width, const size_t height, AtlasRegion &region);
+    void release(const AtlasRegion &region);
+
+    size_t get_page_size(void) const;
+    size_t get_padding(void) const;
+    size_t get_page_count(void) const;
+    size_t get_region_count(void) const;
+    size_t get_used_area(void) const;
+
+    AtlasTransform get_transform(const AtlasRegion &region) const;
+};
+
+void extend_region_border(void * const content, const size_t pitch, const size_t width, const size_t height, const size_t texel_size, const size_t padding);
+void apply_atlas_transform(const AtlasTransform &transform, float &u, float &v);
+bool is_sampled_inside(const TLVertex &vertex);
+void remap_to_atlas(const AtlasTransform &transform, const TLVertex * const source, const size_t count, TLVertex * const target);
+
+} // namespace emu
+
+#endif // TEXTURE_ATLAS_H
+
+// EOF //
@@ -0,0 +1,132 @@
+#include "texture_compression_job.h"
+#include "texel_conversion.h"
+#include "mipmap.h"
+#include <assert.h>
+
+namespace emu {
+
+TextureCompressionJob::TextureCompressionJob(const TextureSource the_source, const size_t the_width, const size_t the_height, const void * const memory, const size_t pitch, const DXTQuality the_quality, const CompressedTextureCache * const the_cache)
+    : source(the_source)
+    , width(the_width)
+    , height(the_height)
+    , quality(the_quality)
+    , cache(the_cache)
+    , texels(the_width * the_height)
+    , data()
+    , level_offsets()
+    , loaded_from_cache(false)
+{
+    assert(memory);
+    assert((width > 0) && (height > 0));
+    read_same_format(&texels[0], width * sizeof(unsigned short), memory, pitch, width, height, sizeof(unsigned short));
+
+    // Layout of the levels is known in advance.
+
+    const size_t level_count = get_mipmap_level_count(width, height);
+    size_t offset = 0;
+    for (size_t level = 0; level < level_count; ++level) {
+        level_offsets.push_back(offset);
+        offset += get_dxt_size(get_format(), get_mipmap_level_size(width, level), get_mipmap_level_size(height, level));
+    }
+    level_offsets.push_back(offset);
+}
+
+void TextureCompressionJob::run(void)
+{
+    // Try the disk cache first.
+
+    CompressedTextureKey key;
+    key.hash = hash_content(&texels[0], texels.size() * sizeof(unsigned short));
+    key.format = get_format();
+    key.quality = quality;
+    key.width = static_cast<unsigned int>(width);
+    key.height = static_cast<unsigned int>(height);
+    key.levels = static_cast<unsigned int>(get_level_count());
+
+    const size_t expected_size = level_offsets.back();
+    if (cache && cache->load(key, data) && (data.size() == expected_size)) {
+        loaded_from_cache = true;
+        return;
+    }
+
+    compress();
+
+    if (cache) {
+        cache->store(key, data);
+    }
+}
+
+DXTFormat TextureCompressionJob::get_format(void) const
+{
+    return (source == TEXTURE_SOURCE_565) ? DXT_FORMAT_DXT1 : DXT_FORMAT_DXT3;
+}
+
+bool TextureCompressionJob::is_valid(void) const
+{
+    return (! data.empty()) && (data.size() == level_offsets.back());
+}
+
+bool TextureCompressionJob::was_loaded_from_cache(void) const
+{
+    return loaded_from_cache;
+}
+
+size_t TextureCompressionJob::get_level_count(void) const
+{
+    return level_offsets.size() - 1;
+}
+
+const unsigned char *TextureCompressionJob::get_level_data(const size_t level) const
+{
+    assert(is_valid());
+    assert(level < get_level_count());
+    return &data[level_offsets[level]];
+}
+
+/**
+ * @brief Returns size of single row of blocks of specified level.
+ */
+size_t TextureCompressionJob::get_level_row_size(const size_t level) const
+{
+    return get_dxt_size(get_format(), get_mipmap_level_size(width, level), 1);
+}
+
+/**
+ * @brief Returns number of rows of blocks of specified level.
+ */
+size_t TextureCompressionJob::get_level_row_count(const size_t level) const
+{
+    return (get_mipmap_level_size(height, level) + 3) / 4;
+}
+
+/**
+ * @brief Expands the texture to 8888 and compresses all its levels.
+ */
+void TextureCompressionJob::compress(void)
+{
+    std::vector<unsigned int> level_texels(width * height);
+    if (source == TEXTURE_SOURCE_565) {
+        read565_as_8888(&level_texels[0], width * sizeof(unsigned int), &texels[0], width * sizeof(unsigned short), width, height);
+    }
+    else {
+        read4444_as_8888(&level_texels[0], width * sizeof(unsigned int), &texels[0], width * sizeof(unsigned short), width, height);
+    }
+
+    data.resize(level_offsets.back());
+    std::vector<unsigned int> next_level_texels;
+    for (size_t level = 0; level < get_level_count(); ++level) {
+        const size_t level_width = get_mipmap_level_size(width, level);
+        const size_t level_height = get_mipmap_level_size(height, level);
+        encode_dxt(get_format(), quality, &level_texels[0], level_width, level_height, &data[level_offsets[level]]);
+
+        if ((level + 1) < get_level_count()) {
+            next_level_texels.resize(get_mipmap_level_size(level_width, 1) * get_mipmap_level_size(level_height, 1));
+            downsample(&level_texels[0], level_width, level_height, &next_level_texels[0], source == TEXTURE_SOURCE_4444);
+            level_texels.swap(next_level_texels);
+        }
+    }
+}
+
+} // namespace emu
+
+// EOF //
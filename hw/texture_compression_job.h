@@ -0,0 +1,74 @@
+#ifndef TEXTURE_COMPRESSION_JOB_H
+#define TEXTURE_COMPRESSION_JOB_H
+
+#include "texture_levels_job.h"
+#include "dxt_encoder.h"
+#include "texture_format.h"
+#include "compressed_texture_cache.h"
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Compresses 16 bit texture including its mipmap chain.
+ *
+ * The 565 textures are compressed to DXT1, the 4444 ones to DXT3 which
+ * keeps the 4 bit alpha exactly. The result is taken from the disk cache
+ * when possible and stored there otherwise.
+ */
+class TextureCompressionJob : public TextureLevelsJob {
+
+    // Input.
+
+    TextureSource source;
+    size_t width;
+    size_t height;
+    DXTQuality quality;
+    const CompressedTextureCache * cache;
+
+    /**
+     * @brief Copy of the uncompressed texture, without padding.
+     */
+    std::vector<unsigned short> texels;
+
+    // Output.
+
+    /**
+     * @brief All levels of the compressed texture, one after another.
+     */
+    std::vector<unsigned char> data;
+
+    /**
+     * @brief Offset of each level within the data.
+     */
+    std::vector<size_t> level_offsets;
+
+    bool loaded_from_cache;
+
+public:
+
+    TextureCompressionJob(const TextureSource the_source, const size_t the_width, const size_t the_height, const void * const memory, const size_t pitch, const DXTQuality the_quality, const CompressedTextureCache * const the_cache);
+
+    virtual void run(void);
+
+    // Results, valid only after the job has finished.
+
+    DXTFormat get_format(void) const;
+    bool was_loaded_from_cache(void) const;
+
+    virtual bool is_valid(void) const;
+    virtual size_t get_level_count(void) const;
+    virtual const unsigned char *get_level_data(const size_t level) const;
+    virtual size_t get_level_row_size(const size_t level) const;
+    virtual size_t get_level_row_count(const size_t level) const;
+
+private:
+
+    void compress(void);
+};
+
+} // namespace emu
+
+#endif // TEXTURE_COMPRESSION_JOB_H
+
+// EOF //
@@ -0,0 +1,60 @@
+#include "texture_conversion_job.h"
+#include "texel_conversion.h"
+#include <assert.h>
+
+namespace emu {
+
+TextureConversionJob::TextureConversionJob(const TextureSource the_source, const TextureStorage the_storage, const size_t the_width, const size_t the_height, const void * const the_memory, const size_t the_pitch)
+    : source(the_source)
+    , storage(the_storage)
+    , width(the_width)
+    , height(the_height)
+    , memory(the_memory)
+    , pitch(the_pitch)
+    , texels()
+    , converted(false)
+{
+    assert(memory);
+    assert((width > 0) && (height > 0));
+    assert(TextureFormatTable::get_texel_size(storage) > 0);
+}
+
+void TextureConversionJob::run(void)
+{
+    texels.resize(get_pitch() * height);
+    read_as_storage(source, storage, &texels[0], get_pitch(), memory, pitch, width, height);
+    converted = true;
+}
+
+bool TextureConversionJob::is_converted(void) const
+{
+    return converted;
+}
+
+TextureStorage TextureConversionJob::get_storage(void) const
+{
+    return storage;
+}
+
+const void *TextureConversionJob::get_source_memory(void) const
+{
+    return memory;
+}
+
+const unsigned char *TextureConversionJob::get_data(void) const
+{
+    assert(converted);
+    return &texels[0];
+}
+
+/**
+ * @brief Returns pitch of the converted data.
+ */
+size_t TextureConversionJob::get_pitch(void) const
+{
+    return width * TextureFormatTable::get_texel_size(storage);
+}
+
+} // namespace emu
+
+// EOF //
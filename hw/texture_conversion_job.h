@@ -0,0 +1,57 @@
+#ifndef TEXTURE_CONVERSION_JOB_H
+#define TEXTURE_CONVERSION_JOB_H
+
+#include "../helpers/job.h"
+#include "texture_format.h"
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Converts 16 bit texture to its storage format for later upload.
+ *
+ * Reads the source memory directly. The owner must ensure that the memory
+ * is not modified until the job is finished or cancelled.
+ */
+class TextureConversionJob : public Job {
+
+    // Input.
+
+    TextureSource source;
+    TextureStorage storage;
+    size_t width;
+    size_t height;
+    const void * memory;
+    size_t pitch;
+
+    // Output.
+
+    std::vector<unsigned char> texels;
+
+    /**
+     * @brief Set when the conversion was done.
+     *
+     * The job might be dropped without execution when the queue is stopped.
+     */
+    bool converted;
+
+public:
+
+    TextureConversionJob(const TextureSource the_source, const TextureStorage the_storage, const size_t the_width, const size_t the_height, const void * const the_memory, const size_t the_pitch);
+
+    virtual void run(void);
+
+    // Results, valid only after the job has finished.
+
+    bool is_converted(void) const;
+    TextureStorage get_storage(void) const;
+    const void *get_source_memory(void) const;
+    const unsigned char *get_data(void) const;
+    size_t get_pitch(void) const;
+};
+
+} // namespace emu
+
+#endif // TEXTURE_CONVERSION_JOB_H
+
+// EOF //
@@ -0,0 +1,130 @@
+#include "texture_format.h"
+#include <assert.h>
+
+namespace emu {
+
+TextureFormatTable::TextureFormatTable()
+    : native_allowed(true)
+{
+    for (size_t i = 0; i < SIZE_OF_TEXTURE_STORAGE; ++i) {
+        capabilities[i].texture = false;
+        capabilities[i].autogen_mipmap = false;
+    }
+    for (size_t i = 0; i < SIZE_OF_TEXTURE_SOURCE; ++i) {
+        choices[i] = TEXTURE_STORAGE_NONE;
+    }
+}
+
+/**
+ * @brief Sets capabilities of the device for specified storage format.
+ *
+ * The resolve() must be called to update the selection.
+ */
+void TextureFormatTable::set_capabilities(const TextureStorage storage, const bool texture, const bool autogen_mipmap)
+{
+    assert(storage > TEXTURE_STORAGE_NONE);
+    assert(storage < SIZE_OF_TEXTURE_STORAGE);
+    capabilities[storage].texture = texture;
+    capabilities[storage].autogen_mipmap = texture && autogen_mipmap;
+}
+
+/**
+ * @brief Enables or disables use of the native 16 bit formats.
+ *
+ * The resolve() must be called to update the selection.
+ */
+void TextureFormatTable::set_native_allowed(const bool allowed)
+{
+    native_allowed = allowed;
+}
+
+/**
+ * @brief Selects storage for each source format.
+ */
+void TextureFormatTable::resolve(void)
+{
+    choices[TEXTURE_SOURCE_565] = select(TEXTURE_STORAGE_R5G6B5, TEXTURE_STORAGE_X8R8G8B8);
+    choices[TEXTURE_SOURCE_4444] = select(TEXTURE_STORAGE_A4R4G4B4, TEXTURE_STORAGE_A8R8G8B8);
+}
+
+TextureStorage TextureFormatTable::get_storage(const TextureSource source) const
+{
+    assert(source < SIZE_OF_TEXTURE_SOURCE);
+    return choices[source];
+}
+
+/**
+ * @brief Indicates if the texture is stored without conversion.
+ */
+bool TextureFormatTable::is_native(const TextureSource source) const
+{
+    const TextureStorage storage = get_storage(source);
+    return (storage == TEXTURE_STORAGE_R5G6B5) || (storage == TEXTURE_STORAGE_A4R4G4B4);
+}
+
+bool TextureFormatTable::has_autogen_mipmap(const TextureSource source) const
+{
+    return capabilities[get_storage(source)].autogen_mipmap;
+}
+
+const char *TextureFormatTable::get_storage_name(const TextureStorage storage)
+{
+    switch (storage) {
+        case TEXTURE_STORAGE_X8R8G8B8: return "X8R8G8B8";
+        case TEXTURE_STORAGE_A8R8G8B8: return "A8R8G8B8";
+        case TEXTURE_STORAGE_R5G6B5: return "R5G6B5";
+        case TEXTURE_STORAGE_A4R4G4B4: return "A4R4G4B4";
+        default: return "none";
+    }
+}
+
+/**
+ * @brief Returns size of single texel of specified storage in bytes.
+ */
+size_t TextureFormatTable::get_texel_size(const TextureStorage storage)
+{
+    switch (storage) {
+        case TEXTURE_STORAGE_R5G6B5:
+        case TEXTURE_STORAGE_A4R4G4B4:
+            return 2;
+        case TEXTURE_STORAGE_X8R8G8B8:
+        case TEXTURE_STORAGE_A8R8G8B8:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Selects between native and expanded storage.
+ */
+TextureStorage TextureFormatTable::select(const TextureStorage native, const TextureStorage expanded) const
+{
+    const Capabilities &native_caps = capabilities[native];
+    const Capabilities &expanded_caps = capabilities[expanded];
+
+    // Native storage is used unless we would lose the mipmaps.
+
+    if (native_allowed && native_caps.texture) {
+        if (native_caps.autogen_mipmap || (! expanded_caps.autogen_mipmap)) {
+            return native;
+        }
+    }
+
+    // The original conversion.
+
+    if (expanded_caps.texture) {
+        return expanded;
+    }
+
+    // Better something than nothing.
+
+    if (native_caps.texture) {
+        return native;
+    }
+    return TEXTURE_STORAGE_NONE;
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,82 @@
+#ifndef TEXTURE_FORMAT_H
+#define TEXTURE_FORMAT_H
+
+#include <cstddef>
+
+namespace emu {
+
+/**
+ * @brief Formats of game textures.
+ */
+enum TextureSource {
+    TEXTURE_SOURCE_565,
+    TEXTURE_SOURCE_4444,
+
+    SIZE_OF_TEXTURE_SOURCE
+};
+
+/**
+ * @brief Formats in which the textures can be stored on the GPU.
+ */
+enum TextureStorage {
+    TEXTURE_STORAGE_NONE, // No supported format.
+    TEXTURE_STORAGE_X8R8G8B8,
+    TEXTURE_STORAGE_A8R8G8B8,
+    TEXTURE_STORAGE_R5G6B5,
+    TEXTURE_STORAGE_A4R4G4B4,
+
+    SIZE_OF_TEXTURE_STORAGE
+};
+
+/**
+ * @brief Selects storage format for each texture source format based on
+ * capabilities of the device.
+ *
+ * Native 16 bit storage is preferred as it halves upload bandwidth and memory.
+ * It is not used if it would lose mipmap generation which the expanded
+ * 32 bit storage has.
+ */
+class TextureFormatTable {
+
+    struct Capabilities {
+        bool texture;
+        bool autogen_mipmap;
+    };
+
+    Capabilities capabilities[SIZE_OF_TEXTURE_STORAGE];
+
+    /**
+     * @brief Are native 16 bit formats allowed at all?
+     */
+    bool native_allowed;
+
+    /**
+     * @brief Result of the selection.
+     */
+    TextureStorage choices[SIZE_OF_TEXTURE_SOURCE];
+
+public:
+
+    TextureFormatTable();
+
+    void set_capabilities(const TextureStorage storage, const bool texture, const bool autogen_mipmap);
+    void set_native_allowed(const bool allowed);
+    void resolve(void);
+
+    TextureStorage get_storage(const TextureSource source) const;
+    bool is_native(const TextureSource source) const;
+    bool has_autogen_mipmap(const TextureSource source) const;
+
+    static const char *get_storage_name(const TextureStorage storage);
+    static size_t get_texel_size(const TextureStorage storage);
+
+private:
+
+    TextureStorage select(const TextureStorage native, const TextureStorage expanded) const;
+};
+
+} // namespace emu
+
+#endif // TEXTURE_FORMAT_H
+
+// EOF //
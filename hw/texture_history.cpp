@@ -0,0 +1,208 @@
+#include "texture_history.h"
+#include <stdio.h>
+
+namespace emu {
+
+namespace {
+
+/**
+ * @brief First line of the serialized history.
+ *
+ * Contains version which needs to be changed if meaning of the values changes.
+ */
+const char * const HISTORY_HEADER = "KA_DDRAW texture history 1";
+
+/**
+ * @brief Maximal size of history file we are willing to read.
+ */
+const size_t MAX_HISTORY_FILE_SIZE = 1024 * 1024;
+
+} // anonymous namespace
+
+TextureHistory::TextureHistory()
+    : recorded()
+    , recorded_positions()
+    , predicted()
+    , predicted_positions()
+{
+}
+
+void TextureHistory::clear(void)
+{
+    recorded.clear();
+    recorded_positions.clear();
+    predicted.clear();
+    predicted_positions.clear();
+}
+
+/**
+ * @brief Records first use of texture with specified content.
+ *
+ * Returns false if the content was already used during this run.
+ */
+bool TextureHistory::record(const ContentHash hash)
+{
+    if (recorded_positions.find(hash) != recorded_positions.end()) {
+        return false;
+    }
+    recorded_positions[hash] = recorded.size();
+    recorded.push_back(hash);
+    return true;
+}
+
+/**
+ * @brief Returns position of the content in the order of use during
+ * previous runs.
+ *
+ * Returns false if the content was not used.
+ */
+bool TextureHistory::get_predicted_position(const ContentHash hash, size_t &position) const
+{
+    const PositionMap::const_iterator it = predicted_positions.find(hash);
+    if (it == predicted_positions.end()) {
+        return false;
+    }
+    position = it->second;
+    return true;
+}
+
+size_t TextureHistory::get_recorded_count(void) const
+{
+    return recorded.size();
+}
+
+size_t TextureHistory::get_predicted_count(void) const
+{
+    return predicted.size();
+}
+
+/**
+ * @brief Replaces the prediction with serialized history.
+ *
+ * Malformed lines are ignored. Returns false and leaves the prediction empty
+ * if the header does not match.
+ */
+bool TextureHistory::parse(const std::string &text)
+{
+    predicted.clear();
+    predicted_positions.clear();
+
+    size_t line_start = 0;
+    bool header_found = false;
+    while (line_start < text.size()) {
+        size_t line_end = text.find('\n', line_start);
+        if (line_end == std::string::npos) {
+            line_end = text.size();
+        }
+
+        std::string line = text.substr(line_start, line_end - line_start);
+        line_start = line_end + 1;
+        if ((! line.empty()) && (line[line.size() - 1] == '\r')) {
+            line.erase(line.size() - 1);
+        }
+
+        // The header must be the first line.
+
+        if (! header_found) {
+            if (line != HISTORY_HEADER) {
+                return false;
+            }
+            header_found = true;
+            continue;
+        }
+
+        unsigned int high;
+        unsigned int low;
+        char trailing;
+        if (sscanf(line.c_str(), "%8x%8x %c", &high, &low, &trailing) != 2) {
+            continue;
+        }
+
+        const ContentHash hash = (static_cast<ContentHash>(high) << 32) | low;
+        if (predicted_positions.find(hash) == predicted_positions.end()) {
+            predicted_positions[hash] = predicted.size();
+            predicted.push_back(hash);
+        }
+    }
+    return header_found;
+}
+
+/**
+ * @brief Serializes the order of this run followed by textures
+ * from previous runs which were not used during this run.
+ *
+ * At most max_count hashes are stored.
+ */
+std::string TextureHistory::serialize(const size_t max_count) const
+{
+    std::string result = HISTORY_HEADER;
+    result += "\n";
+
+    HashList order = recorded;
+    for (size_t i = 0; i < predicted.size(); ++i) {
+        if (recorded_positions.find(predicted[i]) == recorded_positions.end()) {
+            order.push_back(predicted[i]);
+        }
+    }
+    if (order.size() > max_count) {
+        order.resize(max_count);
+    }
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        char line[32];
+        sprintf(line, "%08x%08x\n", static_cast<unsigned int>(order[i] >> 32), static_cast<unsigned int>(order[i]));
+        result += line;
+    }
+    return result;
+}
+
+/**
+ * @brief Loads the prediction from specified file.
+ *
+ * Returns false and leaves the prediction empty if the file does not
+ * exist or is not valid.
+ */
+bool TextureHistory::load(const char * const file_name)
+{
+    predicted.clear();
+    predicted_positions.clear();
+
+    FILE * const file = fopen(file_name, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    std::string text;
+    char buffer[1024];
+    size_t read_size;
+    while ((read_size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, read_size);
+        if (text.size() > MAX_HISTORY_FILE_SIZE) {
+            fclose(file);
+            return false;
+        }
+    }
+    fclose(file);
+
+    return parse(text);
+}
+
+/**
+ * @brief Stores the history into specified file.
+ */
+bool TextureHistory::save(const char * const file_name, const size_t max_count) const
+{
+    FILE * const file = fopen(file_name, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    const std::string text = serialize(max_count);
+    const bool written = (fwrite(text.data(), 1, text.size(), file) == text.size());
+    const bool closed = (fclose(file) == 0);
+    return written && closed;
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,60 @@
+#ifndef TEXTURE_HISTORY_H
+#define TEXTURE_HISTORY_H
+
+#include "../helpers/hash.h"
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Order in which textures were used for the first time.
+ *
+ * The textures are identified by hash of their content. The order
+ * recorded during previous runs is used to predict which textures
+ * will be used soon.
+ */
+class TextureHistory {
+
+    typedef std::vector<ContentHash> HashList;
+    typedef std::map<ContentHash, size_t> PositionMap;
+
+    /**
+     * @brief Hashes in order of first use during this run.
+     */
+    HashList recorded;
+    PositionMap recorded_positions;
+
+    /**
+     * @brief Hashes in order of first use during previous runs.
+     */
+    HashList predicted;
+    PositionMap predicted_positions;
+
+public:
+
+    TextureHistory();
+
+    void clear(void);
+    bool record(const ContentHash hash);
+    bool get_predicted_position(const ContentHash hash, size_t &position) const;
+
+    size_t get_recorded_count(void) const;
+    size_t get_predicted_count(void) const;
+
+    // Serialization.
+
+    bool parse(const std::string &text);
+    std::string serialize(const size_t max_count) const;
+
+    bool load(const char * const file_name);
+    bool save(const char * const file_name, const size_t max_count) const;
+};
+
+} // namespace emu
+
+#endif // TEXTURE_HISTORY_H
+
+// EOF //
@@ -0,0 +1,37 @@
+#ifndef TEXTURE_LEVELS_JOB_H
+#define TEXTURE_LEVELS_JOB_H
+
+#include "../helpers/job.h"
+#include <cstddef>
+
+namespace emu {
+
+/**
+ * @brief Job producing all levels of a texture for upload by the HW layer.
+ *
+ * The results are valid only after the job has finished.
+ */
+class TextureLevelsJob : public Job {
+
+public:
+
+    virtual bool is_valid(void) const = 0;
+    virtual size_t get_level_count(void) const = 0;
+    virtual const unsigned char *get_level_data(const size_t level) const = 0;
+
+    /**
+     * @brief Returns size of single row of specified level in bytes.
+     */
+    virtual size_t get_level_row_size(const size_t level) const = 0;
+
+    /**
+     * @brief Returns number of rows of specified level.
+     */
+    virtual size_t get_level_row_count(const size_t level) const = 0;
+};
+
+} // namespace emu
+
+#endif // TEXTURE_LEVELS_JOB_H
+
+// EOF //
@@ -0,0 +1,113 @@
+#include "texture_mipmap_job.h"
+#include "texel_conversion.h"
+#include "mipmap.h"
+#include <assert.h>
+
+namespace emu {
+
+TextureMipmapJob::TextureMipmapJob(const TextureSource the_source, const TextureStorage the_storage, const size_t the_width, const size_t the_height, const void * const memory, const size_t pitch)
+    : source(the_source)
+    , storage(the_storage)
+    , width(the_width)
+    , height(the_height)
+    , texels(the_width * the_height)
+    , data()
+    , level_offsets()
+{
+    assert(memory);
+    assert((width > 0) && (height > 0));
+    assert(TextureFormatTable::get_texel_size(storage) > 0);
+    read_same_format(&texels[0], width * sizeof(unsigned short), memory, pitch, width, height, sizeof(unsigned short));
+
+    const size_t level_count = get_mipmap_level_count(width, height);
+    size_t offset = 0;
+    for (size_t level = 0; level < level_count; ++level) {
+        level_offsets.push_back(offset);
+        offset += get_level_row_size(level) * get_level_row_count(level);
+    }
+    level_offsets.push_back(offset);
+}
+
+void TextureMipmapJob::run(void)
+{
+    std::vector<unsigned int> level_texels(width * height);
+    if (source == TEXTURE_SOURCE_565) {
+        read565_as_8888(&level_texels[0], width * sizeof(unsigned int), &texels[0], width * sizeof(unsigned short), width, height);
+    }
+    else {
+        read4444_as_8888(&level_texels[0], width * sizeof(unsigned int), &texels[0], width * sizeof(unsigned short), width, height);
+    }
+
+    data.resize(level_offsets.back());
+    std::vector<unsigned int> next_level_texels;
+    for (size_t level = 0; level < get_level_count(); ++level) {
+        const size_t level_width = get_mipmap_level_size(width, level);
+        const size_t level_height = get_mipmap_level_size(height, level);
+        store_level(level, &level_texels[0]);
+
+        if ((level + 1) < get_level_count()) {
+            next_level_texels.resize(get_mipmap_level_size(level_width, 1) * get_mipmap_level_size(level_height, 1));
+            downsample(&level_texels[0], level_width, level_height, &next_level_texels[0], source == TEXTURE_SOURCE_4444);
+            level_texels.swap(next_level_texels);
+        }
+    }
+}
+
+TextureStorage TextureMipmapJob::get_storage(void) const
+{
+    return storage;
+}
+
+bool TextureMipmapJob::is_valid(void) const
+{
+    return (! data.empty()) && (data.size() == level_offsets.back());
+}
+
+size_t TextureMipmapJob::get_level_count(void) const
+{
+    return level_offsets.size() - 1;
+}
+
+const unsigned char *TextureMipmapJob::get_level_data(const size_t level) const
+{
+    assert(is_valid());
+    assert(level < get_level_count());
+    return &data[level_offsets[level]];
+}
+
+size_t TextureMipmapJob::get_level_row_size(const size_t level) const
+{
+    return get_mipmap_level_size(width, level) * TextureFormatTable::get_texel_size(storage);
+}
+
+size_t TextureMipmapJob::get_level_row_count(const size_t level) const
+{
+    return get_mipmap_level_size(height, level);
+}
+
+/**
+ * @brief Converts the filtered 8888 level to the storage format.
+ */
+void TextureMipmapJob::store_level(const size_t level, const unsigned int * const level_texels)
+{
+    const size_t level_width = get_mipmap_level_size(width, level);
+    const size_t level_height = get_level_row_count(level);
+    const size_t row_size = get_level_row_size(level);
+    unsigned char * const destination = &data[level_offsets[level]];
+
+    switch (storage) {
+        case TEXTURE_STORAGE_R5G6B5:
+            read8888_as_565(destination, row_size, level_texels, level_width * sizeof(unsigned int), level_width, level_height);
+            break;
+        case TEXTURE_STORAGE_A4R4G4B4:
+            read8888_as_4444(destination, row_size, level_texels, level_width * sizeof(unsigned int), level_width, level_height);
+            break;
+        default:
+            read_same_format(destination, row_size, level_texels, level_width * sizeof(unsigned int), level_width, level_height, sizeof(unsigned int));
+            break;
+    }
+}
+
+} // namespace emu
+
+// EOF //
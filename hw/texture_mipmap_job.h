@@ -0,0 +1,67 @@
+#ifndef TEXTURE_MIPMAP_JOB_H
+#define TEXTURE_MIPMAP_JOB_H
+
+#include "texture_levels_job.h"
+#include "texture_format.h"
+#include <vector>
+
+namespace emu {
+
+/**
+ * @brief Builds full mipmap chain of 16 bit texture in specified storage format.
+ *
+ * The levels are filtered in 8888. The 4444 textures are filtered with
+ * color weighted by alpha so transparent texels do not darken the edges.
+ */
+class TextureMipmapJob : public TextureLevelsJob {
+
+    // Input.
+
+    TextureSource source;
+    TextureStorage storage;
+    size_t width;
+    size_t height;
+
+    /**
+     * @brief Copy of the texture, without padding.
+     */
+    std::vector<unsigned short> texels;
+
+    // Output.
+
+    /**
+     * @brief All levels in the storage format, one after another.
+     */
+    std::vector<unsigned char> data;
+
+    /**
+     * @brief Offset of each level within the data.
+     */
+    std::vector<size_t> level_offsets;
+
+public:
+
+    TextureMipmapJob(const TextureSource the_source, const TextureStorage the_storage, const size_t the_width, const size_t the_height, const void * const memory, const size_t pitch);
+
+    virtual void run(void);
+
+    // Results, valid only after the job has finished.
+
+    TextureStorage get_storage(void) const;
+
+    virtual bool is_valid(void) const;
+    virtual size_t get_level_count(void) const;
+    virtual const unsigned char *get_level_data(const size_t level) const;
+    virtual size_t get_level_row_size(const size_t level) const;
+    virtual size_t get_level_row_count(const size_t level) const;
+
+private:
+
+    void store_level(const size_t level, const unsigned int * const level_texels);
+};
+
+} // namespace emu
+
+#endif // TEXTURE_MIPMAP_JOB_H
+
+// EOF //
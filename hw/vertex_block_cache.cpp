@@ -0,0 +1,67 @@
+#include "vertex_block_cache.h"
+#include <assert.h>
+
+namespace emu {
+
+VertexBlockCache::VertexBlockCache()
+    : entry_count(0)
+    , next_slot(0)
+{
+}
+
+/**
+ * @brief Forgets all blocks, called when the buffer content is discarded.
+ */
+void VertexBlockCache::invalidate(void)
+{
+    entry_count = 0;
+    next_slot = 0;
+}
+
+/**
+ * @brief Looks for resident block with specified content.
+ *
+ * Returns index of its first vertex in the start.
+ */
+bool VertexBlockCache::find(const ContentHash hash, const size_t count, size_t &start) const
+{
+    for (size_t i = 0; i < entry_count; ++i) {
+        const Entry &entry = entries[i];
+        if ((entry.hash == hash) && (entry.count == count)) {
+            start = entry.start;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Remembers block just written to the buffer.
+ *
+ * The oldest block is forgotten if the cache is full.
+ */
+void VertexBlockCache::insert(const ContentHash hash, const size_t count, const size_t start)
+{
+    size_t slot = entry_count;
+    if (entry_count < SLOT_COUNT) {
+        entry_count++;
+    }
+    else {
+        slot = next_slot;
+        next_slot = (next_slot + 1) % SLOT_COUNT;
+    }
+
+    assert(slot < SLOT_COUNT);
+    entries[slot].hash = hash;
+    entries[slot].count = count;
+    entries[slot].start = start;
+}
+
+size_t VertexBlockCache::get_entry_count(void) const
+{
+    return entry_count;
+}
+
+} // namespace emu
+
+// EOF //
@@ -0,0 +1,59 @@
+#ifndef VERTEX_BLOCK_CACHE_H
+#define VERTEX_BLOCK_CACHE_H
+
+#include "../helpers/hash.h"
+#include <cstddef>
+
+namespace emu {
+
+/**
+ * @brief Remembers blocks of vertices which are still resident
+ * in the dynamic vertex buffer.
+ *
+ * The buffer is filled as a ring so the blocks stay untouched until
+ * the buffer is discarded which must be reported by the invalidate().
+ * The identification of the blocks uses content hash and the number
+ * of vertices.
+ */
+class VertexBlockCache {
+
+public:
+
+    static const size_t SLOT_COUNT = 32;
+
+private:
+
+    struct Entry {
+        ContentHash hash;
+        size_t count;
+        size_t start;
+    };
+
+    Entry entries[SLOT_COUNT];
+
+    /**
+     * @brief Number of valid entries.
+     */
+    size_t entry_count;
+
+    /**
+     * @brief Entry to overwrite when all entries are valid.
+     */
+    size_t next_slot;
+
+public:
+
+    VertexBlockCache();
+
+    void invalidate(void);
+    bool find(const ContentHash hash, const size_t count, size_t &start) const;
+    void insert(const ContentHash hash, const size_t count, const size_t start);
+
+    size_t get_entry_count(void) const;
+};
+
+} // namespace emu
+
+#endif // VERTEX_BLOCK_CACHE_H
+
+// EOF //
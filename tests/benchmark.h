@@ -0,0 +1,55 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+namespace emu {
+namespace test {
+
+/**
+ * @brief Measures wall time of a benchmark section.
+ */
+class Stopwatch {
+
+    std::chrono::steady_clock::time_point start;
+
+public:
+
+    Stopwatch()
+        : start(std::chrono::steady_clock::now())
+    {
+    }
+
+    double get_seconds(void) const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+/**
+ * @brief Keeps result of the measured code so it is not optimized out.
+ */
+inline void consume(const unsigned int value)
+{
+    static volatile unsigned int sink = 0;
+    sink = sink + value;
+}
+
+/**
+ * @brief Prints the time per iteration and the throughput of one variant.
+ */
+inline void report(const char * const name, const size_t iterations, const size_t bytes_per_iteration, const double seconds)
+{
+    const double microseconds = seconds * 1000000.0 / static_cast<double>(iterations);
+    const double megabytes = static_cast<double>(bytes_per_iteration) * static_cast<double>(iterations) / (seconds * 1024.0 * 1024.0);
+    printf("%-40s %10.3f us %10.1f MB/s\n", name, microseconds, megabytes);
+}
+
+} // namespace test
+} // namespace emu
+
+#endif // BENCHMARK_H
+
+// EOF //
@@ -0,0 +1,409 @@
+#include "test.h"
+#include "ddraw/draw_list.h"
+#include <vector>
+
+using namespace emu;
+using emu::test::create_vertex;
+using emu::test::next_random;
+
+namespace {
+
+const size_t TARGET_SIZE = 64;
+
+/**
+ * @brief Batch of the recorded frame as the game submitted it.
+ */
+struct FrameBatch {
+    DrawSortKey key;
+    std::vector<TLVertex> vertices;
+    std::vector<unsigned short> indices;
+};
+
+typedef std::vector<FrameBatch> Frame;
+
+/**
+ * @brief Color and depth buffer drawn with the less-equal depth test
+ * and depth writes, as the sorted geometry is. The blended target has
+ * no depth test and mixes the colors so each order gives other result.
+ */
+class Target {
+
+    bool blended;
+    std::vector<unsigned int> colors;
+    std::vector<float> depths;
+
+public:
+
+    explicit Target(const bool blended = false)
+        : blended(blended)
+        , colors(TARGET_SIZE * TARGET_SIZE, 0)
+        , depths(TARGET_SIZE * TARGET_SIZE, 1.0f)
+    {
+    }
+
+    /**
+     * @brief Draws triangle covering the pixels whose center is inside
+     * or on its edge. The coverage does not depend on the winding.
+     */
+    void draw_triangle(const TLVertex &a, const TLVertex &b, const TLVertex &c)
+    {
+        const float area = ((b.sx - a.sx) * (c.sy - a.sy)) - ((b.sy - a.sy) * (c.sx - a.sx));
+        if (area == 0.0f) {
+            return;
+        }
+        for (size_t y = 0; y < TARGET_SIZE; ++y) {
+            for (size_t x = 0; x < TARGET_SIZE; ++x) {
+                const float px = static_cast<float>(x) + 0.5f;
+                const float py = static_cast<float>(y) + 0.5f;
+                const float wa = (((b.sx - px) * (c.sy - py)) - ((b.sy - py) * (c.sx - px))) / area;
+                const float wb = (((c.sx - px) * (a.sy - py)) - ((c.sy - py) * (a.sx - px))) / area;
+                const float wc = 1.0f - wa - wb;
+                if ((wa < 0.0f) || (wb < 0.0f) || (wc < 0.0f)) {
+                    continue;
+                }
+                const float depth = (wa * a.sz) + (wb * b.sz) + (wc * c.sz);
+                const size_t pixel = (y * TARGET_SIZE) + x;
+                if (blended) {
+                    colors[pixel] = (colors[pixel] * 31) + a.color;
+                }
+                else if (depth <= depths[pixel]) {
+                    depths[pixel] = depth;
+                    colors[pixel] = a.color;
+                }
+            }
+        }
+    }
+
+    void draw_indexed(const TLVertex * const vertices, const unsigned short * const indices, const size_t index_count)
+    {
+        for (size_t i = 0; i < index_count; i += 3) {
+            draw_triangle(vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]]);
+        }
+    }
+
+    bool operator==(const Target &other) const
+    {
+        return (colors == other.colors) && (depths == other.depths);
+    }
+};
+
+DrawSortKey create_key(const unsigned int texture, const unsigned int state)
+{
+    DrawSortKey key;
+    key.variant = (texture != 0) ? 1 : 0;
+    key.texture = texture;
+    key.state = state;
+    return key;
+}
+
+/**
+ * @brief Adds rectangle drawn as two triangles. The depth grows by
+ * the slope in both directions from the base at the top left corner.
+ */
+void add_rectangle(FrameBatch &batch, const float left, const float top, const float right, const float bottom, const float base, const float slope, const unsigned int color)
+{
+    const unsigned short first = static_cast<unsigned short>(batch.vertices.size());
+    batch.vertices.push_back(create_vertex(left, top, base, color));
+    batch.vertices.push_back(create_vertex(right, top, base + (slope * (right - left)), color));
+    batch.vertices.push_back(create_vertex(right, bottom, base + (slope * ((right - left) + (bottom - top))), color));
+    batch.vertices.push_back(create_vertex(left, bottom, base + (slope * (bottom - top)), color));
+    const unsigned short quad[] = {0, 1, 2, 0, 2, 3};
+    for (size_t i = 0; i < 6; ++i) {
+        batch.indices.push_back(static_cast<unsigned short>(first + quad[i]));
+    }
+}
+
+/**
+ * @brief Records frame of the level geometry with few textures drawn
+ * in the scene graph order, interleaved with cockpit overlays.
+ *
+ * Each level batch has its own depth range so the order is decided by
+ * the depth test, at most 240 level batches are supported. The overlays
+ * are all at the near plane and overlap each other, only their order
+ * decides which one is visible.
+ */
+Frame record_frame(unsigned int seed, const size_t level_count, const size_t overlay_period)
+{
+    Frame frame;
+    const float DEPTH_STEP = 1.0f / 256.0f;
+    const float SLOPE = DEPTH_STEP / (4.0f * TARGET_SIZE);
+    const size_t depth_offset = seed % 240;
+    for (size_t i = 0; i < level_count; ++i) {
+        FrameBatch batch;
+        batch.key = create_key(1 + (next_random(seed) % 4), 1);
+        const float left = static_cast<float>(next_random(seed) % TARGET_SIZE);
+        const float top = static_cast<float>(next_random(seed) % TARGET_SIZE);
+        const float base = static_cast<float>(1 + (((i * 97) + depth_offset) % 240)) * DEPTH_STEP;
+        const unsigned int color = static_cast<unsigned int>(frame.size() + 1);
+        add_rectangle(batch, left - 20.0f, top - 20.0f, left + 8.0f, top + 8.0f, base, SLOPE, color);
+        add_rectangle(batch, top - 4.0f, left - 4.0f, top + 20.0f, left + 20.0f, base + (DEPTH_STEP / 2.0f), SLOPE, color);
+        frame.push_back(batch);
+
+        if ((overlay_period != 0) && ((i % overlay_period) == (overlay_period - 1))) {
+            FrameBatch overlay;
+            overlay.key = create_key(10 + (next_random(seed) % 2), 1);
+            const float offset = static_cast<float>(next_random(seed) % 16);
+            add_rectangle(overlay, offset, 40.0f, offset + 40.0f, 64.0f, 0.0f, 0.0f, static_cast<unsigned int>(frame.size() + 1));
+            frame.push_back(overlay);
+        }
+    }
+    return frame;
+}
+
+Target draw_in_order(const Frame &frame, const bool blended = false)
+{
+    Target target(blended);
+    for (size_t i = 0; i < frame.size(); ++i) {
+        target.draw_indexed(&frame[i].vertices[0], &frame[i].indices[0], frame[i].indices.size());
+    }
+    return target;
+}
+
+/**
+ * @brief Draws batches of the list the way the surface does, returns
+ * number of the draws.
+ */
+size_t draw_list(const DrawList &list, Target &target)
+{
+    size_t draw_count = 0;
+    const DrawList::BatchList &batches = list.get_batches();
+    for (size_t first = 0; first < batches.size(); ) {
+        const size_t end = list.get_group_end(first);
+        for (size_t i = first; i < end; ++i) {
+            target.draw_indexed(list.get_vertices(), list.get_indices() + batches[i].first_index, batches[i].index_count);
+        }
+        draw_count++;
+        first = end;
+    }
+    return draw_count;
+}
+
+void add_frame(const Frame &frame, DrawList &list, const bool ordered)
+{
+    list.clear();
+    for (size_t i = 0; i < frame.size(); ++i) {
+        const FrameBatch &batch = frame[i];
+        list.add(batch.key, i, &batch.vertices[0], 0, batch.vertices.size(), &batch.indices[0], batch.indices.size(), ordered);
+    }
+}
+
+size_t draw_sorted(const Frame &frame, DrawList &list, Target &target)
+{
+    add_frame(frame, list, false);
+    list.sort();
+    return draw_list(list, target);
+}
+
+/**
+ * @brief Records frame of blended particles with few textures, spread
+ * over the screen so many of them do not overlap.
+ */
+Frame record_blended_frame(unsigned int seed, const size_t count)
+{
+    Frame frame;
+    for (size_t i = 0; i < count; ++i) {
+        FrameBatch batch;
+        batch.key = create_key(1 + (next_random(seed) % 3), 2);
+        const float left = static_cast<float>(next_random(seed) % TARGET_SIZE) - 4.0f;
+        const float top = static_cast<float>(next_random(seed) % TARGET_SIZE) - 4.0f;
+        const float size = static_cast<float>(1 + (next_random(seed) % 8));
+        add_rectangle(batch, left, top, left + size, top + size, 0.5f, 0.0f, static_cast<unsigned int>(i + 1));
+        frame.push_back(batch);
+    }
+    return frame;
+}
+
+/**
+ * @brief Adds batch of single rectangle with specified key and tag.
+ */
+void add_ordered(DrawList &list, const DrawSortKey &key, const size_t tag, const float left, const float top)
+{
+    FrameBatch batch;
+    add_rectangle(batch, left, top, left + 4.0f, top + 4.0f, 0.5f, 0.0f, 1);
+    list.add(key, tag, &batch.vertices[0], 0, batch.vertices.size(), &batch.indices[0], batch.indices.size(), true);
+}
+
+void test_sort_key(void)
+{
+    // The texture stage variant is the most significant part.
+
+    CHECK(! (create_key(5, 0) < create_key(0, 1)));
+    CHECK(create_key(0, 9) < create_key(1, 0));
+    CHECK(create_key(1, 9) < create_key(2, 0));
+    CHECK(create_key(1, 0) < create_key(1, 1));
+    CHECK(! (create_key(1, 1) < create_key(1, 1)));
+
+    HWStateKey textured;
+    textured.depth_test = DEPTH_TEST_ON;
+    textured.texture = 7;
+    HWStateKey other_fog = textured;
+    other_fog.fog = FOG_VERTEX;
+    CHECK(DrawSortKey(textured) == DrawSortKey(textured));
+    CHECK(! (DrawSortKey(textured) == DrawSortKey(other_fog)));
+    CHECK(DrawSortKey(textured).texture == 7);
+}
+
+void test_level_frames(void)
+{
+    // Without overlays the sorted frames match and need few draws.
+
+    DrawList list;
+    for (unsigned int seed = 1; seed <= 20; ++seed) {
+        const Frame frame = record_frame(seed, 60, 0);
+        Target sorted;
+        const size_t draw_count = draw_sorted(frame, list, sorted);
+        CHECK(sorted == draw_in_order(frame));
+        CHECK(draw_count <= 4);
+        CHECK(list.get_fixed_count() == 0);
+    }
+}
+
+void test_overlay_frames(void)
+{
+    // The overlays at equal depth keep their order, the level geometry
+    // is still sorted between them.
+
+    DrawList list;
+    for (unsigned int seed = 1; seed <= 20; ++seed) {
+        const Frame frame = record_frame(seed, 60, 12);
+        Target sorted;
+        const size_t draw_count = draw_sorted(frame, list, sorted);
+        CHECK(sorted == draw_in_order(frame));
+        CHECK(list.get_fixed_count() == 5);
+        CHECK(draw_count < (frame.size() / 2));
+    }
+}
+
+void test_fixed_position(void)
+{
+    // Constant depth keeps the batch in place even when its key sorts
+    // before the surrounding batches.
+
+    Frame frame;
+    const DrawSortKey keys[] = {create_key(3, 1), create_key(1, 1), create_key(0, 1), create_key(2, 1), create_key(1, 1)};
+    const float slopes[] = {0.001f, 0.001f, 0.0f, 0.001f, 0.001f};
+    for (size_t i = 0; i < 5; ++i) {
+        FrameBatch batch;
+        batch.key = keys[i];
+        add_rectangle(batch, 0.0f, 0.0f, 8.0f, 8.0f, 0.5f, slopes[i], static_cast<unsigned int>(i + 1));
+        frame.push_back(batch);
+    }
+
+    DrawList list;
+    Target target;
+    draw_sorted(frame, list, target);
+    const DrawList::BatchList &batches = list.get_batches();
+    CHECK(list.get_fixed_count() == 1);
+    CHECK(batches.size() == 5);
+    CHECK((batches[0].tag == 1) && (batches[1].tag == 0));
+    CHECK(batches[2].tag == 2);
+    CHECK(batches[2].fixed);
+    CHECK((batches[3].tag == 4) && (batches[4].tag == 3));
+}
+
+void test_ordered_invariants(void)
+{
+    // Each added batch stays at the end or follows a batch with the same
+    // key. Batches which might touch the same pixel keep the order in
+    // which they were added so the result is the same as in order.
+
+    DrawList list;
+    for (unsigned int seed = 1; seed <= 20; ++seed) {
+        const Frame frame = record_blended_frame(seed, 150);
+        list.clear();
+        bool joined_placement = true;
+        for (size_t i = 0; i < frame.size(); ++i) {
+            const FrameBatch &batch = frame[i];
+            list.add(batch.key, i, &batch.vertices[0], 0, batch.vertices.size(), &batch.indices[0], batch.indices.size(), true);
+            const DrawList::BatchList &batches = list.get_batches();
+            size_t position = 0;
+            while (batches[position].tag != i) {
+                position++;
+            }
+            if ((position + 1) != batches.size()) {
+                joined_placement = joined_placement && (position > 0) && (batches[position - 1].key == batch.key);
+            }
+        }
+        CHECK(joined_placement);
+        CHECK(list.get_joined_count() > 0);
+
+        const DrawList::BatchList &batches = list.get_batches();
+        CHECK(batches.size() == frame.size());
+        bool overlap_order = true;
+        for (size_t i = 0; i < batches.size(); ++i) {
+            for (size_t j = i + 1; j < batches.size(); ++j) {
+                if (are_bounds_overlapping(batches[i].bounds, batches[j].bounds)) {
+                    overlap_order = overlap_order && (batches[i].tag < batches[j].tag);
+                }
+            }
+        }
+        CHECK(overlap_order);
+
+        Target merged(true);
+        const size_t draw_count = draw_list(list, merged);
+        CHECK(merged == draw_in_order(frame, true));
+        CHECK(draw_count < frame.size());
+    }
+}
+
+void test_ordered_barriers(void)
+{
+    // Overlapping batch with other key stops the move, overlapping batch
+    // with the same key is joined.
+
+    DrawList list;
+    add_ordered(list, create_key(1, 2), 0, 0.0f, 0.0f);
+    add_ordered(list, create_key(2, 2), 1, 2.0f, 2.0f);
+    add_ordered(list, create_key(1, 2), 2, 5.5f, 5.5f);
+    add_ordered(list, create_key(1, 2), 3, 5.5f, 5.5f);
+    const DrawList::BatchList &batches = list.get_batches();
+    CHECK(batches.size() == 4);
+    CHECK((batches[0].tag == 0) && (batches[1].tag == 1) && (batches[2].tag == 2) && (batches[3].tag == 3));
+    CHECK(list.get_joined_count() == 1);
+
+    // The touching rectangle counts as overlapping, the bounds include
+    // the rasterization margin.
+
+    list.clear();
+    add_ordered(list, create_key(1, 2), 0, 0.0f, 0.0f);
+    add_ordered(list, create_key(2, 2), 1, 4.5f, 0.0f);
+    add_ordered(list, create_key(1, 2), 2, 9.0f, 0.0f);
+    CHECK(list.get_joined_count() == 0);
+    CHECK(list.get_batches()[2].tag == 2);
+}
+
+void test_ordered_move_limit(void)
+{
+    // The batch moves over at most MAXIMAL_ORDERED_MOVE batches.
+
+    const size_t moves[] = {DrawList::MAXIMAL_ORDERED_MOVE - 1, DrawList::MAXIMAL_ORDERED_MOVE};
+    for (size_t k = 0; k < 2; ++k) {
+        DrawList list;
+        add_ordered(list, create_key(1, 2), 0, 0.0f, 0.0f);
+        for (size_t i = 0; i < moves[k]; ++i) {
+            add_ordered(list, create_key(static_cast<unsigned int>(i + 2), 2), i + 1, 20.0f + static_cast<float>(i * 8), 20.0f);
+        }
+        add_ordered(list, create_key(1, 2), moves[k] + 1, 0.0f, 40.0f);
+        const DrawList::BatchList &batches = list.get_batches();
+        const bool joined = (k == 0);
+        CHECK(list.get_joined_count() == (joined ? 1 : 0));
+        CHECK((batches[1].tag == (moves[k] + 1)) == joined);
+        CHECK((batches.back().tag == (moves[k] + 1)) != joined);
+    }
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_sort_key();
+    test_level_frames();
+    test_overlay_frames();
+    test_fixed_position();
+    test_ordered_invariants();
+    test_ordered_barriers();
+    test_ordered_move_limit();
+    return emu::test::finish("draw_list_test");
+}
+
+// EOF //
@@ -0,0 +1,317 @@
+#include "test.h"
+#include "hw/dxt_encoder.h"
+#include "hw/compressed_texture_cache.h"
+#include "hw/texture_compression_job.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+const size_t IMAGE_SIZE = 64;
+
+/**
+ * @brief Minimal PSNR of the color channels, in dB, for each quality.
+ */
+const double MIN_GRADIENT_PSNR[SIZE_OF_DXT_QUALITY] = {34.0, 37.0, 37.5};
+const double MIN_NOISE_PSNR[SIZE_OF_DXT_QUALITY] = {11.0, 12.5, 12.5};
+
+/**
+ * @brief Tolerance when comparing PSNR of two qualities.
+ */
+const double PSNR_TOLERANCE = 0.05;
+
+/**
+ * @brief Smooth image with different gradient in each channel.
+ */
+std::vector<unsigned int> create_gradient(const size_t width, const size_t height)
+{
+    std::vector<unsigned int> pixels(width * height);
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            const unsigned int alpha = static_cast<unsigned int>((x + y) * 255 / (width + height - 2));
+            const unsigned int red = static_cast<unsigned int>(x * 255 / (width - 1));
+            const unsigned int green = static_cast<unsigned int>(y * 255 / (height - 1));
+            const unsigned int blue = static_cast<unsigned int>(255 - red / 2 - green / 2);
+            pixels[y * width + x] = (alpha << 24) | (red << 16) | (green << 8) | blue;
+        }
+    }
+    return pixels;
+}
+
+/**
+ * @brief Deterministic noise, the worst case for the block encoder.
+ */
+std::vector<unsigned int> create_noise(const size_t width, const size_t height)
+{
+    std::vector<unsigned int> pixels(width * height);
+    unsigned int state = 12345;
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        state = state * 1664525 + 1013904223;
+        pixels[i] = state;
+    }
+    return pixels;
+}
+
+/**
+ * @brief Returns PSNR of the color channels, alpha is ignored.
+ */
+double get_color_psnr(const std::vector<unsigned int> &original, const std::vector<unsigned int> &decoded)
+{
+    double error = 0.0;
+    for (size_t i = 0; i < original.size(); ++i) {
+        for (unsigned int shift = 0; shift < 24; shift += 8) {
+            const double difference = static_cast<double>((original[i] >> shift) & 0xFF) - static_cast<double>((decoded[i] >> shift) & 0xFF);
+            error += difference * difference;
+        }
+    }
+    if (error == 0.0) {
+        return 1000.0;
+    }
+    const double mean_error = error / (original.size() * 3);
+    return 10.0 * log10(255.0 * 255.0 / mean_error);
+}
+
+std::vector<unsigned int> round_trip(const DXTFormat format, const DXTQuality quality, const std::vector<unsigned int> &pixels, const size_t width, const size_t height)
+{
+    std::vector<unsigned char> compressed(get_dxt_size(format, width, height));
+    encode_dxt(format, quality, &pixels[0], width, height, &compressed[0]);
+    std::vector<unsigned int> decoded(width * height, 0);
+    decode_dxt(format, &compressed[0], width, height, &decoded[0]);
+    return decoded;
+}
+
+void test_size(void)
+{
+    CHECK(get_dxt_size(DXT_FORMAT_DXT1, 4, 4) == 8);
+    CHECK(get_dxt_size(DXT_FORMAT_DXT3, 4, 4) == 16);
+    CHECK(get_dxt_size(DXT_FORMAT_DXT1, 1, 1) == 8);
+    CHECK(get_dxt_size(DXT_FORMAT_DXT1, 5, 3) == 16);
+    CHECK(get_dxt_size(DXT_FORMAT_DXT3, 256, 128) == 64 * 32 * 16);
+}
+
+void test_solid_color_exact(void)
+{
+    // Colors representable in 565 survive the compression exactly.
+
+    const unsigned int colors[] = {0xFF000000, 0xFFFFFFFF, 0xFFFF0000, 0xFF00FF00, 0xFF0000FF, 0xFF844108};
+    for (size_t i = 0; i < sizeof(colors) / sizeof(colors[0]); ++i) {
+        const std::vector<unsigned int> pixels(8 * 8, colors[i]);
+        for (int quality = 0; quality < SIZE_OF_DXT_QUALITY; ++quality) {
+            const std::vector<unsigned int> decoded = round_trip(DXT_FORMAT_DXT1, static_cast<DXTQuality>(quality), pixels, 8, 8);
+            CHECK(decoded == pixels);
+        }
+    }
+}
+
+void test_quality(const std::vector<unsigned int> &pixels, const double * const min_psnr)
+{
+    for (int format = DXT_FORMAT_DXT1; format <= DXT_FORMAT_DXT3; ++format) {
+        double previous_psnr = 0.0;
+        for (int quality = 0; quality < SIZE_OF_DXT_QUALITY; ++quality) {
+            const std::vector<unsigned int> decoded = round_trip(static_cast<DXTFormat>(format), static_cast<DXTQuality>(quality), pixels, IMAGE_SIZE, IMAGE_SIZE);
+            const double psnr = get_color_psnr(pixels, decoded);
+            CHECK(psnr >= min_psnr[quality]);
+            CHECK(psnr + PSNR_TOLERANCE >= previous_psnr);
+            previous_psnr = psnr;
+        }
+    }
+}
+
+void test_gradient_quality(void)
+{
+    test_quality(create_gradient(IMAGE_SIZE, IMAGE_SIZE), MIN_GRADIENT_PSNR);
+}
+
+void test_noise_quality(void)
+{
+    test_quality(create_noise(IMAGE_SIZE, IMAGE_SIZE), MIN_NOISE_PSNR);
+}
+
+void test_dxt3_alpha(void)
+{
+    // The 4444 textures keep their alpha exactly.
+
+    std::vector<unsigned int> pixels = create_gradient(16, 16);
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        const unsigned int alpha_4 = static_cast<unsigned int>(i & 0xF);
+        pixels[i] = (pixels[i] & 0x00FFFFFF) | (((alpha_4 << 4) | alpha_4) << 24);
+    }
+    const std::vector<unsigned int> decoded = round_trip(DXT_FORMAT_DXT3, DXT_QUALITY_NORMAL, pixels, 16, 16);
+    bool alpha_exact = true;
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        alpha_exact = alpha_exact && ((pixels[i] >> 24) == (decoded[i] >> 24));
+    }
+    CHECK(alpha_exact);
+}
+
+void test_partial_blocks(void)
+{
+    // Images smaller than a block and with partial blocks at the border.
+
+    const size_t sizes[][2] = {{1, 1}, {2, 2}, {3, 5}, {7, 6}};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        const size_t width = sizes[i][0];
+        const size_t height = sizes[i][1];
+        const std::vector<unsigned int> pixels(width * height, 0xFF00FF00);
+        const std::vector<unsigned int> decoded = round_trip(DXT_FORMAT_DXT1, DXT_QUALITY_FAST, pixels, width, height);
+        CHECK(decoded == pixels);
+    }
+}
+
+/**
+ * @brief Temporary directory removed with its content at the end of the test.
+ */
+class TemporaryDirectory {
+
+    std::string path;
+
+public:
+
+    TemporaryDirectory()
+        : path()
+    {
+        char name[] = "/tmp/dxt_cache_XXXXXX";
+        if (mkdtemp(name) != NULL) {
+            path = name;
+        }
+    }
+
+    ~TemporaryDirectory()
+    {
+        if (! path.empty()) {
+            const std::string command = "rm -rf '" + path + "'";
+            if (system(command.c_str()) != 0) {
+                fprintf(stderr, "failed to remove %s\n", path.c_str());
+            }
+        }
+    }
+
+    const std::string &get_path(void) const
+    {
+        return path;
+    }
+};
+
+CompressedTextureKey create_key(const ContentHash hash)
+{
+    CompressedTextureKey key;
+    key.hash = hash;
+    key.format = DXT_FORMAT_DXT1;
+    key.quality = DXT_QUALITY_NORMAL;
+    key.width = 8;
+    key.height = 8;
+    key.levels = 4;
+    return key;
+}
+
+void test_cache_disabled(void)
+{
+    CompressedTextureCache cache;
+    CHECK(! cache.is_enabled());
+
+    const std::vector<unsigned char> data(32, 7);
+    std::vector<unsigned char> loaded;
+    CHECK(! cache.store(create_key(1), data));
+    CHECK(! cache.load(create_key(1), loaded));
+    CHECK(loaded.empty());
+}
+
+void test_cache_hits(void)
+{
+    const TemporaryDirectory directory;
+    CHECK(! directory.get_path().empty());
+    CompressedTextureCache cache;
+    cache.set_directory(directory.get_path());
+    CHECK(cache.is_enabled());
+
+    std::vector<unsigned char> data(40);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<unsigned char>(i * 3);
+    }
+
+    std::vector<unsigned char> loaded;
+    CHECK(! cache.load(create_key(0x1234567890ABCDEFULL), loaded));
+    CHECK(cache.store(create_key(0x1234567890ABCDEFULL), data));
+    CHECK(cache.load(create_key(0x1234567890ABCDEFULL), loaded));
+    CHECK(loaded == data);
+
+    // Different content or different layout of the same content misses.
+
+    CHECK(! cache.load(create_key(0x1234567890ABCDEEULL), loaded));
+    CHECK(loaded.empty());
+    CompressedTextureKey other_size = create_key(0x1234567890ABCDEFULL);
+    other_size.width = 16;
+    CHECK(! cache.load(other_size, loaded));
+    CompressedTextureKey other_quality = create_key(0x1234567890ABCDEFULL);
+    other_quality.quality = DXT_QUALITY_HIGH;
+    CHECK(! cache.load(other_quality, loaded));
+
+    // Empty data is never stored.
+
+    CHECK(! cache.store(create_key(5), std::vector<unsigned char>()));
+    CHECK(! cache.load(create_key(5), loaded));
+}
+
+void test_job_uses_cache(void)
+{
+    const TemporaryDirectory directory;
+    CompressedTextureCache cache;
+    cache.set_directory(directory.get_path());
+
+    const size_t width = 32;
+    const size_t height = 16;
+    std::vector<unsigned short> texels(width * height);
+    for (size_t i = 0; i < texels.size(); ++i) {
+        texels[i] = static_cast<unsigned short>(i * 37);
+    }
+
+    TextureCompressionJob first(TEXTURE_SOURCE_565, width, height, &texels[0], width * sizeof(unsigned short), DXT_QUALITY_NORMAL, &cache);
+    first.run();
+    CHECK(first.is_valid());
+    CHECK(! first.was_loaded_from_cache());
+    CHECK(first.get_format() == DXT_FORMAT_DXT1);
+    CHECK(first.get_level_count() == 6);
+
+    TextureCompressionJob second(TEXTURE_SOURCE_565, width, height, &texels[0], width * sizeof(unsigned short), DXT_QUALITY_NORMAL, &cache);
+    second.run();
+    CHECK(second.is_valid());
+    CHECK(second.was_loaded_from_cache());
+    bool identical = true;
+    for (size_t level = 0; level < first.get_level_count(); ++level) {
+        const size_t size = first.get_level_row_size(level) * first.get_level_row_count(level);
+        identical = identical && (memcmp(first.get_level_data(level), second.get_level_data(level), size) == 0);
+    }
+    CHECK(identical);
+
+    // Other quality is a separate entry.
+
+    TextureCompressionJob third(TEXTURE_SOURCE_565, width, height, &texels[0], width * sizeof(unsigned short), DXT_QUALITY_FAST, &cache);
+    third.run();
+    CHECK(third.is_valid());
+    CHECK(! third.was_loaded_from_cache());
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_size();
+    test_solid_color_exact();
+    test_gradient_quality();
+    test_noise_quality();
+    test_dxt3_alpha();
+    test_partial_blocks();
+    test_cache_disabled();
+    test_cache_hits();
+    test_job_uses_cache();
+    return emu::test::finish("dxt_encoder_test");
+}
+
+// EOF //
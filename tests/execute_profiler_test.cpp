@@ -0,0 +1,240 @@
+#include "test.h"
+#include "execute_stream.h"
+#include "ddraw/execute_profiler.h"
+#include "ddraw/instruction_decoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+void test_bucket_index(void)
+{
+    CHECK(Histogram::get_bucket_index(0) == 0);
+    CHECK(Histogram::get_bucket_index(1) == 1);
+    CHECK(Histogram::get_bucket_index(2) == 2);
+    CHECK(Histogram::get_bucket_index(3) == 2);
+    CHECK(Histogram::get_bucket_index(4) == 3);
+    CHECK(Histogram::get_bucket_index(1023) == 10);
+    CHECK(Histogram::get_bucket_index(1024) == 11);
+    CHECK(Histogram::get_bucket_index(static_cast<size_t>(-1)) == Histogram::BUCKET_COUNT - 1);
+
+    // Each bucket starts at its minimum.
+
+    for (size_t bucket = 0; bucket < Histogram::BUCKET_COUNT; ++bucket) {
+        CHECK(Histogram::get_bucket_index(Histogram::get_bucket_minimum(bucket)) == bucket);
+        if (bucket > 1) {
+            CHECK(Histogram::get_bucket_index(Histogram::get_bucket_minimum(bucket) - 1) == bucket - 1);
+        }
+    }
+}
+
+void test_histogram(void)
+{
+    Histogram histogram;
+    CHECK(histogram.get_count() == 0);
+    CHECK(histogram.get_average() == 0.0);
+
+    const size_t values[] = {0, 1, 1, 5, 6, 7, 100000000};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        histogram.add(values[i]);
+    }
+    CHECK(histogram.get_count() == 7);
+    CHECK(histogram.get_maximum() == 100000000);
+    CHECK(histogram.get_bucket(0) == 1);
+    CHECK(histogram.get_bucket(1) == 2);
+    CHECK(histogram.get_bucket(3) == 3);
+    CHECK(histogram.get_bucket(Histogram::BUCKET_COUNT - 1) == 1);
+    CHECK(histogram.get_average() == (100000020.0 / 7.0));
+
+    // Only non-empty buckets are listed, the last one as open range.
+
+    const std::string line = histogram.format("values");
+    CHECK(line.find("count 7") != std::string::npos);
+    CHECK(line.find(" 0:1 1:2 4:3 65536+:1\n") != std::string::npos);
+    CHECK(line.find(" 2:") == std::string::npos);
+
+    histogram.clear();
+    CHECK(histogram.get_count() == 0);
+    CHECK(histogram.get_maximum() == 0);
+    CHECK(histogram.get_bucket(3) == 0);
+}
+
+/**
+ * @brief Replays the stream through the profiler the way the execute does.
+ */
+void replay(ExecuteProfiler &profiler, const test::ExecuteStream &stream, const size_t vertex_count)
+{
+    std::vector<DecodedInstruction> instructions;
+    decode_instructions(stream.get_data(), 0, stream.get_size(), instructions);
+    profiler.begin_execute(vertex_count);
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        profiler.record_decoded_instruction(stream.get_data(), instructions[i], true, true);
+    }
+    profiler.end_execute();
+}
+
+test::ExecuteStream create_stream(void)
+{
+    test::ExecuteStream stream;
+    const unsigned int states[] = {1, 12, 22, 1, 27, 0};
+    const unsigned short indices[] = {0, 1, 2, 2, 1, 3, 4, 5, 6};
+    stream.add_render_states(states, 3);
+    stream.add_process_vertices(0, 0, 4);
+    stream.add_triangles(indices, 2);
+    stream.add_render_states(states, 1);
+    stream.add_process_vertices(4, 4, 3);
+    stream.add_triangles(indices + 6, 1);
+    stream.add_exit();
+    return stream;
+}
+
+void test_synthetic_buffers(void)
+{
+    ExecuteProfiler profiler;
+    CHECK(! profiler.is_enabled());
+    profiler.set_enabled(true);
+
+    // Two frames, the first with two executes of the same buffer.
+
+    const test::ExecuteStream stream = create_stream();
+    replay(profiler, stream, 7);
+    profiler.record_draw(3);
+    replay(profiler, stream, 7);
+    profiler.record_draw(3);
+    profiler.end_frame();
+    replay(profiler, stream, 7);
+    profiler.end_frame();
+
+    CHECK(profiler.get_execute_count() == 3);
+    CHECK(profiler.get_frame_count() == 2);
+    CHECK(profiler.get_instruction_count(INSTRUCTION_STATERENDER) == 6);
+    CHECK(profiler.get_operation_count(INSTRUCTION_STATERENDER) == 12);
+    CHECK(profiler.get_instruction_count(INSTRUCTION_PROCESSVERTICES) == 6);
+    CHECK(profiler.get_operation_count(INSTRUCTION_TRIANGLE) == 9);
+    CHECK(profiler.get_instruction_count(INSTRUCTION_EXIT) == 0);
+
+    const Histogram &blocks = profiler.get_triangles_per_block();
+    CHECK(blocks.get_count() == 6);
+    CHECK(blocks.get_bucket(1) == 3);
+    CHECK(blocks.get_bucket(2) == 3);
+
+    // The state changes are attributed to the following draw.
+
+    const Histogram &changes = profiler.get_state_changes_per_draw();
+    CHECK(changes.get_count() == 2);
+    CHECK(changes.get_maximum() == 4);
+
+    // Only the second process vertices of each execute has an offset.
+
+    const std::string report = profiler.report();
+    CHECK(report.find("executes 3 frames 2\n") != std::string::npos);
+    CHECK(report.find("process vertices 6, with offset 3\n") != std::string::npos);
+    CHECK(report.find("STATERENDER") != std::string::npos);
+    CHECK(report.find("POINT") == std::string::npos);
+
+    profiler.clear();
+    CHECK(profiler.get_execute_count() == 0);
+    CHECK(profiler.get_operation_count(INSTRUCTION_TRIANGLE) == 0);
+    CHECK(profiler.get_triangles_per_block().get_count() == 0);
+}
+
+void test_unsupported_and_failures(void)
+{
+    ExecuteProfiler profiler;
+    profiler.set_enabled(true);
+    profiler.begin_execute(0);
+
+    // Unknown opcodes share the slot 0.
+
+    DecodedInstruction instruction;
+    instruction.opcode = 4; // D3DOP_MATRIXLOAD
+    instruction.size = 8;
+    instruction.count = 2;
+    instruction.offset = 0;
+    const unsigned char memory[16] = {0};
+    profiler.record_decoded_instruction(memory, instruction, false, true);
+    instruction.opcode = INSTRUCTION_TRIANGLE;
+    profiler.record_decoded_instruction(memory, instruction, true, false);
+    instruction.opcode = 200;
+    profiler.record_decoded_instruction(memory, instruction, false, true);
+    profiler.end_execute();
+
+    CHECK(profiler.get_unsupported_count(4) == 1);
+    CHECK(profiler.get_failure_count(INSTRUCTION_TRIANGLE) == 1);
+    CHECK(profiler.get_unsupported_count(200) == 1);
+    CHECK(profiler.get_unsupported_count(0) == 1);
+    CHECK(ExecuteProfiler::get_opcode_name(200) == std::string("unknown"));
+    CHECK(ExecuteProfiler::get_opcode_name(INSTRUCTION_PROCESSVERTICES) == std::string("PROCESSVERTICES"));
+}
+
+void test_culling_and_indices(void)
+{
+    ExecuteProfiler profiler;
+    profiler.set_enabled(true);
+    profiler.record_triangle_indices(30, 12, true);
+    profiler.record_triangle_indices(6, 6, false);
+    profiler.record_culled_triangles(10, 3);
+    profiler.record_merged_batch();
+    profiler.end_frame();
+
+    // Frame without tested triangles does not add a culling sample.
+
+    profiler.end_frame();
+
+    const std::string report = profiler.report();
+    CHECK(report.find("triangle indices 36, submitted 18, strip draws 1\n") != std::string::npos);
+    CHECK(report.find("batches merged across executes 1\n") != std::string::npos);
+    CHECK(report.find("triangles tested by culling 10, culled 3\n") != std::string::npos);
+    CHECK(report.find("culled percent per frame   count 1 avg 30.00") != std::string::npos);
+}
+
+void test_save(void)
+{
+    ExecuteProfiler profiler;
+    profiler.set_enabled(true);
+    replay(profiler, create_stream(), 7);
+    profiler.end_frame();
+
+    char name[] = "/tmp/execute_profile_XXXXXX";
+    const int descriptor = mkstemp(name);
+    CHECK(descriptor >= 0);
+    if (descriptor < 0) {
+        return;
+    }
+    close(descriptor);
+
+    CHECK(profiler.save(name));
+    std::string content;
+    FILE * const file = fopen(name, "rb");
+    CHECK(file != NULL);
+    if (file) {
+        char buffer[256];
+        size_t length = 0;
+        while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            content.append(buffer, length);
+        }
+        fclose(file);
+    }
+    unlink(name);
+    CHECK(content == profiler.report());
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_bucket_index();
+    test_histogram();
+    test_synthetic_buffers();
+    test_unsupported_and_failures();
+    test_culling_and_indices();
+    test_save();
+    return emu::test::finish("execute_profiler_test");
+}
+
+// EOF //
@@ -0,0 +1,112 @@
+#ifndef EXECUTE_STREAM_H
+#define EXECUTE_STREAM_H
+
+#include "ddraw/instruction_decoder.h"
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace emu {
+namespace test {
+
+/**
+ * @brief Element sizes of the D3D structures used by the synthetic streams.
+ */
+const size_t STREAM_STATE_SIZE = 8;
+const size_t STREAM_PROCESSVERTICES_SIZE = 16;
+const size_t STREAM_TRIANGLE_SIZE = 8;
+
+/**
+ * @brief Builds memory of execute buffer the way the game fills it.
+ */
+class ExecuteStream {
+
+    std::vector<unsigned char> bytes;
+
+public:
+
+    ExecuteStream()
+        : bytes()
+    {
+    }
+
+    /**
+     * @brief Appends D3DINSTRUCTION header followed by its data block.
+     */
+    void add(const unsigned char opcode, const size_t size, const size_t count, const void * const data)
+    {
+        const unsigned short word_count = static_cast<unsigned short>(count);
+        bytes.push_back(opcode);
+        bytes.push_back(static_cast<unsigned char>(size));
+        bytes.push_back(static_cast<unsigned char>(word_count & 0xFF));
+        bytes.push_back(static_cast<unsigned char>(word_count >> 8));
+        append(data, size * count);
+    }
+
+    /**
+     * @brief Appends raw bytes, used for vertices in front of the instructions.
+     */
+    void append(const void * const data, const size_t length)
+    {
+        const size_t offset = bytes.size();
+        bytes.resize(offset + length);
+        if (length > 0) {
+            memcpy(&bytes[offset], data, length);
+        }
+    }
+
+    void add_render_states(const unsigned int * const states, const size_t count)
+    {
+        add(INSTRUCTION_STATERENDER, STREAM_STATE_SIZE, count, states);
+    }
+
+    /**
+     * @brief Appends D3DPROCESSVERTICES which copies transformed vertices.
+     */
+    void add_process_vertices(const unsigned short start, const unsigned short dest, const unsigned int count)
+    {
+        unsigned char data[STREAM_PROCESSVERTICES_SIZE] = {0};
+        const unsigned int flags = 2; // D3DPROCESSVERTICES_COPY
+        memcpy(data, &flags, 4);
+        memcpy(data + 4, &start, 2);
+        memcpy(data + 6, &dest, 2);
+        memcpy(data + 8, &count, 4);
+        add(INSTRUCTION_PROCESSVERTICES, STREAM_PROCESSVERTICES_SIZE, 1, data);
+    }
+
+    /**
+     * @brief Appends D3DTRIANGLE records of triangles given by three indices each.
+     */
+    void add_triangles(const unsigned short * const indices, const size_t triangle_count)
+    {
+        std::vector<unsigned short> records(triangle_count * 4, 0);
+        for (size_t i = 0; i < triangle_count; ++i) {
+            records[i * 4 + 0] = indices[i * 3 + 0];
+            records[i * 4 + 1] = indices[i * 3 + 1];
+            records[i * 4 + 2] = indices[i * 3 + 2];
+        }
+        add(INSTRUCTION_TRIANGLE, STREAM_TRIANGLE_SIZE, triangle_count, records.empty() ? NULL : &records[0]);
+    }
+
+    void add_exit(void)
+    {
+        add(INSTRUCTION_EXIT, 0, 0, NULL);
+    }
+
+    size_t get_size(void) const
+    {
+        return bytes.size();
+    }
+
+    const unsigned char *get_data(void) const
+    {
+        return bytes.empty() ? NULL : &bytes[0];
+    }
+};
+
+} // namespace test
+} // namespace emu
+
+#endif // EXECUTE_STREAM_H
+
+// EOF //
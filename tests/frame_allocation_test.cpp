@@ -0,0 +1,308 @@
+#include "test.h"
+#include "ddraw/draw_list.h"
+#include "ddraw/render_state_set.h"
+#include "ddraw/triangle_culling.h"
+#include "ddraw/triangle_indices.h"
+#include "ddraw/triangle_strip.h"
+#include "ddraw/vertex_pool.h"
+#include <stdlib.h>
+#include <new>
+#include <vector>
+
+using namespace emu;
+using emu::test::next_random;
+
+namespace {
+
+/**
+ * @brief Number of heap allocations done by the operator new since
+ * the start of the program.
+ */
+size_t allocation_count = 0;
+
+void *allocate(const size_t size)
+{
+    allocation_count++;
+    void * const memory = malloc((size != 0) ? size : 1);
+    if (memory == NULL) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+} // anonymous namespace
+
+// Every allocation of the program goes through the counting allocator.
+
+void *operator new(size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) throw()
+{
+    allocation_count++;
+    return malloc((size != 0) ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) throw()
+{
+    allocation_count++;
+    return malloc((size != 0) ? size : 1);
+}
+
+void operator delete(void *memory) throw()
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) throw()
+{
+    free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) throw()
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) throw()
+{
+    free(memory);
+}
+
+namespace {
+
+/**
+ * @brief Values used by the surface to size the reserve.
+ */
+//@{
+const size_t GEOMETRY_RESERVE = 16384;
+const size_t VERTICES_PER_RESERVED_BATCH = 16;
+//@}
+
+const size_t EXECUTE_COUNT = 24;
+
+/**
+ * @brief Execute buffer of the game, its vertices and D3DTRIANGLE records.
+ */
+struct Execute {
+    std::vector<TLVertex> vertices;
+    std::vector<unsigned short> triangles;
+    RenderStateSet states;
+    DrawSortKey key;
+};
+
+std::vector<Execute> create_executes(unsigned int seed)
+{
+    std::vector<Execute> executes(EXECUTE_COUNT);
+    for (size_t i = 0; i < executes.size(); ++i) {
+        Execute &execute = executes[i];
+        execute.vertices.resize(16 + (next_random(seed) % 600));
+        for (size_t k = 0; k < execute.vertices.size(); ++k) {
+            TLVertex &vertex = execute.vertices[k];
+            vertex.sx = static_cast<float>(next_random(seed) % 640);
+            vertex.sy = static_cast<float>(next_random(seed) % 480);
+            vertex.sz = static_cast<float>(next_random(seed) % 1000) / 1000.0f;
+            vertex.rhw = 1.0f;
+            vertex.color = next_random(seed);
+            vertex.specular = 0;
+            vertex.tu = 0.0f;
+            vertex.tv = 0.0f;
+        }
+
+        // Strip-like triangles so the strip conversion succeeds for some.
+
+        const size_t triangle_count = execute.vertices.size() - 2;
+        for (size_t k = 0; k < triangle_count; ++k) {
+            const bool odd = ((k % 2) != 0);
+            execute.triangles.push_back(static_cast<unsigned short>(odd ? (k + 1) : k));
+            execute.triangles.push_back(static_cast<unsigned short>(odd ? k : (k + 1)));
+            execute.triangles.push_back(static_cast<unsigned short>(k + 2));
+            execute.triangles.push_back(0);
+        }
+        execute.states.set_rs_dw(1, 1 + (next_random(seed) % 4));
+        execute.key.texture = 1 + (next_random(seed) % 4);
+    }
+    return executes;
+}
+
+/**
+ * @brief Transient geometry storage of the surface, processed the way
+ * the executes and the sorted drawing process it.
+ */
+class FrameStorage {
+
+    VertexPool vertex_pool;
+    std::vector<unsigned short> indices;
+    std::vector<unsigned short> strip_indices;
+    std::vector<unsigned short> culled_records;
+    DrawList draw_list;
+    std::vector<RenderStateSet> draw_list_states;
+    size_t draw_count;
+
+public:
+
+    FrameStorage()
+        : vertex_pool()
+        , indices()
+        , strip_indices()
+        , culled_records()
+        , draw_list()
+        , draw_list_states()
+        , draw_count(0)
+    {
+    }
+
+    /**
+     * @brief Reserves the storage as the reserve_geometry_storage() does.
+     */
+    void reserve(const size_t vertex_count)
+    {
+        const size_t index_count = vertex_count * 3;
+        const size_t batch_count = vertex_count / VERTICES_PER_RESERVED_BATCH;
+        vertex_pool.reserve(vertex_count);
+        indices.reserve(index_count);
+        strip_indices.reserve(index_count);
+        culled_records.reserve((index_count / 3) * TRIANGLE_RECORD_WORDS);
+        draw_list.reserve(vertex_count, index_count, batch_count);
+        draw_list_states.reserve(batch_count);
+    }
+
+    void execute(const Execute &execute)
+    {
+        if (! vertex_pool.can_append_window(execute.vertices.size())) {
+            submit();
+        }
+        vertex_pool.begin_window(execute.vertices.size());
+
+        // The first half is set separately so the windows are pooled.
+
+        const size_t half = execute.vertices.size() / 2;
+        vertex_pool.set_vertices(0, &execute.vertices[0], half);
+        vertex_pool.set_vertices(half, &execute.vertices[half], execute.vertices.size() - half);
+
+        // The block is culled into the work buffer.
+
+        CullParameters parameters;
+        parameters.min_x = 0.0f;
+        parameters.min_y = 0.0f;
+        parameters.max_x = 640.0f;
+        parameters.max_y = 480.0f;
+        culled_records.resize(execute.triangles.size());
+        const size_t triangle_count = cull_triangles(&execute.triangles[0], execute.triangles.size() / TRIANGLE_RECORD_WORDS, vertex_pool.get_data() + vertex_pool.get_base(), execute.vertices.size(), parameters, &culled_records[0]);
+        if (triangle_count == 0) {
+            vertex_pool.carry_window();
+            return;
+        }
+
+        size_t min_vertex = MAXIMAL_MERGED_VERTEX_COUNT;
+        size_t max_vertex = 0;
+        indices.clear();
+        indices.resize((triangle_count * 3) + 1);
+        append_rebased_triangle_indices(&culled_records[0], triangle_count, vertex_pool.get_base(), &indices[0], min_vertex, max_vertex);
+        indices.pop_back();
+        build_triangle_strip(&indices[0], triangle_count, strip_indices);
+
+        const size_t vertex_count = max_vertex - min_vertex + 1;
+        if (! draw_list.can_add(vertex_count)) {
+            submit();
+        }
+        draw_list.add(execute.key, draw_list_states.size(), vertex_pool.get_data(), min_vertex, vertex_count, &indices[0], indices.size(), false);
+        draw_list_states.push_back(execute.states);
+        vertex_pool.carry_window();
+    }
+
+    void submit(void)
+    {
+        draw_list.sort();
+        const DrawList::BatchList &batches = draw_list.get_batches();
+        for (size_t first = 0; first < batches.size(); ) {
+            first = draw_list.get_group_end(first);
+            draw_count++;
+        }
+        draw_list.clear();
+        draw_list_states.clear();
+        vertex_pool.clear();
+    }
+
+    void draw_frame(const std::vector<Execute> &executes)
+    {
+        for (size_t i = 0; i < executes.size(); ++i) {
+            execute(executes[i]);
+        }
+        submit();
+    }
+
+    size_t get_draw_count(void) const
+    {
+        return draw_count;
+    }
+};
+
+void test_counting(void)
+{
+    // The harness sees the allocations of the tested code.
+
+    const size_t before = allocation_count;
+    std::vector<int> values;
+    values.push_back(1);
+    CHECK(allocation_count == (before + 1));
+}
+
+void test_reserved_frames(void)
+{
+    // With the storage reserved for the frame even the first frame
+    // does not allocate.
+
+    std::vector<std::vector<Execute> > frames;
+    for (unsigned int seed = 1; seed <= 10; ++seed) {
+        frames.push_back(create_executes(seed));
+    }
+    FrameStorage storage;
+    storage.reserve(GEOMETRY_RESERVE);
+
+    const size_t before = allocation_count;
+    for (size_t frame = 0; frame < 100; ++frame) {
+        storage.draw_frame(frames[frame % frames.size()]);
+    }
+    CHECK(allocation_count == before);
+    CHECK(storage.get_draw_count() > 0);
+}
+
+void test_steady_frames(void)
+{
+    // Without the reserve the storage grows during the first frames only.
+
+    std::vector<std::vector<Execute> > frames;
+    for (unsigned int seed = 1; seed <= 10; ++seed) {
+        frames.push_back(create_executes(seed));
+    }
+    FrameStorage storage;
+    for (size_t frame = 0; frame < frames.size(); ++frame) {
+        storage.draw_frame(frames[frame]);
+    }
+
+    const size_t before = allocation_count;
+    for (size_t frame = 0; frame < 100; ++frame) {
+        storage.draw_frame(frames[(frame * 7) % frames.size()]);
+    }
+    CHECK(allocation_count == before);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_counting();
+    test_reserved_frames();
+    test_steady_frames();
+    return emu::test::finish("frame_allocation_test");
+}
+
+// EOF //
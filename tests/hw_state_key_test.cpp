@@ -0,0 +1,176 @@
+#include "test.h"
+#include "ddraw/hw_state_key.h"
+#include <vector>
+
+using namespace emu;
+using emu::test::next_random;
+
+namespace {
+
+// Other D3DRENDERSTATE_* values used by the tests.
+
+const size_t STATE_DITHERENABLE = 26;
+const size_t STATE_CULLMODE = 22;
+
+/**
+ * @brief States the game sets, each with few values including
+ * unsupported ones.
+ */
+const size_t RANDOM_STATES[] = {
+    RENDER_STATE_TEXTUREHANDLE, RENDER_STATE_ZENABLE, RENDER_STATE_SHADEMODE, RENDER_STATE_ZWRITEENABLE,
+    RENDER_STATE_ALPHATESTENABLE, RENDER_STATE_SRCBLEND, RENDER_STATE_DESTBLEND, RENDER_STATE_TEXTUREMAPBLEND,
+    RENDER_STATE_ZFUNC, RENDER_STATE_ALPHAFUNC, RENDER_STATE_BLENDENABLE, RENDER_STATE_FOGENABLE,
+    RENDER_STATE_FOGCOLOR, RENDER_STATE_FOGTABLEMODE, STATE_DITHERENABLE, STATE_CULLMODE
+};
+const unsigned int RANDOM_VALUES[] = {0, 1, 2, 3, 4, 5, 6, 8, 12};
+
+RenderStateSet create_supported_set(void)
+{
+    RenderStateSet set;
+    set.set_rs_float(RENDER_STATE_FOGTABLEDENSITY, 1.0f);
+    set.set_rs_float(RENDER_STATE_FOGTABLEEND, 1.0f);
+    return set;
+}
+
+/**
+ * @brief Applies random changes to the set and returns them.
+ */
+std::vector<unsigned int> change_randomly(RenderStateSet &set, unsigned int &seed, const size_t count)
+{
+    std::vector<unsigned int> changes;
+    for (size_t i = 0; i < count; ++i) {
+        const size_t type = RANDOM_STATES[next_random(seed) % (sizeof(RANDOM_STATES) / sizeof(RANDOM_STATES[0]))];
+        const unsigned int value = RANDOM_VALUES[next_random(seed) % (sizeof(RANDOM_VALUES) / sizeof(RANDOM_VALUES[0]))];
+        set.set_rs_dw(type, value);
+        changes.push_back(static_cast<unsigned int>(type));
+        changes.push_back(value);
+    }
+    return changes;
+}
+
+void test_key_is_function_of_set(void)
+{
+    // Sets with the same states have the same key no matter how they
+    // were reached, the translation keeps no state of its own.
+
+    unsigned int seed = 3;
+    for (size_t i = 0; i < 5000; ++i) {
+        RenderStateSet first = create_supported_set();
+        const std::vector<unsigned int> changes = change_randomly(first, seed, 1 + (i % 12));
+
+        // Same changes in reverse order with detours over other values.
+
+        RenderStateSet second = create_supported_set();
+        for (size_t j = changes.size(); j > 0; j -= 2) {
+            second.set_rs_dw(changes[j - 2], changes[j - 1] + 1);
+        }
+        for (size_t j = 0; j < changes.size(); j += 2) {
+            second.set_rs_dw(changes[j], changes[j + 1]);
+        }
+        CHECK(first.equals(second));
+        CHECK(HWStateKey(first) == HWStateKey(second));
+        CHECK(HWStateKey(first) == HWStateKey(first));
+    }
+}
+
+void test_key_ignores_unused_states(void)
+{
+    RenderStateSet set = create_supported_set();
+    set.set_rs_dw(RENDER_STATE_ZENABLE, 1);
+    set.set_rs_dw(RENDER_STATE_ZFUNC, RENDER_VALUE_CMP_LESSEQUAL);
+    const HWStateKey key(set);
+
+    // States without effect in the current configuration.
+
+    RenderStateSet other = set;
+    other.set_rs_dw(RENDER_STATE_FOGCOLOR, 0xFF00FF00);
+    other.set_rs_dw(RENDER_STATE_TEXTUREMAPBLEND, RENDER_VALUE_TBLEND_MODULATEALPHA);
+    other.set_rs_dw(RENDER_STATE_SRCBLEND, RENDER_VALUE_BLEND_SRCALPHA);
+    other.set_rs_dw(STATE_DITHERENABLE, 1);
+    CHECK(HWStateKey(other) == key);
+
+    // States which change the rendering.
+
+    other.set_rs_dw(RENDER_STATE_FOGENABLE, 1);
+    CHECK(! (HWStateKey(other) == key));
+    other = set;
+    other.set_rs_dw(RENDER_STATE_TEXTUREHANDLE, 0x1000);
+    CHECK(! (HWStateKey(other) == key));
+    other = set;
+    other.set_rs_dw(RENDER_STATE_SHADEMODE, 1);
+    CHECK(! (HWStateKey(other) == key));
+    other = set;
+    other.set_rs_dw(RENDER_STATE_ZWRITEENABLE, 1);
+    CHECK(! (HWStateKey(other) == key));
+}
+
+void test_depth_test(void)
+{
+    RenderStateSet set;
+    CHECK(get_depth_test_state(set) == DEPTH_TEST_NONE);
+    set.set_rs_dw(RENDER_STATE_ZENABLE, 1);
+    set.set_rs_dw(RENDER_STATE_ZFUNC, RENDER_VALUE_CMP_LESSEQUAL);
+    CHECK(get_depth_test_state(set) == DEPTH_TEST_NOZWRITE);
+    set.set_rs_dw(RENDER_STATE_ZWRITEENABLE, 1);
+    CHECK(get_depth_test_state(set) == DEPTH_TEST_ON);
+
+    // Unsupported function falls back to no test.
+
+    set.set_rs_dw(RENDER_STATE_ZFUNC, 2);
+    CHECK(get_depth_test_state(set) == DEPTH_TEST_NONE);
+    set.set_rs_dw(RENDER_STATE_ZFUNC, RENDER_VALUE_CMP_ALWAYS);
+    set.set_rs_dw(RENDER_STATE_ZWRITEENABLE, 0);
+    CHECK(get_depth_test_state(set) == DEPTH_TEST_NONE);
+}
+
+void test_alpha_states(void)
+{
+    RenderStateSet set;
+    set.set_rs_dw(RENDER_STATE_ALPHATESTENABLE, 1);
+    set.set_rs_dw(RENDER_STATE_ALPHAFUNC, RENDER_VALUE_CMP_NOTEQUAL);
+    CHECK(get_alpha_test_state(set) == ALPHA_TEST_NOEQUAL);
+    set.set_rs_dw(RENDER_STATE_ALPHAREF, 5);
+    CHECK(get_alpha_test_state(set) == ALPHA_TEST_NONE);
+
+    set.set_rs_dw(RENDER_STATE_BLENDENABLE, 1);
+    set.set_rs_dw(RENDER_STATE_SRCBLEND, RENDER_VALUE_BLEND_ONE);
+    set.set_rs_dw(RENDER_STATE_DESTBLEND, RENDER_VALUE_BLEND_ZERO);
+    CHECK(get_alpha_blend_state(set) == BLEND_NONE);
+    set.set_rs_dw(RENDER_STATE_SRCBLEND, RENDER_VALUE_BLEND_SRCALPHA);
+    set.set_rs_dw(RENDER_STATE_DESTBLEND, RENDER_VALUE_BLEND_INVSRCALPHA);
+    CHECK(get_alpha_blend_state(set) == BLEND_OVER);
+    set.set_rs_dw(RENDER_STATE_SRCBLEND, RENDER_VALUE_BLEND_BOTHSRCALPHA);
+    CHECK(get_alpha_blend_state(set) == BLEND_OVER);
+}
+
+void test_fog_and_texture_blend(void)
+{
+    RenderStateSet set = create_supported_set();
+    set.set_rs_dw(RENDER_STATE_FOGENABLE, 1);
+    CHECK(get_fog_state(set) == FOG_VERTEX);
+    set.set_rs_dw(RENDER_STATE_FOGTABLEMODE, RENDER_VALUE_FOG_LINEAR);
+    CHECK(get_fog_state(set) == FOG_TABLE);
+    set.set_rs_dw(RENDER_STATE_FOGTABLEMODE, 1);
+    CHECK(get_fog_state(set) == FOG_NONE);
+    set.set_rs_dw(RENDER_STATE_FOGTABLEMODE, RENDER_VALUE_FOG_NONE);
+    set.set_rs_float(RENDER_STATE_FOGTABLESTART, 0.5f);
+    CHECK(get_fog_state(set) == FOG_NONE);
+
+    CHECK(get_texture_blend(set) == TEXTURE_BLEND_MODULATE);
+    set.set_rs_dw(RENDER_STATE_TEXTUREMAPBLEND, RENDER_VALUE_TBLEND_MODULATEALPHA);
+    CHECK(get_texture_blend(set) == TEXTURE_BLEND_MODULATEALPHA);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_key_is_function_of_set();
+    test_key_ignores_unused_states();
+    test_depth_test();
+    test_alpha_states();
+    test_fog_and_texture_blend();
+    return emu::test::finish("hw_state_key_test");
+}
+
+// EOF //
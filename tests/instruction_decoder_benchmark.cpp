@@ -0,0 +1,77 @@
+#include "benchmark.h"
+#include "execute_stream.h"
+#include "ddraw/instruction_decoder.h"
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+const size_t ITERATIONS = 20000;
+
+/**
+ * @brief Builds execute buffer shaped like the ones of a typical frame.
+ *
+ * Each batch changes few render states, processes its vertices and
+ * draws few triangles.
+ */
+test::ExecuteStream create_stream(const size_t batch_count, const size_t triangles_per_batch)
+{
+    test::ExecuteStream stream;
+    const unsigned int states[] = {1, 12, 22, 1, 27, 0, 41, 0};
+    std::vector<unsigned short> indices(triangles_per_batch * 3);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        indices[i] = static_cast<unsigned short>(i % 64);
+    }
+    for (size_t batch = 0; batch < batch_count; ++batch) {
+        stream.add_render_states(states, 4);
+        stream.add_process_vertices(0, 0, 64);
+        stream.add_triangles(&indices[0], triangles_per_batch);
+    }
+    stream.add_exit();
+    return stream;
+}
+
+/**
+ * @brief Touches the data of each instruction like the execute does.
+ */
+unsigned int walk(const unsigned char * const memory, const std::vector<DecodedInstruction> &instructions)
+{
+    unsigned int sum = 0;
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        const DecodedInstruction &instruction = instructions[i];
+        sum += instruction.opcode * instruction.count + memory[instruction.offset];
+    }
+    return sum;
+}
+
+void measure(const char * const name, const test::ExecuteStream &stream, const bool cached)
+{
+    std::vector<DecodedInstruction> instructions;
+    decode_instructions(stream.get_data(), 0, stream.get_size(), instructions);
+
+    const test::Stopwatch stopwatch;
+    for (size_t iteration = 0; iteration < ITERATIONS; ++iteration) {
+        if (! cached) {
+            decode_instructions(stream.get_data(), 0, stream.get_size(), instructions);
+        }
+        test::consume(walk(stream.get_data(), instructions));
+    }
+    test::report(name, ITERATIONS, stream.get_size(), stopwatch.get_seconds());
+}
+
+} // anonymous namespace
+
+int main()
+{
+    const size_t shapes[][2] = {{16, 2}, {64, 8}, {256, 4}};
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); ++i) {
+        const test::ExecuteStream stream = create_stream(shapes[i][0], shapes[i][1]);
+        printf("%u batches of %u triangles, %u bytes:\n", static_cast<unsigned int>(shapes[i][0]), static_cast<unsigned int>(shapes[i][1]), static_cast<unsigned int>(stream.get_size()));
+        measure("decoded on every execute", stream, false);
+        measure("decoded once", stream, true);
+    }
+    return 0;
+}
+
+// EOF //
@@ -0,0 +1,116 @@
+#include "test.h"
+#include "execute_stream.h"
+#include "ddraw/instruction_decoder.h"
+#include <string.h>
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+void test_empty_stream(void)
+{
+    std::vector<DecodedInstruction> instructions(3);
+    const unsigned char memory[4] = {0};
+    decode_instructions(memory, 0, 0, instructions);
+    CHECK(instructions.empty());
+}
+
+void test_offsets(void)
+{
+    // Vertices come first, the instructions follow them.
+
+    test::ExecuteStream stream;
+    const unsigned char vertices[64] = {0};
+    stream.append(vertices, sizeof(vertices));
+    const size_t instruction_offset = stream.get_size();
+
+    const unsigned int states[] = {22, 1, 27, 0};
+    const unsigned short indices[] = {0, 1, 2, 2, 1, 3};
+    stream.add_render_states(states, 2);
+    stream.add_process_vertices(0, 0, 4);
+    stream.add_triangles(indices, 2);
+    stream.add_exit();
+
+    std::vector<DecodedInstruction> instructions;
+    decode_instructions(stream.get_data(), instruction_offset, stream.get_size() - instruction_offset, instructions);
+    CHECK(instructions.size() == 3);
+    if (instructions.size() != 3) {
+        return;
+    }
+
+    CHECK(instructions[0].opcode == INSTRUCTION_STATERENDER);
+    CHECK(instructions[0].size == test::STREAM_STATE_SIZE);
+    CHECK(instructions[0].count == 2);
+    CHECK(instructions[0].offset == instruction_offset + INSTRUCTION_HEADER_SIZE);
+    CHECK(memcmp(stream.get_data() + instructions[0].offset, states, sizeof(states)) == 0);
+
+    CHECK(instructions[1].opcode == INSTRUCTION_PROCESSVERTICES);
+    CHECK(instructions[1].count == 1);
+    CHECK(instructions[1].offset == instructions[0].offset + 2 * test::STREAM_STATE_SIZE + INSTRUCTION_HEADER_SIZE);
+
+    CHECK(instructions[2].opcode == INSTRUCTION_TRIANGLE);
+    CHECK(instructions[2].count == 2);
+    CHECK(instructions[2].offset == instructions[1].offset + test::STREAM_PROCESSVERTICES_SIZE + INSTRUCTION_HEADER_SIZE);
+    const unsigned short * const records = reinterpret_cast<const unsigned short *>(stream.get_data() + instructions[2].offset);
+    CHECK((records[4] == 2) && (records[5] == 1) && (records[6] == 3));
+}
+
+void test_exit_ends_stream(void)
+{
+    // Anything behind D3DOP_EXIT is ignored even if it is inside of the range.
+
+    test::ExecuteStream stream;
+    const unsigned short indices[] = {0, 1, 2};
+    stream.add_triangles(indices, 1);
+    stream.add_exit();
+    stream.add_triangles(indices, 1);
+
+    std::vector<DecodedInstruction> instructions;
+    decode_instructions(stream.get_data(), 0, stream.get_size(), instructions);
+    CHECK(instructions.size() == 1);
+}
+
+void test_stream_without_exit(void)
+{
+    test::ExecuteStream stream;
+    const unsigned short indices[] = {0, 1, 2, 3, 4, 5};
+    stream.add_triangles(indices, 2);
+    stream.add_triangles(indices, 0);
+    stream.add_triangles(indices, 1);
+
+    std::vector<DecodedInstruction> instructions;
+    decode_instructions(stream.get_data(), 0, stream.get_size(), instructions);
+    CHECK(instructions.size() == 3);
+    CHECK((instructions.size() == 3) && (instructions[1].count == 0) && (instructions[2].count == 1));
+}
+
+void test_decoding_replaces_previous(void)
+{
+    test::ExecuteStream first;
+    const unsigned short indices[] = {0, 1, 2};
+    first.add_triangles(indices, 1);
+    first.add_triangles(indices, 1);
+    test::ExecuteStream second;
+    second.add_exit();
+
+    std::vector<DecodedInstruction> instructions;
+    decode_instructions(first.get_data(), 0, first.get_size(), instructions);
+    CHECK(instructions.size() == 2);
+    decode_instructions(second.get_data(), 0, second.get_size(), instructions);
+    CHECK(instructions.empty());
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_empty_stream();
+    test_offsets();
+    test_exit_ends_stream();
+    test_stream_without_exit();
+    test_decoding_replaces_previous();
+    return emu::test::finish("instruction_decoder_test");
+}
+
+// EOF //
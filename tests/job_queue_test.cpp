@@ -0,0 +1,295 @@
+#include "test.h"
+#include "helpers/job_queue.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+/**
+ * @brief Job recording how many times and on which thread it was run.
+ */
+class CountingJob : public Job {
+
+    std::atomic<int> run_count;
+    std::thread::id run_thread;
+
+public:
+
+    CountingJob()
+        : run_count(0)
+        , run_thread()
+    {
+    }
+
+    virtual void run(void)
+    {
+        run_thread = std::this_thread::get_id();
+        run_count++;
+    }
+
+    int get_run_count(void) const
+    {
+        return run_count;
+    }
+
+    std::thread::id get_run_thread(void) const
+    {
+        return run_thread;
+    }
+};
+
+/**
+ * @brief Job which does not finish until it is released.
+ */
+class BlockingJob : public Job {
+
+    std::mutex lock;
+    std::condition_variable changed;
+    bool started;
+    bool released;
+
+public:
+
+    BlockingJob()
+        : started(false)
+        , released(false)
+    {
+    }
+
+    virtual void run(void)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        started = true;
+        changed.notify_all();
+        while (! released) {
+            changed.wait(guard);
+        }
+    }
+
+    void wait_until_started(void)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while (! started) {
+            changed.wait(guard);
+        }
+    }
+
+    void release(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        released = true;
+        changed.notify_all();
+    }
+};
+
+/**
+ * @brief Job appending its number to shared list, to check the order.
+ */
+class OrderedJob : public Job {
+
+    std::mutex * lock;
+    std::vector<int> * order;
+    int number;
+
+public:
+
+    OrderedJob()
+        : lock(NULL)
+        , order(NULL)
+        , number(0)
+    {
+    }
+
+    void set(std::mutex * const the_lock, std::vector<int> * const the_order, const int the_number)
+    {
+        lock = the_lock;
+        order = the_order;
+        number = the_number;
+    }
+
+    virtual void run(void)
+    {
+        std::lock_guard<std::mutex> guard(*lock);
+        order->push_back(number);
+    }
+};
+
+void test_synchronous_without_thread(void)
+{
+    JobQueue queue;
+    CountingJob job;
+    queue.submit(&job);
+    CHECK(job.get_run_count() == 1);
+    CHECK(job.get_run_thread() == std::this_thread::get_id());
+    CHECK(queue.is_finished(&job));
+}
+
+void test_jobs_run_in_order(void)
+{
+    JobQueue queue;
+    CHECK(queue.start());
+    CHECK(queue.start());
+
+    // Hold the worker so all the jobs are queued before the first runs.
+
+    BlockingJob blocker;
+    queue.submit(&blocker);
+    std::mutex lock;
+    std::vector<int> order;
+    OrderedJob jobs[64];
+    for (int i = 0; i < 64; ++i) {
+        jobs[i].set(&lock, &order, i);
+        queue.submit(&jobs[i]);
+    }
+    blocker.release();
+    while (! queue.is_finished(&jobs[63])) {
+        std::this_thread::yield();
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    CHECK(order.size() == 64);
+    bool ordered = true;
+    for (size_t i = 0; i < order.size(); ++i) {
+        ordered = ordered && (order[i] == static_cast<int>(i));
+    }
+    CHECK(ordered);
+}
+
+void test_wait_runs_pending_job(void)
+{
+    JobQueue queue;
+    CHECK(queue.start());
+
+    BlockingJob blocker;
+    CountingJob job;
+    queue.submit(&blocker);
+    blocker.wait_until_started();
+    queue.submit(&job);
+    CHECK(! queue.is_finished(&blocker));
+    CHECK(! queue.is_finished(&job));
+
+    // The waiting thread does not need to wait for the blocking job.
+
+    queue.wait(&job);
+    CHECK(job.get_run_count() == 1);
+    CHECK(job.get_run_thread() == std::this_thread::get_id());
+    CHECK(queue.is_finished(&job));
+
+    blocker.release();
+    queue.wait(&blocker);
+    CHECK(queue.is_finished(&blocker));
+}
+
+void test_cancel(void)
+{
+    JobQueue queue;
+    CHECK(queue.start());
+
+    BlockingJob blocker;
+    CountingJob canceled;
+    queue.submit(&blocker);
+    blocker.wait_until_started();
+    queue.submit(&canceled);
+    queue.cancel(&canceled);
+    CHECK(queue.is_finished(&canceled));
+
+    // Canceling the running job waits for it.
+
+    std::thread releaser([&blocker]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        blocker.release();
+    });
+    queue.cancel(&blocker);
+    CHECK(queue.is_finished(&blocker));
+    releaser.join();
+
+    CountingJob after;
+    queue.submit(&after);
+    queue.wait(&after);
+    CHECK(canceled.get_run_count() == 0);
+    CHECK(after.get_run_count() == 1);
+}
+
+void test_stop_drops_pending_jobs(void)
+{
+    CountingJob dropped;
+    BlockingJob blocker;
+    {
+        JobQueue queue;
+        CHECK(queue.start());
+        queue.submit(&blocker);
+        blocker.wait_until_started();
+        queue.submit(&dropped);
+
+        std::thread releaser([&blocker]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            blocker.release();
+        });
+        queue.stop();
+        releaser.join();
+        CHECK(queue.is_finished(&dropped));
+
+        // Stopped queue executes synchronously and can be started again.
+
+        CountingJob synchronous;
+        queue.submit(&synchronous);
+        CHECK(synchronous.get_run_count() == 1);
+        CHECK(queue.start());
+    }
+    CHECK(dropped.get_run_count() == 0);
+}
+
+void test_concurrent_waits_and_cancels(void)
+{
+    // Mix of operations the game thread does while the worker runs,
+    // mainly for the thread sanitizer.
+
+    JobQueue queue;
+    CHECK(queue.start());
+
+    const size_t JOB_COUNT = 2000;
+    std::vector<CountingJob> jobs(JOB_COUNT);
+    size_t canceled = 0;
+    for (size_t i = 0; i < JOB_COUNT; ++i) {
+        queue.submit(&jobs[i]);
+        if ((i % 3) == 0) {
+            queue.wait(&jobs[i / 2]);
+        }
+        else if ((i % 7) == 0) {
+            if (! queue.is_finished(&jobs[i - 1])) {
+                queue.cancel(&jobs[i - 1]);
+            }
+        }
+    }
+    for (size_t i = 0; i < JOB_COUNT; ++i) {
+        queue.cancel(&jobs[i]);
+    }
+
+    bool at_most_once = true;
+    for (size_t i = 0; i < JOB_COUNT; ++i) {
+        at_most_once = at_most_once && (jobs[i].get_run_count() <= 1);
+        canceled += (jobs[i].get_run_count() == 0) ? 1 : 0;
+    }
+    CHECK(at_most_once);
+    CHECK(canceled < JOB_COUNT);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_synchronous_without_thread();
+    test_jobs_run_in_order();
+    test_wait_runs_pending_job();
+    test_cancel();
+    test_stop_drops_pending_jobs();
+    test_concurrent_waits_and_cancels();
+    return emu::test::finish("job_queue_test");
+}
+
+// EOF //
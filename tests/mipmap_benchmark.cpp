@@ -0,0 +1,49 @@
+#include "benchmark.h"
+#include "hw/mipmap.h"
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+typedef void (*DownsampleFunction)(const unsigned int * const source, const size_t width, const size_t height, unsigned int * const destination);
+
+const size_t ITERATIONS = 200;
+
+/**
+ * @brief Measures generation of the whole mipmap chain of square texture.
+ */
+void measure(const char * const name, const DownsampleFunction function, const size_t size)
+{
+    std::vector<unsigned int> source(size * size);
+    for (size_t i = 0; i < source.size(); ++i) {
+        source[i] = static_cast<unsigned int>(i * 2654435761u);
+    }
+    std::vector<unsigned int> destination(source.size() / 4 + 1);
+
+    const test::Stopwatch stopwatch;
+    for (size_t iteration = 0; iteration < ITERATIONS; ++iteration) {
+        for (size_t level_size = size; level_size > 1; level_size /= 2) {
+            function(&source[0], level_size, level_size, &destination[0]);
+        }
+        test::consume(destination[0]);
+    }
+    test::report(name, ITERATIONS, source.size() * sizeof(unsigned int), stopwatch.get_seconds());
+}
+
+} // anonymous namespace
+
+int main()
+{
+    const size_t sizes[] = {64, 256, 1024};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        printf("chain of %ux%u texture:\n", static_cast<unsigned int>(sizes[i]), static_cast<unsigned int>(sizes[i]));
+        measure("box scalar", downsample_box, sizes[i]);
+        measure("box sse2", downsample_box_sse2, sizes[i]);
+        measure("alpha weighted scalar", downsample_alpha_weighted, sizes[i]);
+        measure("alpha weighted sse2", downsample_alpha_weighted_sse2, sizes[i]);
+    }
+    return 0;
+}
+
+// EOF //
@@ -0,0 +1,161 @@
+#include "test.h"
+#include "hw/mipmap.h"
+#include "helpers/cpu_features.h"
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+/**
+ * @brief Deterministic pseudo random texels.
+ *
+ * Every fourth texel is fully transparent and some 2x2 blocks are
+ * transparent completely to cover the special case of the weighting.
+ */
+std::vector<unsigned int> create_texels(const size_t width, const size_t height, unsigned int seed)
+{
+    std::vector<unsigned int> texels(width * height);
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            seed = seed * 1664525 + 1013904223;
+            unsigned int texel = seed;
+            if (((seed >> 8) & 3) == 0) {
+                texel &= 0x00FFFFFF;
+            }
+            if ((((x / 2) + (y / 2)) % 7) == 0) {
+                texel &= 0x00FFFFFF;
+            }
+            texels[y * width + x] = texel;
+        }
+    }
+    return texels;
+}
+
+void test_level_sizes(void)
+{
+    CHECK(get_mipmap_level_count(1, 1) == 1);
+    CHECK(get_mipmap_level_count(256, 256) == 9);
+    CHECK(get_mipmap_level_count(256, 16) == 9);
+    CHECK(get_mipmap_level_count(3, 5) == 3);
+    CHECK(get_mipmap_level_size(256, 3) == 32);
+    CHECK(get_mipmap_level_size(16, 8) == 1);
+    CHECK(get_mipmap_level_size(5, 1) == 2);
+}
+
+void test_box_filter(void)
+{
+    const unsigned int texels[4] = {0x00000000, 0xFF030201, 0x80050403, 0x7F070605};
+    unsigned int result = 0;
+    downsample_box(texels, 2, 2, &result);
+
+    // Each channel is (sum + 2) / 4.
+
+    CHECK(result == 0x80040302);
+}
+
+void test_alpha_weighted_filter(void)
+{
+    // Color of the transparent texels does not contribute.
+
+    const unsigned int texels[4] = {0x00FFFFFF, 0xFF102030, 0x00FFFFFF, 0xFF102030};
+    unsigned int result = 0;
+    downsample_alpha_weighted(texels, 2, 2, &result);
+    CHECK(result == 0x80102030);
+
+    // Fully transparent block is averaged evenly.
+
+    const unsigned int transparent[4] = {0x00000000, 0x00040404, 0x00000000, 0x00040404};
+    downsample_alpha_weighted(transparent, 2, 2, &result);
+    CHECK(result == 0x00020202);
+}
+
+/**
+ * @brief Compares the SSE2 kernels with the scalar reference texel by texel.
+ */
+void test_sse2_matches_scalar(void)
+{
+    if (! has_sse2()) {
+        return;
+    }
+
+    const size_t sizes[][2] = {{2, 2}, {3, 3}, {4, 2}, {6, 4}, {7, 5}, {8, 8}, {9, 17}, {64, 32}, {255, 3}, {256, 256}};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        const size_t width = sizes[i][0];
+        const size_t height = sizes[i][1];
+        const std::vector<unsigned int> source = create_texels(width, height, static_cast<unsigned int>(i + 1));
+        const size_t dest_size = get_mipmap_level_size(width, 1) * get_mipmap_level_size(height, 1);
+
+        std::vector<unsigned int> scalar(dest_size, 0xDEADBEEF);
+        std::vector<unsigned int> sse2(dest_size, 0xBEEFDEAD);
+        downsample_box(&source[0], width, height, &scalar[0]);
+        downsample_box_sse2(&source[0], width, height, &sse2[0]);
+        CHECK(scalar == sse2);
+
+        scalar.assign(dest_size, 0xDEADBEEF);
+        sse2.assign(dest_size, 0xBEEFDEAD);
+        downsample_alpha_weighted(&source[0], width, height, &scalar[0]);
+        downsample_alpha_weighted_sse2(&source[0], width, height, &sse2[0]);
+        CHECK(scalar == sse2);
+    }
+}
+
+void test_alpha_weighted_exhaustive_weights(void)
+{
+    // Every alpha sum with extreme colors, the range where the floating
+    // point division of the SSE2 kernel could differ from the integer one.
+
+    if (! has_sse2()) {
+        return;
+    }
+
+    bool equal = true;
+    for (unsigned int alpha_0 = 0; alpha_0 < 256; ++alpha_0) {
+        for (unsigned int alpha_1 = 0; alpha_1 < 256; alpha_1 += 5) {
+            const unsigned int texels[4] = {
+                (alpha_0 << 24) | 0x00FF00FF,
+                (alpha_1 << 24) | 0x0000FF01,
+                (alpha_0 << 24) | 0x00FE0180,
+                ((255 - alpha_1) << 24) | 0x007F7F7F,
+            };
+            unsigned int scalar = 0;
+            unsigned int sse2 = 0;
+            downsample_alpha_weighted(texels, 2, 2, &scalar);
+            downsample_alpha_weighted_sse2(texels, 2, 2, &sse2);
+            equal = equal && (scalar == sse2);
+        }
+    }
+    CHECK(equal);
+}
+
+void test_dispatch_degenerate_sizes(void)
+{
+    // Images one texel wide or high always use the scalar kernels.
+
+    const std::vector<unsigned int> column = create_texels(1, 8, 3);
+    std::vector<unsigned int> expected(4);
+    std::vector<unsigned int> result(4);
+    downsample_box(&column[0], 1, 8, &expected[0]);
+    downsample(&column[0], 1, 8, &result[0], false);
+    CHECK(result == expected);
+
+    const std::vector<unsigned int> row = create_texels(8, 1, 4);
+    downsample_alpha_weighted(&row[0], 8, 1, &expected[0]);
+    downsample(&row[0], 8, 1, &result[0], true);
+    CHECK(result == expected);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_level_sizes();
+    test_box_filter();
+    test_alpha_weighted_filter();
+    test_sse2_matches_scalar();
+    test_alpha_weighted_exhaustive_weights();
+    test_dispatch_degenerate_sizes();
+    return emu::test::finish("mipmap_test");
+}
+
+// EOF //
@@ -0,0 +1,53 @@
+#include "benchmark.h"
+#include "ddraw/render_state_set.h"
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+const size_t ITERATIONS = 2000;
+const size_t SET_COUNT = 512;
+
+/**
+ * @brief Sets of the queued geometry, neighbours mostly differ only
+ * in the texture like the batches of a frame.
+ */
+std::vector<RenderStateSet> create_sets(void)
+{
+    std::vector<RenderStateSet> sets(SET_COUNT);
+    for (size_t i = 0; i < sets.size(); ++i) {
+        sets[i].set_rs_dw(7, 1);
+        sets[i].set_rs_dw(9, 2);
+        sets[i].set_rs_dw(27, (i % 16) == 0);
+        sets[i].set_rs_dw(1, static_cast<unsigned int>(0x1000 + ((i / 4) * 0x40)));
+    }
+    return sets;
+}
+
+void measure(const char * const name, const std::vector<RenderStateSet> &sets, const bool hashed)
+{
+    const test::Stopwatch stopwatch;
+    for (size_t iteration = 0; iteration < ITERATIONS; ++iteration) {
+        unsigned int equal_count = 0;
+        for (size_t i = 1; i < sets.size(); ++i) {
+            const bool equal = hashed ? sets[i].equals(sets[i - 1]) : sets[i].compare_states(sets[i - 1]);
+            equal_count += equal ? 1 : 0;
+        }
+        test::consume(equal_count);
+    }
+    test::report(name, ITERATIONS * (SET_COUNT - 1), sizeof(RenderStateSet), stopwatch.get_seconds());
+}
+
+} // anonymous namespace
+
+int main()
+{
+    const std::vector<RenderStateSet> sets = create_sets();
+    printf("%u comparisons of neighbouring sets:\n", static_cast<unsigned int>(SET_COUNT - 1));
+    measure("full compare", sets, false);
+    measure("hash compare", sets, true);
+    return 0;
+}
+
+// EOF //
@@ -0,0 +1,135 @@
+#include "test.h"
+#include "ddraw/render_state_set.h"
+#include <vector>
+
+using namespace emu;
+using emu::test::next_random;
+
+namespace {
+
+// D3DRENDERSTATE_* values used by the tests.
+
+const size_t STATE_TEXTUREHANDLE = 1;
+const size_t STATE_ZENABLE = 7;
+const size_t STATE_SHADEMODE = 9;
+const size_t STATE_BLENDENABLE = 27;
+const size_t STATE_FOGCOLOR = 34;
+const size_t STATE_FOGTABLEDENSITY = 38;
+
+/**
+ * @brief Set with few states changed, like the executes of one frame.
+ */
+RenderStateSet create_random_set(unsigned int &seed)
+{
+    RenderStateSet set;
+    const size_t change_count = next_random(seed) % 6;
+    for (size_t i = 0; i < change_count; ++i) {
+        const size_t type = 1 + (next_random(seed) % (RenderStateSet::RENDER_STATE_COUNT - 1));
+        set.set_rs_dw(type, next_random(seed) % 4);
+    }
+    return set;
+}
+
+void test_set_and_get(void)
+{
+    RenderStateSet set;
+    CHECK(set.get_rs_dw(STATE_TEXTUREHANDLE) == 0);
+    CHECK(! set.get_rs_bool(STATE_ZENABLE));
+
+    CHECK(set.set_rs_dw(STATE_TEXTUREHANDLE, 0x12345678));
+    CHECK(set.set_rs_dw(STATE_ZENABLE, 1));
+    CHECK(set.get_rs_dw(STATE_TEXTUREHANDLE) == 0x12345678);
+    CHECK(set.get_rs_bool(STATE_ZENABLE));
+    CHECK(set.get_sequence_number() == 2);
+
+    // Setting the same value is no change.
+
+    CHECK(! set.set_rs_dw(STATE_ZENABLE, 1));
+    CHECK(set.get_sequence_number() == 2);
+
+    // Floats keep their bit pattern.
+
+    CHECK(set.set_rs_float(STATE_FOGTABLEDENSITY, 0.5f));
+    CHECK(set.get_rs_float(STATE_FOGTABLEDENSITY) == 0.5f);
+    CHECK(set.get_rs_dw(STATE_FOGTABLEDENSITY) == 0x3F000000);
+    CHECK(! set.set_rs_dw(STATE_FOGTABLEDENSITY, 0x3F000000));
+}
+
+void test_equals(void)
+{
+    RenderStateSet first;
+    RenderStateSet second;
+    CHECK(first.equals(second));
+
+    // Order of the changes does not matter.
+
+    first.set_rs_dw(STATE_SHADEMODE, 2);
+    first.set_rs_dw(STATE_FOGCOLOR, 0xFF808080);
+    second.set_rs_dw(STATE_FOGCOLOR, 0xFF808080);
+    CHECK(! first.equals(second));
+    second.set_rs_dw(STATE_SHADEMODE, 2);
+    CHECK(first.equals(second));
+    CHECK(first.compare_states(second));
+
+    // Returning to the previous value restores the equality.
+
+    first.set_rs_dw(STATE_BLENDENABLE, 1);
+    CHECK(! first.equals(second));
+    first.set_rs_dw(STATE_BLENDENABLE, 0);
+    CHECK(first.equals(second));
+
+    // Same value in other state differs.
+
+    RenderStateSet third;
+    RenderStateSet fourth;
+    third.set_rs_dw(STATE_ZENABLE, 1);
+    fourth.set_rs_dw(STATE_BLENDENABLE, 1);
+    CHECK(! third.equals(fourth));
+}
+
+void test_equals_matches_compare(void)
+{
+    // The hash decides like the full comparison. Few values per state
+    // make the equal pairs frequent.
+
+    unsigned int seed = 7;
+    size_t equal_count = 0;
+    for (size_t i = 0; i < 20000; ++i) {
+        const RenderStateSet first = create_random_set(seed);
+        const RenderStateSet second = create_random_set(seed);
+        const bool equal = first.compare_states(second);
+        CHECK(first.equals(second) == equal);
+        CHECK(second.equals(first) == equal);
+        if (equal) {
+            ++equal_count;
+        }
+    }
+    CHECK(equal_count > 100);
+}
+
+void test_equals_with_sequence(void)
+{
+    RenderStateSet live;
+    live.set_rs_dw(STATE_ZENABLE, 1);
+    const RenderStateSet copy = live;
+    CHECK(live.equals_with_sequence(copy));
+
+    live.set_rs_dw(STATE_ZENABLE, 0);
+    CHECK(! live.equals_with_sequence(copy));
+    live.set_rs_dw(STATE_ZENABLE, 1);
+    CHECK(live.get_sequence_number() != copy.get_sequence_number());
+    CHECK(live.equals_with_sequence(copy));
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_set_and_get();
+    test_equals();
+    test_equals_matches_compare();
+    test_equals_with_sequence();
+    return emu::test::finish("render_state_set_test");
+}
+
+// EOF //
@@ -0,0 +1,173 @@
+#include "test.h"
+#include "hw/resource_pool.h"
+
+using namespace emu;
+
+namespace {
+
+/**
+ * @brief Distinct objects whose addresses serve as the pool entries.
+ */
+int objects[16];
+
+ResourcePool::Entry get_entry(const size_t index)
+{
+    return &objects[index];
+}
+
+bool contains(const ResourcePool::EntryList &list, const ResourcePool::Entry entry)
+{
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i] == entry) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ResourceKey create_key(const size_t width, const size_t height)
+{
+    ResourceKey key;
+    key.type = 1;
+    key.format = 21;
+    key.levels = 1;
+    key.width = width;
+    key.height = height;
+    return key;
+}
+
+void test_exact_match(void)
+{
+    ResourcePool pool;
+    ResourcePool::EntryList evicted;
+    pool.release(create_key(128, 128), get_entry(0), 100, evicted);
+    pool.release(create_key(64, 64), get_entry(1), 100, evicted);
+    pool.release(create_key(64, 64), get_entry(2), 100, evicted);
+
+    // The exact match wins over the larger entry released before it,
+    // the least recently released one of the equal entries is used.
+
+    ResourceKey found;
+    CHECK(pool.acquire(create_key(64, 64), true, &found) == get_entry(1));
+    CHECK(found.is_exact(create_key(64, 64)));
+    CHECK(pool.acquire(create_key(64, 64), false, NULL) == get_entry(2));
+    CHECK(pool.acquire(create_key(64, 64), false, NULL) == NULL);
+
+    // Incompatible parameters never match.
+
+    ResourceKey other = create_key(128, 128);
+    other.format = 22;
+    CHECK(pool.acquire(other, true, NULL) == NULL);
+
+    const ResourcePool::Statistics &statistics = pool.get_statistics();
+    CHECK(statistics.hits == 2);
+    CHECK(statistics.larger_hits == 0);
+    CHECK(statistics.misses == 2);
+    CHECK(statistics.count == 1);
+    CHECK(statistics.bytes == 100);
+}
+
+void test_best_fit(void)
+{
+    ResourcePool pool;
+    ResourcePool::EntryList evicted;
+    pool.release(create_key(256, 256), get_entry(0), 100, evicted);
+    pool.release(create_key(32, 512), get_entry(1), 100, evicted);
+    pool.release(create_key(128, 64), get_entry(2), 100, evicted);
+    pool.release(create_key(64, 128), get_entry(3), 100, evicted);
+
+    // Entries smaller in either dimension do not fit, the smallest area
+    // of the others is used, the first released one when equal.
+
+    ResourceKey found;
+    CHECK(pool.acquire(create_key(60, 60), false, NULL) == NULL);
+    CHECK(pool.acquire(create_key(60, 60), true, &found) == get_entry(2));
+    CHECK((found.width == 128) && (found.height == 64));
+    CHECK(pool.acquire(create_key(60, 60), true, NULL) == get_entry(3));
+    CHECK(pool.acquire(create_key(60, 60), true, NULL) == get_entry(0));
+    CHECK(pool.acquire(create_key(60, 60), true, NULL) == NULL);
+    CHECK(pool.acquire(create_key(32, 512), true, NULL) == get_entry(1));
+
+    const ResourcePool::Statistics &statistics = pool.get_statistics();
+    CHECK(statistics.hits == 4);
+    CHECK(statistics.larger_hits == 3);
+    CHECK(statistics.misses == 2);
+    CHECK(statistics.count == 0);
+    CHECK(statistics.bytes == 0);
+    CHECK(statistics.peak_bytes == 400);
+}
+
+void test_byte_limit(void)
+{
+    ResourcePool pool;
+    pool.set_limit(250);
+    ResourcePool::EntryList evicted;
+    pool.release(create_key(64, 64), get_entry(0), 100, evicted);
+    pool.release(create_key(32, 32), get_entry(1), 100, evicted);
+    CHECK(evicted.empty());
+
+    // The oldest entries go first until the limit holds.
+
+    pool.release(create_key(16, 16), get_entry(2), 100, evicted);
+    CHECK(evicted.size() == 1);
+    CHECK(contains(evicted, get_entry(0)));
+    CHECK(pool.get_statistics().bytes == 200);
+
+    evicted.clear();
+    pool.release(create_key(8, 8), get_entry(3), 160, evicted);
+    CHECK(evicted.size() == 2);
+    CHECK(contains(evicted, get_entry(1)) && contains(evicted, get_entry(2)));
+    CHECK(pool.get_statistics().bytes == 160);
+
+    // Entry exceeding the limit alone is evicted itself.
+
+    evicted.clear();
+    pool.release(create_key(8, 8), get_entry(4), 300, evicted);
+    CHECK(evicted.size() == 2);
+    CHECK(contains(evicted, get_entry(3)) && contains(evicted, get_entry(4)));
+
+    const ResourcePool::Statistics &statistics = pool.get_statistics();
+    CHECK(statistics.evictions == 5);
+    CHECK(statistics.count == 0);
+    CHECK(statistics.bytes == 0);
+    CHECK(statistics.peak_bytes == 460);
+    CHECK(pool.acquire(create_key(8, 8), true, NULL) == NULL);
+}
+
+void test_clear(void)
+{
+    ResourcePool pool;
+    ResourcePool::EntryList evicted;
+    pool.release(create_key(64, 64), get_entry(0), 100, evicted);
+    pool.release(create_key(32, 32), get_entry(1), 100, evicted);
+    CHECK(pool.acquire(create_key(16, 16), true, NULL) == get_entry(1));
+    pool.release(create_key(32, 32), get_entry(1), 100, evicted);
+
+    ResourcePool::EntryList removed;
+    pool.clear(removed);
+    CHECK(removed.size() == 2);
+    CHECK(contains(removed, get_entry(0)) && contains(removed, get_entry(1)));
+    CHECK(pool.get_statistics().count == 0);
+    CHECK(pool.get_statistics().bytes == 0);
+    CHECK(pool.acquire(create_key(32, 32), true, NULL) == NULL);
+
+    // The statistics survive.
+
+    CHECK(pool.get_statistics().hits == 1);
+    CHECK(pool.get_statistics().larger_hits == 1);
+    CHECK(pool.get_statistics().misses == 1);
+    CHECK(pool.get_statistics().peak_bytes == 200);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_exact_match();
+    test_best_fit();
+    test_byte_limit();
+    test_clear();
+    return emu::test::finish("resource_pool_test");
+}
+
+// EOF //
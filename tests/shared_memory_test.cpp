@@ -0,0 +1,162 @@
+#include "test.h"
+#include "helpers/shared_memory.h"
+#include <stdint.h>
+#include <string.h>
+
+using namespace emu;
+
+namespace {
+
+void fill(SharedMemory &memory, const unsigned char value)
+{
+    memset(memory.get(), value, memory.get_size());
+}
+
+bool is_filled(const SharedMemory &memory, const unsigned char value)
+{
+    const unsigned char * const data = static_cast<const unsigned char *>(memory.get());
+    for (size_t i = 0; i < memory.get_size(); ++i) {
+        if (data[i] != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_empty(void)
+{
+    SharedMemory memory;
+    CHECK(memory.get() == NULL);
+    CHECK(memory.get_size() == 0);
+    CHECK(! memory.is_shared());
+    CHECK(! memory.make_unique());
+    memory.release();
+
+    SharedMemory other;
+    other.share(memory);
+    CHECK(other.get() == NULL);
+}
+
+void test_allocate(void)
+{
+    SharedMemory memory;
+    CHECK(memory.allocate(100));
+    CHECK(memory.get() != NULL);
+    CHECK(memory.get_size() == 100);
+    CHECK(is_filled(memory, 0));
+    CHECK(! memory.is_shared());
+
+    // Same alignment as malloc provides.
+
+    CHECK((reinterpret_cast<uintptr_t>(memory.get()) % (2 * sizeof(void *))) == 0);
+}
+
+void test_share_and_copy_on_write(void)
+{
+    SharedMemory original;
+    CHECK(original.allocate(64));
+    fill(original, 0x11);
+
+    SharedMemory copy;
+    copy.share(original);
+    CHECK(copy.get() == original.get());
+    CHECK(copy.is_shared());
+    CHECK(original.is_shared());
+
+    // The writer gets its own block, the other owner keeps the content.
+
+    const void * const shared_address = original.get();
+    CHECK(copy.make_unique());
+    CHECK(copy.get() != shared_address);
+    CHECK(original.get() == shared_address);
+    CHECK(! copy.is_shared());
+    CHECK(! original.is_shared());
+    CHECK(copy.get_size() == 64);
+    CHECK(is_filled(copy, 0x11));
+
+    fill(copy, 0x22);
+    CHECK(is_filled(original, 0x11));
+    CHECK(is_filled(copy, 0x22));
+
+    // Unique owner writes in place.
+
+    CHECK(! original.make_unique());
+    CHECK(original.get() == shared_address);
+}
+
+void test_release_keeps_other_owners(void)
+{
+    SharedMemory first;
+    CHECK(first.allocate(32));
+    fill(first, 0x33);
+
+    SharedMemory second;
+    SharedMemory third;
+    second.share(first);
+    third.share(second);
+    CHECK(first.is_shared());
+
+    first.release();
+    CHECK(first.get() == NULL);
+    CHECK(second.is_shared());
+    CHECK(is_filled(third, 0x33));
+
+    second.release();
+    CHECK(! third.is_shared());
+    CHECK(is_filled(third, 0x33));
+
+    // Sharing the block again with itself does not change the count.
+
+    SharedMemory fourth;
+    fourth.share(third);
+    fourth.share(third);
+    fourth.release();
+    CHECK(! third.is_shared());
+}
+
+void test_allocate_drops_shared_block(void)
+{
+    SharedMemory first;
+    CHECK(first.allocate(16));
+    fill(first, 0x44);
+    SharedMemory second;
+    second.share(first);
+
+    CHECK(second.allocate(8));
+    CHECK(! first.is_shared());
+    CHECK(is_filled(first, 0x44));
+    CHECK(is_filled(second, 0));
+    CHECK(second.get_size() == 8);
+}
+
+void test_swap(void)
+{
+    SharedMemory first;
+    SharedMemory second;
+    CHECK(first.allocate(10));
+    CHECK(second.allocate(20));
+    const void * const first_address = first.get();
+    SharedMemory shared;
+    shared.share(first);
+
+    first.swap(second);
+    CHECK(first.get_size() == 20);
+    CHECK(second.get() == first_address);
+    CHECK(second.is_shared());
+    CHECK(! first.is_shared());
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_empty();
+    test_allocate();
+    test_share_and_copy_on_write();
+    test_release_keeps_other_owners();
+    test_allocate_drops_shared_block();
+    test_swap();
+    return emu::test::finish("shared_memory_test");
+}
+
+// EOF //
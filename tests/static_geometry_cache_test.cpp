@@ -0,0 +1,248 @@
+#include "test.h"
+#include "hw/static_geometry_cache.h"
+#include <algorithm>
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+const size_t PROMOTE_FRAMES = 3;
+
+GeometryKey create_key(const ContentHash vertex_hash, const size_t vertex_start = 0)
+{
+    GeometryKey key;
+    key.vertex_hash = vertex_hash;
+    key.index_hash = vertex_hash * 31;
+    key.vertex_start = vertex_start;
+    key.vertex_count = 16;
+    key.index_count = 24;
+    key.type = 4;
+    return key;
+}
+
+/**
+ * @brief Opaque entries standing for the static buffers.
+ */
+StaticGeometryCache::Entry get_entry(const size_t index)
+{
+    static char entries[64];
+    return &entries[index];
+}
+
+/**
+ * @brief Draws the geometry the way the HW layer does, inserting an entry
+ * when the promotion is requested.
+ */
+StaticGeometryCache::Decision draw(StaticGeometryCache &cache, const GeometryKey &key, const size_t bytes, const size_t entry_index, StaticGeometryCache::EntryList &evicted)
+{
+    StaticGeometryCache::Entry entry = NULL;
+    const StaticGeometryCache::Decision decision = cache.lookup(key, bytes, entry);
+    if (decision == StaticGeometryCache::DECISION_PROMOTE) {
+        cache.insert(key, get_entry(entry_index), bytes, evicted);
+    }
+    if (decision == StaticGeometryCache::DECISION_RESIDENT) {
+        CHECK(entry == get_entry(entry_index));
+    }
+    return decision;
+}
+
+void test_key_order(void)
+{
+    const GeometryKey key = create_key(1);
+    GeometryKey other = key;
+    CHECK(! (key < other) && ! (other < key));
+    other.vertex_start = 1;
+    CHECK((key < other) != (other < key));
+    other = key;
+    other.type = 5;
+    CHECK((key < other) != (other < key));
+}
+
+void test_promotion(void)
+{
+    StaticGeometryCache cache;
+    cache.configure(PROMOTE_FRAMES, 1000);
+    StaticGeometryCache::EntryList evicted;
+
+    // Several draws in single frame count once.
+
+    for (size_t frame = 0; frame < PROMOTE_FRAMES - 1; ++frame) {
+        CHECK(draw(cache, create_key(1), 100, 0, evicted) == StaticGeometryCache::DECISION_STREAM);
+        CHECK(draw(cache, create_key(1), 100, 0, evicted) == StaticGeometryCache::DECISION_STREAM);
+        cache.advance_frame();
+    }
+    CHECK(draw(cache, create_key(1), 100, 0, evicted) == StaticGeometryCache::DECISION_PROMOTE);
+    CHECK(draw(cache, create_key(1), 100, 0, evicted) == StaticGeometryCache::DECISION_RESIDENT);
+    cache.advance_frame();
+
+    // Resident geometry stays when it is not drawn.
+
+    cache.advance_frame();
+    cache.advance_frame();
+    CHECK(draw(cache, create_key(1), 100, 0, evicted) == StaticGeometryCache::DECISION_RESIDENT);
+    CHECK(cache.get_resident_count() == 1);
+    CHECK(cache.get_total_bytes() == 100);
+    CHECK(evicted.empty());
+
+    const StaticGeometryCache::Statistics &statistics = cache.get_statistics();
+    CHECK(statistics.streamed == 4);
+    CHECK(statistics.resident == 2);
+    CHECK(statistics.promotions == 1);
+    CHECK(statistics.evictions == 0);
+}
+
+void test_broken_streak(void)
+{
+    StaticGeometryCache cache;
+    cache.configure(PROMOTE_FRAMES, 1000);
+    StaticGeometryCache::Entry entry = NULL;
+
+    cache.lookup(create_key(1), 100, entry);
+    cache.advance_frame();
+    cache.lookup(create_key(1), 100, entry);
+    cache.advance_frame();
+    CHECK(cache.get_candidate_count() == 1);
+
+    // The candidate is forgotten after frame without it.
+
+    cache.advance_frame();
+    CHECK(cache.get_candidate_count() == 0);
+    for (size_t frame = 0; frame < PROMOTE_FRAMES - 1; ++frame) {
+        CHECK(cache.lookup(create_key(1), 100, entry) == StaticGeometryCache::DECISION_STREAM);
+        cache.advance_frame();
+    }
+    CHECK(cache.lookup(create_key(1), 100, entry) == StaticGeometryCache::DECISION_PROMOTE);
+}
+
+void test_failed_promotion(void)
+{
+    // When the owner does not insert the promoted geometry, it is streamed
+    // and the promotion is not requested again.
+
+    StaticGeometryCache cache;
+    cache.configure(PROMOTE_FRAMES, 1000);
+    StaticGeometryCache::Entry entry = NULL;
+    size_t promotions = 0;
+    for (size_t frame = 0; frame < 10; ++frame) {
+        if (cache.lookup(create_key(1), 100, entry) == StaticGeometryCache::DECISION_PROMOTE) {
+            ++promotions;
+        }
+        cache.advance_frame();
+    }
+    CHECK(promotions == 1);
+    CHECK(cache.get_resident_count() == 0);
+}
+
+void test_byte_limit(void)
+{
+    StaticGeometryCache cache;
+    cache.configure(PROMOTE_FRAMES, 250);
+    StaticGeometryCache::EntryList evicted;
+
+    // Geometry larger than the limit is never promoted.
+
+    for (size_t frame = 0; frame < PROMOTE_FRAMES + 2; ++frame) {
+        CHECK(draw(cache, create_key(9), 300, 9, evicted) == StaticGeometryCache::DECISION_STREAM);
+        cache.advance_frame();
+    }
+
+    // The third geometry evicts the least recently drawn one.
+
+    for (size_t frame = 0; frame < PROMOTE_FRAMES; ++frame) {
+        draw(cache, create_key(1), 100, 1, evicted);
+        draw(cache, create_key(2), 100, 2, evicted);
+        cache.advance_frame();
+    }
+    CHECK(cache.get_resident_count() == 2);
+    for (size_t frame = 0; frame < PROMOTE_FRAMES; ++frame) {
+        draw(cache, create_key(2), 100, 2, evicted);
+        draw(cache, create_key(3), 100, 3, evicted);
+        cache.advance_frame();
+    }
+    CHECK(evicted.size() == 1);
+    CHECK(evicted[0] == get_entry(1));
+    CHECK(cache.get_resident_count() == 2);
+    CHECK(cache.get_total_bytes() == 200);
+    CHECK(cache.get_statistics().evictions == 1);
+
+    // The evicted geometry starts again as candidate.
+
+    StaticGeometryCache::Entry entry = NULL;
+    CHECK(cache.lookup(create_key(1), 100, entry) == StaticGeometryCache::DECISION_STREAM);
+    CHECK(entry == NULL);
+}
+
+void test_clear(void)
+{
+    StaticGeometryCache cache;
+    cache.configure(1, 1000);
+    StaticGeometryCache::EntryList evicted;
+    draw(cache, create_key(1), 100, 1, evicted);
+    draw(cache, create_key(2), 100, 2, evicted);
+    StaticGeometryCache::Entry entry = NULL;
+    cache.lookup(create_key(3), 2000, entry);
+
+    StaticGeometryCache::EntryList removed;
+    cache.clear(removed);
+    CHECK(removed.size() == 2);
+    CHECK(std::find(removed.begin(), removed.end(), get_entry(1)) != removed.end());
+    CHECK(std::find(removed.begin(), removed.end(), get_entry(2)) != removed.end());
+    CHECK(cache.get_resident_count() == 0);
+    CHECK(cache.get_total_bytes() == 0);
+    CHECK(cache.get_candidate_count() == 0);
+}
+
+void test_frame_trace(void)
+{
+    // Level geometry drawn every frame mixed with animated geometry whose
+    // vertices change each frame. Only the level geometry is promoted and
+    // the animated geometry is not tracked beyond its frame.
+
+    const size_t STATIC_COUNT = 20;
+    const size_t ANIMATED_COUNT = 5;
+    const size_t FRAMES = 30;
+
+    StaticGeometryCache cache;
+    cache.configure(PROMOTE_FRAMES, STATIC_COUNT * 100);
+    StaticGeometryCache::EntryList evicted;
+    for (size_t frame = 0; frame < FRAMES; ++frame) {
+        for (size_t i = 0; i < STATIC_COUNT; ++i) {
+            draw(cache, create_key(i + 1, i * 16), 100, i, evicted);
+        }
+        for (size_t i = 0; i < ANIMATED_COUNT; ++i) {
+            CHECK(draw(cache, create_key(1000 + (frame * ANIMATED_COUNT) + i), 100, STATIC_COUNT + i, evicted) == StaticGeometryCache::DECISION_STREAM);
+        }
+        cache.advance_frame();
+        CHECK(cache.get_candidate_count() <= STATIC_COUNT + ANIMATED_COUNT);
+    }
+
+    // Geometry of the last frame is forgotten with the next one.
+
+    CHECK(cache.get_candidate_count() == STATIC_COUNT + ANIMATED_COUNT);
+    cache.advance_frame();
+    CHECK(cache.get_candidate_count() == STATIC_COUNT);
+
+    const StaticGeometryCache::Statistics &statistics = cache.get_statistics();
+    CHECK(cache.get_resident_count() == STATIC_COUNT);
+    CHECK(evicted.empty());
+    CHECK(statistics.promotions == STATIC_COUNT);
+    CHECK(statistics.resident == STATIC_COUNT * (FRAMES - PROMOTE_FRAMES));
+    CHECK(statistics.streamed == (STATIC_COUNT * (PROMOTE_FRAMES - 1)) + (ANIMATED_COUNT * FRAMES));
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_key_order();
+    test_promotion();
+    test_broken_streak();
+    test_failed_promotion();
+    test_byte_limit();
+    test_clear();
+    test_frame_trace();
+    return emu::test::finish("static_geometry_cache_test");
+}
+
+// EOF //
@@ -0,0 +1,205 @@
+#include "test.h"
+#include "hw/surface_cache.h"
+
+using namespace emu;
+
+namespace {
+
+/**
+ * @brief Distinct objects whose addresses serve as the cache entries.
+ */
+int objects[16];
+
+SurfaceCache::Entry get_entry(const size_t index)
+{
+    return &objects[index];
+}
+
+bool contains(const SurfaceCache::EntryList &list, const SurfaceCache::Entry entry)
+{
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i] == entry) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void test_hits_and_misses(void)
+{
+    SurfaceCache cache(4);
+    SurfaceCache::EntryList evicted;
+
+    CHECK(cache.acquire(1) == NULL);
+    cache.release(1, get_entry(0), 100, evicted);
+    cache.release(1, get_entry(1), 100, evicted);
+    CHECK(evicted.empty());
+    CHECK(cache.get_total_bytes() == 200);
+
+    // The least recently released entry is reused first.
+
+    CHECK(cache.acquire(1) == get_entry(0));
+    CHECK(cache.acquire(1) == get_entry(1));
+    CHECK(cache.acquire(1) == NULL);
+    CHECK(cache.acquire(2) == NULL);
+
+    const SurfaceCache::SlotStatistics &statistics = cache.get_statistics(1);
+    CHECK(statistics.hits == 2);
+    CHECK(statistics.misses == 2);
+    CHECK(statistics.count == 0);
+    CHECK(statistics.peak_count == 2);
+    CHECK(statistics.bytes == 0);
+    CHECK(cache.get_statistics(2).misses == 1);
+    CHECK(cache.get_total_bytes() == 0);
+    CHECK(cache.get_peak_bytes() == 200);
+}
+
+void test_slot_capacity(void)
+{
+    SurfaceCache cache(4);
+    cache.set_limits(2, 0, 0);
+    SurfaceCache::EntryList evicted;
+
+    CHECK(cache.can_insert(1, 10));
+    cache.release(1, get_entry(0), 10, evicted);
+    cache.release(1, get_entry(1), 10, evicted);
+    CHECK(! cache.can_insert(1, 10));
+    CHECK(cache.can_insert(2, 10));
+
+    // The oldest entry of the slot makes place for the new one.
+
+    cache.release(1, get_entry(2), 10, evicted);
+    CHECK(evicted.size() == 1);
+    CHECK(contains(evicted, get_entry(0)));
+    CHECK(cache.get_statistics(1).evictions == 1);
+    CHECK(cache.get_statistics(1).count == 2);
+    CHECK(cache.acquire(1) == get_entry(1));
+}
+
+void test_byte_limit(void)
+{
+    SurfaceCache cache(4);
+    cache.set_limits(0, 250, 0);
+    SurfaceCache::EntryList evicted;
+
+    cache.release(2, get_entry(0), 100, evicted);
+    cache.release(1, get_entry(1), 100, evicted);
+    CHECK(! cache.can_insert(3, 100));
+
+    // The globally oldest entry goes first regardless of its slot.
+
+    cache.release(3, get_entry(2), 100, evicted);
+    CHECK(evicted.size() == 1);
+    CHECK(contains(evicted, get_entry(0)));
+    CHECK(cache.get_total_bytes() == 200);
+    CHECK(cache.get_statistics(2).evictions == 1);
+
+    // Entry exceeding the limit alone is evicted itself.
+
+    evicted.clear();
+    cache.release(1, get_entry(3), 300, evicted);
+    CHECK(contains(evicted, get_entry(3)));
+    CHECK(cache.get_total_bytes() == 0);
+}
+
+void test_trim(void)
+{
+    SurfaceCache cache(4);
+    cache.set_limits(0, 0, 10);
+    SurfaceCache::EntryList evicted;
+
+    cache.release(1, get_entry(0), 10, evicted);
+    for (size_t i = 0; i < 5; ++i) {
+        cache.advance_frame(evicted);
+    }
+    cache.release(1, get_entry(1), 10, evicted);
+
+    // First trim happens at frame 10 and keeps everything released
+    // within the interval.
+
+    for (size_t i = 0; i < 5; ++i) {
+        cache.advance_frame(evicted);
+    }
+    CHECK(evicted.empty());
+
+    // Second trim at frame 20 removes both, the entries released
+    // before frame 10 were not reused during the whole interval.
+
+    for (size_t i = 0; i < 9; ++i) {
+        cache.advance_frame(evicted);
+    }
+    CHECK(evicted.empty());
+    cache.advance_frame(evicted);
+    CHECK(evicted.size() == 2);
+    CHECK(cache.get_statistics(1).evictions == 2);
+    CHECK(cache.get_total_bytes() == 0);
+}
+
+void test_clear(void)
+{
+    SurfaceCache cache(4);
+    SurfaceCache::EntryList evicted;
+    cache.release(1, get_entry(0), 10, evicted);
+    cache.release(3, get_entry(1), 10, evicted);
+    CHECK(cache.acquire(1) == get_entry(0));
+    cache.release(1, get_entry(0), 10, evicted);
+
+    SurfaceCache::EntryList removed;
+    cache.clear(removed);
+    CHECK(removed.size() == 2);
+    CHECK(cache.get_total_bytes() == 0);
+    CHECK(cache.get_statistics(1).count == 0);
+
+    // The statistics survive.
+
+    CHECK(cache.get_statistics(1).hits == 1);
+    CHECK(cache.get_statistics(1).peak_count == 1);
+}
+
+void test_prewarm(void)
+{
+    SurfaceCache cache(4);
+    cache.set_limits(0, 0, 10);
+    SurfaceCache::EntryList evicted;
+
+    cache.prewarm(1, get_entry(0), 10, evicted);
+    cache.prewarm(1, get_entry(1), 10, evicted);
+    cache.release(2, get_entry(2), 10, evicted);
+
+    // Long wait for the mission load trims only the released entry.
+
+    for (size_t i = 0; i < 100; ++i) {
+        cache.advance_frame(evicted);
+    }
+    CHECK(evicted.size() == 1);
+    CHECK(contains(evicted, get_entry(2)));
+    CHECK(cache.get_statistics(1).count == 2);
+
+    // Once used, the entry is trimmed as any other one.
+
+    CHECK(cache.acquire(1) == get_entry(0));
+    CHECK(cache.get_statistics(1).prewarm_hits == 1);
+    cache.release(1, get_entry(0), 10, evicted);
+    for (size_t i = 0; i < 20; ++i) {
+        cache.advance_frame(evicted);
+    }
+    CHECK(contains(evicted, get_entry(0)));
+    CHECK(! contains(evicted, get_entry(1)));
+    CHECK(cache.acquire(1) == get_entry(1));
+    CHECK(cache.get_statistics(1).prewarm_hits == 2);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_hits_and_misses();
+    test_slot_capacity();
+    test_byte_limit();
+    test_trim();
+    test_clear();
+    test_prewarm();
+    return emu::test::finish("surface_cache_test");
+}
+
+// EOF //
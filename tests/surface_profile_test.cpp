@@ -0,0 +1,113 @@
+#include "test.h"
+#include "hw/surface_profile.h"
+#include <cstdio>
+
+using namespace emu;
+
+namespace {
+
+void test_record_keeps_maximum(void)
+{
+    SurfaceProfile profile;
+    profile.record(1, 64, 64, 3);
+    profile.record(1, 64, 64, 7);
+    profile.record(1, 64, 64, 5);
+    profile.record(2, 64, 64, 1);
+    CHECK(profile.get_entries().size() == 2);
+    CHECK(profile.get_count(1, 64, 64) == 7);
+    CHECK(profile.get_count(2, 64, 64) == 1);
+    CHECK(profile.get_count(1, 32, 64) == 0);
+    CHECK(profile.get_total_count() == 8);
+}
+
+void test_merge(void)
+{
+    SurfaceProfile first;
+    first.record(1, 64, 64, 3);
+    first.record(1, 128, 128, 2);
+
+    SurfaceProfile second;
+    second.record(1, 64, 64, 5);
+    second.record(2, 16, 16, 4);
+
+    first.merge(second);
+    CHECK(first.get_count(1, 64, 64) == 5);
+    CHECK(first.get_count(1, 128, 128) == 2);
+    CHECK(first.get_count(2, 16, 16) == 4);
+}
+
+void test_validate(void)
+{
+    SurfaceProfile profile;
+    profile.record(0, 64, 64, 1);       // Format below the range.
+    profile.record(1, 48, 64, 1);       // Not power of two.
+    profile.record(1, 1024, 64, 1);     // Too large.
+    profile.record(1, 64, 64, 0);       // Nothing to prewarm.
+    profile.record(2, 32, 32, 500);     // Clamped.
+    profile.record(3, 64, 64, 1);       // Format above the range.
+    profile.record(2, 512, 8, 2);
+
+    profile.validate(1, 2, 512, 100);
+    CHECK(profile.get_entries().size() == 2);
+    CHECK(profile.get_count(2, 32, 32) == 100);
+    CHECK(profile.get_count(2, 512, 8) == 2);
+}
+
+void test_serialization(void)
+{
+    SurfaceProfile profile;
+    profile.record(1, 64, 64, 3);
+    profile.record(2, 256, 128, 12);
+
+    SurfaceProfile loaded;
+    CHECK(loaded.parse(profile.serialize()));
+    CHECK(loaded.get_entries().size() == 2);
+    CHECK(loaded.get_count(1, 64, 64) == 3);
+    CHECK(loaded.get_count(2, 256, 128) == 12);
+}
+
+void test_malformed_input(void)
+{
+    SurfaceProfile profile;
+    CHECK(! profile.parse("KA_DDRAW surface profile 0\n1 64 64 3\n"));
+    CHECK(profile.get_entries().empty());
+    CHECK(! profile.parse(""));
+
+    // Broken lines are skipped, CRLF line ends are accepted.
+
+    CHECK(profile.parse("KA_DDRAW surface profile 1\r\n1 64 64 3\r\n1 64\r\nabc\r\n1 32 32 2 extra\r\n2 16 16 4"));
+    CHECK(profile.get_entries().size() == 2);
+    CHECK(profile.get_count(1, 64, 64) == 3);
+    CHECK(profile.get_count(2, 16, 16) == 4);
+}
+
+void test_file_round_trip(void)
+{
+    const char * const file_name = "surface_profile_test.txt";
+    SurfaceProfile profile;
+    profile.record(1, 64, 64, 3);
+    CHECK(profile.save(file_name));
+
+    SurfaceProfile loaded;
+    CHECK(loaded.load(file_name));
+    CHECK(loaded.get_count(1, 64, 64) == 3);
+    remove(file_name);
+
+    CHECK(! loaded.load(file_name));
+    CHECK(loaded.get_entries().empty());
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_record_keeps_maximum();
+    test_merge();
+    test_validate();
+    test_serialization();
+    test_malformed_input();
+    test_file_round_trip();
+    return emu::test::finish("surface_profile_test");
+}
+
+// EOF //
@@ -0,0 +1,79 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include "hw/hw_types.h"
+#include <cstddef>
+#include <cstdio>
+
+namespace emu {
+namespace test {
+
+/**
+ * @brief Number of failed checks in the current test program.
+ */
+inline size_t &get_failure_count(void)
+{
+    static size_t count = 0;
+    return count;
+}
+
+inline void report_failure(const char * const file, const int line, const char * const expression)
+{
+    fprintf(stderr, "%s(%d): check failed: %s\n", file, line, expression);
+    get_failure_count()++;
+}
+
+/**
+ * @brief Reports result of the test program and returns its exit code.
+ */
+inline int finish(const char * const name)
+{
+    const size_t failures = get_failure_count();
+    if (failures != 0) {
+        fprintf(stderr, "%s: %u checks failed\n", name, static_cast<unsigned int>(failures));
+        return 1;
+    }
+    printf("%s: passed\n", name);
+    return 0;
+}
+
+/**
+ * @brief Deterministic pseudo-random numbers for the randomized tests.
+ *
+ * Linear congruential generator, the low bits are dropped as they have
+ * short periods.
+ */
+inline unsigned int next_random(unsigned int &seed)
+{
+    seed = seed * 1664525 + 1013904223;
+    return seed >> 8;
+}
+
+/**
+ * @brief Untextured vertex at specified position.
+ */
+inline TLVertex create_vertex(const float x, const float y, const float z = 0.5f, const unsigned int color = 0xFFFFFFFF)
+{
+    TLVertex vertex;
+    vertex.sx = x;
+    vertex.sy = y;
+    vertex.sz = z;
+    vertex.rhw = 1.0f;
+    vertex.color = color;
+    vertex.specular = 0;
+    vertex.tu = 0.0f;
+    vertex.tv = 0.0f;
+    return vertex;
+}
+
+} // namespace test
+} // namespace emu
+
+/**
+ * @brief Records failure if the expression is false. The test continues.
+ */
+#define CHECK(expression) ((expression) ? static_cast<void>(0) : ::emu::test::report_failure(__FILE__, __LINE__, #expression))
+
+#endif // TEST_H
+
+// EOF //
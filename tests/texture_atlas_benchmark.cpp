@@ -0,0 +1,80 @@
+#include "benchmark.h"
+#include "hw/texture_atlas.h"
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+const size_t PAGE_SIZE = 1024;
+const size_t PADDING = 2;
+const size_t ITERATIONS = 50;
+
+/**
+ * @brief Mix of texture sizes to pack.
+ */
+struct SizeMix {
+    const char * name;
+    size_t sizes[4];
+};
+
+/**
+ * @brief Fills single page with textures of the mix and reports the share
+ * of the page covered by the textures with and without their padding.
+ */
+void measure(const SizeMix &mix)
+{
+    size_t texture_area = 0;
+    size_t padded_area = 0;
+    size_t count = 0;
+
+    const test::Stopwatch stopwatch;
+    for (size_t iteration = 0; iteration < ITERATIONS; ++iteration) {
+        TextureAtlas atlas;
+        atlas.configure(PAGE_SIZE, 1, PADDING);
+        unsigned int state = static_cast<unsigned int>(iteration + 1);
+        texture_area = 0;
+        count = 0;
+        AtlasRegion region;
+        for (;;) {
+            state = state * 1664525 + 1013904223;
+            const size_t width = mix.sizes[(state >> 16) & 3];
+            const size_t height = mix.sizes[(state >> 20) & 3];
+            if (! atlas.allocate(width, height, region)) {
+                break;
+            }
+            texture_area += width * height;
+            count++;
+        }
+        padded_area = atlas.get_used_area();
+        test::consume(static_cast<unsigned int>(count));
+    }
+    const double seconds = stopwatch.get_seconds();
+
+    const double page_area = static_cast<double>(PAGE_SIZE * PAGE_SIZE);
+    printf("%-24s %5u textures, %5.1f %% content, %5.1f %% with padding, %8.1f us per page\n",
+        mix.name,
+        static_cast<unsigned int>(count),
+        100.0 * static_cast<double>(texture_area) / page_area,
+        100.0 * static_cast<double>(padded_area) / page_area,
+        seconds * 1000000.0 / ITERATIONS);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    const SizeMix mixes[] = {
+        {"uniform 32x32", {32, 32, 32, 32}},
+        {"uniform 64x64", {64, 64, 64, 64}},
+        {"8 to 64", {8, 16, 32, 64}},
+        {"mostly 16", {16, 16, 16, 64}},
+        {"non power of two", {12, 20, 36, 50}},
+    };
+    for (size_t i = 0; i < sizeof(mixes) / sizeof(mixes[0]); ++i) {
+        measure(mixes[i]);
+    }
+    return 0;
+}
+
+// EOF //
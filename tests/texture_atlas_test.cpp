@@ -0,0 +1,296 @@
+#include "test.h"
+#include "hw/texture_atlas.h"
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+struct Rect {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+};
+
+bool is_overlapping(const Rect &a, const Rect &b)
+{
+    return (a.x < (b.x + b.width)) && (b.x < (a.x + a.width)) && (a.y < (b.y + b.height)) && (b.y < (a.y + a.height));
+}
+
+/**
+ * @brief Checks that the rectangles are inside of the area and disjoint.
+ */
+bool is_valid_packing(const std::vector<Rect> &rects, const size_t width, const size_t height)
+{
+    for (size_t i = 0; i < rects.size(); ++i) {
+        if (((rects[i].x + rects[i].width) > width) || ((rects[i].y + rects[i].height) > height)) {
+            return false;
+        }
+        for (size_t j = i + 1; j < rects.size(); ++j) {
+            if (is_overlapping(rects[i], rects[j])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Deterministic sizes typical for small game textures.
+ */
+size_t next_size(unsigned int &state)
+{
+    state = state * 1664525 + 1013904223;
+    const size_t sizes[] = {8, 16, 16, 32, 32, 32, 64, 64};
+    return sizes[(state >> 16) & 7];
+}
+
+void test_packer_rejects(void)
+{
+    SkylinePacker packer;
+    packer.reset(64, 64);
+    size_t x = 0;
+    size_t y = 0;
+    CHECK(! packer.insert(0, 8, x, y));
+    CHECK(! packer.insert(65, 8, x, y));
+    CHECK(! packer.insert(8, 65, x, y));
+    CHECK(packer.insert(64, 64, x, y));
+    CHECK((x == 0) && (y == 0));
+    CHECK(! packer.insert(1, 1, x, y));
+    CHECK(packer.get_used_area() == 64 * 64);
+}
+
+void test_packer_fills_uniform_tiles(void)
+{
+    // Tiles dividing the area fill it completely.
+
+    SkylinePacker packer;
+    packer.reset(256, 256);
+    std::vector<Rect> rects;
+    for (size_t i = 0; i < 64; ++i) {
+        Rect rect = {0, 0, 32, 32};
+        CHECK(packer.insert(rect.width, rect.height, rect.x, rect.y));
+        rects.push_back(rect);
+    }
+    size_t x = 0;
+    size_t y = 0;
+    CHECK(! packer.insert(1, 1, x, y));
+    CHECK(packer.get_used_area() == 256 * 256);
+    CHECK(is_valid_packing(rects, 256, 256));
+}
+
+void test_packer_mixed_sizes(void)
+{
+    SkylinePacker packer;
+    packer.reset(512, 512);
+    std::vector<Rect> rects;
+    unsigned int state = 7;
+    size_t area = 0;
+    for (;;) {
+        Rect rect = {0, 0, next_size(state), next_size(state)};
+        if (! packer.insert(rect.width, rect.height, rect.x, rect.y)) {
+            break;
+        }
+        rects.push_back(rect);
+        area += rect.width * rect.height;
+    }
+    CHECK(is_valid_packing(rects, 512, 512));
+    CHECK(packer.get_used_area() == area);
+
+    // Bottom-left placement of the typical sizes wastes little space.
+
+    CHECK(area * 10 >= 512 * 512 * 7);
+}
+
+void test_atlas_padding(void)
+{
+    TextureAtlas atlas;
+    atlas.configure(128, 2, 2);
+
+    AtlasRegion first;
+    AtlasRegion second;
+    CHECK(atlas.allocate(30, 20, first));
+    CHECK(atlas.allocate(30, 20, second));
+    CHECK(first.page == 0);
+    CHECK((first.x == 2) && (first.y == 2));
+    CHECK((first.width == 30) && (first.height == 20));
+
+    // The padded regions do not overlap.
+
+    const Rect first_padded = {first.x - 2, first.y - 2, first.width + 4, first.height + 4};
+    const Rect second_padded = {second.x - 2, second.y - 2, second.width + 4, second.height + 4};
+    CHECK(! is_overlapping(first_padded, second_padded));
+    CHECK(atlas.get_used_area() == 2 * 34 * 24);
+
+    // Texture which does not fit into page even without neighbors.
+
+    AtlasRegion too_big;
+    CHECK(! atlas.allocate(125, 10, too_big));
+}
+
+void test_atlas_pages(void)
+{
+    TextureAtlas atlas;
+    atlas.configure(64, 2, 0);
+
+    AtlasRegion regions[8];
+    for (size_t i = 0; i < 8; ++i) {
+        CHECK(atlas.allocate(32, 32, regions[i]));
+        CHECK(regions[i].page == (i / 4));
+    }
+    AtlasRegion extra;
+    CHECK(! atlas.allocate(32, 32, extra));
+    CHECK(atlas.get_page_count() == 2);
+    CHECK(atlas.get_region_count() == 8);
+
+    // Space is reused once all regions of the page are released.
+
+    atlas.release(regions[0]);
+    CHECK(! atlas.allocate(32, 32, extra));
+    for (size_t i = 1; i < 4; ++i) {
+        atlas.release(regions[i]);
+    }
+    CHECK(atlas.get_region_count() == 4);
+    CHECK(atlas.allocate(32, 32, extra));
+    CHECK((extra.page == 0) && (extra.x == 0) && (extra.y == 0));
+
+    // Regions of cleared atlas are ignored.
+
+    atlas.clear();
+    atlas.release(regions[5]);
+    CHECK(atlas.get_page_count() == 0);
+}
+
+void test_transform(void)
+{
+    TextureAtlas atlas;
+    atlas.configure(256, 1, 2);
+    AtlasRegion region;
+    region.page = 0;
+    region.x = 64;
+    region.y = 128;
+    region.width = 32;
+    region.height = 16;
+    const AtlasTransform transform = atlas.get_transform(region);
+
+    float u = 0.0f;
+    float v = 0.0f;
+    apply_atlas_transform(transform, u, v);
+    CHECK((u == 0.25f) && (v == 0.5f));
+    u = 1.0f;
+    v = 1.0f;
+    apply_atlas_transform(transform, u, v);
+    CHECK((u == 0.375f) && (v == 0.5625f));
+}
+
+void test_sampled_inside(void)
+{
+    TLVertex vertex = TLVertex();
+    CHECK(is_sampled_inside(vertex));
+    vertex.tu = 1.0f;
+    vertex.tv = 1.0f;
+    CHECK(is_sampled_inside(vertex));
+
+    // Rounding of the edge coordinates is tolerated, wrapping is not.
+
+    vertex.tu = -0.0005f;
+    vertex.tv = 1.0005f;
+    CHECK(is_sampled_inside(vertex));
+    vertex.tu = -0.01f;
+    CHECK(! is_sampled_inside(vertex));
+    vertex.tu = 0.5f;
+    vertex.tv = 2.0f;
+    CHECK(! is_sampled_inside(vertex));
+}
+
+void test_remap_to_atlas(void)
+{
+    // Second region of the page, its padding follows the first one.
+
+    TextureAtlas atlas;
+    atlas.configure(256, 1, 2);
+    AtlasRegion first;
+    AtlasRegion region;
+    CHECK(atlas.allocate(60, 60, first));
+    CHECK(atlas.allocate(28, 12, region));
+    CHECK((region.x == 66) && (region.y == 2));
+    const AtlasTransform transform = atlas.get_transform(region);
+
+    TLVertex source[4];
+    for (size_t i = 0; i < 4; ++i) {
+        source[i] = TLVertex();
+        source[i].sx = static_cast<float>(i);
+        source[i].color = 0xFF00FF00;
+    }
+    source[1].tu = 1.0f;
+    source[1].tv = 1.0f;
+    source[2].tu = 0.5f;
+    source[2].tv = 0.25f;
+    source[3].tu = -0.0005f;
+    source[3].tv = 1.0005f;
+    TLVertex target[4];
+    remap_to_atlas(transform, source, 4, target);
+
+    // Content starts past the padding and ends before the padding
+    // of the next region.
+
+    const float texel = 1.0f / 256.0f;
+    CHECK((target[0].tu == (66 * texel)) && (target[0].tv == (2 * texel)));
+    CHECK((target[1].tu == (94 * texel)) && (target[1].tv == (14 * texel)));
+    CHECK((target[2].tu == (80 * texel)) && (target[2].tv == (5 * texel)));
+
+    // Coordinates within the tolerance do not reach into the padding.
+
+    CHECK((target[3].tu == target[0].tu) && (target[3].tv == target[1].tv));
+
+    // Other members are copied.
+
+    bool copied = true;
+    for (size_t i = 0; i < 4; ++i) {
+        copied = copied && (target[i].sx == source[i].sx) && (target[i].color == source[i].color);
+    }
+    CHECK(copied);
+}
+
+void test_extend_region_border(void)
+{
+    // 2x2 texture with padding 1 in 4x4 area.
+
+    unsigned short texels[16] = {0};
+    texels[5] = 1;
+    texels[6] = 2;
+    texels[9] = 3;
+    texels[10] = 4;
+    extend_region_border(&texels[5], 4 * sizeof(unsigned short), 2, 2, sizeof(unsigned short), 1);
+
+    const unsigned short expected[16] = {
+        1, 1, 2, 2,
+        1, 1, 2, 2,
+        3, 3, 4, 4,
+        3, 3, 4, 4,
+    };
+    bool equal = true;
+    for (size_t i = 0; i < 16; ++i) {
+        equal = equal && (texels[i] == expected[i]);
+    }
+    CHECK(equal);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_packer_rejects();
+    test_packer_fills_uniform_tiles();
+    test_packer_mixed_sizes();
+    test_atlas_padding();
+    test_atlas_pages();
+    test_transform();
+    test_sampled_inside();
+    test_remap_to_atlas();
+    test_extend_region_border();
+    return emu::test::finish("texture_atlas_test");
+}
+
+// EOF //
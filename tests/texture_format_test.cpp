@@ -0,0 +1,114 @@
+#include "test.h"
+#include "hw/texture_format.h"
+
+using namespace emu;
+
+namespace {
+
+/**
+ * @brief Creates table with specified capabilities of the 16 bit formats.
+ *
+ * The 32 bit formats are always available with mipmap generation.
+ */
+TextureFormatTable create_table(const bool native_texture, const bool native_mipmap)
+{
+    TextureFormatTable table;
+    table.set_capabilities(TEXTURE_STORAGE_X8R8G8B8, true, true);
+    table.set_capabilities(TEXTURE_STORAGE_A8R8G8B8, true, true);
+    table.set_capabilities(TEXTURE_STORAGE_R5G6B5, native_texture, native_mipmap);
+    table.set_capabilities(TEXTURE_STORAGE_A4R4G4B4, native_texture, native_mipmap);
+    table.resolve();
+    return table;
+}
+
+void test_native_preferred(void)
+{
+    const TextureFormatTable table = create_table(true, true);
+    CHECK(table.get_storage(TEXTURE_SOURCE_565) == TEXTURE_STORAGE_R5G6B5);
+    CHECK(table.get_storage(TEXTURE_SOURCE_4444) == TEXTURE_STORAGE_A4R4G4B4);
+    CHECK(table.is_native(TEXTURE_SOURCE_565));
+    CHECK(table.is_native(TEXTURE_SOURCE_4444));
+    CHECK(table.has_autogen_mipmap(TEXTURE_SOURCE_565));
+}
+
+void test_expansion_keeps_mipmaps(void)
+{
+    const TextureFormatTable table = create_table(true, false);
+    CHECK(table.get_storage(TEXTURE_SOURCE_565) == TEXTURE_STORAGE_X8R8G8B8);
+    CHECK(table.get_storage(TEXTURE_SOURCE_4444) == TEXTURE_STORAGE_A8R8G8B8);
+    CHECK(! table.is_native(TEXTURE_SOURCE_565));
+    CHECK(table.has_autogen_mipmap(TEXTURE_SOURCE_4444));
+}
+
+void test_native_unsupported(void)
+{
+    const TextureFormatTable table = create_table(false, true);
+    CHECK(table.get_storage(TEXTURE_SOURCE_565) == TEXTURE_STORAGE_X8R8G8B8);
+    CHECK(table.get_storage(TEXTURE_SOURCE_4444) == TEXTURE_STORAGE_A8R8G8B8);
+    CHECK(table.has_autogen_mipmap(TEXTURE_SOURCE_565));
+
+    // Mipmap capability without texture capability is meaningless.
+
+    TextureFormatTable native_only;
+    native_only.set_capabilities(TEXTURE_STORAGE_R5G6B5, false, true);
+    native_only.resolve();
+    CHECK(native_only.get_storage(TEXTURE_SOURCE_565) == TEXTURE_STORAGE_NONE);
+}
+
+void test_native_disallowed(void)
+{
+    TextureFormatTable table = create_table(true, true);
+    table.set_native_allowed(false);
+
+    // The selection changes only after resolve.
+
+    CHECK(table.get_storage(TEXTURE_SOURCE_565) == TEXTURE_STORAGE_R5G6B5);
+    table.resolve();
+    CHECK(table.get_storage(TEXTURE_SOURCE_565) == TEXTURE_STORAGE_X8R8G8B8);
+    CHECK(table.get_storage(TEXTURE_SOURCE_4444) == TEXTURE_STORAGE_A8R8G8B8);
+}
+
+void test_native_fallback(void)
+{
+    // Device without 32 bit formats still gets native storage, even
+    // when native storage is disallowed.
+
+    TextureFormatTable table;
+    table.set_capabilities(TEXTURE_STORAGE_R5G6B5, true, false);
+    table.set_capabilities(TEXTURE_STORAGE_A4R4G4B4, true, false);
+    table.set_native_allowed(false);
+    table.resolve();
+    CHECK(table.get_storage(TEXTURE_SOURCE_565) == TEXTURE_STORAGE_R5G6B5);
+    CHECK(table.get_storage(TEXTURE_SOURCE_4444) == TEXTURE_STORAGE_A4R4G4B4);
+
+    // Nothing available.
+
+    TextureFormatTable empty;
+    empty.resolve();
+    CHECK(empty.get_storage(TEXTURE_SOURCE_565) == TEXTURE_STORAGE_NONE);
+    CHECK(! empty.has_autogen_mipmap(TEXTURE_SOURCE_565));
+}
+
+void test_texel_sizes(void)
+{
+    CHECK(TextureFormatTable::get_texel_size(TEXTURE_STORAGE_R5G6B5) == 2);
+    CHECK(TextureFormatTable::get_texel_size(TEXTURE_STORAGE_A4R4G4B4) == 2);
+    CHECK(TextureFormatTable::get_texel_size(TEXTURE_STORAGE_X8R8G8B8) == 4);
+    CHECK(TextureFormatTable::get_texel_size(TEXTURE_STORAGE_A8R8G8B8) == 4);
+    CHECK(TextureFormatTable::get_texel_size(TEXTURE_STORAGE_NONE) == 0);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_native_preferred();
+    test_expansion_keeps_mipmaps();
+    test_native_unsupported();
+    test_native_disallowed();
+    test_native_fallback();
+    test_texel_sizes();
+    return emu::test::finish("texture_format_test");
+}
+
+// EOF //
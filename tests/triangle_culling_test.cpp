@@ -0,0 +1,177 @@
+#include "test.h"
+#include "ddraw/triangle_culling.h"
+#include "ddraw/triangle_indices.h"
+#include <limits>
+#include <vector>
+
+using namespace emu;
+using emu::test::create_vertex;
+using emu::test::next_random;
+
+namespace {
+
+const float TARGET_WIDTH = 640.0f;
+const float TARGET_HEIGHT = 480.0f;
+
+CullParameters create_parameters(void)
+{
+    CullParameters parameters;
+    parameters.min_x = -2.0f;
+    parameters.min_y = -2.0f;
+    parameters.max_x = TARGET_WIDTH + 2.0f;
+    parameters.max_y = TARGET_HEIGHT + 2.0f;
+    return parameters;
+}
+
+/**
+ * @brief Vertices spread around the render target, some of them sharing
+ * positions or having NaN coordinates.
+ */
+std::vector<TLVertex> create_vertices(unsigned int &seed, const size_t count)
+{
+    std::vector<TLVertex> vertices;
+    for (size_t i = 0; i < count; ++i) {
+        const float x = static_cast<float>(static_cast<int>(next_random(seed) % 1600) - 480);
+        const float y = static_cast<float>(static_cast<int>(next_random(seed) % 1200) - 360);
+        vertices.push_back(create_vertex(x, y));
+        const unsigned int kind = next_random(seed) % 16;
+        if ((kind == 0) && (i > 0)) {
+            vertices[i] = vertices[next_random(seed) % i];
+        }
+        else if (kind == 1) {
+            vertices[i].sx = std::numeric_limits<float>::quiet_NaN();
+        }
+        else if (kind == 2) {
+            vertices[i].sy = std::numeric_limits<float>::infinity();
+        }
+    }
+    return vertices;
+}
+
+/**
+ * @brief D3DTRIANGLE records with some repeated and missing indices.
+ */
+std::vector<unsigned short> create_triangles(unsigned int &seed, const size_t count, const size_t vertex_count)
+{
+    std::vector<unsigned short> triangles;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned short triangle[TRIANGLE_RECORD_WORDS];
+        for (size_t k = 0; k < 3; ++k) {
+            triangle[k] = static_cast<unsigned short>(next_random(seed) % (vertex_count + 2));
+        }
+        if ((next_random(seed) % 8) == 0) {
+            triangle[2] = triangle[next_random(seed) % 2];
+        }
+        triangle[3] = static_cast<unsigned short>(next_random(seed));
+        triangles.insert(triangles.end(), triangle, triangle + TRIANGLE_RECORD_WORDS);
+    }
+    return triangles;
+}
+
+bool is_culled(const TLVertex &v0, const TLVertex &v1, const TLVertex &v2)
+{
+    const TLVertex vertices[] = {v0, v1, v2};
+    const unsigned short triangle[TRIANGLE_RECORD_WORDS] = {0, 1, 2, 0};
+    return is_triangle_culled(triangle, vertices, 3, create_parameters());
+}
+
+void test_culled_triangles(void)
+{
+    const TLVertex a = create_vertex(10.0f, 10.0f);
+    const TLVertex b = create_vertex(100.0f, 10.0f);
+    const TLVertex c = create_vertex(10.0f, 100.0f);
+    CHECK(! is_culled(a, b, c));
+
+    // Zero area.
+
+    CHECK(is_culled(a, a, c));
+    CHECK(is_culled(a, b, b));
+    CHECK(is_culled(c, b, c));
+
+    // Outside of the target on one side, partially visible are kept.
+
+    CHECK(is_culled(create_vertex(-10.0f, 0.0f), create_vertex(-3.0f, 50.0f), create_vertex(-50.0f, 900.0f)));
+    CHECK(is_culled(create_vertex(0.0f, 490.0f), create_vertex(700.0f, 483.0f), create_vertex(50.0f, 900.0f)));
+    CHECK(! is_culled(create_vertex(-10.0f, 0.0f), create_vertex(-1.0f, 50.0f), create_vertex(-50.0f, 900.0f)));
+    CHECK(! is_culled(create_vertex(-100.0f, -100.0f), create_vertex(800.0f, -100.0f), create_vertex(300.0f, 900.0f)));
+
+    // NaN positions are kept.
+
+    CHECK(! is_culled(create_vertex(std::numeric_limits<float>::quiet_NaN(), 0.0f), b, c));
+
+    // Repeated and missing indices.
+
+    const TLVertex vertices[] = {a, b, c};
+    const unsigned short repeated[TRIANGLE_RECORD_WORDS] = {0, 2, 0, 0};
+    const unsigned short missing[TRIANGLE_RECORD_WORDS] = {0, 1, 3, 0};
+    CHECK(is_triangle_culled(repeated, vertices, 3, create_parameters()));
+    CHECK(! is_triangle_culled(missing, vertices, 3, create_parameters()));
+}
+
+void test_both_windings_kept(void)
+{
+    // The HW draws without face culling so neither winding is dropped.
+
+    const TLVertex a = create_vertex(10.0f, 10.0f);
+    const TLVertex b = create_vertex(100.0f, 10.0f);
+    const TLVertex c = create_vertex(10.0f, 100.0f);
+    CHECK(! is_culled(a, b, c));
+    CHECK(! is_culled(a, c, b));
+
+    const TLVertex vertices[] = {a, b, c};
+    const unsigned short triangles[] = {0, 1, 2, 0, 0, 2, 1, 0, 1, 2, 0, 0, 2, 1, 0, 0, 1, 0, 2, 0};
+    unsigned short scalar[20];
+    unsigned short sse2[20];
+    CHECK(cull_triangles_scalar(triangles, 5, vertices, 3, create_parameters(), scalar) == 5);
+    CHECK(cull_triangles_sse2(triangles, 5, vertices, 3, create_parameters(), sse2) == 5);
+}
+
+void test_scalar_and_sse2_agree(void)
+{
+    // Both implementations keep the same records in the same order for
+    // any block length, including the partial groups at the end.
+
+    unsigned int seed = 5;
+    const CullParameters parameters = create_parameters();
+    size_t total_kept = 0;
+    size_t total_count = 0;
+    for (size_t round = 0; round < 500; ++round) {
+        const size_t vertex_count = next_random(seed) % 64;
+        const std::vector<TLVertex> vertices = create_vertices(seed, vertex_count);
+        const size_t count = 1 + (round % 67);
+        const std::vector<unsigned short> triangles = create_triangles(seed, count, vertex_count);
+
+        std::vector<unsigned short> scalar(triangles.size(), 0xDEAD);
+        std::vector<unsigned short> sse2(triangles.size(), 0xDEAD);
+        const TLVertex * const data = vertices.empty() ? NULL : &vertices[0];
+        const size_t scalar_kept = cull_triangles_scalar(&triangles[0], count, data, vertex_count, parameters, &scalar[0]);
+        const size_t sse2_kept = cull_triangles_sse2(&triangles[0], count, data, vertex_count, parameters, &sse2[0]);
+        CHECK(scalar_kept == sse2_kept);
+        CHECK(scalar == sse2);
+        total_kept += scalar_kept;
+        total_count += count;
+
+        // The dispatcher gives the same result.
+
+        std::vector<unsigned short> dispatched(triangles.size(), 0xDEAD);
+        CHECK(cull_triangles(&triangles[0], count, data, vertex_count, parameters, &dispatched[0]) == scalar_kept);
+        CHECK(dispatched == scalar);
+    }
+
+    // The random blocks exercise both outcomes.
+
+    CHECK(total_kept > (total_count / 10));
+    CHECK(total_kept < total_count);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_culled_triangles();
+    test_both_windings_kept();
+    test_scalar_and_sse2_agree();
+    return emu::test::finish("triangle_culling_test");
+}
+
+// EOF //
@@ -0,0 +1,47 @@
+#include "benchmark.h"
+#include "ddraw/triangle_indices.h"
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+typedef void (*AppendFunction)(const unsigned short * const triangles, const size_t count, unsigned short * const destination, size_t &min_index, size_t &max_index);
+
+const size_t ITERATIONS = 20000;
+
+/**
+ * @brief Measures copy of block of D3DTRIANGLE records.
+ */
+void measure(const char * const name, const AppendFunction function, const size_t count)
+{
+    std::vector<unsigned short> triangles(count * TRIANGLE_RECORD_WORDS);
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        triangles[i] = static_cast<unsigned short>((i * 2654435761u) >> 20);
+    }
+    std::vector<unsigned short> destination(count * 3 + 1);
+
+    const test::Stopwatch stopwatch;
+    for (size_t iteration = 0; iteration < ITERATIONS; ++iteration) {
+        size_t min_index = 0xFFFF;
+        size_t max_index = 0;
+        function(&triangles[0], count, &destination[0], min_index, max_index);
+        test::consume(static_cast<unsigned int>(min_index + max_index + destination[iteration % destination.size()]));
+    }
+    test::report(name, ITERATIONS, triangles.size() * sizeof(unsigned short), stopwatch.get_seconds());
+}
+
+} // anonymous namespace
+
+int main()
+{
+    const size_t counts[] = {8, 64, 1024};
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        printf("block of %u triangles:\n", static_cast<unsigned int>(counts[i]));
+        measure("scalar", append_triangle_indices_scalar, counts[i]);
+        measure("sse2", append_triangle_indices_sse2, counts[i]);
+    }
+    return 0;
+}
+
+// EOF //
@@ -0,0 +1,163 @@
+#include "test.h"
+#include "ddraw/triangle_indices.h"
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+typedef void (*AppendFunction)(const unsigned short * const triangles, const size_t count, unsigned short * const destination, size_t &min_index, size_t &max_index);
+
+const unsigned short SENTINEL = 0xDEAD;
+
+/**
+ * @brief Index values around the bias of the signed SSE2 min/max.
+ */
+const unsigned short EDGE_INDICES[] = {0x0000, 0x0001, 0x7FFE, 0x7FFF, 0x8000, 0x8001, 0xFFFE, 0xFFFF};
+
+std::vector<unsigned short> create_triangles(const size_t count, unsigned int seed)
+{
+    std::vector<unsigned short> triangles(count * TRIANGLE_RECORD_WORDS + 1);
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        seed = seed * 1664525 + 1013904223;
+        if ((seed >> 28) == 0) {
+            triangles[i] = EDGE_INDICES[(seed >> 8) % (sizeof(EDGE_INDICES) / sizeof(EDGE_INDICES[0]))];
+        }
+        else {
+            triangles[i] = static_cast<unsigned short>(seed >> 16);
+        }
+    }
+    return triangles;
+}
+
+/**
+ * @brief Output of single call, the destination is surrounded by sentinels.
+ */
+struct Result {
+    std::vector<unsigned short> destination;
+    size_t min_index;
+    size_t max_index;
+};
+
+Result run(const AppendFunction function, const std::vector<unsigned short> &triangles, const size_t count, const size_t offset, const size_t min_index, const size_t max_index)
+{
+    Result result;
+    result.destination.assign(offset + count * 3 + 8, SENTINEL);
+    result.min_index = min_index;
+    result.max_index = max_index;
+    function(&triangles[0], count, &result.destination[offset], result.min_index, result.max_index);
+    return result;
+}
+
+bool is_untouched(const std::vector<unsigned short> &destination, const size_t begin, const size_t end)
+{
+    for (size_t i = begin; i < end; ++i) {
+        if (destination[i] != SENTINEL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_scalar_reference(void)
+{
+    const unsigned short triangles[] = {5, 9, 7, 0xFFFF, 3, 12, 4, 0x1234};
+    unsigned short destination[7] = {SENTINEL, SENTINEL, SENTINEL, SENTINEL, SENTINEL, SENTINEL, SENTINEL};
+    size_t min_index = 100;
+    size_t max_index = 0;
+    append_triangle_indices_scalar(triangles, 2, destination, min_index, max_index);
+    CHECK((destination[0] == 5) && (destination[1] == 9) && (destination[2] == 7));
+    CHECK((destination[3] == 3) && (destination[4] == 12) && (destination[5] == 4));
+    CHECK(destination[6] == SENTINEL);
+    CHECK(min_index == 3);
+    CHECK(max_index == 12);
+}
+
+void test_sse2_matches_scalar(void)
+{
+    // Odd and even counts, unaligned destinations and different initial
+    // ranges, including ones which the triangles do not extend.
+
+    const size_t ranges[][2] = {{0xFFFFFFFF, 0}, {0x8000, 0x7FFF}, {0, 0xFFFF}, {100, 200}};
+    for (size_t count = 0; count < 40; ++count) {
+        const std::vector<unsigned short> triangles = create_triangles(count, static_cast<unsigned int>(count * 7919 + 1));
+        for (size_t offset = 0; offset < 3; ++offset) {
+            for (size_t range = 0; range < sizeof(ranges) / sizeof(ranges[0]); ++range) {
+                const Result scalar = run(append_triangle_indices_scalar, triangles, count, offset, ranges[range][0], ranges[range][1]);
+                const Result sse2 = run(append_triangle_indices_sse2, triangles, count, offset, ranges[range][0], ranges[range][1]);
+                const size_t end = offset + count * 3;
+
+                CHECK(std::vector<unsigned short>(scalar.destination.begin() + offset, scalar.destination.begin() + end) == std::vector<unsigned short>(sse2.destination.begin() + offset, sse2.destination.begin() + end));
+                CHECK(scalar.min_index == sse2.min_index);
+                CHECK(scalar.max_index == sse2.max_index);
+
+                // Nothing is written in front of the destination, the SSE2
+                // version may write the one word past the indices.
+
+                CHECK(is_untouched(scalar.destination, 0, offset));
+                CHECK(is_untouched(sse2.destination, 0, offset));
+                CHECK(is_untouched(scalar.destination, end, scalar.destination.size()));
+                CHECK(is_untouched(sse2.destination, end + 1, sse2.destination.size()));
+            }
+        }
+    }
+}
+
+void test_flags_do_not_affect_range(void)
+{
+    // Flags hold values outside of the index range in every triangle.
+
+    std::vector<unsigned short> triangles;
+    for (size_t i = 0; i < 9; ++i) {
+        triangles.push_back(static_cast<unsigned short>(1000 + i));
+        triangles.push_back(static_cast<unsigned short>(1001 + i));
+        triangles.push_back(static_cast<unsigned short>(1002 + i));
+        triangles.push_back((i & 1) ? 0xFFFF : 0);
+    }
+    triangles.push_back(0);
+
+    const Result sse2 = run(append_triangle_indices_sse2, triangles, 9, 0, 0xFFFFFFFF, 0);
+    CHECK(sse2.min_index == 1000);
+    CHECK(sse2.max_index == 1010);
+    const Result dispatched = run(append_triangle_indices, triangles, 9, 0, 0xFFFFFFFF, 0);
+    CHECK(dispatched.min_index == 1000);
+    CHECK(dispatched.max_index == 1010);
+}
+
+void test_rebased_indices(void)
+{
+    const unsigned short triangles[] = {5, 9, 7, 0xFFFF, 3, 12, 4, 0x1234};
+    unsigned short destination[7] = {SENTINEL, SENTINEL, SENTINEL, SENTINEL, SENTINEL, SENTINEL, SENTINEL};
+    size_t min_index = 2;
+    size_t max_index = 50;
+    append_rebased_triangle_indices(triangles, 2, 100, destination, min_index, max_index);
+    CHECK((destination[0] == 105) && (destination[1] == 109) && (destination[2] == 107));
+    CHECK((destination[3] == 103) && (destination[4] == 112) && (destination[5] == 104));
+    CHECK(min_index == 2);
+    CHECK(max_index == 112);
+
+    // Zero base copies the indices unchanged, empty block keeps the range.
+
+    min_index = 200;
+    max_index = 0;
+    append_rebased_triangle_indices(triangles, 2, 0, destination, min_index, max_index);
+    CHECK((destination[0] == 5) && (destination[5] == 4));
+    CHECK((min_index == 3) && (max_index == 12));
+    min_index = ~static_cast<size_t>(0);
+    max_index = 0;
+    append_rebased_triangle_indices(triangles, 0, 100, destination, min_index, max_index);
+    CHECK((min_index == ~static_cast<size_t>(0)) && (max_index == 0));
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_scalar_reference();
+    test_sse2_matches_scalar();
+    test_flags_do_not_affect_range();
+    test_rebased_indices();
+    return emu::test::finish("triangle_indices_test");
+}
+
+// EOF //
@@ -0,0 +1,189 @@
+#include "test.h"
+#include "ddraw/triangle_strip.h"
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+/**
+ * @brief Triangle as drawn by the HW together with its flat shading vertex.
+ */
+struct DrawnTriangle {
+    unsigned short vertices[3];
+    unsigned short flat_vertex;
+};
+
+bool is_degenerate(const unsigned short a, const unsigned short b, const unsigned short c)
+{
+    return (a == b) || (b == c) || (a == c);
+}
+
+/**
+ * @brief Expands strip into the triangles the HW draws, skipping the
+ * degenerate ones. Odd triangles have their first two vertices swapped,
+ * the flat shading always uses the first vertex of the strip triangle.
+ */
+std::vector<DrawnTriangle> expand_strip(const std::vector<unsigned short> &strip)
+{
+    std::vector<DrawnTriangle> triangles;
+    for (size_t k = 0; (k + 2) < strip.size(); ++k) {
+        if (is_degenerate(strip[k], strip[k + 1], strip[k + 2])) {
+            continue;
+        }
+        const bool odd = ((k % 2) != 0);
+        DrawnTriangle triangle;
+        triangle.vertices[0] = odd ? strip[k + 1] : strip[k];
+        triangle.vertices[1] = odd ? strip[k] : strip[k + 1];
+        triangle.vertices[2] = strip[k + 2];
+        triangle.flat_vertex = strip[k];
+        triangles.push_back(triangle);
+    }
+    return triangles;
+}
+
+/**
+ * @brief Checks that the triangle is drawn with the winding of the original
+ * one and with its first vertex as the flat shading vertex.
+ */
+bool is_same_triangle(const DrawnTriangle &drawn, const unsigned short * const original)
+{
+    bool rotation = false;
+    for (size_t i = 0; i < 3; ++i) {
+        rotation = rotation || (
+            (drawn.vertices[0] == original[i]) &&
+            (drawn.vertices[1] == original[(i + 1) % 3]) &&
+            (drawn.vertices[2] == original[(i + 2) % 3])
+        );
+    }
+    return rotation && (drawn.flat_vertex == original[0]);
+}
+
+/**
+ * @brief Verifies that the strip draws exactly the list triangles in their order.
+ */
+bool draws_list(const std::vector<unsigned short> &list, const std::vector<unsigned short> &strip)
+{
+    const std::vector<DrawnTriangle> drawn = expand_strip(strip);
+    if ((drawn.size() * 3) != list.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < drawn.size(); ++i) {
+        if (! is_same_triangle(drawn[i], &list[i * 3])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Creates the triangle list which a strip of specified vertices draws.
+ */
+std::vector<unsigned short> create_list_of_strip(const unsigned short first, const size_t vertex_count)
+{
+    std::vector<unsigned short> list;
+    for (size_t k = 0; (k + 2) < vertex_count; ++k) {
+        const unsigned short a = static_cast<unsigned short>(first + k);
+        const unsigned short b = static_cast<unsigned short>(first + k + 1);
+        const unsigned short c = static_cast<unsigned short>(first + k + 2);
+        list.push_back(a);
+        list.push_back(((k % 2) != 0) ? c : b);
+        list.push_back(((k % 2) != 0) ? b : c);
+    }
+    return list;
+}
+
+void test_strip_round_trip(void)
+{
+    // List produced by a strip is converted back to the same strip.
+
+    for (size_t vertex_count = 5; vertex_count < 20; ++vertex_count) {
+        const std::vector<unsigned short> list = create_list_of_strip(10, vertex_count);
+        std::vector<unsigned short> strip;
+        CHECK(build_triangle_strip(&list[0], list.size() / 3, strip));
+        CHECK(strip.size() == vertex_count);
+        CHECK(draws_list(list, strip));
+    }
+}
+
+void test_joined_strips(void)
+{
+    // Two strips joined by degenerate triangles, the second one starting
+    // at both parities.
+
+    for (size_t first_count = 5; first_count < 9; ++first_count) {
+        std::vector<unsigned short> list = create_list_of_strip(0, first_count);
+        const std::vector<unsigned short> second = create_list_of_strip(100, 12);
+        list.insert(list.end(), second.begin(), second.end());
+
+        std::vector<unsigned short> strip;
+        CHECK(build_triangle_strip(&list[0], list.size() / 3, strip));
+        CHECK(draws_list(list, strip));
+    }
+}
+
+void test_rotated_triangles_keep_first_vertex(void)
+{
+    // The second triangle shares an edge only in a rotation which would
+    // move its first vertex, it must not extend the strip.
+
+    const unsigned short list[] = {0, 1, 2, 1, 3, 2, 2, 3, 4, 3, 5, 4};
+    const std::vector<unsigned short> triangles(list, list + 12);
+    std::vector<unsigned short> strip;
+    const bool built = build_triangle_strip(list, 4, strip);
+    CHECK((! built) || draws_list(triangles, strip));
+}
+
+void test_random_lists(void)
+{
+    // Arbitrary lists from small vertex set so the triangles share edges
+    // frequently in all rotations.
+
+    unsigned int seed = 4242;
+    size_t built_count = 0;
+    for (size_t iteration = 0; iteration < 2000; ++iteration) {
+        std::vector<unsigned short> list;
+        const size_t triangle_count = 2 + (iteration % 30);
+        for (size_t i = 0; i < triangle_count; ++i) {
+            unsigned short triangle[3];
+            do {
+                for (size_t j = 0; j < 3; ++j) {
+                    seed = seed * 1664525 + 1013904223;
+                    triangle[j] = static_cast<unsigned short>((seed >> 16) % 6);
+                }
+            } while (is_degenerate(triangle[0], triangle[1], triangle[2]));
+            list.insert(list.end(), triangle, triangle + 3);
+        }
+
+        std::vector<unsigned short> strip;
+        if (build_triangle_strip(&list[0], triangle_count, strip)) {
+            built_count++;
+            CHECK(strip.size() < list.size());
+            CHECK(draws_list(list, strip));
+        }
+    }
+    CHECK(built_count > 0);
+}
+
+void test_unconnected_triangles(void)
+{
+    // Separate triangles make the strip longer than the list.
+
+    const unsigned short list[] = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+    std::vector<unsigned short> strip;
+    CHECK(! build_triangle_strip(list, 3, strip));
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_strip_round_trip();
+    test_joined_strips();
+    test_rotated_triangles_keep_first_vertex();
+    test_random_lists();
+    test_unconnected_triangles();
+    return emu::test::finish("triangle_strip_test");
+}
+
+// EOF //
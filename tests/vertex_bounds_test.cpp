@@ -0,0 +1,161 @@
+#include "test.h"
+#include "ddraw/vertex_bounds.h"
+#include <float.h>
+#include <limits>
+#include <vector>
+
+using namespace emu;
+using emu::test::next_random;
+
+namespace {
+
+VertexBounds create_bounds(const float min_x, const float min_y, const float max_x, const float max_y)
+{
+    VertexBounds bounds;
+    bounds.min_x = min_x;
+    bounds.min_y = min_y;
+    bounds.min_z = 0.5f;
+    bounds.max_x = max_x;
+    bounds.max_y = max_y;
+    bounds.max_z = 0.5f;
+    return bounds;
+}
+
+bool are_bounds_equal(const VertexBounds &first, const VertexBounds &second)
+{
+    return
+        (first.min_x == second.min_x) &&
+        (first.min_y == second.min_y) &&
+        (first.min_z == second.min_z) &&
+        (first.max_x == second.max_x) &&
+        (first.max_y == second.max_y) &&
+        (first.max_z == second.max_z)
+    ;
+}
+
+std::vector<TLVertex> create_vertices(unsigned int &seed, const size_t count)
+{
+    std::vector<TLVertex> vertices(count);
+    for (size_t i = 0; i < count; ++i) {
+        vertices[i].sx = static_cast<float>(static_cast<int>(next_random(seed) % 2000) - 500) / 3.0f;
+        vertices[i].sy = static_cast<float>(static_cast<int>(next_random(seed) % 2000) - 500) / 7.0f;
+        vertices[i].sz = static_cast<float>(next_random(seed) % 1000) / 999.0f;
+        vertices[i].rhw = 1.0f;
+        vertices[i].color = next_random(seed);
+        vertices[i].specular = 0;
+        vertices[i].tu = 0.0f;
+        vertices[i].tv = 0.0f;
+    }
+    return vertices;
+}
+
+void test_scalar_and_sse2_agree(void)
+{
+    // Both implementations give identical bounds, including the NaN
+    // positions in any coordinate and any vertex.
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    unsigned int seed = 7;
+    for (size_t round = 0; round < 2000; ++round) {
+        std::vector<TLVertex> vertices = create_vertices(seed, 1 + (round % 37));
+        if ((round % 5) == 0) {
+            TLVertex &vertex = vertices[next_random(seed) % vertices.size()];
+            float * const coordinates[] = {&vertex.sx, &vertex.sy, &vertex.sz};
+            *coordinates[next_random(seed) % 3] = nan;
+        }
+        VertexBounds scalar;
+        VertexBounds sse2;
+        get_vertex_bounds_scalar(&vertices[0], vertices.size(), scalar);
+        get_vertex_bounds_sse2(&vertices[0], vertices.size(), sse2);
+        CHECK(are_bounds_equal(scalar, sse2));
+    }
+}
+
+void test_bounds(void)
+{
+    unsigned int seed = 3;
+    const std::vector<TLVertex> vertices = create_vertices(seed, 50);
+    VertexBounds bounds;
+    get_vertex_bounds(&vertices[0], vertices.size(), bounds);
+    bool inside = true;
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        inside = inside &&
+            (vertices[i].sx >= bounds.min_x) && (vertices[i].sx <= bounds.max_x) &&
+            (vertices[i].sy >= bounds.min_y) && (vertices[i].sy <= bounds.max_y) &&
+            (vertices[i].sz >= bounds.min_z) && (vertices[i].sz <= bounds.max_z);
+    }
+    CHECK(inside);
+    CHECK(! is_depth_constant(bounds));
+
+    // Invalid position covers everything.
+
+    std::vector<TLVertex> invalid = vertices;
+    invalid[20].sy = std::numeric_limits<float>::quiet_NaN();
+    get_vertex_bounds(&invalid[0], invalid.size(), bounds);
+    CHECK((bounds.min_x == -FLT_MAX) && (bounds.max_y == FLT_MAX));
+    CHECK(! is_depth_constant(bounds));
+
+    std::vector<TLVertex> flat = vertices;
+    for (size_t i = 0; i < flat.size(); ++i) {
+        flat[i].sz = 0.25f;
+    }
+    get_vertex_bounds(&flat[0], flat.size(), bounds);
+    CHECK(is_depth_constant(bounds));
+}
+
+void test_overlapping_invariants(void)
+{
+    // The test is symmetric, every bounds overlap themselves and the
+    // bounds covering everything overlap any other.
+
+    const VertexBounds infinite = create_bounds(-FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX);
+    unsigned int seed = 11;
+    bool symmetric = true;
+    bool reflexive = true;
+    bool contained = true;
+    for (size_t round = 0; round < 5000; ++round) {
+        const float x = static_cast<float>(next_random(seed) % 64);
+        const float y = static_cast<float>(next_random(seed) % 64);
+        const VertexBounds first = create_bounds(x, y, x + static_cast<float>(next_random(seed) % 16), y + static_cast<float>(next_random(seed) % 16));
+        const float u = static_cast<float>(next_random(seed) % 64);
+        const float v = static_cast<float>(next_random(seed) % 64);
+        const VertexBounds second = create_bounds(u, v, u + static_cast<float>(next_random(seed) % 16), v + static_cast<float>(next_random(seed) % 16));
+        symmetric = symmetric && (are_bounds_overlapping(first, second) == are_bounds_overlapping(second, first));
+        reflexive = reflexive && are_bounds_overlapping(first, first);
+        contained = contained && are_bounds_overlapping(first, infinite) && are_bounds_overlapping(infinite, second);
+    }
+    CHECK(symmetric);
+    CHECK(reflexive);
+    CHECK(contained);
+}
+
+void test_overlapping_margin(void)
+{
+    // Bounds closer than the rasterization margin overlap in either axis,
+    // the depth does not matter.
+
+    const VertexBounds first = create_bounds(0.0f, 0.0f, 10.0f, 10.0f);
+    CHECK(are_bounds_overlapping(first, create_bounds(11.0f, 0.0f, 20.0f, 10.0f)));
+    CHECK(! are_bounds_overlapping(first, create_bounds(11.5f, 0.0f, 20.0f, 10.0f)));
+    CHECK(are_bounds_overlapping(first, create_bounds(0.0f, -8.0f, 10.0f, -1.0f)));
+    CHECK(! are_bounds_overlapping(first, create_bounds(0.0f, -8.0f, 10.0f, -1.5f)));
+    CHECK(! are_bounds_overlapping(first, create_bounds(12.0f, 12.0f, 20.0f, 20.0f)));
+
+    VertexBounds deeper = create_bounds(5.0f, 5.0f, 6.0f, 6.0f);
+    deeper.min_z = 0.9f;
+    deeper.max_z = 0.9f;
+    CHECK(are_bounds_overlapping(first, deeper));
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_scalar_and_sse2_agree();
+    test_bounds();
+    test_overlapping_invariants();
+    test_overlapping_margin();
+    return emu::test::finish("vertex_bounds_test");
+}
+
+// EOF //
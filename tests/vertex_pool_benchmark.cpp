@@ -0,0 +1,125 @@
+#include "benchmark.h"
+#include "ddraw/vertex_pool.h"
+#include <string.h>
+#include <vector>
+
+using namespace emu;
+
+namespace {
+
+const size_t FRAMES = 200;
+const size_t EXECUTES_PER_FRAME = 150;
+const size_t VERTICES_PER_EXECUTE = 300;
+
+/**
+ * @brief Stands for the dynamic vertex buffer of the HW layer.
+ */
+struct VertexBuffer {
+    std::vector<TLVertex> vertices;
+    size_t uploaded_count;
+
+    VertexBuffer()
+        : vertices(VERTICES_PER_EXECUTE * EXECUTES_PER_FRAME)
+        , uploaded_count(0)
+    {
+    }
+
+    void upload(const TLVertex * const data, const size_t count)
+    {
+        memcpy(&vertices[0], data, count * sizeof(TLVertex));
+        uploaded_count += count;
+    }
+};
+
+std::vector<TLVertex> create_execute_buffer(void)
+{
+    std::vector<TLVertex> vertices(VERTICES_PER_EXECUTE);
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        vertices[i].sx = static_cast<float>(i);
+        vertices[i].sy = static_cast<float>(i * 2);
+        vertices[i].color = static_cast<unsigned int>(i * 2654435761u);
+    }
+    return vertices;
+}
+
+void print_bytes(const char * const name, const size_t copied_count, const size_t uploaded_count)
+{
+    const size_t copied_kb = (copied_count * sizeof(TLVertex)) / (FRAMES * 1024);
+    const size_t uploaded_kb = (uploaded_count * sizeof(TLVertex)) / (FRAMES * 1024);
+    printf("%-40s %6u KB copied %6u KB uploaded\n", name, static_cast<unsigned int>(copied_kb), static_cast<unsigned int>(uploaded_kb));
+}
+
+/**
+ * @brief The original path, every execute copies its vertices element
+ * by element into local array which is then uploaded.
+ */
+void measure_element_copy(const std::vector<TLVertex> &execute_buffer)
+{
+    VertexBuffer buffer;
+    std::vector<TLVertex> vertices;
+    size_t copied_count = 0;
+
+    const test::Stopwatch stopwatch;
+    for (size_t frame = 0; frame < FRAMES; ++frame) {
+        for (size_t execute = 0; execute < EXECUTES_PER_FRAME; ++execute) {
+            vertices.resize(execute_buffer.size());
+            for (size_t i = 0; i < execute_buffer.size(); ++i) {
+                vertices[i] = execute_buffer[i];
+            }
+            copied_count += execute_buffer.size();
+            buffer.upload(&vertices[0], vertices.size());
+            vertices.clear();
+        }
+        test::consume(buffer.vertices[frame].color);
+    }
+    const double seconds = stopwatch.get_seconds();
+    const size_t moved_count = copied_count + buffer.uploaded_count;
+    test::report("element copy and upload", FRAMES, (moved_count / FRAMES) * sizeof(TLVertex), seconds);
+    print_bytes("    bytes moved", copied_count, buffer.uploaded_count);
+}
+
+/**
+ * @brief The vertex pool, each execute is drawn before the next one
+ * or carried so the next execute joins its draw.
+ */
+void measure_pool(const char * const name, const std::vector<TLVertex> &execute_buffer, const size_t executes_per_draw)
+{
+    VertexBuffer buffer;
+    VertexPool pool;
+
+    const test::Stopwatch stopwatch;
+    for (size_t frame = 0; frame < FRAMES; ++frame) {
+        for (size_t execute = 0; execute < EXECUTES_PER_FRAME; ++execute) {
+            pool.begin_window(execute_buffer.size());
+            pool.set_vertices(0, &execute_buffer[0], execute_buffer.size());
+            if (((execute + 1) % executes_per_draw) != 0) {
+                pool.carry_window();
+                continue;
+            }
+            if (pool.is_upload_pending()) {
+                buffer.upload(pool.get_data(), pool.get_total_count());
+                pool.mark_uploaded();
+            }
+            pool.clear();
+        }
+        test::consume(buffer.vertices[frame].color);
+    }
+    const double seconds = stopwatch.get_seconds();
+    const size_t moved_count = pool.get_copied_count() + pool.get_uploaded_count();
+    test::report(name, FRAMES, (moved_count / FRAMES) * sizeof(TLVertex), seconds);
+    print_bytes("    bytes moved", pool.get_copied_count(), pool.get_uploaded_count());
+}
+
+} // anonymous namespace
+
+int main()
+{
+    printf("%u executes of %u vertices per frame, times per frame:\n", static_cast<unsigned int>(EXECUTES_PER_FRAME), static_cast<unsigned int>(VERTICES_PER_EXECUTE));
+    const std::vector<TLVertex> execute_buffer = create_execute_buffer();
+    measure_element_copy(execute_buffer);
+    measure_pool("pool, draw per execute", execute_buffer, 1);
+    measure_pool("pool, draw per 4 executes", execute_buffer, 4);
+    return 0;
+}
+
+// EOF //
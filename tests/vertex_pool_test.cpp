@@ -0,0 +1,706 @@
+#include "test.h"
+#include "execute_stream.h"
+#include "ddraw/instruction_decoder.h"
+#include "ddraw/triangle_indices.h"
+#include "ddraw/vertex_pool.h"
+#include <string.h>
+#include <vector>
+
+using namespace emu;
+using emu::test::ExecuteStream;
+
+namespace {
+
+/**
+ * @brief Vertex whose position identifies the execute and the vertex.
+ *
+ * Zero is never used so unset vertices are recognized.
+ */
+TLVertex create_vertex(const size_t execute, const size_t index)
+{
+    TLVertex vertex;
+    memset(&vertex, 0, sizeof(vertex));
+    vertex.sx = static_cast<float>((execute * 100000) + index + 1);
+    vertex.color = static_cast<unsigned int>(index * 2654435761u);
+    return vertex;
+}
+
+std::vector<TLVertex> create_vertices(const size_t execute, const size_t count)
+{
+    std::vector<TLVertex> vertices;
+    for (size_t i = 0; i < count; ++i) {
+        vertices.push_back(create_vertex(execute, i));
+    }
+    return vertices;
+}
+
+/**
+ * @brief Execute buffer with the vertices in front of the instructions.
+ */
+class SyntheticExecute {
+
+    size_t vertex_count;
+    ExecuteStream stream;
+
+public:
+
+    SyntheticExecute(const size_t execute, const size_t vertex_count)
+        : vertex_count(vertex_count)
+        , stream()
+    {
+        const std::vector<TLVertex> vertices = create_vertices(execute, vertex_count);
+        stream.append(&vertices[0], vertex_count * sizeof(TLVertex));
+    }
+
+    ExecuteStream &get_stream(void)
+    {
+        return stream;
+    }
+
+    size_t get_vertex_count(void) const
+    {
+        return vertex_count;
+    }
+
+    const unsigned char *get_memory(void) const
+    {
+        return stream.get_data();
+    }
+
+    const TLVertex *get_vertices(void) const
+    {
+        return reinterpret_cast<const TLVertex *>(stream.get_data());
+    }
+
+    size_t get_instruction_offset(void) const
+    {
+        return vertex_count * sizeof(TLVertex);
+    }
+
+    size_t get_instruction_length(void) const
+    {
+        return stream.get_size() - get_instruction_offset();
+    }
+};
+
+struct ProcessVertices {
+    size_t start;
+    size_t dest;
+    size_t count;
+};
+
+ProcessVertices read_process_vertices(const unsigned char * const block)
+{
+    unsigned short start = 0;
+    unsigned short dest = 0;
+    unsigned int count = 0;
+    memcpy(&start, block + 4, 2);
+    memcpy(&dest, block + 6, 2);
+    memcpy(&count, block + 8, 4);
+    ProcessVertices operation;
+    operation.start = start;
+    operation.dest = dest;
+    operation.count = count;
+    return operation;
+}
+
+/**
+ * @brief Draws the executes the way D3D does, each triangle immediately
+ * from its own copy of the vertices. Returns positions of the drawn vertices.
+ */
+std::vector<float> draw_reference(const std::vector<SyntheticExecute> &executes)
+{
+    std::vector<float> drawn;
+    std::vector<DecodedInstruction> instructions;
+    for (size_t e = 0; e < executes.size(); ++e) {
+        const SyntheticExecute &execute = executes[e];
+        std::vector<TLVertex> window(execute.get_vertex_count());
+        memset(&window[0], 0, window.size() * sizeof(TLVertex));
+        decode_instructions(execute.get_memory(), execute.get_instruction_offset(), execute.get_instruction_length(), instructions);
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            const DecodedInstruction &instruction = instructions[i];
+            const unsigned char * const block = execute.get_memory() + instruction.offset;
+            if (instruction.opcode == INSTRUCTION_PROCESSVERTICES) {
+                const ProcessVertices operation = read_process_vertices(block);
+                for (size_t v = 0; v < operation.count; ++v) {
+                    window[operation.dest + v] = execute.get_vertices()[operation.start + v];
+                }
+            }
+            else if (instruction.opcode == INSTRUCTION_TRIANGLE) {
+                const unsigned short * const records = reinterpret_cast<const unsigned short *>(block);
+                for (size_t t = 0; t < instruction.count; ++t) {
+                    for (size_t v = 0; v < 3; ++v) {
+                        drawn.push_back(window[records[(t * TRIANGLE_RECORD_WORDS) + v]].sx);
+                    }
+                }
+            }
+        }
+    }
+    return drawn;
+}
+
+/**
+ * @brief Replays the executes through the vertex pool the way the surface
+ * does. The triangles are queued and drawn only when a window overwrites
+ * vertices they use or at the end of the execute. With the merging the
+ * queued triangles outlive their execute and the next execute places its
+ * window behind theirs.
+ */
+class ReplayDevice {
+
+    bool merging;
+    VertexPool pool;
+    std::vector<unsigned short> indices;
+    size_t min_vertex;
+    size_t max_vertex;
+
+    /**
+     * @brief Stands for the HW vertex buffer.
+     */
+    std::vector<TLVertex> hw_vertices;
+
+    std::vector<float> drawn;
+    size_t draw_count;
+    size_t pooled_window_count;
+
+    void flush(void)
+    {
+        if (indices.empty()) {
+            return;
+        }
+        if (pool.is_upload_pending()) {
+            hw_vertices.assign(pool.get_data(), pool.get_data() + pool.get_total_count());
+            pool.mark_uploaded();
+        }
+        for (size_t i = 0; i < indices.size(); ++i) {
+            drawn.push_back(hw_vertices[indices[i]].sx);
+        }
+        indices.clear();
+        min_vertex = ~static_cast<size_t>(0);
+        max_vertex = 0;
+        ++draw_count;
+    }
+
+    void add_triangles(const unsigned short * const records, const size_t count)
+    {
+        const size_t old_size = indices.size();
+        indices.resize(old_size + (count * 3) + 1);
+        append_rebased_triangle_indices(records, count, pool.get_base(), &indices[old_size], min_vertex, max_vertex);
+        indices.pop_back();
+    }
+
+public:
+
+    explicit ReplayDevice(const bool merging)
+        : merging(merging)
+        , pool()
+        , indices()
+        , min_vertex(~static_cast<size_t>(0))
+        , max_vertex(0)
+        , hw_vertices()
+        , drawn()
+        , draw_count(0)
+        , pooled_window_count(0)
+    {
+    }
+
+    void execute(const SyntheticExecute &execute)
+    {
+        if (! pool.can_append_window(execute.get_vertex_count())) {
+            flush();
+        }
+        if (indices.empty()) {
+            pool.clear();
+        }
+        pool.begin_window(execute.get_vertex_count());
+
+        std::vector<DecodedInstruction> instructions;
+        decode_instructions(execute.get_memory(), execute.get_instruction_offset(), execute.get_instruction_length(), instructions);
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            const DecodedInstruction &instruction = instructions[i];
+            const unsigned char * const block = execute.get_memory() + instruction.offset;
+            if (instruction.opcode == INSTRUCTION_PROCESSVERTICES) {
+                const ProcessVertices operation = read_process_vertices(block);
+                if (pool.overwrites(operation.dest, operation.count, min_vertex, max_vertex)) {
+                    flush();
+                }
+                pool.set_vertices(operation.dest, execute.get_vertices() + operation.start, operation.count);
+            }
+            else if (instruction.opcode == INSTRUCTION_TRIANGLE) {
+                add_triangles(reinterpret_cast<const unsigned short *>(block), instruction.count);
+            }
+        }
+        if (pool.is_pooled()) {
+            ++pooled_window_count;
+        }
+
+        if (merging && (! indices.empty()) && (pool.get_data() != NULL)) {
+            pool.carry_window();
+            return;
+        }
+        flush();
+        pool.clear();
+    }
+
+    /**
+     * @brief Draws the carried geometry, stands for the end of the scene.
+     */
+    void finish(void)
+    {
+        flush();
+        pool.clear();
+    }
+
+    const std::vector<float> &get_drawn(void) const
+    {
+        return drawn;
+    }
+
+    size_t get_draw_count(void) const
+    {
+        return draw_count;
+    }
+
+    size_t get_pooled_window_count(void) const
+    {
+        return pooled_window_count;
+    }
+
+    const VertexPool &get_pool(void) const
+    {
+        return pool;
+    }
+};
+
+/**
+ * @brief Replays the executes from single buffer refilled by each of
+ * them, as the game does. The carried vertices must not reference it.
+ */
+ReplayDevice replay(const std::vector<SyntheticExecute> &executes, const bool merging = false)
+{
+    ReplayDevice device(merging);
+    SyntheticExecute buffer(0, 0x10000);
+    for (size_t i = 0; i < executes.size(); ++i) {
+        buffer = executes[i];
+        device.execute(buffer);
+    }
+    device.finish();
+    return device;
+}
+
+void add_quad(SyntheticExecute &execute, const unsigned short first)
+{
+    const unsigned short indices[] = {
+        first, static_cast<unsigned short>(first + 1), static_cast<unsigned short>(first + 2),
+        first, static_cast<unsigned short>(first + 2), static_cast<unsigned short>(first + 3)
+    };
+    execute.get_stream().add_triangles(indices, 2);
+}
+
+void test_direct_window(void)
+{
+    const std::vector<TLVertex> input = create_vertices(0, 4);
+    VertexPool pool;
+    pool.begin_window(4);
+    CHECK(pool.get_data() == NULL);
+    pool.set_vertices(0, &input[0], 4);
+    CHECK(pool.get_data() == &input[0]);
+    CHECK(! pool.is_pooled());
+    CHECK(pool.is_upload_pending());
+    CHECK(pool.get_copied_count() == 0);
+    pool.mark_uploaded();
+    CHECK(! pool.is_upload_pending());
+    CHECK(pool.get_uploaded_count() == 4);
+}
+
+void test_partial_windows_are_pooled(void)
+{
+    const std::vector<TLVertex> first = create_vertices(1, 4);
+    const std::vector<TLVertex> second = create_vertices(2, 4);
+    VertexPool pool;
+    pool.begin_window(8);
+    pool.set_vertices(0, &first[0], 4);
+    CHECK(pool.is_pooled());
+    CHECK(pool.get_data() != &first[0]);
+    pool.set_vertices(4, &second[0], 4);
+    CHECK(pool.get_data()[0].sx == first[0].sx);
+    CHECK(pool.get_data()[3].sx == first[3].sx);
+    CHECK(pool.get_data()[4].sx == second[0].sx);
+    CHECK(pool.get_data()[7].sx == second[3].sx);
+    CHECK(pool.get_copied_count() == 8);
+}
+
+void test_direct_window_switches_to_pool(void)
+{
+    // Partial update of directly referenced window keeps the rest of it.
+
+    const std::vector<TLVertex> first = create_vertices(1, 4);
+    const std::vector<TLVertex> second = create_vertices(2, 4);
+    VertexPool pool;
+    pool.begin_window(4);
+    pool.set_vertices(0, &first[0], 4);
+    pool.mark_uploaded();
+    pool.set_vertices(1, &second[2], 2);
+    CHECK(pool.is_pooled());
+    CHECK(pool.is_upload_pending());
+    CHECK(pool.get_data()[0].sx == first[0].sx);
+    CHECK(pool.get_data()[1].sx == second[2].sx);
+    CHECK(pool.get_data()[2].sx == second[3].sx);
+    CHECK(pool.get_data()[3].sx == first[3].sx);
+    CHECK(pool.get_copied_count() == 4 + 2);
+
+    // The pool memory is reused by the next frame.
+
+    const size_t capacity = pool.get_capacity();
+    pool.clear();
+    CHECK(pool.get_data() == NULL);
+    pool.begin_window(4);
+    pool.set_vertices(2, &first[0], 2);
+    CHECK(pool.is_pooled());
+    CHECK(pool.get_capacity() == capacity);
+}
+
+void test_overwrites(void)
+{
+    const std::vector<TLVertex> input = create_vertices(0, 10);
+    VertexPool pool;
+    pool.begin_window(10);
+    pool.set_vertices(0, &input[0], 10);
+
+    CHECK(pool.overwrites(2, 3, 4, 9));
+    CHECK(pool.overwrites(2, 3, 0, 2));
+    CHECK(pool.overwrites(2, 3, 3, 3));
+    CHECK(! pool.overwrites(2, 3, 5, 9));
+    CHECK(! pool.overwrites(2, 3, 0, 1));
+    CHECK(! pool.overwrites(2, 0, 0, 9));
+    CHECK(! pool.overwrites(2, 3, ~static_cast<size_t>(0), 0));
+}
+
+void test_invalidate_upload(void)
+{
+    const std::vector<TLVertex> input = create_vertices(0, 4);
+    VertexPool pool;
+    pool.invalidate_upload();
+    CHECK(! pool.is_upload_pending());
+    pool.begin_window(4);
+    pool.set_vertices(0, &input[0], 4);
+    pool.mark_uploaded();
+    pool.invalidate_upload();
+    CHECK(pool.is_upload_pending());
+}
+
+void test_carry_window(void)
+{
+    const std::vector<TLVertex> first = create_vertices(1, 4);
+    const std::vector<TLVertex> second = create_vertices(2, 3);
+    VertexPool pool;
+    pool.begin_window(4);
+    pool.set_vertices(0, &first[0], 4);
+    pool.carry_window();
+    CHECK(pool.is_pooled());
+    CHECK(pool.get_base() == 4);
+    CHECK(pool.get_count() == 0);
+    CHECK(pool.get_copied_count() == 4);
+
+    // The next window follows the carried one and is never referenced
+    // directly, its offsets are relative to the base.
+
+    pool.begin_window(3);
+    pool.set_vertices(0, &second[0], 3);
+    CHECK(pool.is_pooled());
+    CHECK(pool.get_total_count() == 7);
+    CHECK(pool.get_data()[0].sx == first[0].sx);
+    CHECK(pool.get_data()[3].sx == first[3].sx);
+    CHECK(pool.get_data()[4].sx == second[0].sx);
+    CHECK(pool.get_data()[6].sx == second[2].sx);
+    CHECK(! pool.overwrites(0, 3, 0, 3));
+    CHECK(pool.overwrites(2, 1, 0, 6));
+    CHECK(pool.overwrites(0, 1, 4, 4));
+
+    // Carrying pooled window does not copy it again.
+
+    pool.carry_window();
+    CHECK(pool.get_base() == 7);
+    CHECK(pool.get_copied_count() == 4 + 3);
+}
+
+void test_append_vertices(void)
+{
+    const std::vector<TLVertex> first = create_vertices(1, 4);
+    const std::vector<TLVertex> second = create_vertices(2, 4);
+    const std::vector<TLVertex> derived = create_vertices(3, 2);
+    VertexPool pool;
+    pool.begin_window(4);
+    pool.set_vertices(0, &first[0], 4);
+    pool.mark_uploaded();
+
+    // Directly referenced window is moved to the pool in front of
+    // the appended vertices.
+
+    CHECK(pool.can_append_vertices(MAXIMAL_MERGED_VERTEX_COUNT - 4));
+    CHECK(! pool.can_append_vertices(MAXIMAL_MERGED_VERTEX_COUNT - 3));
+    TLVertex *appended = pool.append_vertices(2);
+    appended[0] = derived[0];
+    appended[1] = derived[1];
+    CHECK(pool.is_pooled());
+    CHECK(pool.is_upload_pending());
+    CHECK(pool.get_count() == 4);
+    CHECK(pool.get_total_count() == 6);
+    CHECK(pool.get_copied_count() == 4);
+    CHECK(! pool.can_append_vertices(MAXIMAL_MERGED_VERTEX_COUNT - 5));
+
+    // Update of the window keeps them.
+
+    pool.set_vertices(0, &second[0], 4);
+    CHECK(pool.get_data()[0].sx == second[0].sx);
+    CHECK(pool.get_data()[4].sx == derived[0].sx);
+    CHECK(pool.get_data()[5].sx == derived[1].sx);
+
+    // Further appends follow the previous ones, the window is not copied
+    // again.
+
+    appended = pool.append_vertices(1);
+    appended[0] = first[2];
+    CHECK(pool.get_total_count() == 7);
+    CHECK(pool.get_copied_count() == 4 + 4);
+    CHECK(pool.get_data()[6].sx == first[2].sx);
+
+    // Carried window takes them along.
+
+    pool.carry_window();
+    CHECK(pool.get_base() == 7);
+    CHECK(pool.get_total_count() == 7);
+    pool.begin_window(2);
+    pool.set_vertices(0, &first[0], 2);
+    CHECK(pool.get_data()[5].sx == derived[1].sx);
+    CHECK(pool.get_data()[7].sx == first[0].sx);
+
+    pool.clear();
+    CHECK(pool.get_total_count() == 0);
+}
+
+void test_can_append_window(void)
+{
+    const std::vector<TLVertex> input = create_vertices(0, 1000);
+    VertexPool pool;
+    CHECK(pool.can_append_window(MAXIMAL_MERGED_VERTEX_COUNT));
+    CHECK(! pool.can_append_window(MAXIMAL_MERGED_VERTEX_COUNT + 1));
+    pool.begin_window(1000);
+    pool.set_vertices(0, &input[0], 1000);
+    pool.carry_window();
+    CHECK(pool.can_append_window(MAXIMAL_MERGED_VERTEX_COUNT - 1000));
+    CHECK(! pool.can_append_window(MAXIMAL_MERGED_VERTEX_COUNT - 999));
+}
+
+void test_replay_full_window(void)
+{
+    std::vector<SyntheticExecute> executes;
+    executes.push_back(SyntheticExecute(0, 8));
+    executes[0].get_stream().add_process_vertices(0, 0, 8);
+    add_quad(executes[0], 0);
+    add_quad(executes[0], 4);
+    executes[0].get_stream().add_exit();
+
+    const ReplayDevice device = replay(executes);
+    CHECK(device.get_drawn() == draw_reference(executes));
+    CHECK(device.get_draw_count() == 1);
+    CHECK(device.get_pooled_window_count() == 0);
+    CHECK(device.get_pool().get_copied_count() == 0);
+    CHECK(device.get_pool().get_uploaded_count() == 8);
+}
+
+void test_replay_split_windows(void)
+{
+    // Windows which do not overlap the queued geometry are drawn together.
+
+    std::vector<SyntheticExecute> executes;
+    executes.push_back(SyntheticExecute(0, 8));
+    executes[0].get_stream().add_process_vertices(0, 0, 4);
+    add_quad(executes[0], 0);
+    executes[0].get_stream().add_process_vertices(4, 4, 4);
+    add_quad(executes[0], 4);
+    executes[0].get_stream().add_exit();
+
+    const ReplayDevice device = replay(executes);
+    CHECK(device.get_drawn() == draw_reference(executes));
+    CHECK(device.get_draw_count() == 1);
+    CHECK(device.get_pooled_window_count() == 1);
+    CHECK(device.get_pool().get_copied_count() == 8);
+}
+
+void test_replay_overlap_flush(void)
+{
+    // Window overwriting the queued vertices draws them first.
+
+    std::vector<SyntheticExecute> executes;
+    executes.push_back(SyntheticExecute(0, 8));
+    executes[0].get_stream().add_process_vertices(0, 0, 4);
+    add_quad(executes[0], 0);
+    executes[0].get_stream().add_process_vertices(4, 2, 4);
+    add_quad(executes[0], 2);
+    executes[0].get_stream().add_exit();
+
+    const ReplayDevice device = replay(executes);
+    CHECK(device.get_drawn() == draw_reference(executes));
+    CHECK(device.get_draw_count() == 2);
+}
+
+void test_replay_source_offset(void)
+{
+    // Vertices taken from the middle of the buffer into the middle of the window.
+
+    std::vector<SyntheticExecute> executes;
+    executes.push_back(SyntheticExecute(0, 12));
+    executes[0].get_stream().add_process_vertices(7, 3, 4);
+    add_quad(executes[0], 3);
+    executes[0].get_stream().add_exit();
+    executes.push_back(SyntheticExecute(1, 12));
+    executes[1].get_stream().add_process_vertices(0, 0, 12);
+    add_quad(executes[1], 8);
+    executes[1].get_stream().add_exit();
+
+    const ReplayDevice device = replay(executes);
+    CHECK(device.get_drawn() == draw_reference(executes));
+    CHECK(device.get_draw_count() == 2);
+    CHECK(device.get_pooled_window_count() == 1);
+}
+
+/**
+ * @brief Deterministic random executes with several windows each,
+ * the triangles use only vertices set before them.
+ */
+std::vector<SyntheticExecute> create_random_executes(const size_t count, unsigned int seed)
+{
+    std::vector<SyntheticExecute> executes;
+    for (size_t e = 0; e < count; ++e) {
+        seed = seed * 1664525 + 1013904223;
+        const size_t vertex_count = 4 + ((seed >> 16) % 40);
+        executes.push_back(SyntheticExecute(e, vertex_count));
+        ExecuteStream &stream = executes.back().get_stream();
+
+        std::vector<unsigned short> set_vertices;
+        seed = seed * 1664525 + 1013904223;
+        const size_t operation_count = 1 + ((seed >> 16) % 4);
+        for (size_t o = 0; o < operation_count; ++o) {
+            seed = seed * 1664525 + 1013904223;
+            const size_t window_count = 1 + ((seed >> 16) % vertex_count);
+            seed = seed * 1664525 + 1013904223;
+            const size_t start = (seed >> 16) % (vertex_count - window_count + 1);
+            seed = seed * 1664525 + 1013904223;
+            const size_t dest = (seed >> 16) % (vertex_count - window_count + 1);
+            stream.add_process_vertices(static_cast<unsigned short>(start), static_cast<unsigned short>(dest), static_cast<unsigned int>(window_count));
+            for (size_t v = 0; v < window_count; ++v) {
+                set_vertices.push_back(static_cast<unsigned short>(dest + v));
+            }
+
+            seed = seed * 1664525 + 1013904223;
+            const size_t triangle_count = (seed >> 16) % 6;
+            std::vector<unsigned short> indices;
+            for (size_t t = 0; t < (triangle_count * 3); ++t) {
+                seed = seed * 1664525 + 1013904223;
+                indices.push_back(set_vertices[(seed >> 16) % set_vertices.size()]);
+            }
+            if (triangle_count > 0) {
+                stream.add_triangles(&indices[0], triangle_count);
+            }
+        }
+        stream.add_exit();
+    }
+    return executes;
+}
+
+void test_replay_carried(void)
+{
+    // Executes with full windows are drawn together from the pool.
+
+    std::vector<SyntheticExecute> executes;
+    for (size_t e = 0; e < 3; ++e) {
+        executes.push_back(SyntheticExecute(e, 4));
+        executes[e].get_stream().add_process_vertices(0, 0, 4);
+        add_quad(executes[e], 0);
+        executes[e].get_stream().add_exit();
+    }
+
+    const ReplayDevice device = replay(executes, true);
+    CHECK(device.get_drawn() == draw_reference(executes));
+    CHECK(device.get_draw_count() == 1);
+    CHECK(device.get_pooled_window_count() == 2);
+    CHECK(device.get_pool().get_uploaded_count() == 12);
+}
+
+void test_replay_carried_overlap(void)
+{
+    // Window overwriting vertices of the same execute flushes the carried
+    // geometry too, windows of the previous executes are never overwritten.
+
+    std::vector<SyntheticExecute> executes;
+    executes.push_back(SyntheticExecute(0, 4));
+    executes[0].get_stream().add_process_vertices(0, 0, 4);
+    add_quad(executes[0], 0);
+    executes[0].get_stream().add_exit();
+    executes.push_back(SyntheticExecute(1, 8));
+    executes[1].get_stream().add_process_vertices(0, 0, 4);
+    add_quad(executes[1], 0);
+    executes[1].get_stream().add_process_vertices(4, 0, 4);
+    add_quad(executes[1], 0);
+    executes[1].get_stream().add_exit();
+
+    const ReplayDevice device = replay(executes, true);
+    CHECK(device.get_drawn() == draw_reference(executes));
+    CHECK(device.get_draw_count() == 2);
+}
+
+void test_replay_vertex_limit(void)
+{
+    // The merged windows never exceed the 16 bit indices.
+
+    std::vector<SyntheticExecute> executes;
+    for (size_t e = 0; e < 3; ++e) {
+        executes.push_back(SyntheticExecute(e, 30000));
+        executes[e].get_stream().add_process_vertices(0, 0, 30000);
+        add_quad(executes[e], 0);
+        add_quad(executes[e], 29996);
+        executes[e].get_stream().add_exit();
+    }
+
+    const ReplayDevice device = replay(executes, true);
+    CHECK(device.get_drawn() == draw_reference(executes));
+    CHECK(device.get_draw_count() == 2);
+}
+
+void test_replay_random(void)
+{
+    for (unsigned int seed = 1; seed <= 20; ++seed) {
+        const std::vector<SyntheticExecute> executes = create_random_executes(50, seed);
+        const ReplayDevice device = replay(executes);
+        CHECK(device.get_drawn() == draw_reference(executes));
+        const ReplayDevice merged = replay(executes, true);
+        CHECK(merged.get_drawn() == draw_reference(executes));
+        CHECK(merged.get_draw_count() <= device.get_draw_count());
+    }
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_direct_window();
+    test_partial_windows_are_pooled();
+    test_direct_window_switches_to_pool();
+    test_overwrites();
+    test_invalidate_upload();
+    test_carry_window();
+    test_append_vertices();
+    test_can_append_window();
+    test_replay_full_window();
+    test_replay_split_windows();
+    test_replay_overlap_flush();
+    test_replay_source_offset();
+    test_replay_carried();
+    test_replay_carried_overlap();
+    test_replay_vertex_limit();
+    test_replay_random();
+    return emu::test::finish("vertex_pool_test");
+}
+
+// EOF //